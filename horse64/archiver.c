@@ -457,15 +457,8 @@ int _h64archive_AddFile_CheckName(
             filename[0] == '/' || filename[0] == '\\'
             )
         return H64ARCHIVE_ADDERROR_INVALIDNAME;
-    unsigned int i = 0;
-    while (i < strlen(filename)) {
-        if (!is_valid_utf8_char(
-                (uint8_t *)(filename + i), strlen(filename + i)
-                )) {
-            return H64ARCHIVE_ADDERROR_INVALIDNAME;
-        }
-        i += utf8_char_len((uint8_t *)(filename + i));
-    }
+    if (!is_valid_utf8(filename, strlen(filename)))
+        return H64ARCHIVE_ADDERROR_INVALIDNAME;
     char *clean_name = h64archive_NormalizeName(filename);
     if (!clean_name)
         return H64ARCHIVE_ADDERROR_OUTOFMEMORY;
@@ -0,0 +1,101 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "compileconfig.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asyncjobqueue.h"
+
+
+int asyncjobqueue_Init(asyncjobqueue *q, int64_t size) {
+    memset(q, 0, sizeof(*q));
+    int64_t realsize = 2;
+    while (realsize < size)
+        realsize *= 2;
+    q->cell = malloc(sizeof(*q->cell) * realsize);
+    if (!q->cell)
+        return 0;
+    int64_t i = 0;
+    while (i < realsize) {
+        atomic_init(&q->cell[i].sequence, i);
+        q->cell[i].job = NULL;
+        i++;
+    }
+    q->size = realsize;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    return 1;
+}
+
+void asyncjobqueue_Uninit(asyncjobqueue *q) {
+    free(q->cell);
+    q->cell = NULL;
+    q->size = 0;
+}
+
+int asyncjobqueue_Push(asyncjobqueue *q, h64asyncsysjob *job) {
+    int64_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    while (1) {
+        asyncjobqueuecell *cell = &q->cell[pos & (q->size - 1)];
+        int64_t seq = atomic_load_explicit(
+            &cell->sequence, memory_order_acquire
+        );
+        if (seq == pos) {
+            // Free cell, try to claim it:
+            if (atomic_compare_exchange_weak_explicit(
+                    &q->head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                cell->job = job;
+                atomic_store_explicit(
+                    &cell->sequence, pos + 1, memory_order_release
+                );
+                return 1;
+            }
+            // (pos was updated by the failed exchange.)
+        } else if (seq < pos) {
+            // Still holds an entry from one round earlier, so full:
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+}
+
+h64asyncsysjob *asyncjobqueue_Pop(asyncjobqueue *q) {
+    int64_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    while (1) {
+        asyncjobqueuecell *cell = &q->cell[pos & (q->size - 1)];
+        int64_t seq = atomic_load_explicit(
+            &cell->sequence, memory_order_acquire
+        );
+        if (seq == pos + 1) {
+            // Filled cell, try to claim it:
+            if (atomic_compare_exchange_weak_explicit(
+                    &q->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                h64asyncsysjob *job = cell->job;
+                atomic_store_explicit(
+                    &cell->sequence, pos + q->size, memory_order_release
+                );
+                return job;
+            }
+        } else if (seq < pos + 1) {
+            // Not filled yet, so empty:
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+}
+
+int64_t asyncjobqueue_Count(asyncjobqueue *q) {
+    int64_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    int64_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    return (head > tail ? head - tail : 0);
+}
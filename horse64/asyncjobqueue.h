@@ -0,0 +1,49 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef HORSE64_ASYNCJOBQUEUE_H_
+#define HORSE64_ASYNCJOBQUEUE_H_
+
+#include "compileconfig.h"
+
+#include <stdint.h>
+
+typedef struct h64asyncsysjob h64asyncsysjob;
+
+// A bounded queue of async system jobs that any thread may push to and
+// pop from without a lock, as described by Dmitry Vyukov. Each cell
+// carries a sequence number that tells pushers and poppers whether it
+// is theirs to use yet.
+
+typedef struct asyncjobqueuecell {
+    _Atomic int64_t sequence;
+    h64asyncsysjob *job;
+} asyncjobqueuecell;
+
+typedef struct asyncjobqueue {
+    int64_t size;  // always a power of two
+    asyncjobqueuecell *cell;
+    char _pad1[64];  // keep pushers and poppers on separate cache lines
+    _Atomic int64_t head;  // next position to push to
+    char _pad2[64];
+    _Atomic int64_t tail;  // next position to pop from
+} asyncjobqueue;
+
+int asyncjobqueue_Init(
+    asyncjobqueue *q, int64_t size
+);  // size is rounded up to a power of two, returns 1 or 0 on oom
+
+void asyncjobqueue_Uninit(asyncjobqueue *q);
+
+int asyncjobqueue_Push(
+    asyncjobqueue *q, h64asyncsysjob *job
+);  // returns 1 on success, 0 if the queue is full
+
+h64asyncsysjob *asyncjobqueue_Pop(
+    asyncjobqueue *q
+);  // returns NULL if empty
+
+int64_t asyncjobqueue_Count(asyncjobqueue *q);  // only a snapshot
+
+#endif  // HORSE64_ASYNCJOBQUEUE_H_
@@ -5,6 +5,7 @@
 #include "compileconfig.h"
 
 #include <assert.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,13 +19,17 @@
 #include <netdb.h>
 #endif
 
+#include "asyncjobqueue.h"
 #include "asyncsysjob.h"
+#include "compiler/globallimits.h"
+#include "corelib/io.h"
 #include "nonlocale.h"
 #include "poolalloc.h"
 #include "processrun.h"
 #include "sockets.h"
 #include "threading.h"
 #include "vmexec.h"
+#include "vmschedule.h"
 #include "widechar.h"
 
 
@@ -32,25 +37,52 @@ mutex *asyncsysjob_schedule_lock = NULL;
 poolalloc *asyncsysjob_allocator = NULL;
 
 
-static h64asyncsysjob **jobs = NULL;
-static int jobs_alloc = 0;
-static int jobs_count = 0;
+// Queued jobs. Any thread pushes and pops here without a lock, and
+// only if the ring is full do jobs spill over into the list below:
+static asyncjobqueue jobs = {0};
+static h64asyncsysjob **jobs_overflow = NULL;
+static int jobs_overflow_alloc = 0;
+static _Atomic int jobs_overflow_count = 0;
 static threadevent *job_done_supervisor_waitevent = NULL;
 
-static thread **async_worker = NULL;
-static threadevent **async_worker_event = NULL;
-static int async_worker_count = 0;
+// The vmexec whose waiting threads get queued up directly once their
+// job is done. Guarded by asyncsysjob_notify_lock:
+static mutex *asyncsysjob_notify_lock = NULL;
+static h64vmexec *asyncsysjob_notify_vmexec = NULL;
+
+// Worker slots. There are only as many workers as jobs keep busy,
+// up to ASYNCSYSJOB_MAX_WORKERS, and idle ones exit after a while:
+#define ASYNCWORKER_UNUSED 0
+#define ASYNCWORKER_BUSY 1
+#define ASYNCWORKER_PARKED 2
+
+typedef struct asyncsysjobworker {
+    thread *t;  // guarded by asyncsysjob_schedule_lock
+    threadevent *wakeupevent;
+    _Atomic int state;
+} asyncsysjobworker;
+
+static asyncsysjobworker async_worker[ASYNCSYSJOB_MAX_WORKERS];
+static _Atomic int async_worker_count = 0;
 
 static void __attribute__((constructor)) _asyncsysjob_InitLock() {
     assert(asyncsysjob_schedule_lock == NULL);
     asyncsysjob_schedule_lock = mutex_Create();
-    if (!asyncsysjob_schedule_lock) {
+    asyncsysjob_notify_lock = mutex_Create();
+    if (!asyncsysjob_schedule_lock || !asyncsysjob_notify_lock ||
+            !asyncjobqueue_Init(&jobs, ASYNCSYSJOB_QUEUE_SIZE)) {
         h64fprintf(stderr, "horsevm: error: failed to "
             "allocate asyncsysjob_schedule_lock\n");
         _exit(1);
     }
 }
 
+void asyncjob_SetNotifyVMExec(h64vmexec *vmexec) {
+    mutex_Lock(asyncsysjob_notify_lock);
+    asyncsysjob_notify_vmexec = vmexec;
+    mutex_Release(asyncsysjob_notify_lock);
+}
+
 h64asyncsysjob *asyncjob_CreateEmpty() {
     mutex_Lock(asyncsysjob_schedule_lock);
     if (!asyncsysjob_allocator) {
@@ -95,6 +127,17 @@ void _asyncjob_FreeNoLock(h64asyncsysjob *job) {
             free(job->runcmd.cmd);
             job->runcmd.cmd = NULL;
         }
+    } else if (job->type == ASYNCSYSJOB_FILEIO) {
+        if (job->fileio.op == ASYNCFILEIO_OPEN && job->fileio.f) {
+            // Opened for a task that was aborted, so nobody took it:
+            fclose(job->fileio.f);
+            job->fileio.f = NULL;
+        }
+        free(job->fileio.path);
+        job->fileio.path = NULL;
+        if (job->fileio.buf_owned)
+            free(job->fileio.buf);
+        job->fileio.buf = NULL;
     }
     poolalloc_free(asyncsysjob_allocator, job);
 }
@@ -130,39 +173,135 @@ int _asyncjob_GetSupervisorWaitFD() {
     return fd;
 }
 
+void asyncjob_MarkDone(h64asyncsysjob *job) {
+    // Mark it done, and if its thread is already waiting on it then
+    // hand that one right back to the vm workers:
+    mutex_Lock(asyncsysjob_notify_lock);
+    h64vmexec *vmexec = asyncsysjob_notify_vmexec;
+    if (vmexec)
+        mutex_Lock(vmexec->worker_overview->worker_mutex);
+    mutex_Lock(asyncsysjob_schedule_lock);
+    job->inprogress = 0;
+    job->done = 1;
+    int freejob = (job->abandoned != 0 && job->waitrefs == 0);
+    int queued = 0;
+    if (!freejob && vmexec)
+        queued = vmschedule_AsyncSysJobDone(vmexec, job);
+    if (freejob)
+        _asyncjob_FreeNoLock(job);
+    mutex_Release(asyncsysjob_schedule_lock);
+    if (vmexec)
+        mutex_Release(vmexec->worker_overview->worker_mutex);
+    mutex_Release(asyncsysjob_notify_lock);
+    if (!freejob && !queued)
+        threadevent_Set(job_done_supervisor_waitevent);  // it'll rescan
+}
+
+static h64asyncsysjob *_asyncjob_PopJob() {
+    h64asyncsysjob *job = asyncjobqueue_Pop(&jobs);
+    if (job || atomic_load(&jobs_overflow_count) <= 0)
+        return job;
+    mutex_Lock(asyncsysjob_schedule_lock);
+    int count = atomic_load(&jobs_overflow_count);
+    if (count > 0) {
+        job = jobs_overflow[0];
+        if (count > 1)
+            memmove(
+                &jobs_overflow[0], &jobs_overflow[1],
+                sizeof(*jobs_overflow) * (count - 1)
+            );
+        atomic_store(&jobs_overflow_count, count - 1);
+    }
+    mutex_Release(asyncsysjob_schedule_lock);
+    return job;
+}
+
+static int _asyncjob_HaveQueuedJobs() {
+    return (asyncjobqueue_Count(&jobs) > 0 ||
+            atomic_load(&jobs_overflow_count) > 0);
+}
+
+static int _asyncjob_WakeParkedWorker() {
+    int i = 0;
+    while (i < ASYNCSYSJOB_MAX_WORKERS) {
+        int expected = ASYNCWORKER_PARKED;
+        if (atomic_compare_exchange_strong(
+                &async_worker[i].state, &expected, ASYNCWORKER_BUSY
+                )) {
+            threadevent_Set(async_worker[i].wakeupevent);
+            return 1;
+        }
+        i++;
+    }
+    return 0;
+}
+
+static int _asyncjob_Park(int worker_id) {
+    // Returns 1 if the worker should go on, 0 if it should exit.
+    asyncsysjobworker *w = &async_worker[worker_id];
+    atomic_store(&w->state, ASYNCWORKER_PARKED);
+    if (_asyncjob_HaveQueuedJobs()) {
+        // A job came in after we looked, so see if we get to keep it:
+        int expected = ASYNCWORKER_PARKED;
+        atomic_compare_exchange_strong(
+            &w->state, &expected, ASYNCWORKER_BUSY
+        );
+        return 1;  // (if the exchange failed, someone woke us anyway)
+    }
+    int woken = threadevent_WaitUntilSet(
+        w->wakeupevent, ASYNCSYSJOB_WORKER_IDLE_MS, 1
+    );
+    int expected = ASYNCWORKER_PARKED;
+    if (!atomic_compare_exchange_strong(
+            &w->state, &expected, ASYNCWORKER_BUSY
+            ) || woken)
+        return 1;  // woken up for a new job, or a stale wakeup
+    // Nobody needed us for a while, so exit unless work came in:
+    mutex_Lock(asyncsysjob_schedule_lock);
+    if (_asyncjob_HaveQueuedJobs()) {
+        mutex_Release(asyncsysjob_schedule_lock);
+        return 1;
+    }
+    thread_Detach(w->t);
+    w->t = NULL;
+    atomic_store(&w->state, ASYNCWORKER_UNUSED);
+    atomic_fetch_sub(&async_worker_count, 1);
+    mutex_Release(asyncsysjob_schedule_lock);
+    #ifndef NDEBUG
+    if (_vmasyncjobs_debug)
+        h64fprintf(stderr, "horsevm: debug: "
+            "async worker %d exiting after idling\n", worker_id);
+    #endif
+    return 0;
+}
+
 void asyncsysjobworker_Do(void *userdata) {
     int worker_id = (uintptr_t)userdata;
     while (1) {
-        mutex_Lock(asyncsysjob_schedule_lock);
-        h64asyncsysjob *ourjob = NULL;
-        int i = 0;
-        while (i < jobs_count) {
-            if (!jobs[i]->inprogress &&
-                    (!jobs[i]->done || jobs[i]->abandoned)) {
-                if (jobs[i]->abandoned) {
-                    _asyncjob_FreeNoLock(jobs[i]);
-                    jobs[i] = NULL;
-                    if (i + 1 < jobs_count)
-                        memcpy(
-                            &jobs[i], &jobs[i + 1],
-                            sizeof(*jobs) * (jobs_count - i - 1)
-                        );
-                    jobs_count--;
-                    continue;
+        h64asyncsysjob *ourjob = _asyncjob_PopJob();
+        if (ourjob != NULL) {
+            mutex_Lock(asyncsysjob_schedule_lock);
+            if (ourjob->abandoned) {
+                // Nobody wants the result anymore:
+                if (ourjob->waitrefs == 0) {
+                    _asyncjob_FreeNoLock(ourjob);
+                    mutex_Release(asyncsysjob_schedule_lock);
+                } else {
+                    // Others still wait for it to be out of the way:
+                    mutex_Release(asyncsysjob_schedule_lock);
+                    asyncjob_MarkDone(ourjob);
                 }
-                jobs[i]->inprogress = 1;
-                #ifndef NDEBUG
-                if (_vmasyncjobs_debug)
-                    h64fprintf(stderr, "horsevm: debug: "
-                        "picking up job ptr=%p type=%d\n",
-                        jobs[i], (int)jobs[i]->type);
-                #endif
-                ourjob = jobs[i];
-                break;
+                continue;
             }
-            i++;
+            ourjob->inprogress = 1;
+            mutex_Release(asyncsysjob_schedule_lock);
+            #ifndef NDEBUG
+            if (_vmasyncjobs_debug)
+                h64fprintf(stderr, "horsevm: debug: "
+                    "picking up job ptr=%p type=%d\n",
+                    ourjob, (int)ourjob->type);
+            #endif
         }
-        mutex_Release(asyncsysjob_schedule_lock);
         if (ourjob != NULL &&
                 ourjob->type == ASYNCSYSJOB_HOSTLOOKUP) {
             #ifndef NDEBUG
@@ -191,11 +330,7 @@ void asyncsysjobworker_Do(void *userdata) {
                 ourjob->hostlookup.resultip4len = (
                     ourjob->hostlookup.hostlen
                 );
-                mutex_Lock(asyncsysjob_schedule_lock);
-                ourjob->inprogress = 0;
-                ourjob->done = 1;
-                mutex_Release(asyncsysjob_schedule_lock);
-                threadevent_Set(job_done_supervisor_waitevent);
+                asyncjob_MarkDone(ourjob);
                 #ifndef NDEBUG
                 if (_vmasyncjobs_debug)
                     h64fprintf(stderr, "horsevm: debug: "
@@ -218,11 +353,7 @@ void asyncsysjobworker_Do(void *userdata) {
                 ourjob->hostlookup.resultip6len = (
                     ourjob->hostlookup.hostlen
                 );
-                mutex_Lock(asyncsysjob_schedule_lock);
-                ourjob->inprogress = 0;
-                ourjob->done = 1;
-                mutex_Release(asyncsysjob_schedule_lock);
-                threadevent_Set(job_done_supervisor_waitevent);
+                asyncjob_MarkDone(ourjob);
                 #ifndef NDEBUG
                 if (_vmasyncjobs_debug)
                     h64fprintf(stderr, "horsevm: debug: "
@@ -257,12 +388,8 @@ void asyncsysjobworker_Do(void *userdata) {
                 invalidhost:
                 if (hostutf8)
                     free(hostutf8);
-                mutex_Lock(asyncsysjob_schedule_lock);
                 ourjob->failed_external = 1;
-                ourjob->inprogress = 0;
-                ourjob->done = 1;
-                mutex_Release(asyncsysjob_schedule_lock);
-                threadevent_Set(job_done_supervisor_waitevent);
+                asyncjob_MarkDone(ourjob);
                 #ifndef NDEBUG
                 if (_vmasyncjobs_debug)
                     h64fprintf(stderr, "horsevm: debug: "
@@ -286,12 +413,8 @@ void asyncsysjobworker_Do(void *userdata) {
                 lookupoom:
                 if (hostutf8)
                     free(hostutf8);
-                mutex_Lock(asyncsysjob_schedule_lock);
                 ourjob->failed_oomorinternal = 1;
-                ourjob->inprogress = 0;
-                ourjob->done = 1;
-                mutex_Release(asyncsysjob_schedule_lock);
-                threadevent_Set(job_done_supervisor_waitevent);
+                asyncjob_MarkDone(ourjob);
                 #ifndef NDEBUG
                 if (_vmasyncjobs_debug)
                     h64fprintf(stderr, "horsevm: debug: "
@@ -387,13 +510,9 @@ void asyncsysjobworker_Do(void *userdata) {
             // Bail out on failure (=> neither ipv4 nor ipv6 resolved):
             if (ourjob->hostlookup.resultip4len == 0 &&
                     ourjob->hostlookup.resultip6len == 0) {
-                mutex_Lock(asyncsysjob_schedule_lock);
                 ourjob->failed_oomorinternal = 0;
                 ourjob->failed_external = 1;
-                ourjob->inprogress = 0;
-                ourjob->done = 1;
-                mutex_Release(asyncsysjob_schedule_lock);
-                threadevent_Set(job_done_supervisor_waitevent);
+                asyncjob_MarkDone(ourjob);
                 #ifndef NDEBUG
                 if (_vmasyncjobs_debug)
                     h64fprintf(stderr, "horsevm: debug: "
@@ -403,11 +522,7 @@ void asyncsysjobworker_Do(void *userdata) {
                 continue;
             }
             // Mark done on success:
-            mutex_Lock(asyncsysjob_schedule_lock);
-            ourjob->inprogress = 0;
-            ourjob->done = 1;
-            mutex_Release(asyncsysjob_schedule_lock);
-            threadevent_Set(job_done_supervisor_waitevent);
+            asyncjob_MarkDone(ourjob);
             #ifndef NDEBUG
             if (_vmasyncjobs_debug)
                 h64fprintf(stderr, "horsevm: debug: "
@@ -436,12 +551,8 @@ void asyncsysjobworker_Do(void *userdata) {
                 );
                 if (!ourjob->runcmd.processrunptr) {
                     // Mark done on failure:
-                    mutex_Lock(asyncsysjob_schedule_lock);
-                    ourjob->inprogress = 0;
-                    ourjob->done = 1;
                     ourjob->failed_external = 1;
-                    mutex_Release(asyncsysjob_schedule_lock);
-                    threadevent_Set(job_done_supervisor_waitevent);
+                    asyncjob_MarkDone(ourjob);
                     #ifndef NDEBUG
                     if (_vmasyncjobs_debug)
                         h64fprintf(stderr, "horsevm: debug: "
@@ -465,13 +576,9 @@ void asyncsysjobworker_Do(void *userdata) {
                 ourjob->runcmd.processrunptr = NULL;
                 ourjob->runcmd.exit_code = exit_code;
                 // Mark done with exit_code:
-                mutex_Lock(asyncsysjob_schedule_lock);
-                ourjob->inprogress = 0;
-                ourjob->done = 1;
                 ourjob->failed_external = 0;
                 ourjob->failed_oomorinternal = 0;
-                mutex_Release(asyncsysjob_schedule_lock);
-                threadevent_Set(job_done_supervisor_waitevent);
+                asyncjob_MarkDone(ourjob);
                 #ifndef NDEBUG
                 if (_vmasyncjobs_debug)
                     h64fprintf(stderr, "horsevm: debug: "
@@ -482,10 +589,26 @@ void asyncsysjobworker_Do(void *userdata) {
                 continue;
             }
         }
-        threadevent_WaitUntilSet(
-            async_worker_event[worker_id],
-            5000, 1
-        );
+        if (ourjob != NULL &&
+                ourjob->type == ASYNCSYSJOB_FILEIO) {
+            #ifndef NDEBUG
+            if (_vmasyncjobs_debug)
+                h64fprintf(stderr, "horsevm: debug: "
+                    "processing file i/o op %d (job ptr=%p)\n",
+                    ourjob->fileio.op, ourjob);
+            #endif
+            iolib_RunFileIOJob(ourjob);
+            asyncjob_MarkDone(ourjob);
+            continue;
+        }
+        if (ourjob != NULL) {
+            // Unknown job type, nothing we can do about it:
+            ourjob->failed_oomorinternal = 1;
+            asyncjob_MarkDone(ourjob);
+            continue;
+        }
+        if (!_asyncjob_Park(worker_id))
+            return;
     }
 }
 
@@ -506,6 +629,62 @@ int asyncjob_IsDone(h64asyncsysjob *job) {
     return result;
 }
 
+int asyncjob_AddWaitRef(h64asyncsysjob *job) {
+    mutex_Lock(asyncsysjob_schedule_lock);
+    if (job->done) {
+        mutex_Release(asyncsysjob_schedule_lock);
+        return 0;
+    }
+    job->waitrefs++;
+    mutex_Release(asyncsysjob_schedule_lock);
+    return 1;
+}
+
+void asyncjob_DropWaitRef(h64asyncsysjob *job) {
+    mutex_Lock(asyncsysjob_schedule_lock);
+    assert(job->waitrefs > 0);
+    job->waitrefs--;
+    if (job->waitrefs == 0 && job->abandoned &&
+            job->done && !job->inprogress)
+        _asyncjob_FreeNoLock(job);
+    mutex_Release(asyncsysjob_schedule_lock);
+}
+
+static int _asyncjob_SpawnWorker() {
+    // IMPORTANT: asyncsysjob_schedule_lock must be LOCKED entering this.
+    int i = 0;
+    while (i < ASYNCSYSJOB_MAX_WORKERS) {
+        if (async_worker[i].t == NULL &&
+                atomic_load(&async_worker[i].state) ==
+                ASYNCWORKER_UNUSED)
+            break;
+        i++;
+    }
+    if (i >= ASYNCSYSJOB_MAX_WORKERS)
+        return 0;
+    if (!async_worker[i].wakeupevent) {
+        async_worker[i].wakeupevent = threadevent_Create();
+        if (!async_worker[i].wakeupevent)
+            return 0;
+    }
+    atomic_store(&async_worker[i].state, ASYNCWORKER_BUSY);
+    async_worker[i].t = thread_SpawnWithPriority(
+        THREAD_PRIO_LOW, asyncsysjobworker_Do, (void*)(uintptr_t)i
+    );
+    if (!async_worker[i].t) {
+        atomic_store(&async_worker[i].state, ASYNCWORKER_UNUSED);
+        return 0;
+    }
+    atomic_fetch_add(&async_worker_count, 1);
+    #ifndef NDEBUG
+    if (_vmasyncjobs_debug)
+        h64fprintf(stderr, "horsevm: debug: "
+            "spawned async worker %d, now %d running\n",
+            i, (int)atomic_load(&async_worker_count));
+    #endif
+    return 1;
+}
+
 int asyncjob_RequestAsync(
         h64vmthread *request_thread,
         h64asyncsysjob *job
@@ -516,91 +695,49 @@ int asyncjob_RequestAsync(
     assert(job->request_thread == NULL ||
            job->request_thread == request_thread);
     job->request_thread = request_thread;
-    mutex_Lock(asyncsysjob_schedule_lock);
-    if (jobs_count + 1 > jobs_alloc) {
-        int newc = (jobs_count + 64);
-        if (newc < jobs_alloc * 2)
-            newc = jobs_alloc * 2;
-        h64asyncsysjob **new_jobs = realloc(
-            jobs, sizeof(*new_jobs) * newc
-        );
-        if (!new_jobs) {
+
+    if (atomic_load(&async_worker_count) <= 0) {
+        // Make sure there is a worker before the job is queued,
+        // since it can't be taken back out after:
+        mutex_Lock(asyncsysjob_schedule_lock);
+        if (atomic_load(&async_worker_count) <= 0 &&
+                !_asyncjob_SpawnWorker()) {
             mutex_Release(asyncsysjob_schedule_lock);
             return 0;
         }
-        jobs = new_jobs;
-        jobs_alloc = newc;
+        mutex_Release(asyncsysjob_schedule_lock);
     }
-    jobs[jobs_count] = job;
-    jobs_count++;
-    if (async_worker_count < ASYNCSYSJOB_WORKER_COUNT) {
-        if (!async_worker) {
-            async_worker = malloc(
-                sizeof(*async_worker) * ASYNCSYSJOB_WORKER_COUNT
-            );
-            if (!async_worker)
-                goto abortduetospawn;
-            memset(
-                async_worker, 0,
-                sizeof(*async_worker) * ASYNCSYSJOB_WORKER_COUNT
-            );
-        }
-        if (!async_worker_event) {
-            async_worker_event = malloc(
-                sizeof(*async_worker_event) * ASYNCSYSJOB_WORKER_COUNT
-            );
-            if (!async_worker_event)
-                goto abortduetospawn;
-            memset(
-                async_worker_event, 0,
-                sizeof(*async_worker_event) * ASYNCSYSJOB_WORKER_COUNT
-            );
-        }
-        int i = 0;
-        while (i < ASYNCSYSJOB_WORKER_COUNT) {
-            if (!async_worker_event[i]) {
-                async_worker_event[i] = (
-                    threadevent_Create()
-                );
-                if (!async_worker_event[i]) {
-                    if (async_worker_count <= 0)
-                        goto abortduetospawn;
-                }
-            }
-            i++;
-        }
-        while (async_worker_count < ASYNCSYSJOB_WORKER_COUNT) {
-            if (!async_worker_event[async_worker_count])
-                break;
-            async_worker[async_worker_count] = (
-                thread_SpawnWithPriority(
-                    THREAD_PRIO_LOW, asyncsysjobworker_Do,
-                    (void*)(uintptr_t)async_worker_count
-                )
+    if (!asyncjobqueue_Push(&jobs, job)) {
+        // The queue is full, so put it into the overflow list:
+        mutex_Lock(asyncsysjob_schedule_lock);
+        int count = atomic_load(&jobs_overflow_count);
+        if (count + 1 > jobs_overflow_alloc) {
+            int newc = (count + 64);
+            if (newc < jobs_overflow_alloc * 2)
+                newc = jobs_overflow_alloc * 2;
+            h64asyncsysjob **new_overflow = realloc(
+                jobs_overflow, sizeof(*new_overflow) * newc
             );
-            if (!async_worker[async_worker_count]) {
-                if (async_worker_count <= 0) {
-                    // Didn't manage to spawn even one worker, abort.
-                    abortduetospawn:
-                    jobs_count--;
-                    jobs[jobs_count] = NULL;  // disown it again
-                    mutex_Release(asyncsysjob_schedule_lock);
-                    return 0;
-                }
-                // Got one worker running, so ignore for now.
-            }
-            async_worker_count++;
-        }
-    } else {
-        int i = 0;
-        while (i < ASYNCSYSJOB_WORKER_COUNT) {
-            if (async_worker_event[i]) {
-                threadevent_Set(async_worker_event[i]);
+            if (!new_overflow) {
+                mutex_Release(asyncsysjob_schedule_lock);
+                return 0;
             }
-            i++;
+            jobs_overflow = new_overflow;
+            jobs_overflow_alloc = newc;
         }
+        jobs_overflow[count] = job;
+        atomic_store(&jobs_overflow_count, count + 1);
+        mutex_Release(asyncsysjob_schedule_lock);
+    }
+
+    // Get a worker on it. A parked one is the cheapest, otherwise grow
+    // the pool since the busy ones may be stuck in blocking calls.
+    // (If that fails, the busy ones will get to it eventually.)
+    if (!_asyncjob_WakeParkedWorker()) {
+        mutex_Lock(asyncsysjob_schedule_lock);
+        _asyncjob_SpawnWorker();
+        mutex_Release(asyncsysjob_schedule_lock);
     }
-    mutex_Release(asyncsysjob_schedule_lock);
     return 1;
 }
 
@@ -608,6 +745,13 @@ void asyncjob_AbandonJob(
         h64asyncsysjob *job
         ) {
     mutex_Lock(asyncsysjob_schedule_lock);
-    job->abandoned = 1;
+    if (job->done && !job->inprogress && job->waitrefs == 0) {
+        // No worker refers to it anymore, so get rid of it now:
+        _asyncjob_FreeNoLock(job);
+    } else {
+        // Whichever worker has it, or whoever drops the last wait ref,
+        // will free it once it gets to it:
+        job->abandoned = 1;
+    }
     mutex_Release(asyncsysjob_schedule_lock);
 }
\ No newline at end of file
@@ -8,23 +8,33 @@
 #include "compileconfig.h"
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include "widechar.h"
 
+typedef struct h64vmexec h64vmexec;
 typedef struct h64vmthread h64vmthread;
 typedef struct processrun processrun;
 
 typedef enum h64asyncsysjobtype {
     ASYNCSYSJOB_NONE = 0,
     ASYNCSYSJOB_HOSTLOOKUP = 1,
-    ASYNCSYSJOB_RUNCMD
+    ASYNCSYSJOB_RUNCMD,
+    ASYNCSYSJOB_FILEIO
 } h64asyncsysjobtype;
 
+typedef enum h64asyncfileioop {
+    ASYNCFILEIO_OPEN = 1,
+    ASYNCFILEIO_READ,
+    ASYNCFILEIO_WRITE
+} h64asyncfileioop;
+
 typedef struct h64asyncsysjob {
     h64vmthread *request_thread;
     int type;
     volatile uint8_t done, inprogress, failed_oomorinternal;
     volatile uint8_t failed_external, abandoned;
+    int32_t waitrefs;  // see asyncjob_AddWaitRef(), guarded by lock
     union {
         struct hostlookup {
             h64wchar *host;
@@ -44,6 +54,22 @@ typedef struct h64asyncsysjob {
             processrun *processrunptr;
             int exit_code;
         } runcmd;
+        struct fileio {
+            int op;
+            FILE *f;
+            char *path;  // for opening, utf-8 and null-terminated
+            char mode[5];
+            uint8_t reopen_append;
+            uint8_t flush_first, binary, cached_error;
+            int64_t amount;  // for reading, -1 to read everything
+            char *buf;  // read result, or data to be written
+            int64_t buflen;
+            uint8_t buf_owned;
+            int64_t written;
+            int error_no;  // errno if opening failed
+            int error_class_id;  // -1 unless failed
+            const char *error_msg;
+        } fileio;
     };
 } h64asyncsysjob;
 
@@ -58,10 +84,25 @@ int asyncjob_RequestAsync(
 
 int asyncjob_IsDone(h64asyncsysjob *job);
 
+void asyncjob_MarkDone(h64asyncsysjob *job);
+    // also for jobs run right away when asyncjob_RequestAsync() failed
+
+int asyncjob_AddWaitRef(h64asyncsysjob *job);
+    // For a thread other than the requesting one that wants to suspend
+    // with SUSPENDTYPE_ASYNCSYSJOBWAIT on job: keeps job from being freed
+    // until asyncjob_DropWaitRef(), and has the supervisor look for
+    // waiters once it's done. Returns 0 and adds no ref if it's done.
+
+void asyncjob_DropWaitRef(h64asyncsysjob *job);
+
 void asyncjob_AbandonJob(
     h64asyncsysjob *job
 );
 
+void asyncjob_SetNotifyVMExec(
+    h64vmexec *vmexec
+);  // threads of this vmexec waiting on a job get queued once it's done
+
 int _asyncjob_GetSupervisorWaitFD();
 
 void asyncjob_FlushSupervisorWakeupEvents();
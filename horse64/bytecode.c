@@ -22,6 +22,7 @@
 #include "uri32.h"
 #include "vmexec.h"
 #include "vmstrings.h"
+#include "vmvector.h"
 
 
 static char _name_itype_invalid[] = "invalid_instruction";
@@ -577,10 +578,30 @@ HOTSPOT void valuecontent_Free_Do(
                 i++;
             }
             free(gcval->varattr);
+            gcval->varattr = NULL;
+            if (gcval->cdata) {
+                // Any C data struct starts with its destructor:
+                void (*on_destroy)(h64gcvalue *obj) = (
+                    *(void (**)(h64gcvalue *))gcval->cdata
+                );
+                if (on_destroy)
+                    on_destroy(gcval);
+                free(gcval->cdata);
+                gcval->cdata = NULL;
+            }
             return;
         } else if (gcval->type == H64GCVALUETYPE_STRING) {
             vmstrings_Free(vmthread, &gcval->str_val);
             return;
+        } else if (gcval->type == H64GCVALUETYPE_BYTES) {
+            vmbytes_Free(vmthread, &gcval->bytes_val);
+            return;
+        }
+    } else if (content->type == H64VALTYPE_VECTOR) {
+        if (content->vector->refcount <= 0) {
+            vmvector_Free(content->vector);
+            content->vector = NULL;
+            content->type = H64VALTYPE_NONE;
         }
     }
 
@@ -792,6 +813,16 @@ void h64program_Free(h64program *p) {
         free(p->string_indexes.func_name);
         free(p->string_indexes.func_name_idx);
     }
+    if (p->vector_indexes.func_count > 0) {
+        free(p->vector_indexes.func_idx);
+        int i = 0;
+        while (i < p->vector_indexes.func_count) {
+            free(p->vector_indexes.func_name[i]);
+            i++;
+        }
+        free(p->vector_indexes.func_name);
+        free(p->vector_indexes.func_name_idx);
+    }
 
     free(p);
 }
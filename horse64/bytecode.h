@@ -16,6 +16,7 @@
 #include "compiler/globallimits.h"
 #include "corelib/moduleless_containers.h"
 #include "corelib/moduleless_strings.h"
+#include "corelib/moduleless_vectors.h"
 
 #define MAX_ERROR_STACK_FRAMES 10
 
@@ -436,6 +437,7 @@ typedef struct h64program {
     funcid_t is_a_func_index;
     h64moduleless_strings_indexes string_indexes;
     h64moduleless_containers_indexes container_indexes;
+    h64moduleless_vectors_indexes vector_indexes;
 
     int64_t as_bytes_name_index;
     int64_t as_str_name_index;
@@ -448,7 +450,9 @@ typedef struct h64program {
     int64_t contains_name_index;
     int64_t is_a_name_index;
 
+    classid_t _channel_class_idx;  // used by channel module
     classid_t _io_file_class_idx;  // used by io module
+    classid_t _io_buffer_class_idx;  // used by io module
     classid_t _net_stream_class_idx;  // used by net module
     classid_t _urilib_uri_class_idx;  // used by uri module
     int64_t _processlib_args_globalvar_idx;  // used by process module
@@ -577,6 +581,8 @@ ATTR_UNUSED static inline void DELREF_NONHEAP(valuecontent *content) {
     } else if (content->type == H64VALTYPE_ERROR) {
         if (content->einfo)
             content->einfo->refcount--;
+    } else if (content->type == H64VALTYPE_VECTOR) {
+        content->vector->refcount--;
     }
 }
 
@@ -588,6 +594,8 @@ ATTR_UNUSED static inline void ADDREF_NONHEAP(valuecontent *content) {
     } else if (content->type == H64VALTYPE_ERROR) {
         if (content->einfo)
             content->einfo->refcount++;
+    } else if (content->type == H64VALTYPE_VECTOR) {
+        content->vector->refcount++;
     }
 }
 
@@ -599,6 +607,8 @@ ATTR_UNUSED static inline void DELREF_HEAP(valuecontent *content) {
     } else if (content->type == H64VALTYPE_ERROR) {
         if (content->einfo)
             content->einfo->refcount--;
+    } else if (content->type == H64VALTYPE_VECTOR) {
+        content->vector->refcount--;
     }
 }
 
@@ -610,6 +620,8 @@ ATTR_UNUSED static inline void ADDREF_HEAP(valuecontent *content) {
     } else if (content->type == H64VALTYPE_ERROR) {
         if (content->einfo)
             content->einfo->refcount++;
+    } else if (content->type == H64VALTYPE_VECTOR) {
+        content->vector->refcount++;
     }
 }
 
@@ -179,7 +179,9 @@ int h64program_Dump(h64program *p, char **out, int64_t *out_len) {
     _DUMP(p->contains_name_index);
     _DUMP(p->is_a_name_index);
 
+    _DUMP(p->_channel_class_idx);
     _DUMP(p->_io_file_class_idx);
+    _DUMP(p->_io_buffer_class_idx);
     _DUMP(p->_net_stream_class_idx);
     _DUMP(p->_urilib_uri_class_idx);
 
@@ -459,7 +461,9 @@ int h64program_Restore(
     _LOAD(p->contains_name_index);
     _LOAD(p->is_a_name_index);
 
+    _LOAD(p->_channel_class_idx);
     _LOAD(p->_io_file_class_idx);
+    _LOAD(p->_io_buffer_class_idx);
     _LOAD(p->_net_stream_class_idx);
     _LOAD(p->_urilib_uri_class_idx);
 
@@ -21,6 +21,7 @@
 #endif
 
 #define USE_POLL_ON_UNIX 1
+#define USE_EPOLL_ON_LINUX 1
 
 #include <math.h>
 #include <stdint.h>
@@ -553,6 +553,119 @@ static int _compare_kw_args(void *item1, void *item2) {
     return 0;
 }
 
+typedef struct _lastusesearchinfo {
+    hashmap *last_use;
+    int hadoutofmemory;
+} _lastusesearchinfo;
+
+static int _codegencallback_FindLastUse_visit_in(
+        h64expression *expr, ATTR_UNUSED h64expression *parent,
+        void *ud
+        ) {
+    _lastusesearchinfo *info = ud;
+    if (expr->type != H64EXPRTYPE_IDENTIFIERREF ||
+            !expr->identifierref.resolved_to_def)
+        return 1;
+    int64_t key = (int64_t)(uintptr_t)(
+        expr->identifierref.resolved_to_def
+    );
+    uint64_t prev = 0;
+    if (hash_IntMapGet(info->last_use, key, &prev) &&
+            prev >= (uint64_t)expr->tokenindex)
+        return 1;
+    if (!hash_IntMapSet(info->last_use, key, expr->tokenindex)) {
+        info->hadoutofmemory = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static int _codegen_CallPipesArgs(
+        asttransforminfo *rinfo, h64expression *callexpr
+        ) {
+    // Returns 1 if this is an async call to a func known to be
+    // parallel, which means the arguments are piped to another heap:
+    if (!callexpr->inlinecall.is_async)
+        return 0;
+    h64expression *called = callexpr->inlinecall.value;
+    if (!called->storage.set ||
+            called->storage.ref.type != H64STORETYPE_GLOBALFUNCSLOT)
+        return 0;
+    return (rinfo->pr->program->func[
+        called->storage.ref.id
+    ].user_set_parallel != 0);
+}
+
+static int _codegen_ArgIsPipedAway(
+        h64expression *func, h64expression *arg, int *outofmemory
+        ) {
+    // For calls that pipe their args, returns 1 if the argument's value
+    // slot can be cleared right after it was copied into the call, such
+    // that the value has a single owner and may be moved rather than
+    // copied. This is true for temporaries, and for the last use of a
+    // plain local or parameter that isn't captured or in a loop.
+    *outofmemory = 0;
+    if (arg->storage.eval_temp_id < 0)
+        return 0;
+    if (arg->storage.eval_temp_id >=
+            func->funcdef._storageinfo->lowest_guaranteed_free_temp)
+        return 1;
+    if (arg->type != H64EXPRTYPE_IDENTIFIERREF ||
+            !arg->storage.set ||
+            arg->storage.ref.type != H64STORETYPE_STACKSLOT ||
+            arg->storage.ref.id != arg->storage.eval_temp_id ||
+            !arg->identifierref.resolved_to_def ||
+            arg->identifierref.resolved_to_def->closurebound)
+        return 0;
+    // Only plain vars and params. Other storage, like that of a
+    // with clause, is still read by code the compiler emits later:
+    h64expression *declexpr = (
+        arg->identifierref.resolved_to_def->declarationexpr
+    );
+    if (declexpr != func && (!declexpr ||
+            declexpr->type != H64EXPRTYPE_VARDEF_STMT))
+        return 0;
+    h64expression *upwards = arg->parent;
+    while (upwards && upwards != func) {
+        if (upwards->type == H64EXPRTYPE_WHILE_STMT ||
+                upwards->type == H64EXPRTYPE_FOR_STMT ||
+                upwards->type == H64EXPRTYPE_FUNCDEF_STMT ||
+                upwards->type == H64EXPRTYPE_INLINEFUNCDEF)
+            return 0;
+        upwards = upwards->parent;
+    }
+    if (upwards != func)
+        return 0;
+    // Find the last use of every local in one go, on first need:
+    h64funcstorageextrainfo *einfo = func->funcdef._storageinfo;
+    if (!einfo->codegen.last_use_tokenindex) {
+        _lastusesearchinfo info = {0};
+        info.last_use = hash_NewIntMap(64);
+        if (!info.last_use) {
+            *outofmemory = 1;
+            return 0;
+        }
+        ast_VisitExpression(
+            func, NULL, &_codegencallback_FindLastUse_visit_in, NULL,
+            NULL, &info
+        );
+        if (info.hadoutofmemory) {
+            hash_FreeMap(info.last_use);
+            *outofmemory = 1;
+            return 0;
+        }
+        einfo->codegen.last_use_tokenindex = info.last_use;
+    }
+    uint64_t last_use = 0;
+    if (!hash_IntMapGet(
+            einfo->codegen.last_use_tokenindex,
+            (int64_t)(uintptr_t)arg->identifierref.resolved_to_def,
+            &last_use
+            ))
+        return 0;
+    return (last_use == (uint64_t)arg->tokenindex);
+}
+
 static int _codegen_call_to(
         asttransforminfo *rinfo, h64expression *func,
         h64expression *callexpr,
@@ -800,6 +913,36 @@ static int _codegen_call_to(
     if (alloc_heap)
         free(arg_kwsortinfo);
     arg_kwsortinfo = NULL;
+    // For async parallel calls, drop our own references to values that
+    // aren't used again, so they can be moved instead of copied when piped:
+    if (_codegen_CallPipesArgs(rinfo, callexpr)) {
+        i = 0;
+        while (i < callexpr->inlinecall.arguments.arg_count) {
+            h64expression *arg = (
+                callexpr->inlinecall.arguments.arg_value[i]
+            );
+            int outofmemory = 0;
+            if (!_codegen_ArgIsPipedAway(func, arg, &outofmemory)) {
+                if (outofmemory) {
+                    rinfo->hadoutofmemory = 1;
+                    return 0;
+                }
+                i++;
+                continue;
+            }
+            h64instruction_setconst inst_clear = {0};
+            inst_clear.type = H64INST_SETCONST;
+            inst_clear.slot = arg->storage.eval_temp_id;
+            inst_clear.content.type = H64VALTYPE_NONE;
+            if (!appendinst(
+                    rinfo->pr->program, func, callexpr,
+                    &inst_clear)) {
+                rinfo->hadoutofmemory = 1;
+                return 0;
+            }
+            i++;
+        }
+    }
     // Ok, now we got arguments done so do actual call:
     int maxslotsused = _argtemp - (
         func->funcdef._storageinfo->lowest_guaranteed_free_temp
@@ -1410,7 +1553,13 @@ int _codegencallback_DoCodegen_visit_out(
                 instsc.type = H64INST_SETCONST;
                 instsc.slot = key_slot;
                 instsc.content.type = H64VALTYPE_INT64;
-                instsc.content.int_value = i;
+                instsc.content.int_value = i + 1;  // 1-based index
+                if (!appendinst(
+                        rinfo->pr->program, func, expr, &instsc
+                        )) {
+                    rinfo->hadoutofmemory = 1;
+                    return 0;
+                }
             }
             h64instruction_setbyindexexpr instbyindexexpr = {0};
             instbyindexexpr.type = H64INST_SETBYINDEXEXPR;
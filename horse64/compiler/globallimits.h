@@ -19,7 +19,9 @@
 #define H64LIMIT_MAX_CLASS_FUNCATTRS ((INT16_MAX / 4) - 2)
 
 #define CFUNC_ASYNCDATA_DEFAULTITEMSIZE 64
-#define ASYNCSYSJOB_WORKER_COUNT 6
+#define ASYNCSYSJOB_MAX_WORKERS 64
+#define ASYNCSYSJOB_WORKER_IDLE_MS 10000
+#define ASYNCSYSJOB_QUEUE_SIZE 4096
 
 typedef int16_t attridx_t;
 typedef int32_t classid_t;
@@ -193,6 +193,18 @@ static int _compileargparse(
                     "  --vmsockets-debug:       Show debug info about "
                     "horsevm sockets\n"
                 );
+                h64printf(
+                    "  --vm-workers <count>:    Use this many worker "
+                    "threads\n"
+                );
+                h64printf(
+                    "  --vm-worker-cpus <list>: Pin workers to these "
+                    "CPUs, e.g. 0-3,6\n"
+                );
+                h64printf(
+                    "  --vm-supervisor-cpu <n>: Pin the event loop to "
+                    "this CPU, keep workers off it\n"
+                );
             }
             if (strcmp(cmd, "run") == 0 || strcmp(cmd, "exec") == 0 ||
                     strcmp(cmd, "compile") == 0 ||
@@ -325,6 +337,69 @@ static int _compileargparse(
                 "output for --vmsched-verbose-debug not compiled in\n", cmd
             );
             #endif
+        } else if ((strcmp(cmd, "run") == 0 ||
+                strcmp(cmd, "exec") == 0) && (
+                h64cmp_u32u8(argv[i], argvlen[i],
+                    "--vm-workers") == 0 ||
+                h64cmp_u32u8(argv[i], argvlen[i],
+                    "--vm-worker-cpus") == 0 ||
+                h64cmp_u32u8(argv[i], argvlen[i],
+                    "--vm-supervisor-cpu") == 0)) {
+            char *u8argv = AS_U8(argv[i], argvlen[i]);
+            if (!u8argv) {
+                h64fprintf(stderr, "horsec: error: "
+                    "out of memory parsing arguments\n");
+                goto failquit;
+            }
+            if (i + 1 >= argc || (argvlen[i + 1] > 0 &&
+                    argv[i + 1][0] == '-')) {
+                h64fprintf(stderr, "horsec: error: %s: "
+                    "%s needs argument\n", cmd, u8argv);
+                free(u8argv);
+                goto failquit;
+            }
+            char *u8value = AS_U8(argv[i + 1], argvlen[i + 1]);
+            if (!u8value) {
+                free(u8argv);
+                h64fprintf(stderr, "horsec: error: "
+                    "out of memory parsing arguments\n");
+                goto failquit;
+            }
+            int valid = 1;
+            if (strcmp(u8argv, "--vm-worker-cpus") == 0) {
+                valid = threadcpuset_FromStr(
+                    &miscoptions->vm_worker_cpus, u8value
+                );
+                miscoptions->vm_pin_workers = valid;
+            } else {
+                char *endptr = NULL;
+                int64_t value = h64strtoll(u8value, &endptr, 10);
+                if (!endptr || *endptr != '\0' || endptr == u8value)
+                    valid = 0;
+                if (strcmp(u8argv, "--vm-workers") == 0) {
+                    if (value < 1 || value > THREAD_MAX_CPUS)
+                        valid = 0;
+                    else
+                        miscoptions->vm_worker_count = value;
+                } else {
+                    if (value < 0 || value >= THREAD_MAX_CPUS)
+                        valid = 0;
+                    miscoptions->vm_pin_supervisor = valid;
+                    miscoptions->vm_supervisor_cpu = value;
+                }
+            }
+            if (!valid) {
+                h64fprintf(stderr, "horsec: error: %s: "
+                    "invalid value for %s: %s\n", cmd, u8argv,
+                    u8value);
+                free(u8argv);
+                free(u8value);
+                goto failquit;
+            }
+            free(u8argv);
+            free(u8value);
+            i += 2;
+            continue;
         } else if (h64cmp_u32u8(argv[i], argvlen[i],
                 "--compiler-stage-debug") == 0) {
             miscoptions->compiler_stage_debug = 1;
@@ -8,6 +8,7 @@
 #include "compileconfig.h"
 
 #include "json.h"
+#include "threading.h"
 #include "widechar.h"
 
 typedef struct h64compilewarnconfig h64compilewarnconfig;
@@ -71,6 +72,13 @@ typedef struct h64misccompileroptions {
     int vmsockets_debug;
     int vmasyncjobs_debug;
     int compile_project_debug;
+
+    // Worker pool setup for "run" and "exec", all 0 for the defaults:
+    int vm_worker_count;  // 0 to pick one from the CPU count
+    int vm_pin_workers;  // set if vm_worker_cpus was given
+    threadcpuset vm_worker_cpus;
+    int vm_pin_supervisor;  // set if vm_supervisor_cpu was given
+    int vm_supervisor_cpu;
 } h64misccompileroptions;
 
 #endif  // HORSE64_COMPILER_MAIN_H_
@@ -15,6 +15,7 @@
 #include "compiler/asttransform.h"
 #include "compiler/compileproject.h"
 #include "compiler/varstorage.h"
+#include "hash.h"
 #include "nonlocale.h"
 
 
@@ -458,6 +459,8 @@ void varstorage_FreeExtraInfo(
         return;
     free(einfo->codegen.extra_temps_used);
     free(einfo->codegen.extra_temps_deletepastline);
+    if (einfo->codegen.last_use_tokenindex)
+        hash_FreeMap(einfo->codegen.last_use_tokenindex);
     free(einfo->lstoreassign);
     free(einfo->closureboundvars);
     free(einfo);
@@ -14,6 +14,7 @@ typedef struct h64ast h64ast;
 typedef struct jsonvalue jsonvalue;
 typedef struct h64scopedef h64scopedef;
 typedef struct h64expression h64expression;
+typedef struct hashmap hashmap;
 
 int varstorage_AssignLocalStorage(
     h64compileproject *pr, h64ast *ast
@@ -31,6 +32,8 @@ struct h64codegenstorageinfo {
 
     int extra_temps_count;
     int *extra_temps_used, *extra_temps_deletepastline;
+
+    hashmap *last_use_tokenindex;  // scopedef -> last use, computed lazily
 };
 
 typedef struct h64funcstorageextrainfo {
@@ -18,6 +18,8 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "bytecode.h"
 #include "corelib/errors.h"
@@ -29,11 +31,13 @@
 #include "itemsort.h"
 #include "net.h"
 #include "nonlocale.h"
+#include "osinfo.h"
 #include "poolalloc.h"
 #include "process.h"
 #include "stack.h"
 #include "vmexec.h"
 #include "vmlist.h"
+#include "vmschedule.h"
 #include "widechar.h"
 
 
@@ -57,6 +61,152 @@ static int _cmp_valuecontent(void *a, void *b) {
     return 1;
 }
 
+static int _cmp_packedint(void *a, void *b) {
+    int64_t ia = *((int64_t *)a);
+    int64_t ib = *((int64_t *)b);
+    return (ia > ib) - (ia < ib);
+}
+
+static int _cmp_packedfloat(void *a, void *b) {
+    double fa = *((double *)a);
+    double fb = *((double *)b);
+    return (fa > fb) - (fa < fb);
+}
+
+typedef struct _sortstringitem {
+    const h64wchar *s;
+    int64_t len;
+    valuecontent vc;
+} _sortstringitem;
+
+static int _cmp_sortstringitem(void *a, void *b) {
+    _sortstringitem *sa = a;
+    _sortstringitem *sb = b;
+    int64_t minlen = (sa->len < sb->len ? sa->len : sb->len);
+    int64_t i = 0;
+    while (i < minlen) {
+        if (sa->s[i] != sb->s[i])
+            return (sa->s[i] > sb->s[i] ? 1 : -1);
+        i++;
+    }
+    return (sa->len > sb->len) - (sa->len < sb->len);
+}
+
+static int _sortstringitem_Set(
+        _sortstringitem *item, valuecontent *vc
+        ) {
+    if (vc->type == H64VALTYPE_SHORTSTR) {
+        item->s = vc->shortstr_value;
+        item->len = vc->shortstr_len;
+    } else if (vc->type == H64VALTYPE_CONSTPREALLOCSTR) {
+        item->s = vc->constpreallocstr_value;
+        item->len = vc->constpreallocstr_len;
+    } else if (vc->type == H64VALTYPE_GCVAL &&
+            ((h64gcvalue *)vc->ptr_value)->type ==
+                H64GCVALUETYPE_STRING) {
+        item->s = ((h64gcvalue *)vc->ptr_value)->str_val.s;
+        item->len = ((h64gcvalue *)vc->ptr_value)->str_val.len;
+    } else {
+        return 0;
+    }
+    memcpy(&item->vc, vc, sizeof(*vc));
+    return 1;
+}
+
+static int _sort_ThreadCount(h64vmthread *vmthread, int64_t count) {
+    // Only large sorts are worth spinning up helper threads for, and
+    // never more than the VM may use for workers (see --vm-workers):
+    if (count < ITEMSORT_PARALLEL_MIN_ITEMS)
+        return 1;
+    int thread_count = osinfo_CpuThreads();
+    int worker_count = vmschedule_WorkerCount(
+        &vmthread->vmexec_owner->moptions
+    );
+    if (worker_count < thread_count)
+        thread_count = worker_count;
+    return thread_count;
+}
+
+static int _sort_ReturnList(
+        h64vmthread *vmthread, genericlist *lresult
+        ) {
+    h64gcvalue *gcval = poolalloc_malloc(vmthread->heap, 0);
+    if (!gcval) {
+        vmlist_Free(lresult);
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory allocating result list"
+        );
+    }
+    memset(gcval, 0, sizeof(*gcval));
+    gcval->type = H64GCVALUETYPE_LIST;
+    gcval->list_values = lresult;
+
+    // Note: the input list is in the result slot, so replace it only now.
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memset(vcresult, 0, sizeof(*vcresult));
+    vcresult->type = H64VALTYPE_GCVAL;
+    vcresult->ptr_value = gcval;
+    ADDREF_NONHEAP(vcresult);
+    return 1;
+}
+
+static int _sort_packedlist(
+        h64vmthread *vmthread, genericlist *l, int ascend
+        ) {
+    // Packed number lists are sorted as raw 8-byte values, without
+    // any per-item type checks or refcounting:
+    const int64_t count = vmlist_Count(l);
+    const uint8_t packed_type = l->packed_type;
+    int64_t *sorted = malloc(sizeof(*sorted) * (count > 0 ? count : 1));
+    if (!sorted) {
+        oom: ;
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory sorting list"
+        );
+    }
+    if (count > 0)
+        memcpy(sorted, l->packed_int_values, sizeof(*sorted) * count);
+    int oom = 0;
+    if (!itemsort_DoParallel(
+            sorted, sizeof(*sorted) * count, sizeof(*sorted),
+            (packed_type == LISTPACKED_FLOAT64 ?
+             _cmp_packedfloat : _cmp_packedint),
+            _sort_ThreadCount(vmthread, count), &oom, NULL
+            )) {
+        free(sorted);
+        goto oom;
+    }
+    genericlist *lresult = vmlist_New();
+    if (!lresult) {
+        free(sorted);
+        goto oom;
+    }
+    int64_t i = 0;
+    while (i < count) {
+        int64_t k = (ascend ? i : count - 1 - i);
+        valuecontent v = {0};
+        if (packed_type == LISTPACKED_FLOAT64) {
+            v.type = H64VALTYPE_FLOAT64;
+            v.float_value = ((double *)sorted)[k];
+        } else {
+            v.type = H64VALTYPE_INT64;
+            v.int_value = sorted[k];
+        }
+        if (!vmlist_Add(lresult, &v)) {
+            vmlist_Free(lresult);
+            free(sorted);
+            goto oom;
+        }
+        i++;
+    }
+    free(sorted);
+    return _sort_ReturnList(vmthread, lresult);
+}
+
 int builtininternals_sort(h64vmthread *vmthread) {
     assert(STACK_TOP(vmthread->stack) >= 2);
 
@@ -69,158 +219,114 @@ int builtininternals_sort(h64vmthread *vmthread) {
     }
     int ascend = (vdescend->int_value == 0);
 
-    valuecontent _stackbuf[128];
-    valuecontent *to_be_sorted = _stackbuf;
-    int64_t to_be_sorted_alloc = 128;
-    int64_t to_be_sorted_count = 0;
-    int to_be_sorted_onheap = 0;
     valuecontent *sortinput = STACK_ENTRY(vmthread->stack, 0);
     if (sortinput->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue *)sortinput->ptr_value)->type ==
-                H64GCVALUETYPE_LIST) {
-        genericlist *l = ((h64gcvalue *)sortinput->ptr_value)->list_values;
-        const int64_t count = vmlist_Count(l);
-        int64_t i = 0;
-        while (i < count) {
-            valuecontent *v = vmlist_Get(l, i + 1);
-            assert(v != NULL);
-            if (to_be_sorted_count + 1 > to_be_sorted_alloc) {
-                int64_t new_alloc = to_be_sorted_alloc * 2;
-                valuecontent *new_to_be_sorted = NULL;
-                if (to_be_sorted_onheap) {
-                    new_to_be_sorted = realloc(
-                        to_be_sorted, sizeof(*to_be_sorted) * (
-                        new_alloc)
-                    );
-                } else {
-                    new_to_be_sorted = malloc(
-                        sizeof(*to_be_sorted) * new_alloc
-                    );
-                }
-                if (!new_to_be_sorted) {
-                    oom: ;
-                    i = 0;
-                    while (i < to_be_sorted_count) {
-                        DELREF_NONHEAP(&to_be_sorted[i]);
-                        valuecontent_Free(
-                            vmthread, &to_be_sorted[i]
-                        );
-                        i++;
-                    }
-                    if (to_be_sorted_onheap)
-                        free(to_be_sorted);
-                    return vmexec_ReturnFuncError(
-                        vmthread, H64STDERROR_OUTOFMEMORYERROR,
-                        "out of memory allocating result list"
-                    );
-                }
-                if (!to_be_sorted_onheap) {
-                    memcpy(
-                        new_to_be_sorted, to_be_sorted,
-                        sizeof(*to_be_sorted) * new_alloc
-                    );
-                }
-                to_be_sorted = new_to_be_sorted;
-                to_be_sorted_alloc = new_alloc;
-                to_be_sorted_onheap = 1;
-            }
-            memcpy(
-                &to_be_sorted[i], v, sizeof(*v)
-            );
-            ADDREF_NONHEAP(&to_be_sorted[i]);
-            to_be_sorted_count++;
-            i++;
-        }
-    } else if (sortinput->type == H64VALTYPE_GCVAL &&
             ((h64gcvalue *)sortinput->ptr_value)->type ==
                 H64GCVALUETYPE_SET) {
         assert(0);  // FIXME, implement this
-    } else  {
+    } else if (sortinput->type != H64VALTYPE_GCVAL ||
+            ((h64gcvalue *)sortinput->ptr_value)->type !=
+                H64GCVALUETYPE_LIST) {
         return vmexec_ReturnFuncError(
             vmthread, H64STDERROR_TYPEERROR,
             "cannot sort a type other than list or set"
         );
     }
+    genericlist *l = ((h64gcvalue *)sortinput->ptr_value)->list_values;
+    if (l->packed_type != LISTPACKED_NONE)
+        return _sort_packedlist(vmthread, l, ascend);
+
+    // Sort borrowed copies of the entries. This needs no refcounting,
+    // since the input list stays alive in its stack slot until we are
+    // done, and the result list takes its own references.
+    const int64_t count = vmlist_Count(l);
+    valuecontent *items = malloc(
+        sizeof(*items) * (count > 0 ? count : 1)
+    );
+    if (!items) {
+        oom: ;
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory sorting list"
+        );
+    }
+    int allstrings = 1;
+    int64_t i = 0;
+    while (i < count) {
+        int gotentry = vmlist_Get(l, i + 1, &items[i]);
+        assert(gotentry);
+        if (allstrings && items[i].type != H64VALTYPE_SHORTSTR &&
+                items[i].type != H64VALTYPE_CONSTPREALLOCSTR && (
+                items[i].type != H64VALTYPE_GCVAL ||
+                ((h64gcvalue *)items[i].ptr_value)->type !=
+                    H64GCVALUETYPE_STRING))
+            allstrings = 0;
+        i++;
+    }
 
-    if (likely(to_be_sorted_count >= 2)) {
-        // Ok, apply quick sort.
-        int oom = 0; int unsortable = 0;
-        int result = itemsort_Do(
-            to_be_sorted, sizeof(*to_be_sorted) * to_be_sorted_count,
-            sizeof(*to_be_sorted),
-            _cmp_valuecontent,
+    int oom = 0;
+    int unsortable = 0;
+    int result = 1;
+    if (allstrings && count >= 2) {
+        // All strings, so compare them directly without going through
+        // the generic value comparison:
+        _sortstringitem *stritems = malloc(sizeof(*stritems) * count);
+        if (!stritems) {
+            free(items);
+            goto oom;
+        }
+        i = 0;
+        while (i < count) {
+            _sortstringitem_Set(&stritems[i], &items[i]);
+            i++;
+        }
+        result = itemsort_DoParallel(
+            stritems, sizeof(*stritems) * count, sizeof(*stritems),
+            _cmp_sortstringitem, _sort_ThreadCount(vmthread, count),
             &oom, &unsortable
         );
-        if (!result) {
-            int64_t i = 0;
-            while (i < to_be_sorted_count) {
-                DELREF_NONHEAP(&to_be_sorted[i]);
-                valuecontent_Free(vmthread, &to_be_sorted[i]);
-                i++;
-            }
-            if (to_be_sorted_onheap)
-                free(to_be_sorted);
-            if (oom) {
-                return vmexec_ReturnFuncError(
-                    vmthread, H64STDERROR_OUTOFMEMORYERROR,
-                    "out of memory sorting list"
-                );
-            } else {
-                assert(unsortable);
-                return vmexec_ReturnFuncError(
-                    vmthread, H64STDERROR_VALUEERROR,
-                    "container has unsortable value"
-                );
-            }
+        i = 0;
+        while (result && i < count) {
+            memcpy(&items[i], &stritems[i].vc, sizeof(items[i]));
+            i++;
         }
-    } else {
-        // One or zero elements, no need to sort.
+        free(stritems);
+    } else if (count >= 2) {
+        result = itemsort_DoParallel(
+            items, sizeof(*items) * count, sizeof(*items),
+            _cmp_valuecontent, _sort_ThreadCount(vmthread, count),
+            &oom, &unsortable
+        );
+    }
+    if (!result) {
+        free(items);
+        if (oom)
+            goto oom;
+        assert(unsortable);
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_VALUEERROR,
+            "container has unsortable value"
+        );
     }
 
     // Assemble result list and copy in the sorted values:
-    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
-    DELREF_NONHEAP(vcresult);
-    valuecontent_Free(vmthread, vcresult);
-    memset(vcresult, 0, sizeof(*vcresult));
-    vcresult->type = H64VALTYPE_GCVAL;
-    vcresult->ptr_value = poolalloc_malloc(
-        vmthread->heap, 0
-    );
-    if (!vcresult->ptr_value)
-        goto oom;
-    h64gcvalue *gcval = vcresult->ptr_value;
-    memset(gcval, 0, sizeof(*gcval));
-    gcval->type = H64GCVALUETYPE_LIST;
-    gcval->list_values = vmlist_New();
-    if (!gcval->list_values) {
-        poolalloc_free(vmthread->heap, gcval);
-        vcresult->ptr_value = NULL;
+    genericlist *lresult = vmlist_New();
+    if (!lresult) {
+        free(items);
         goto oom;
     }
-    genericlist *lresult = gcval->list_values;
-    if (ascend) {
-        int64_t i = 0;
-        while (i < to_be_sorted_count) {
-            if (!vmlist_Add(lresult, &to_be_sorted[i]))
-                goto oom;
-            DELREF_NONHEAP(&to_be_sorted[i]);
-            valuecontent_Free(vmthread, &to_be_sorted[i]);
-            to_be_sorted[i].type = H64VALTYPE_NONE;
-            i++;
-        }
-    } else {
-        int64_t i = to_be_sorted_count - 1;
-        while (i >= 0) {
-            if (!vmlist_Add(lresult, &to_be_sorted[i]))
-                goto oom;
-            DELREF_NONHEAP(&to_be_sorted[i]);
-            valuecontent_Free(vmthread, &to_be_sorted[i]);
-            to_be_sorted[i].type = H64VALTYPE_NONE;
-            i--;
+    i = 0;
+    while (i < count) {
+        int64_t k = (ascend ? i : count - 1 - i);
+        if (!vmlist_Add(lresult, &items[k])) {
+            vmlist_Free(lresult);
+            free(items);
+            goto oom;
         }
+        i++;
     }
-    ADDREF_NONHEAP(vcresult);
-    return 1;
+    free(items);
+    return _sort_ReturnList(vmthread, lresult);
 }
 
 int builtininternals_pow(h64vmthread *vmthread) {
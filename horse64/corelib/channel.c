@@ -0,0 +1,504 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "compileconfig.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "corelib/channel.h"
+#include "corelib/errors.h"
+#include "gcvalue.h"
+#include "pipe.h"
+#include "poolalloc.h"
+#include "stack.h"
+#include "valuecontentstruct.h"
+#include "vmchannel.h"
+#include "vmexec.h"
+#include "vmlist.h"
+#include "vmschedule.h"
+#include "vmsuspendtypeenum.h"
+
+/// @module channel Pass values between concurrent and parallel tasks.
+
+#define CHANNEL_DEFAULT_CAPACITY 16
+
+/**
+ * A channel object, returned from @see{channel.open}. Channel objects
+ * can be passed to parallel funcs, and even sent through channels,
+ * and all of them still refer to the same channel.
+ *
+ * @class channel
+ */
+
+struct channellib_asyncprogress {
+    void (*abortfunc)(void *dataptr);
+    h64vmthread *vmthread;
+    h64channel *channel;
+    int64_t next;
+};
+
+static void _channellib_abort(void *dataptr) {
+    struct channellib_asyncprogress *adata = dataptr;
+    if (adata->channel)
+        vmchannel_ForgetWaiter(adata->channel, adata->vmthread);
+}
+
+static h64channel *_getchannelarg(
+        h64vmthread *vmthread, valuecontent *vc
+        ) {
+    if (vc->type != H64VALTYPE_GCVAL ||
+            !vmchannel_IsChannelObject(vmthread, vc->ptr_value))
+        return NULL;
+    return vmchannel_FromObject(vc->ptr_value);
+}
+
+static struct channellib_asyncprogress *_channellib_progress(
+        h64vmthread *vmthread, valuecontent *vcself
+        ) {
+    struct channellib_asyncprogress *asprogress = (
+        vmthread->foreground_async_work_dataptr
+    );
+    assert(asprogress != NULL);
+    asprogress->abortfunc = &_channellib_abort;
+    asprogress->vmthread = vmthread;
+    asprogress->channel = _getchannelarg(vmthread, vcself);
+    assert(asprogress->channel != NULL);
+    return asprogress;
+}
+
+static int _channellib_ReturnError(
+        h64vmthread *vmthread, vmchannelresult result,
+        const char *closed_msg
+        ) {
+    if (result == VMCHANNEL_CLOSED) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_VALUEERROR, closed_msg
+        );
+    } else if (result == VMCHANNEL_UNSUPPORTEDTYPE) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "cannot pass this value type through a channel"
+        );
+    }
+    assert(result == VMCHANNEL_OUTOFMEMORY);
+    return vmexec_ReturnFuncError(
+        vmthread, H64STDERROR_OUTOFMEMORYERROR,
+        "out of memory passing value through channel"
+    );
+}
+
+static int _channellib_ReturnNone(h64vmthread *vmthread) {
+    vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memset(vcresult, 0, sizeof(*vcresult));
+    vcresult->type = H64VALTYPE_NONE;
+    return 1;
+}
+
+int channellib_open(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Open a new channel, which tasks can then send values into and
+     * receive them from in the order they were sent. Unlike with
+     * global variables, this works with parallel tasks too.
+     *
+     * @func open
+     * @param capacity=16 how many values may wait in the channel
+     *     before sending blocks until a receiver catches up.
+     * @returns the new @see{channel object|channel.channel}
+     * @raises ValueError if the capacity isn't at least 1.
+     */
+    assert(STACK_TOP(vmthread->stack) >= 1);
+
+    int64_t capacity = CHANNEL_DEFAULT_CAPACITY;
+    valuecontent *vccapacity = STACK_ENTRY(vmthread->stack, 0);
+    if (vccapacity->type != H64VALTYPE_UNSPECIFIED_KWARG) {
+        if (vccapacity->type != H64VALTYPE_INT64) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_TYPEERROR,
+                "capacity must be a number"
+            );
+        }
+        capacity = vccapacity->int_value;
+        if (capacity < 1) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "capacity must be at least 1"
+            );
+        }
+    }
+
+    h64channel *ch = vmchannel_New(vmthread->vmexec_owner, capacity);
+    if (!ch) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory allocating channel"
+        );
+    }
+    h64gcvalue *channelobj = vmchannel_NewObject(vmthread, ch);
+    if (!channelobj) {
+        vmchannel_Free(ch);
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory allocating channel"
+        );
+    }
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vc);
+    valuecontent_Free(vmthread, vc);
+    memset(vc, 0, sizeof(*vc));
+    vc->type = H64VALTYPE_GCVAL;
+    vc->ptr_value = channelobj;
+    ADDREF_NONHEAP(vc);
+    return 1;
+}
+
+int channellib_send(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Send a value into the channel. If the channel is full, this
+     * waits until a receiver made room. Values that aren't referenced
+     * anywhere else, like a list that was just built up, have their
+     * contents moved into the channel rather than copied.
+     *
+     * @funcattr channel.channel send
+     * @param value the value to send.
+     * @raises ValueError if the channel was closed.
+     * @raises TypeError if the value can't be passed between tasks.
+     */
+    assert(STACK_TOP(vmthread->stack) >= 2);
+
+    struct channellib_asyncprogress *asprogress = _channellib_progress(
+        vmthread, STACK_ENTRY(vmthread->stack, 1)
+    );
+    vmchannelresult result = vmchannel_Send(
+        asprogress->channel, vmthread, STACK_ENTRY(vmthread->stack, 0),
+        PIPESOURCE_CFUNCSLOT0
+    );
+    if (result == VMCHANNEL_MUSTWAIT) {
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_CHANNELSENDWAIT,
+            (uintptr_t)asprogress->channel
+        );
+    } else if (result != VMCHANNEL_DONE) {
+        return _channellib_ReturnError(
+            vmthread, result, "cannot send on closed channel"
+        );
+    }
+    return _channellib_ReturnNone(vmthread);
+}
+
+int channellib_sendmany(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Send all items of a list into the channel, in order. This
+     * takes the channel's lock once for as many items as fit, rather
+     * than once per item like @see{send|channel.channel.send} would.
+     * If the list isn't referenced anywhere else, its items are moved
+     * into the channel rather than copied, and it is left with
+     * only none values.
+     *
+     * @funcattr channel.channel send_many
+     * @param items the @see{list} of values to send.
+     * @raises ValueError if the channel was closed. The items up to
+     *     that point were sent.
+     * @raises TypeError if an item can't be passed between tasks.
+     */
+    assert(STACK_TOP(vmthread->stack) >= 2);
+
+    struct channellib_asyncprogress *asprogress = _channellib_progress(
+        vmthread, STACK_ENTRY(vmthread->stack, 1)
+    );
+    valuecontent *vcitems = STACK_ENTRY(vmthread->stack, 0);
+    if (vcitems->type != H64VALTYPE_GCVAL ||
+            ((h64gcvalue *)vcitems->ptr_value)->type !=
+                H64GCVALUETYPE_LIST) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "items must be a list"
+        );
+    }
+    // (One reference is the stack slot, and one the copy of it that
+    // vmexec.c keeps during the call.)
+    h64gcvalue *gcitems = vcitems->ptr_value;
+    int items_owned = (gcitems->externalreferencecount == 2 &&
+                       gcitems->heapreferencecount == 0);
+    vmchannelresult result = vmchannel_SendList(
+        asprogress->channel, vmthread, gcitems->list_values,
+        items_owned, &asprogress->next
+    );
+    if (result == VMCHANNEL_MUSTWAIT) {
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_CHANNELSENDWAIT,
+            (uintptr_t)asprogress->channel
+        );
+    } else if (result != VMCHANNEL_DONE) {
+        return _channellib_ReturnError(
+            vmthread, result, "cannot send on closed channel"
+        );
+    }
+    return _channellib_ReturnNone(vmthread);
+}
+
+int channellib_receive(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Receive the next value from the channel. If the channel is
+     * empty, this waits until a sender provides one.
+     *
+     * @funcattr channel.channel receive
+     * @returns the received value.
+     * @raises ValueError if the channel was closed, and all values
+     *     sent before that were received.
+     */
+    assert(STACK_TOP(vmthread->stack) >= 1);
+
+    struct channellib_asyncprogress *asprogress = _channellib_progress(
+        vmthread, STACK_ENTRY(vmthread->stack, 0)
+    );
+    valuecontent received = {0};
+    int64_t received_count = 0;
+    vmchannelresult result = vmchannel_Receive(
+        asprogress->channel, vmthread, &received, 1, &received_count
+    );
+    if (result == VMCHANNEL_MUSTWAIT) {
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_CHANNELRECEIVEWAIT,
+            (uintptr_t)asprogress->channel
+        );
+    } else if (result != VMCHANNEL_DONE) {
+        return _channellib_ReturnError(
+            vmthread, result, "channel is closed and has no more values"
+        );
+    }
+    assert(received_count == 1);
+    vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memcpy(vcresult, &received, sizeof(received));
+    return 1;
+}
+
+int channellib_receivemany(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Receive as many values as are waiting in the channel, up to the
+     * given maximum, in one go. If the channel is empty, this waits
+     * until a sender provides at least one value.
+     *
+     * @funcattr channel.channel receive_many
+     * @param max=(capacity) the most values to receive at once,
+     *     defaults to the channel's capacity.
+     * @returns a @see{list} of the received values, which is empty
+     *     once the channel was closed and all values sent before that
+     *     were received.
+     */
+    assert(STACK_TOP(vmthread->stack) >= 2);
+
+    struct channellib_asyncprogress *asprogress = _channellib_progress(
+        vmthread, STACK_ENTRY(vmthread->stack, 1)
+    );
+    h64channel *ch = asprogress->channel;
+    int64_t max = ch->capacity;
+    valuecontent *vcmax = STACK_ENTRY(vmthread->stack, 0);
+    if (vcmax->type != H64VALTYPE_UNSPECIFIED_KWARG) {
+        if (vcmax->type != H64VALTYPE_INT64) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_TYPEERROR,
+                "max must be a number"
+            );
+        }
+        if (vcmax->int_value < 1) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "max must be at least 1"
+            );
+        }
+        if (vcmax->int_value < max)
+            max = vcmax->int_value;
+    }
+
+    int64_t received_count = 0;
+    valuecontent *received = malloc(sizeof(*received) * max);
+    if (!received) {
+        oom:
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory allocating result list"
+        );
+    }
+    vmchannelresult result = vmchannel_Receive(
+        ch, vmthread, received, max, &received_count
+    );
+    if (result == VMCHANNEL_MUSTWAIT) {
+        free(received);
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_CHANNELRECEIVEWAIT, (uintptr_t)ch
+        );
+    } else if (result != VMCHANNEL_DONE && result != VMCHANNEL_CLOSED) {
+        free(received);
+        return _channellib_ReturnError(vmthread, result, NULL);
+    }
+
+    valuecontent vlist = {0};
+    h64gcvalue *gcval = poolalloc_malloc(vmthread->heap, 0);
+    if (gcval) {
+        memset(gcval, 0, sizeof(*gcval));
+        gcval->type = H64GCVALUETYPE_LIST;
+        gcval->hash = -1;
+        gcval->externalreferencecount = 1;
+        gcval->list_values = vmlist_New();
+        if (!gcval->list_values) {
+            poolalloc_free(vmthread->heap, gcval);
+            gcval = NULL;
+        } else {
+            vlist.type = H64VALTYPE_GCVAL;
+            vlist.ptr_value = gcval;
+        }
+    }
+    int oom = (gcval == NULL);
+    int64_t i = 0;
+    while (i < received_count) {
+        if (!oom && vmlist_Add(gcval->list_values, &received[i]) <= 0)
+            oom = 1;
+        DELREF_NONHEAP(&received[i]);
+        valuecontent_Free(vmthread, &received[i]);
+        i++;
+    }
+    free(received);
+    if (oom) {
+        if (gcval) {
+            DELREF_NONHEAP(&vlist);
+            valuecontent_Free(vmthread, &vlist);
+        }
+        goto oom;
+    }
+
+    vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memcpy(vcresult, &vlist, sizeof(vlist));
+    return 1;
+}
+
+int channellib_close(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Close the channel, after which no values can be sent anymore.
+     * Values that were sent already can still be received. Tasks
+     * waiting to send or receive are woken up, and get an error once
+     * there is nothing left to receive. Closing a channel twice has no
+     * further effect.
+     *
+     * @funcattr channel.channel close
+     */
+    assert(STACK_TOP(vmthread->stack) >= 1);
+
+    h64channel *ch = _getchannelarg(
+        vmthread, STACK_ENTRY(vmthread->stack, 0)
+    );
+    assert(ch != NULL);
+    vmchannel_Close(ch);
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memset(vcresult, 0, sizeof(*vcresult));
+    vcresult->type = H64VALTYPE_NONE;
+    return 1;
+}
+
+int channellib_RegisterFuncsAndModules(h64program *p) {
+    // channel.open:
+    const char *channel_open_kw_arg_name[] = {"capacity"};
+    int64_t idx = h64program_RegisterCFunction(
+        p, "open", &channellib_open,
+        NULL, 0, 1, channel_open_kw_arg_name,  // fileuri, args
+        "channel", "core.horse64.org", 1, -1
+    );
+    if (idx < 0)
+        return 0;
+
+    // channel class:
+    p->_channel_class_idx = h64program_AddClass(
+        p, "channel", NULL, 0, "channel", "core.horse64.org"
+    );
+    if (p->_channel_class_idx < 0)
+        return 0;
+
+    // channel.send method:
+    const char *channel_send_kw_arg_name[] = {NULL};
+    idx = h64program_RegisterCFunction(
+        p, "send", &channellib_send,
+        NULL, 0, 1, channel_send_kw_arg_name,  // fileuri, args
+        "channel", "core.horse64.org", 1, p->_channel_class_idx
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct channellib_asyncprogress)
+    );
+
+    // channel.send_many method:
+    const char *channel_sendmany_kw_arg_name[] = {NULL};
+    idx = h64program_RegisterCFunction(
+        p, "send_many", &channellib_sendmany,
+        NULL, 0, 1, channel_sendmany_kw_arg_name,  // fileuri, args
+        "channel", "core.horse64.org", 1, p->_channel_class_idx
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct channellib_asyncprogress)
+    );
+
+    // channel.receive method:
+    idx = h64program_RegisterCFunction(
+        p, "receive", &channellib_receive,
+        NULL, 0, 0, NULL,  // fileuri, args
+        "channel", "core.horse64.org", 1, p->_channel_class_idx
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct channellib_asyncprogress)
+    );
+
+    // channel.receive_many method:
+    const char *channel_receivemany_kw_arg_name[] = {"max"};
+    idx = h64program_RegisterCFunction(
+        p, "receive_many", &channellib_receivemany,
+        NULL, 0, 1, channel_receivemany_kw_arg_name,  // fileuri, args
+        "channel", "core.horse64.org", 1, p->_channel_class_idx
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct channellib_asyncprogress)
+    );
+
+    // channel.close method:
+    idx = h64program_RegisterCFunction(
+        p, "close", &channellib_close,
+        NULL, 0, 0, NULL,  // fileuri, args
+        "channel", "core.horse64.org", 1, p->_channel_class_idx
+    );
+    if (idx < 0)
+        return 0;
+
+    return 1;
+}
@@ -0,0 +1,12 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef HORSE64_CORELIB_CHANNEL_H_
+#define HORSE64_CORELIB_CHANNEL_H_
+
+typedef struct h64program h64program;
+
+int channellib_RegisterFuncsAndModules(h64program *p);
+
+#endif  // HORSE64_CORELIB_CHANNEL_H_
@@ -42,6 +42,7 @@ int _open_osfhandle(intptr_t osfhandle, int flags);
 #include <stdio.h>
 #include <string.h>
 
+#include "asyncsysjob.h"
 #include "bytecode.h"
 #include "corelib/errors.h"
 #include "corelib/io.h"
@@ -51,7 +52,9 @@ int _open_osfhandle(intptr_t osfhandle, int flags);
 #include "stack.h"
 #include "vmexec.h"
 #include "vmlist.h"
+#include "vmschedule.h"
 #include "vmstrings.h"
+#include "vmsuspendtypeenum.h"
 #include "widechar.h"
 
 #define FILEOBJ_FLAGS_APPEND 0x1
@@ -70,8 +73,109 @@ typedef struct _fileobj_cdata {
     FILE *file_handle;
     uint8_t flags;
     uint64_t text_offset;
+    h64asyncsysjob *running_job;  // read or write using file_handle
+    uint8_t running_job_orphaned;  // its task is gone, we hold a wait ref
 } __attribute__((packed)) _fileobj_cdata;
 
+// Reads, writes and opens hand their blocking part to an async
+// system job, such that the calling task suspends instead of stalling
+// all other tasks on its worker:
+struct iolib_fileio_asyncprogress {
+    void (*abortfunc)(void *dataptr);
+    h64asyncsysjob *job;
+    _fileobj_cdata *cdata;
+    h64asyncsysjob *waitjob;  // another task's job we hold a wait ref on
+};
+
+static void _iolib_FileIOJobFail(
+        h64asyncsysjob *job, int error_class_id, const char *msg
+        ) {
+    job->fileio.error_class_id = error_class_id;
+    job->fileio.error_msg = msg;
+}
+
+static h64asyncsysjob *_iolib_NewFileIOJob(int op) {
+    h64asyncsysjob *job = asyncjob_CreateEmpty();
+    if (!job)
+        return NULL;
+    job->type = ASYNCSYSJOB_FILEIO;
+    job->fileio.op = op;
+    job->fileio.error_class_id = -1;
+    return job;
+}
+
+static int _fileobj_MustWaitForJob(
+        _fileobj_cdata *cdata, struct iolib_fileio_asyncprogress *adata
+        ) {
+    // Returns 1 if another task's read or write still uses the file
+    // handle, in which case the caller must suspend on adata->waitjob.
+    if (adata->waitjob) {
+        // We're back from waiting on it:
+        asyncjob_DropWaitRef(adata->waitjob);
+        adata->waitjob = NULL;
+    }
+    h64asyncsysjob *job = cdata->running_job;
+    if (!job)
+        return 0;
+    if (asyncjob_AddWaitRef(job)) {
+        adata->waitjob = job;
+        return 1;
+    }
+    if (cdata->running_job_orphaned) {
+        // Its task was aborted, so nobody else will clear this:
+        cdata->running_job = NULL;
+        cdata->running_job_orphaned = 0;
+        asyncjob_DropWaitRef(job);
+    }
+    return 0;
+}
+
+static void _iolib_ReleaseFileIOJob(
+        struct iolib_fileio_asyncprogress *adata
+        ) {
+    if (!adata->job)
+        return;
+    if (adata->cdata && adata->cdata->running_job == adata->job)
+        adata->cdata->running_job = NULL;
+    asyncjob_AbandonJob(adata->job);
+    adata->job = NULL;
+}
+
+static void _iolib_fileio_abort(void *dataptr) {
+    struct iolib_fileio_asyncprogress *adata = dataptr;
+    if (adata->waitjob) {
+        asyncjob_DropWaitRef(adata->waitjob);
+        adata->waitjob = NULL;
+    }
+    if (!adata->job)
+        return;
+    if (adata->cdata && adata->cdata->running_job == adata->job &&
+            asyncjob_AddWaitRef(adata->job)) {
+        // It still uses the file handle, so other tasks must keep
+        // waiting for it even with us gone:
+        adata->cdata->running_job_orphaned = 1;
+        asyncjob_AbandonJob(adata->job);
+        adata->job = NULL;
+        return;
+    }
+    // (A file opened by an abandoned job is closed when it's freed.)
+    _iolib_ReleaseFileIOJob(adata);
+}
+
+static int _iolib_StartFileIOJob(
+        h64vmthread *vmthread, struct iolib_fileio_asyncprogress *adata
+        ) {
+    // Returns 1 if the job is done already, 0 if we need to suspend.
+    if (adata->cdata)
+        adata->cdata->running_job = adata->job;
+    if (asyncjob_RequestAsync(vmthread, adata->job))
+        return 0;
+    // No async worker available, so do it right here instead:
+    iolib_RunFileIOJob(adata->job);
+    asyncjob_MarkDone(adata->job);
+    return 1;
+}
+
 
 /**
  * A file object class, returned from @see{io.open}.
@@ -79,6 +183,45 @@ typedef struct _fileobj_cdata {
  * @class file
  */
 
+/**
+ * A growable bytes buffer, returned from @see{io.new_buffer}. Unlike
+ * with @see{bytes} values, appending and removing data at the front
+ * happens in place, which makes it suitable to accumulate data from
+ * files or network streams and to parse it piece by piece.
+ *
+ * @class buffer
+ */
+
+typedef struct _bufferobj_cdata {
+    void (*on_destroy)(h64gcvalue *bufferobj);
+    char *data;
+    int64_t offset, len, alloc;
+} __attribute__((packed)) _bufferobj_cdata;
+
+#define BUFFEROBJ_MIN_ALLOC 64
+
+static void _bufferobj_Destroy(h64gcvalue *bufferobj) {
+    _bufferobj_cdata *cdata = bufferobj->cdata;
+    free(cdata->data);
+    cdata->data = NULL;
+    cdata->offset = 0;
+    cdata->len = 0;
+    cdata->alloc = 0;
+}
+
+static _bufferobj_cdata *_getbufferarg(
+        h64vmthread *vmthread, valuecontent *vc
+        ) {
+    // Returns the buffer data if vc is an io.buffer, otherwise NULL.
+    if (vc->type != H64VALTYPE_GCVAL ||
+            ((h64gcvalue *)vc->ptr_value)->type !=
+                H64GCVALUETYPE_OBJINSTANCE ||
+            ((h64gcvalue *)vc->ptr_value)->class_id !=
+                vmthread->vmexec_owner->program->_io_buffer_class_idx)
+        return NULL;
+    return ((h64gcvalue *)vc->ptr_value)->cdata;
+}
+
 int iolib_open(
         h64vmthread *vmthread
         ) {
@@ -123,6 +266,12 @@ int iolib_open(
      */
     assert(STACK_TOP(vmthread->stack) >= 6);
 
+    struct iolib_fileio_asyncprogress *asprogress = (
+        vmthread->foreground_async_work_dataptr
+    );
+    assert(asprogress != NULL);
+    asprogress->abortfunc = &_iolib_fileio_abort;
+
     valuecontent *vcpath = STACK_ENTRY(vmthread->stack, 0);
     char *pathstr = NULL;
     int64_t pathlen = 0;
@@ -383,6 +532,8 @@ int iolib_open(
     filedescr = -1;  // now owned by 'f'/FILE* ptr
 
     #else
+    if (asprogress->job != NULL)
+        goto openjobstarted;
     char _utf8bufstack[1024];
     char *utf8buf = _utf8bufstack;
     int64_t utf8bufsize = 1024;
@@ -396,6 +547,8 @@ int iolib_open(
                 "alloc failure converting file path"
             );
         }
+        utf8bufsize = wantbufsize;
+        freeutf8buf = 1;
     }
     int64_t outlen = 0;
     int result = utf32_to_utf8(
@@ -430,14 +583,47 @@ int iolib_open(
         utf8buf[0] = '.';
         utf8buf[1] = '\0';
     }
-    errno = 0;
-    FILE *f3 = fopen64(
-        utf8buf, modestr
-    );
-    if (!f3) {
-        if (freeutf8buf)
-            free(utf8buf);
-        handlelinuxfileerror: ;
+    h64asyncsysjob *job = _iolib_NewFileIOJob(ASYNCFILEIO_OPEN);
+    if (job)
+        job->fileio.path = strdup(utf8buf);
+    if (freeutf8buf)
+        free(utf8buf);
+    if (!job || !job->fileio.path) {
+        asyncjob_Free(job);
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory opening file"
+        );
+    }
+    memcpy(job->fileio.mode, modestr, sizeof(modestr));
+    job->fileio.reopen_append = (mode_append != 0);
+    asprogress->job = job;
+    if (!_iolib_StartFileIOJob(vmthread, asprogress)) {
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+            (uintptr_t)asprogress->job
+        );
+    }
+    openjobstarted: ;
+    if (!asyncjob_IsDone(asprogress->job)) {
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+            (uintptr_t)asprogress->job
+        );
+    }
+    FILE *f = asprogress->job->fileio.f;
+    asprogress->job->fileio.f = NULL;  // now owned by us
+    int error_class_id = asprogress->job->fileio.error_class_id;
+    const char *error_msg = asprogress->job->fileio.error_msg;
+    errno = asprogress->job->fileio.error_no;
+    _iolib_ReleaseFileIOJob(asprogress);
+    vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
+    if (error_class_id >= 0) {
+        return vmexec_ReturnFuncError(
+            vmthread, error_class_id, error_msg
+        );
+    }
+    if (!f) {
         if (errno == EACCES)
             return vmexec_ReturnFuncError(
                 vmthread, H64STDERROR_PERMISSIONERROR,
@@ -493,43 +679,6 @@ int iolib_open(
             buf
         );
     }
-    if (freeutf8buf)
-        free(utf8buf);
-    FILE *f = NULL;
-    if (mode_append) {
-        if (mode_read)
-            memcpy(modestr, "a+b", strlen("a+b"));
-        else
-            memcpy(modestr, "ab", strlen("ab"));
-        f = freopen64(NULL, modestr, f3);
-        if (!f) {
-            goto handlelinuxfileerror;
-        }
-    } else {
-        f = f3;
-    }
-    // Make sure we didn't open a directory:
-    errno = 0;
-    struct stat filestatinfo;
-    if (fstat(fileno(f), &filestatinfo) != 0) {
-        fclose(f);
-        if (errno == EACCES)
-            return vmexec_ReturnFuncError(
-                vmthread, H64STDERROR_PERMISSIONERROR,
-                "permission denied"
-            );
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_RESOURCEERROR,
-            "fstat() failed on file for unknown reason"
-        );
-    }
-    if (S_ISDIR(filestatinfo.st_mode)) {
-        fclose(f);
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_RESOURCEERROR,
-            "path refers to a directory, not a file"
-        );
-    }
     #endif  // end of unix/windows split
 
     // Return as a new file object:
@@ -552,6 +701,7 @@ int iolib_open(
     fileobj->heapreferencecount = 0;
     fileobj->externalreferencecount = 1;
     fileobj->class_id = vmthread->vmexec_owner->program->_io_file_class_idx;
+    fileobj->varattr = NULL;
     fileobj->cdata = malloc(sizeof(_fileobj_cdata));
     if (!fileobj->cdata) {
         #if defined(_WIN32) || defined(_WIN64)
@@ -576,6 +726,7 @@ int iolib_open(
     vc->type = H64VALTYPE_GCVAL;
     vc->ptr_value = fileobj;
     ADDREF_NONHEAP(vc);
+    vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
     return 1;
 }
 
@@ -586,9 +737,9 @@ int iolib_filewrite(
      * Write to the given file.
      *
      * @funcattr file write
-     * @param data the data to write, which must be @see{bytes} if
-     *    the file was opened with binary=yes, and otherwise must
-     *    be @see{string}.
+     * @param data the data to write, which must be @see{bytes} or a
+     *    @see{buffer|io.buffer} if the file was opened with binary=yes,
+     *    and otherwise must be @see{string}.
      * @raises IOError raised when there is a failure that is NOT expected
      *    to go away with retrying, like writing to a file only opened
      *    for reading.
@@ -607,25 +758,38 @@ int iolib_filewrite(
     _fileobj_cdata *cdata = (gcvalue->cdata);
     FILE *f = cdata->file_handle;
 
-    if (!f) {
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_IOERROR,
-            "file was closed"
-        );
-    }
-    if ((cdata->flags & FILEOBJ_FLAGS_CACHEDUNSENTERROR) != 0) {
-        cdata->flags &= ~((uint8_t)FILEOBJ_FLAGS_CACHEDUNSENTERROR);
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_RESOURCEERROR,
-            "unknown I/O error"
-        );
-    }
-
-    if ((cdata->flags & FILEOBJ_FLAGS_WRITE) == 0) {
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_IOERROR,
-            "not opened for writing"
-        );
+    struct iolib_fileio_asyncprogress *asprogress = (
+        vmthread->foreground_async_work_dataptr
+    );
+    assert(asprogress != NULL);
+    asprogress->abortfunc = &_iolib_fileio_abort;
+    asprogress->cdata = cdata;
+
+    if (asprogress->job == NULL) {
+        if (_fileobj_MustWaitForJob(cdata, asprogress))
+            return vmschedule_SuspendFunc(
+                vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+                (uintptr_t)asprogress->waitjob
+            );
+        if (!f) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_IOERROR,
+                "file was closed"
+            );
+        }
+        if ((cdata->flags & FILEOBJ_FLAGS_CACHEDUNSENTERROR) != 0) {
+            cdata->flags &= ~((uint8_t)FILEOBJ_FLAGS_CACHEDUNSENTERROR);
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_RESOURCEERROR,
+                "unknown I/O error"
+            );
+        }
+        if ((cdata->flags & FILEOBJ_FLAGS_WRITE) == 0) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_IOERROR,
+                "not opened for writing"
+            );
+        }
     }
 
     valuecontent *vcwriteobj = STACK_ENTRY(vmthread->stack, 0);
@@ -667,6 +831,12 @@ int iolib_filewrite(
     } else if (vcwriteobj->type == H64VALTYPE_SHORTBYTES) {
         writebytes = vcwriteobj->shortbytes_value;
         writebyteslen = vcwriteobj->shortbytes_len;
+    } else if (_getbufferarg(vmthread, vcwriteobj) != NULL) {
+        _bufferobj_cdata *bufcdata = _getbufferarg(vmthread, vcwriteobj);
+        writebytes = bufcdata->data + bufcdata->offset;
+        writebyteslen = bufcdata->len;
+        if (!writebytes)
+            writebytes = "";
     }
     int readbinary = ((cdata->flags & FILEOBJ_FLAGS_BINARY) != 0);
     if (writestr == NULL && !readbinary) {
@@ -678,18 +848,20 @@ int iolib_filewrite(
     if (writebytes == NULL && readbinary) {
         return vmexec_ReturnFuncError(
             vmthread, H64STDERROR_TYPEERROR,
-            "data argument must be bytes for binary file"
+            "data argument must be bytes or buffer for binary file"
         );
     }
 
+    if (asprogress->job != NULL)
+        goto writejobstarted;
+
+    int flush_first = 0;
     if ((cdata->flags & FILEOBJ_FLAGS_LASTWASWRITE) == 0) {
-        fflush(f);
-        fseek64(f, 0, SEEK_CUR);
+        flush_first = 1;
         cdata->flags |= ((uint8_t)FILEOBJ_FLAGS_LASTWASWRITE);
     }
 
     // If we're writing a string, convert to bytes first:
-    int64_t writelenresult = writebyteslen;
     int freebytes = 0;
     if (writestr) {
         assert(!writebytes);
@@ -716,24 +888,68 @@ int iolib_filewrite(
             );
         }
         writebytes[writebyteslen] = '\0';
-        writelenresult = writestrletters;
+    } else if (writebyteslen > 0) {
+        // The buffer may change while we wait, and the bytes value may
+        // be gone if this task is aborted midway, so write out a copy:
+        char *writecopy = malloc(writebyteslen);
+        if (!writecopy) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                "out of memory on write data copy"
+            );
+        }
+        memcpy(writecopy, writebytes, writebyteslen);
+        writebytes = writecopy;
+        freebytes = 1;
     }
 
     // If nothing to write, bail out early:
     if (writebyteslen == 0) {
+        if (freebytes)
+            free(writebytes);
         valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
         DELREF_NONHEAP(vcresult);
         valuecontent_Free(vmthread, vcresult);
         vcresult->type = H64VALTYPE_INT64;
         vcresult->int_value = 0;
         ADDREF_NONHEAP(vcresult);
+        vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
         return 1;
     }
 
-    // Write out data:
-    size_t written = fwrite(
-        writebytes, 1, writebyteslen, f
-    );
+    // Write out data on an async worker:
+    h64asyncsysjob *job = _iolib_NewFileIOJob(ASYNCFILEIO_WRITE);
+    if (!job) {
+        if (freebytes)
+            free(writebytes);
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory starting write"
+        );
+    }
+    job->fileio.f = f;
+    job->fileio.flush_first = flush_first;
+    job->fileio.buf = writebytes;
+    job->fileio.buflen = writebyteslen;
+    job->fileio.buf_owned = freebytes;
+    asprogress->job = job;
+    if (!_iolib_StartFileIOJob(vmthread, asprogress)) {
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+            (uintptr_t)asprogress->job
+        );
+    }
+    writejobstarted: ;
+    if (!asyncjob_IsDone(asprogress->job)) {
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+            (uintptr_t)asprogress->job
+        );
+    }
+    size_t written = asprogress->job->fileio.written;
+    writebytes = asprogress->job->fileio.buf;
+    writebyteslen = asprogress->job->fileio.buflen;
+    int64_t writelenresult = (writestr ? writestrletters : writebyteslen);
     if (written < (size_t)writebyteslen) {
         if (written == 0) {
             writelenresult = 0;
@@ -772,6 +988,8 @@ int iolib_filewrite(
             // Return the written amount first, delay
             // reporting the error until later:
             cdata->flags |= (FILEOBJ_FLAGS_CACHEDUNSENTERROR);
+            _iolib_ReleaseFileIOJob(asprogress);
+            vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
             valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
             DELREF_NONHEAP(vcresult);
             valuecontent_Free(vmthread, vcresult);
@@ -785,6 +1003,8 @@ int iolib_filewrite(
             "unknown I/O error"
         );
     } else {
+        _iolib_ReleaseFileIOJob(asprogress);
+        vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
         valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
         DELREF_NONHEAP(vcresult);
         valuecontent_Free(vmthread, vcresult);
@@ -876,90 +1096,69 @@ void _count_actual_letters_in_raw(
     *letters = lettercount;
 }
 
-int iolib_fileread(
-        h64vmthread *vmthread
-        ) {
-    /**
-     * Read from the given file.
-     *
-     * @funcattr file read
-     * @param len=-1 amount of bytes/letters to read. When
-     *    the file was opened with binary=yes then amount will be
-     *    interpreted as bytes, otherwise with binary=no as fully
-     *    decoded text (decoded from utf-8). Specify -1 to read
-     *    everything until the end of the file.
-     * @returns the data read, which is a @see{bytes} value when the
-     *    file was opened with binary=yes, otherwise a @see{string}
-     *    value.
-     * @raises IOError raised when there is a failure that is NOT expected
-     *    to go away with retrying, like reading from a file only opened
-     *    for writing.
-     * @raises ResourceError raised when there is unexpected resource
-     *    exhaustion that MAY go away when retrying, like running out of
-     *    file handles, read timeout, and so on.
-     */
-    assert(STACK_TOP(vmthread->stack) >= 2);
-
-    valuecontent *vc = STACK_ENTRY(vmthread->stack, 1);  // first closure arg
-    assert(vc->type == H64VALTYPE_GCVAL);
-    h64gcvalue *gcvalue = (h64gcvalue *)vc->ptr_value;
-    assert(gcvalue->type == H64GCVALUETYPE_OBJINSTANCE);
-    assert(gcvalue->class_id ==
-           vmthread->vmexec_owner->program->_io_file_class_idx);
-    _fileobj_cdata *cdata = (gcvalue->cdata);
-    FILE *f = cdata->file_handle;
-
-    if (!f) {
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_IOERROR,
-            "file was closed"
+#if !defined(_WIN32) && !defined(_WIN64)
+static void _iolib_DoFileOpen(h64asyncsysjob *job) {
+    errno = 0;
+    FILE *f = fopen64(
+        job->fileio.path, job->fileio.mode
+    );
+    if (f && job->fileio.reopen_append) {
+        // We opened it without appending to not create a new file,
+        // so now that it exists switch modes:
+        f = freopen64(
+            NULL, (strcmp(job->fileio.mode, "r+b") == 0 ? "a+b" : "ab"),
+            f
         );
     }
-    if ((cdata->flags & FILEOBJ_FLAGS_CACHEDUNSENTERROR) != 0) {
-        cdata->flags &= ~((uint8_t)FILEOBJ_FLAGS_CACHEDUNSENTERROR);
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_RESOURCEERROR,
-            "unknown i/o error"
-        );
+    if (!f) {
+        job->fileio.error_no = errno;
+        return;
     }
-
-    if ((cdata->flags & FILEOBJ_FLAGS_READ) == 0) {
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_IOERROR,
-            "not opened for reading"
+    // Make sure we didn't open a directory:
+    errno = 0;
+    struct stat filestatinfo;
+    if (fstat(fileno(f), &filestatinfo) != 0) {
+        fclose(f);
+        if (errno == EACCES) {
+            _iolib_FileIOJobFail(
+                job, H64STDERROR_PERMISSIONERROR,
+                "permission denied"
+            );
+            return;
+        }
+        _iolib_FileIOJobFail(
+            job, H64STDERROR_RESOURCEERROR,
+            "fstat() failed on file for unknown reason"
         );
+        return;
     }
-
-    valuecontent *vcamount = STACK_ENTRY(vmthread->stack, 0);
-    if ((vcamount->type != H64VALTYPE_INT64 &&
-            vcamount->type != H64VALTYPE_FLOAT64) &&
-            vcamount->type != H64VALTYPE_UNSPECIFIED_KWARG) {
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_TYPEERROR,
-            "len must be a number"
+    if (S_ISDIR(filestatinfo.st_mode)) {
+        fclose(f);
+        _iolib_FileIOJobFail(
+            job, H64STDERROR_RESOURCEERROR,
+            "path refers to a directory, not a file"
         );
+        return;
     }
-    int readbinary = ((cdata->flags & FILEOBJ_FLAGS_BINARY) != 0);
-    int64_t amount = -1;
-    if (vcamount->type == H64VALTYPE_INT64) {
-        amount = vcamount->int_value;
-    } else if (vcamount->type == H64VALTYPE_FLOAT64) {
-        amount = clamped_round(vcamount->float_value);
-    }
-    if (amount == 0 || feof(f)) {
-        valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
-        DELREF_NONHEAP(vc);
-        valuecontent_Free(vmthread, vc);
-        memset(vc, 0, sizeof(*vc));
-        if (readbinary) {
-            vc->type = H64VALTYPE_SHORTBYTES;
-            vc->shortbytes_len = 0;
-        } else {
-            vc->type = H64VALTYPE_SHORTSTR;
-            vc->shortstr_len = 0;
-        }
-        return 1;
+    job->fileio.f = f;
+}
+#endif
+
+static void _iolib_DoFileWrite(h64asyncsysjob *job) {
+    FILE *f = job->fileio.f;
+    if (job->fileio.flush_first) {
+        fflush(f);
+        fseek64(f, 0, SEEK_CUR);
     }
+    job->fileio.written = fwrite(
+        job->fileio.buf, 1, job->fileio.buflen, f
+    );
+}
+
+static void _iolib_DoFileRead(h64asyncsysjob *job) {
+    FILE *f = job->fileio.f;
+    int64_t amount = job->fileio.amount;
+    int readbinary = (job->fileio.binary != 0);
 
     char _stackreadbuf[1024];
     char *readbuf = _stackreadbuf;
@@ -975,13 +1174,13 @@ int iolib_fileread(
 
     if (ferror(f)) {
         clearerr(f);
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_RESOURCEERROR,
+        _iolib_FileIOJobFail(
+            job, H64STDERROR_RESOURCEERROR,
             "unknown I/O error"
         );
+        return;
     }
-    if ((cdata->flags & FILEOBJ_FLAGS_LASTWASWRITE) != 0) {
-        cdata->flags &= ~((uint8_t)FILEOBJ_FLAGS_LASTWASWRITE);
+    if (job->fileio.flush_first) {
         fflush(f);
         fseek64(f, 0, SEEK_CUR);
     }
@@ -1009,10 +1208,11 @@ int iolib_fileread(
                         free(readbuf);
                     if (decodebufheap)
                         free(decodebuf);
-                    return vmexec_ReturnFuncError(
-                        vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                    _iolib_FileIOJobFail(
+                        job, H64STDERROR_OUTOFMEMORYERROR,
                         "out of memory resizing read buf"
                     );
+                    return;
                 }
                 readbufheap = 1;
                 readbuf = newbuf;
@@ -1033,12 +1233,13 @@ int iolib_fileread(
                             free(readbuf);
                         if (decodebufheap)
                             free(decodebuf);
-                        return vmexec_ReturnFuncError(
-                            vmthread, H64STDERROR_RESOURCEERROR,
+                        _iolib_FileIOJobFail(
+                            job, H64STDERROR_RESOURCEERROR,
                             "unknown I/O error"
                         );
+                        return;
                     }
-                    cdata->flags |= FILEOBJ_FLAGS_CACHEDUNSENTERROR;
+                    job->fileio.cached_error = 1;
                     break;
                 }
                 continue;
@@ -1131,10 +1332,11 @@ int iolib_fileread(
                         free(readbuf);
                     if (decodebufheap)
                         free(decodebuf);
-                    return vmexec_ReturnFuncError(
-                        vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                    _iolib_FileIOJobFail(
+                        job, H64STDERROR_OUTOFMEMORYERROR,
                         "out of memory resizing read buf"
                     );
+                    return;
                 }
                 readbufheap = 1;
                 readbuf = newbuf;
@@ -1163,10 +1365,11 @@ int iolib_fileread(
                         free(readbuf);
                     if (decodebufheap)
                         free(decodebuf);
-                    return vmexec_ReturnFuncError(
-                        vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                    _iolib_FileIOJobFail(
+                        job, H64STDERROR_OUTOFMEMORYERROR,
                         "out of memory resizing read buf"
                     );
+                    return;
                 }
                 decodebufheap = 1;
                 decodebuf = newbuf;
@@ -1199,10 +1402,11 @@ int iolib_fileread(
                     free(readbuf);
                 if (decodebufheap)
                     free(decodebuf);
-                return vmexec_ReturnFuncError(
-                    vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                _iolib_FileIOJobFail(
+                    job, H64STDERROR_OUTOFMEMORYERROR,
                     "out of memory determining read buf reverse"
                 );
+                return;
             }
             if (bytes <= 0)
                 break;
@@ -1217,10 +1421,15 @@ int iolib_fileread(
             if (overshotbytes > 0) {
                 if (fseek64(f, -overshotbytes, SEEK_CUR) != 0) {
                     clearerr(f);
-                    return vmexec_ReturnFuncError(
-                        vmthread, H64STDERROR_RESOURCEERROR,
+                    if (readbufheap)
+                        free(readbuf);
+                    if (decodebufheap)
+                        free(decodebuf);
+                    _iolib_FileIOJobFail(
+                        job, H64STDERROR_RESOURCEERROR,
                         "unexpected I/O error reading file"
                     );
+                    return;
                 }
             }
         }
@@ -1231,12 +1440,13 @@ int iolib_fileread(
                     free(readbuf);
                 if (decodebufheap)
                     free(decodebuf);
-                return vmexec_ReturnFuncError(
-                    vmthread, H64STDERROR_RESOURCEERROR,
+                _iolib_FileIOJobFail(
+                    job, H64STDERROR_RESOURCEERROR,
                     "unknown I/O error"
                 );
+                return;
             }
-            cdata->flags |= FILEOBJ_FLAGS_CACHEDUNSENTERROR;
+            job->fileio.cached_error = 1;
         }
         readbuffill = i;  // Truncate to what we want to return.
     } else {
@@ -1246,40 +1456,226 @@ int iolib_fileread(
                 free(readbuf);
             readbufheap = 1;
             readbuf = malloc(
-                sizeof(*readbuf) * readbufsize
+                sizeof(*readbuf) * amount
             );
             if (!readbuf) {
                 if (decodebufheap)
                     free(decodebuf);
-                return vmexec_ReturnFuncError(
-                    vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                _iolib_FileIOJobFail(
+                    job, H64STDERROR_OUTOFMEMORYERROR,
                     "out of memory resizing read buf"
                 );
+                return;
+            }
+        }
+        int64_t _didread = fread(
+            readbuf, 1, amount, f
+        );
+        if (_didread < 0) {
+            if (feof(f)) {
+                _didread = 0;
+            } else if (ferror(f)) {
+                clearerr(f);
+                if (readbufheap)
+                    free(readbuf);
+                if (decodebufheap)
+                    free(decodebuf);
+                _iolib_FileIOJobFail(
+                    job, H64STDERROR_RESOURCEERROR,
+                    "unknown I/O error"
+                );
+                return;
             }
         }
-        int64_t _didread = fread(
-            readbuf, 1, amount, f
+        readbuffill = _didread;
+    }
+    if (decodebufheap) {
+        free(decodebuf);
+        decodebuf = NULL;
+    }
+
+    // Hand over the result, which always needs to be on the heap:
+    if (readbuffill > 0 && !readbufheap) {
+        char *heapbuf = malloc(readbuffill);
+        if (!heapbuf) {
+            _iolib_FileIOJobFail(
+                job, H64STDERROR_OUTOFMEMORYERROR,
+                "out of memory resizing read buf"
+            );
+            return;
+        }
+        memcpy(heapbuf, readbuf, readbuffill);
+        readbuf = heapbuf;
+        readbufheap = 1;
+    } else if (readbuffill <= 0 && readbufheap) {
+        free(readbuf);
+        readbuf = NULL;
+    }
+    job->fileio.buf = (readbuffill > 0 ? readbuf : NULL);
+    job->fileio.buflen = readbuffill;
+    job->fileio.buf_owned = 1;
+}
+
+void iolib_RunFileIOJob(h64asyncsysjob *job) {
+    if (job->fileio.op == ASYNCFILEIO_READ) {
+        _iolib_DoFileRead(job);
+    } else if (job->fileio.op == ASYNCFILEIO_WRITE) {
+        _iolib_DoFileWrite(job);
+    #if !defined(_WIN32) && !defined(_WIN64)
+    } else if (job->fileio.op == ASYNCFILEIO_OPEN) {
+        _iolib_DoFileOpen(job);
+    #endif
+    } else {
+        _iolib_FileIOJobFail(
+            job, H64STDERROR_RUNTIMEERROR,
+            "internal error: unsupported file i/o job"
+        );
+    }
+}
+
+int iolib_fileread(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Read from the given file.
+     *
+     * @funcattr file read
+     * @param len=-1 amount of bytes/letters to read. When
+     *    the file was opened with binary=yes then amount will be
+     *    interpreted as bytes, otherwise with binary=no as fully
+     *    decoded text (decoded from utf-8). Specify -1 to read
+     *    everything until the end of the file.
+     * @returns the data read, which is a @see{bytes} value when the
+     *    file was opened with binary=yes, otherwise a @see{string}
+     *    value.
+     * @raises IOError raised when there is a failure that is NOT expected
+     *    to go away with retrying, like reading from a file only opened
+     *    for writing.
+     * @raises ResourceError raised when there is unexpected resource
+     *    exhaustion that MAY go away when retrying, like running out of
+     *    file handles, read timeout, and so on.
+     */
+    assert(STACK_TOP(vmthread->stack) >= 2);
+
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 1);  // first closure arg
+    assert(vc->type == H64VALTYPE_GCVAL);
+    h64gcvalue *gcvalue = (h64gcvalue *)vc->ptr_value;
+    assert(gcvalue->type == H64GCVALUETYPE_OBJINSTANCE);
+    assert(gcvalue->class_id ==
+           vmthread->vmexec_owner->program->_io_file_class_idx);
+    _fileobj_cdata *cdata = (gcvalue->cdata);
+    FILE *f = cdata->file_handle;
+    int readbinary = ((cdata->flags & FILEOBJ_FLAGS_BINARY) != 0);
+
+    struct iolib_fileio_asyncprogress *asprogress = (
+        vmthread->foreground_async_work_dataptr
+    );
+    assert(asprogress != NULL);
+    asprogress->abortfunc = &_iolib_fileio_abort;
+    asprogress->cdata = cdata;
+    if (asprogress->job != NULL)
+        goto readjobstarted;
+
+    if (_fileobj_MustWaitForJob(cdata, asprogress))
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+            (uintptr_t)asprogress->waitjob
+        );
+    if (!f) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_IOERROR,
+            "file was closed"
+        );
+    }
+    if ((cdata->flags & FILEOBJ_FLAGS_CACHEDUNSENTERROR) != 0) {
+        cdata->flags &= ~((uint8_t)FILEOBJ_FLAGS_CACHEDUNSENTERROR);
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_RESOURCEERROR,
+            "unknown i/o error"
+        );
+    }
+
+    if ((cdata->flags & FILEOBJ_FLAGS_READ) == 0) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_IOERROR,
+            "not opened for reading"
+        );
+    }
+
+    valuecontent *vcamount = STACK_ENTRY(vmthread->stack, 0);
+    if ((vcamount->type != H64VALTYPE_INT64 &&
+            vcamount->type != H64VALTYPE_FLOAT64) &&
+            vcamount->type != H64VALTYPE_UNSPECIFIED_KWARG) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "len must be a number"
+        );
+    }
+    int64_t amount = -1;
+    if (vcamount->type == H64VALTYPE_INT64) {
+        amount = vcamount->int_value;
+    } else if (vcamount->type == H64VALTYPE_FLOAT64) {
+        amount = clamped_round(vcamount->float_value);
+    }
+    if (amount == 0 || feof(f)) {
+        valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+        DELREF_NONHEAP(vc);
+        valuecontent_Free(vmthread, vc);
+        memset(vc, 0, sizeof(*vc));
+        if (readbinary) {
+            vc->type = H64VALTYPE_SHORTBYTES;
+            vc->shortbytes_len = 0;
+        } else {
+            vc->type = H64VALTYPE_SHORTSTR;
+            vc->shortstr_len = 0;
+        }
+        vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
+        return 1;
+    }
+
+    // Do the actual reading on an async worker:
+    h64asyncsysjob *job = _iolib_NewFileIOJob(ASYNCFILEIO_READ);
+    if (!job) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory starting read"
         );
-        if (_didread < 0) {
-            if (feof(f)) {
-                _didread = 0;
-            } else if (ferror(f)) {
-                clearerr(f);
-                if (readbufheap)
-                    free(readbuf);
-                if (decodebufheap)
-                    free(decodebuf);
-                return vmexec_ReturnFuncError(
-                    vmthread, H64STDERROR_RESOURCEERROR,
-                    "unknown I/O error"
-                );
-            }
-        }
-        readbuffill = _didread;
     }
-    if (decodebufheap) {
-        free(decodebuf);
-        decodebuf = NULL;
+    job->fileio.f = f;
+    job->fileio.amount = amount;
+    job->fileio.binary = readbinary;
+    if ((cdata->flags & FILEOBJ_FLAGS_LASTWASWRITE) != 0) {
+        cdata->flags &= ~((uint8_t)FILEOBJ_FLAGS_LASTWASWRITE);
+        job->fileio.flush_first = 1;
+    }
+    asprogress->job = job;
+    if (!_iolib_StartFileIOJob(vmthread, asprogress)) {
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+            (uintptr_t)asprogress->job
+        );
+    }
+    readjobstarted: ;
+    if (!asyncjob_IsDone(asprogress->job)) {
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+            (uintptr_t)asprogress->job
+        );
+    }
+    int error_class_id = asprogress->job->fileio.error_class_id;
+    const char *error_msg = asprogress->job->fileio.error_msg;
+    if (asprogress->job->fileio.cached_error)
+        cdata->flags |= FILEOBJ_FLAGS_CACHEDUNSENTERROR;
+    char *readbuf = asprogress->job->fileio.buf;
+    int64_t readbuffill = asprogress->job->fileio.buflen;
+    int readbufheap = 1;
+    asprogress->job->fileio.buf = NULL;  // now owned by us
+    _iolib_ReleaseFileIOJob(asprogress);
+    vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
+    if (error_class_id >= 0) {
+        return vmexec_ReturnFuncError(
+            vmthread, error_class_id, error_msg
+        );
     }
 
     valuecontent *vresult = STACK_ENTRY(vmthread->stack, 0);
@@ -1449,6 +1845,16 @@ int iolib_fileseek(
     assert(gcvalue->class_id ==
            vmthread->vmexec_owner->program->_io_file_class_idx);
     _fileobj_cdata *cdata = (gcvalue->cdata);
+    struct iolib_fileio_asyncprogress *asprogress = (
+        vmthread->foreground_async_work_dataptr
+    );
+    assert(asprogress != NULL);
+    asprogress->abortfunc = &_iolib_fileio_abort;
+    if (_fileobj_MustWaitForJob(cdata, asprogress))
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+            (uintptr_t)asprogress->waitjob
+        );
 
     if (cdata->file_handle == NULL) {
         return vmexec_ReturnFuncError(
@@ -1502,6 +1908,7 @@ int iolib_fileseek(
     memset(vresult, 0, sizeof(*vresult));
     vresult->type = H64VALTYPE_NONE;
     ADDREF_NONHEAP(vresult);
+    vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
     return 1;
 }
 
@@ -1530,6 +1937,16 @@ int iolib_fileoffset(
     assert(gcvalue->class_id ==
            vmthread->vmexec_owner->program->_io_file_class_idx);
     _fileobj_cdata *cdata = (gcvalue->cdata);
+    struct iolib_fileio_asyncprogress *asprogress = (
+        vmthread->foreground_async_work_dataptr
+    );
+    assert(asprogress != NULL);
+    asprogress->abortfunc = &_iolib_fileio_abort;
+    if (_fileobj_MustWaitForJob(cdata, asprogress))
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+            (uintptr_t)asprogress->waitjob
+        );
 
     if (cdata->file_handle == NULL) {
         return vmexec_ReturnFuncError(
@@ -1562,6 +1979,7 @@ int iolib_fileoffset(
     vresult->type = H64VALTYPE_INT64;
     vresult->int_value = result;
     ADDREF_NONHEAP(vresult);
+    vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
     return 1;
 }
 
@@ -1589,6 +2007,16 @@ int iolib_fileclose(
     assert(gcvalue->class_id ==
            vmthread->vmexec_owner->program->_io_file_class_idx);
     _fileobj_cdata *cdata = (gcvalue->cdata);
+    struct iolib_fileio_asyncprogress *asprogress = (
+        vmthread->foreground_async_work_dataptr
+    );
+    assert(asprogress != NULL);
+    asprogress->abortfunc = &_iolib_fileio_abort;
+    if (_fileobj_MustWaitForJob(cdata, asprogress))
+        return vmschedule_SuspendFunc(
+            vmthread, SUSPENDTYPE_ASYNCSYSJOBWAIT,
+            (uintptr_t)asprogress->waitjob
+        );
 
     if (cdata->file_handle != NULL) {
         fclose(cdata->file_handle);
@@ -1602,9 +2030,343 @@ int iolib_fileclose(
     valuecontent_Free(vmthread, vcresult);
     vcresult->type = H64VALTYPE_NONE;
     ADDREF_NONHEAP(vcresult);
+    vmthread_FreeAsyncForegroundWorkWithoutAbort(vmthread);
+    return 1;
+}
+
+
+static int _bufferobj_Reserve(
+        _bufferobj_cdata *cdata, int64_t extralen
+        ) {
+    if (cdata->offset + cdata->len + extralen <= cdata->alloc)
+        return 1;
+    // If most of the space is taken up by consumed data at the front,
+    // move the remainder back to the start rather than growing:
+    if (cdata->offset > 0 && cdata->len + extralen <= cdata->alloc &&
+            cdata->offset >= cdata->alloc / 2) {
+        memmove(cdata->data, cdata->data + cdata->offset, cdata->len);
+        cdata->offset = 0;
+        return 1;
+    }
+    int64_t new_alloc = cdata->alloc * 2;
+    if (new_alloc < cdata->len + extralen)
+        new_alloc = cdata->len + extralen;
+    if (new_alloc < BUFFEROBJ_MIN_ALLOC)
+        new_alloc = BUFFEROBJ_MIN_ALLOC;
+    if (cdata->offset > 0) {
+        memmove(cdata->data, cdata->data + cdata->offset, cdata->len);
+        cdata->offset = 0;
+    }
+    char *new_data = realloc(cdata->data, new_alloc);
+    if (!new_data)
+        return 0;
+    cdata->data = new_data;
+    cdata->alloc = new_alloc;
+    return 1;
+}
+
+static int _bufferobj_GetLenArg(
+        valuecontent *vclen, int64_t buflen, int64_t *out_len
+        ) {
+    // Clamps the len argument to the buffered data, where a
+    // negative or unspecified len means all of it.
+    int64_t len = -1;
+    if (vclen->type == H64VALTYPE_INT64) {
+        len = vclen->int_value;
+    } else if (vclen->type == H64VALTYPE_FLOAT64) {
+        len = clamped_round(vclen->float_value);
+    } else if (vclen->type != H64VALTYPE_UNSPECIFIED_KWARG) {
+        return 0;
+    }
+    if (len < 0 || len > buflen)
+        len = buflen;
+    *out_len = len;
+    return 1;
+}
+
+int iolib_new_buffer(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Create a new empty @see{buffer|io.buffer}.
+     *
+     * @func new_buffer
+     * @returns a @see{buffer object|io.buffer}
+     */
+    assert(STACK_TOP(vmthread->stack) >= 1);
+
+    h64gcvalue *bufferobj = poolalloc_malloc(
+        vmthread->heap, 0
+    );
+    if (!bufferobj) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory allocating buffer object"
+        );
+    }
+    memset(bufferobj, 0, sizeof(*bufferobj));
+    bufferobj->type = H64GCVALUETYPE_OBJINSTANCE;
+    bufferobj->heapreferencecount = 0;
+    bufferobj->externalreferencecount = 1;
+    bufferobj->class_id = (
+        vmthread->vmexec_owner->program->_io_buffer_class_idx
+    );
+    bufferobj->cdata = malloc(sizeof(_bufferobj_cdata));
+    if (!bufferobj->cdata) {
+        poolalloc_free(vmthread->heap, bufferobj);
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory allocating buffer object"
+        );
+    }
+    memset(bufferobj->cdata, 0, sizeof(_bufferobj_cdata));
+    ((_bufferobj_cdata *)bufferobj->cdata)->on_destroy = (
+        &_bufferobj_Destroy
+    );
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vc);
+    valuecontent_Free(vmthread, vc);
+    memset(vc, 0, sizeof(*vc));
+    vc->type = H64VALTYPE_GCVAL;
+    vc->ptr_value = bufferobj;
+    ADDREF_NONHEAP(vc);
+    return 1;
+}
+
+int iolib_bufferappend(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Append data to the end of the buffer. This doesn't copy the
+     * already buffered data, other than every once in a while when
+     * the buffer needs to grow.
+     *
+     * @funcattr io.buffer append
+     * @param data the data to append, which must be @see{bytes} or
+     *    another @see{buffer|io.buffer}.
+     */
+    assert(STACK_TOP(vmthread->stack) >= 2);
+
+    _bufferobj_cdata *cdata = _getbufferarg(
+        vmthread, STACK_ENTRY(vmthread->stack, 1)
+    );
+    assert(cdata != NULL);
+
+    valuecontent *vcdata = STACK_ENTRY(vmthread->stack, 0);
+    char *appendbytes = NULL;
+    int64_t appendlen = 0;
+    _bufferobj_cdata *appendbuf = _getbufferarg(vmthread, vcdata);
+    if (appendbuf) {
+        appendbytes = appendbuf->data + appendbuf->offset;
+        appendlen = appendbuf->len;
+    } else if (vcdata->type == H64VALTYPE_GCVAL &&
+            ((h64gcvalue *)vcdata->ptr_value)->type ==
+                H64GCVALUETYPE_BYTES) {
+        appendbytes = ((h64gcvalue *)vcdata->ptr_value)->bytes_val.s;
+        appendlen = ((h64gcvalue *)vcdata->ptr_value)->bytes_val.len;
+    } else if (vcdata->type == H64VALTYPE_SHORTBYTES) {
+        appendbytes = vcdata->shortbytes_value;
+        appendlen = vcdata->shortbytes_len;
+    } else {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "data argument must be bytes or buffer"
+        );
+    }
+    if (appendlen > 0) {
+        if (!_bufferobj_Reserve(cdata, appendlen)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                "out of memory growing buffer"
+            );
+        }
+        if (appendbuf == cdata)  // data may have moved when growing
+            appendbytes = cdata->data + cdata->offset;
+        memcpy(
+            cdata->data + cdata->offset + cdata->len,
+            appendbytes, appendlen
+        );
+        cdata->len += appendlen;
+    }
+
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memset(vcresult, 0, sizeof(*vcresult));
+    vcresult->type = H64VALTYPE_NONE;
+    return 1;
+}
+
+static int _iolib_bufferpeekorconsume(
+        h64vmthread *vmthread, int consume, int returndata
+        ) {
+    assert(STACK_TOP(vmthread->stack) >= 2);
+
+    _bufferobj_cdata *cdata = _getbufferarg(
+        vmthread, STACK_ENTRY(vmthread->stack, 1)
+    );
+    assert(cdata != NULL);
+
+    int64_t len = 0;
+    if (!_bufferobj_GetLenArg(
+            STACK_ENTRY(vmthread->stack, 0), cdata->len, &len
+            )) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "len must be a number"
+        );
+    }
+
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memset(vcresult, 0, sizeof(*vcresult));
+    vcresult->type = H64VALTYPE_NONE;
+    if (returndata) {
+        if (!valuecontent_SetBytesU8(
+                vmthread, vcresult,
+                (uint8_t *)cdata->data + cdata->offset, len)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                "out of memory allocating bytes result"
+            );
+        }
+        ADDREF_NONHEAP(vcresult);
+    }
+    if (consume) {
+        // Removing from the front only moves the offset:
+        cdata->offset += len;
+        cdata->len -= len;
+        if (cdata->len == 0)
+            cdata->offset = 0;
+    }
+    return 1;
+}
+
+int iolib_bufferconsume(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Remove data from the front of the buffer, and return it.
+     *
+     * @funcattr io.buffer consume
+     * @param len=-1 the amount of bytes to remove. If negative or
+     *    if it exceeds the buffered data, everything is removed.
+     * @returns the removed data as @see{bytes}
+     */
+    return _iolib_bufferpeekorconsume(vmthread, 1, 1);
+}
+
+int iolib_bufferdiscard(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Remove data from the front of the buffer without returning it,
+     * which doesn't copy anything.
+     *
+     * @funcattr io.buffer discard
+     * @param len=-1 the amount of bytes to remove. If negative or
+     *    if it exceeds the buffered data, everything is removed.
+     */
+    return _iolib_bufferpeekorconsume(vmthread, 1, 0);
+}
+
+int iolib_bufferpeek(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Return data from the front of the buffer without removing it.
+     *
+     * @funcattr io.buffer peek
+     * @param len=-1 the amount of bytes to return. If negative or
+     *    if it exceeds the buffered data, everything is returned.
+     * @returns the data as @see{bytes}
+     */
+    return _iolib_bufferpeekorconsume(vmthread, 0, 1);
+}
+
+int iolib_bufferfind(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Find the given bytes sequence in the buffered data.
+     *
+     * @funcattr io.buffer find
+     * @param data the @see{bytes} to search for
+     * @returns the position of the first byte of the first occurrence,
+     *    starting at 1 for the front of the buffer, or -1 if the
+     *    buffered data doesn't contain it.
+     */
+    assert(STACK_TOP(vmthread->stack) >= 2);
+
+    _bufferobj_cdata *cdata = _getbufferarg(
+        vmthread, STACK_ENTRY(vmthread->stack, 1)
+    );
+    assert(cdata != NULL);
+
+    valuecontent *vcneedle = STACK_ENTRY(vmthread->stack, 0);
+    char *needle = NULL;
+    int64_t needlelen = 0;
+    if (vcneedle->type == H64VALTYPE_GCVAL &&
+            ((h64gcvalue *)vcneedle->ptr_value)->type ==
+                H64GCVALUETYPE_BYTES) {
+        needle = ((h64gcvalue *)vcneedle->ptr_value)->bytes_val.s;
+        needlelen = ((h64gcvalue *)vcneedle->ptr_value)->bytes_val.len;
+    } else if (vcneedle->type == H64VALTYPE_SHORTBYTES) {
+        needle = vcneedle->shortbytes_value;
+        needlelen = vcneedle->shortbytes_len;
+    } else {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "data argument must be bytes"
+        );
+    }
+    if (needlelen <= 0) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_VALUEERROR,
+            "cannot find empty bytes"
+        );
+    }
+    h64searcher sr;
+    vmbytes_SearcherInit(&sr, needle, needlelen);
+    int64_t found_at = vmbytes_SearcherFind(
+        &sr, cdata->data + cdata->offset, cdata->len
+    );
+
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memset(vcresult, 0, sizeof(*vcresult));
+    vcresult->type = H64VALTYPE_INT64;
+    vcresult->int_value = (found_at >= 0 ? found_at + 1 : -1);
     return 1;
 }
 
+int iolib_buffersize(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Get the amount of bytes currently in the buffer.
+     *
+     * @funcattr io.buffer size
+     * @returns the amount of buffered bytes as a number
+     */
+    assert(STACK_TOP(vmthread->stack) >= 1);
+
+    _bufferobj_cdata *cdata = _getbufferarg(
+        vmthread, STACK_ENTRY(vmthread->stack, 0)
+    );
+    assert(cdata != NULL);
+    int64_t len = cdata->len;
+
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memset(vcresult, 0, sizeof(*vcresult));
+    vcresult->type = H64VALTYPE_INT64;
+    vcresult->int_value = len;
+    return 1;
+}
 
 int iolib_get_unix_perms(
         h64vmthread *vmthread
@@ -2396,6 +3158,9 @@ int iolib_RegisterFuncsAndModules(h64program *p) {
     );
     if (idx < 0)
         return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct iolib_fileio_asyncprogress)
+    );
 
     // file class:
     p->_io_file_class_idx = h64program_AddClass(
@@ -2413,6 +3178,9 @@ int iolib_RegisterFuncsAndModules(h64program *p) {
     );
     if (idx < 0)
         return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct iolib_fileio_asyncprogress)
+    );
 
     // file.write method:
     const char *io_filewrite_kw_arg_name[] = {NULL};
@@ -2423,6 +3191,9 @@ int iolib_RegisterFuncsAndModules(h64program *p) {
     );
     if (idx < 0)
         return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct iolib_fileio_asyncprogress)
+    );
 
     // file.offset method:
     const char *io_fileoffset_kw_arg_name[] = {};
@@ -2433,6 +3204,9 @@ int iolib_RegisterFuncsAndModules(h64program *p) {
     );
     if (idx < 0)
         return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct iolib_fileio_asyncprogress)
+    );
 
     // file.seek method:
     const char *io_fileseek_kw_arg_name[] = {NULL};
@@ -2443,6 +3217,9 @@ int iolib_RegisterFuncsAndModules(h64program *p) {
     );
     if (idx < 0)
         return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct iolib_fileio_asyncprogress)
+    );
 
     // file.close method:
     idx = h64program_RegisterCFunction(
@@ -2450,6 +3227,84 @@ int iolib_RegisterFuncsAndModules(h64program *p) {
         NULL, 0, 0, NULL,  // fileuri, args
         "io", "core.horse64.org", 1, p->_io_file_class_idx
     );
+    if (idx < 0)
+        return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct iolib_fileio_asyncprogress)
+    );
+
+    // io.new_buffer:
+    idx = h64program_RegisterCFunction(
+        p, "new_buffer", &iolib_new_buffer,
+        NULL, 0, 0, NULL,  // fileuri, args
+        "io", "core.horse64.org", 1, -1
+    );
+    if (idx < 0)
+        return 0;
+
+    // buffer class:
+    p->_io_buffer_class_idx = h64program_AddClass(
+        p, "buffer", NULL, 0, "io", "core.horse64.org"
+    );
+    if (p->_io_buffer_class_idx < 0)
+        return 0;
+
+    // buffer.append method:
+    const char *io_bufferappend_kw_arg_name[] = {NULL};
+    idx = h64program_RegisterCFunction(
+        p, "append", &iolib_bufferappend,
+        NULL, 0, 1, io_bufferappend_kw_arg_name,  // fileuri, args
+        "io", "core.horse64.org", 1, p->_io_buffer_class_idx
+    );
+    if (idx < 0)
+        return 0;
+
+    // buffer.consume method:
+    const char *io_bufferconsume_kw_arg_name[] = {"len"};
+    idx = h64program_RegisterCFunction(
+        p, "consume", &iolib_bufferconsume,
+        NULL, 0, 1, io_bufferconsume_kw_arg_name,  // fileuri, args
+        "io", "core.horse64.org", 1, p->_io_buffer_class_idx
+    );
+    if (idx < 0)
+        return 0;
+
+    // buffer.discard method:
+    const char *io_bufferdiscard_kw_arg_name[] = {"len"};
+    idx = h64program_RegisterCFunction(
+        p, "discard", &iolib_bufferdiscard,
+        NULL, 0, 1, io_bufferdiscard_kw_arg_name,  // fileuri, args
+        "io", "core.horse64.org", 1, p->_io_buffer_class_idx
+    );
+    if (idx < 0)
+        return 0;
+
+    // buffer.peek method:
+    const char *io_bufferpeek_kw_arg_name[] = {"len"};
+    idx = h64program_RegisterCFunction(
+        p, "peek", &iolib_bufferpeek,
+        NULL, 0, 1, io_bufferpeek_kw_arg_name,  // fileuri, args
+        "io", "core.horse64.org", 1, p->_io_buffer_class_idx
+    );
+    if (idx < 0)
+        return 0;
+
+    // buffer.find method:
+    const char *io_bufferfind_kw_arg_name[] = {NULL};
+    idx = h64program_RegisterCFunction(
+        p, "find", &iolib_bufferfind,
+        NULL, 0, 1, io_bufferfind_kw_arg_name,  // fileuri, args
+        "io", "core.horse64.org", 1, p->_io_buffer_class_idx
+    );
+    if (idx < 0)
+        return 0;
+
+    // buffer.size method:
+    idx = h64program_RegisterCFunction(
+        p, "size", &iolib_buffersize,
+        NULL, 0, 0, NULL,  // fileuri, args
+        "io", "core.horse64.org", 1, p->_io_buffer_class_idx
+    );
     if (idx < 0)
         return 0;
 
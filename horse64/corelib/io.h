@@ -5,8 +5,13 @@
 #ifndef HORSE64_CORELIB_IO_H_
 #define HORSE64_CORELIB_IO_H_
 
+typedef struct h64asyncsysjob h64asyncsysjob;
 typedef struct h64program h64program;
 
 int iolib_RegisterFuncsAndModules(h64program *p);
 
+void iolib_RunFileIOJob(
+    h64asyncsysjob *job
+);  // does the blocking part of a file op, usually on an async worker
+
 #endif  // HORSE64_CORELIB_IO_H_
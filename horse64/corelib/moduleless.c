@@ -21,11 +21,13 @@
 
 #include "bytecode.h"
 #include "corelib/builtininternals.h"
+#include "corelib/channel.h"
 #include "corelib/errors.h"
 #include "corelib/io.h"
 #include "corelib/moduleless.h"
 #include "corelib/moduleless_containers.h"
 #include "corelib/moduleless_strings.h"
+#include "corelib/moduleless_vectors.h"
 #include "corelib/path.h"
 #include "corelib/prng.h"
 #include "corelib/random.h"
@@ -36,10 +38,14 @@
 #include "hash.h"
 #include "net.h"
 #include "nonlocale.h"
+#include "poolalloc.h"
 #include "process.h"
 #include "stack.h"
 #include "vmexec.h"
 #include "vmlist.h"
+#include "vmschedule.h"
+#include "vmsuspendtypeenum.h"
+#include "vmvector.h"
 #include "widechar.h"
 
 
@@ -250,61 +256,79 @@ static h64wchar *_corelib_value_to_str_do(
                     int64_t total_entry_count = (
                         gcval->list_values->list_total_entry_count
                     );
-                    listblock *block = gcval->list_values->first_block;
-                    while (block) {
-                        int64_t k = 0;
-                        while (k < block->entry_count) {
-                            entry_offset++;
-                            assert(entry_offset < total_entry_count);
-                            int64_t innerlen = 0;
-                            h64wchar *innerval = (
-                                _corelib_value_to_str_do(
-                                    vmthread,
-                                    &block->entry_values[k], sinfo,
-                                    NULL, 0, currentnesting + 1,
-                                    &innerlen
-                                )
+                    while (entry_offset + 1 < total_entry_count) {
+                        entry_offset++;
+                        valuecontent entry;
+                        vmlist_Get(
+                            gcval->list_values, entry_offset + 1, &entry
+                        );
+                        // Strings are copied straight from the entry,
+                        // and other short values go through a stack
+                        // buffer, to avoid a heap temporary per entry:
+                        int64_t innerlen = 0;
+                        h64wchar innertemp[64];
+                        h64wchar *innerval = NULL;
+                        int innerfree = 0;
+                        if (entry.type == H64VALTYPE_GCVAL &&
+                                ((h64gcvalue *)entry.ptr_value)->type ==
+                                    H64GCVALUETYPE_STRING) {
+                            innerval = (
+                                ((h64gcvalue *)entry.ptr_value)->str_val.s
+                            );
+                            innerlen = (
+                                ((h64gcvalue *)entry.ptr_value)->
+                                    str_val.len
+                            );
+                        } else {
+                            innerval = _corelib_value_to_str_do(
+                                vmthread,
+                                &entry, sinfo,
+                                innertemp,
+                                sizeof(innertemp) / sizeof(*innertemp),
+                                currentnesting + 1,
+                                &innerlen
                             );
-                            if (!innerval) {
+                            innerfree = (innerval != innertemp);
+                        }
+                        if (!innerval) {
+                            if (buffree)
+                                free(buf);
+                            return 0;
+                        }
+                        if (innerlen + 10 + buffill > (int64_t)buflen) {
+                            h64wchar *newbuf = malloc(
+                                (innerlen + 512 + buffill) *
+                                sizeof(h64wchar)
+                            );
+                            if (!newbuf) {
                                 if (buffree)
                                     free(buf);
-                                return 0;
-                            }
-                            if (innerlen + 10 + buffill > (int64_t)buflen) {
-                                h64wchar *newbuf = malloc(
-                                    (innerlen + 512 + buffill) *
-                                    sizeof(h64wchar)
-                                );
-                                if (!newbuf) {
-                                    if (buffree)
-                                        free(buf);
+                                if (innerfree)
                                     free(innerval);
-                                    return NULL;
-                                }
-                                memcpy(
-                                    newbuf, buf, buffill * sizeof(h64wchar)
-                                );
-                                if (buffree)
-                                    free(buf);
-                                buf = newbuf;
-                                buffree = 1;
-                                buflen = (innerlen + 512 + buffill);
+                                return NULL;
                             }
                             memcpy(
-                                buf + buffill, innerval,
-                                innerlen * sizeof(h64wchar)
+                                newbuf, buf, buffill * sizeof(h64wchar)
                             );
+                            if (buffree)
+                                free(buf);
+                            buf = newbuf;
+                            buffree = 1;
+                            buflen = (innerlen + 512 + buffill);
+                        }
+                        memcpy(
+                            buf + buffill, innerval,
+                            innerlen * sizeof(h64wchar)
+                        );
+                        if (innerfree)
                             free(innerval);
-                            buffill += innerlen;
-                            if (likely(entry_offset + 1 <
-                                    total_entry_count)) {
-                                buf[buffill] = ',';
-                                buf[buffill + 1] = ' ';
-                                buffill += 2;
-                            }
-                            k++;
+                        buffill += innerlen;
+                        if (likely(entry_offset + 1 <
+                                total_entry_count)) {
+                            buf[buffill] = ',';
+                            buf[buffill + 1] = ' ';
+                            buffill += 2;
                         }
-                        block = block->next_block;
                     }
                     buf[buffill] = ']';
                     buffill++;
@@ -324,6 +348,75 @@ static h64wchar *_corelib_value_to_str_do(
             }
             break;
         }
+        case H64VALTYPE_VECTOR: {
+            int64_t buffill = 1;
+            buf[0] = '[';
+            int64_t total_entry_count = vmvector_Count(c->vector);
+            int64_t k = 1;
+            while (k <= total_entry_count) {
+                valuecontent entry = {0};
+                vmvector_Get(c->vector, k, &entry);
+                char prefix[32];
+                h64snprintf(prefix, sizeof(prefix), "%" PRId64 ": ", k);
+                prefix[sizeof(prefix) - 1] = '\0';
+                int64_t prefixlen = strlen(prefix);
+                int64_t innerlen = 0;
+                h64wchar innertemp[64];
+                h64wchar *innerval = _corelib_value_to_str_do(
+                    vmthread, &entry, sinfo, innertemp,
+                    sizeof(innertemp) / sizeof(*innertemp),
+                    currentnesting + 1, &innerlen
+                );
+                if (!innerval) {
+                    if (buffree)
+                        free(buf);
+                    return NULL;
+                }
+                if (innerlen + prefixlen + 10 + buffill >
+                        (int64_t)buflen) {
+                    h64wchar *newbuf = malloc(
+                        (innerlen + prefixlen + 512 + buffill) *
+                        sizeof(h64wchar)
+                    );
+                    if (!newbuf) {
+                        if (buffree)
+                            free(buf);
+                        if (innerval != innertemp)
+                            free(innerval);
+                        return NULL;
+                    }
+                    memcpy(newbuf, buf, buffill * sizeof(h64wchar));
+                    if (buffree)
+                        free(buf);
+                    buf = newbuf;
+                    buffree = 1;
+                    buflen = (innerlen + prefixlen + 512 + buffill);
+                }
+                int64_t z = 0;
+                while (z < prefixlen) {
+                    buf[buffill + z] = prefix[z];
+                    z++;
+                }
+                buffill += prefixlen;
+                memcpy(
+                    buf + buffill, innerval,
+                    innerlen * sizeof(h64wchar)
+                );
+                if (innerval != innertemp)
+                    free(innerval);
+                buffill += innerlen;
+                if (likely(k < total_entry_count)) {
+                    buf[buffill] = ',';
+                    buf[buffill + 1] = ' ';
+                    buffill += 2;
+                }
+                k++;
+            }
+            buf[buffill] = ']';
+            buffill++;
+            *outlen = buffill;
+            return buf;
+        }
         case H64VALTYPE_SHORTSTR: {
             assert(buflen >= 25);
             assert(c->shortstr_len >= 0 &&
@@ -641,6 +734,170 @@ int corelib_print(  // $$builtin.print
     return 1;
 }
 
+struct corelib_parallel_asyncprogress {
+    void (*abortfunc)(void *dataptr);
+    h64vmthread *vmthread;
+    h64paralleljob *job;
+};
+
+void _corelib_parallel_abort(void *dataptr) {
+    struct corelib_parallel_asyncprogress *adata = dataptr;
+    if (adata->job) {
+        vmschedule_ParallelJobAbandon(adata->vmthread, adata->job);
+        adata->job = NULL;
+    }
+}
+
+static int _corelib_parallel_run(
+        h64vmthread *vmthread, int keep_results
+        ) {
+    assert(STACK_TOP(vmthread->stack) >= 2);
+
+    struct corelib_parallel_asyncprogress *asprogress = (
+        vmthread->foreground_async_work_dataptr
+    );
+    assert(asprogress != NULL);
+    asprogress->abortfunc = &_corelib_parallel_abort;
+    asprogress->vmthread = vmthread;
+    if (asprogress->job) {
+        // We were resumed, so all items have been processed:
+        h64paralleljob *job = asprogress->job;
+        asprogress->job = NULL;
+        return vmschedule_ParallelJobReturn(vmthread, job);
+    }
+
+    valuecontent *vcfunc = STACK_ENTRY(vmthread->stack, 0);
+    if (vcfunc->type != H64VALTYPE_FUNCREF) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "func must be a plain function, not a closure or "
+            "other value"
+        );
+    }
+    int64_t func_id = vcfunc->int_value;
+    h64program *pr = vmthread->vmexec_owner->program;
+    assert(func_id >= 0 && func_id < pr->func_count);
+    if (pr->func[func_id].iscfunc ||
+            !pr->func[func_id].is_threadable) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "func must be a threadable horse64 function "
+            "that doesn't use global state"
+        );
+    }
+    if (pr->func[func_id].input_stack_size != 1 ||
+            pr->func[func_id].kwarg_count != 0) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_ARGUMENTERROR,
+            "func must take exactly one positional argument"
+        );
+    }
+    valuecontent *vcitems = STACK_ENTRY(vmthread->stack, 1);
+    if (vcitems->type != H64VALTYPE_GCVAL ||
+            ((h64gcvalue *)vcitems->ptr_value)->type !=
+                H64GCVALUETYPE_LIST) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "items must be a list"
+        );
+    }
+    genericlist *items = (
+        ((h64gcvalue *)vcitems->ptr_value)->list_values
+    );
+
+    if (vmlist_Count(items) == 0) {
+        // Nothing to do, so return right away:
+        valuecontent vresult = {0};
+        vresult.type = H64VALTYPE_NONE;
+        if (keep_results) {
+            h64gcvalue *gcval = poolalloc_malloc(vmthread->heap, 0);
+            if (!gcval)
+                return vmexec_ReturnFuncError(
+                    vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                    "out of memory allocating result list"
+                );
+            memset(gcval, 0, sizeof(*gcval));
+            gcval->type = H64GCVALUETYPE_LIST;
+            gcval->hash = -1;
+            gcval->externalreferencecount = 1;
+            gcval->list_values = vmlist_New();
+            if (!gcval->list_values) {
+                poolalloc_free(vmthread->heap, gcval);
+                return vmexec_ReturnFuncError(
+                    vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                    "out of memory allocating result list"
+                );
+            }
+            vresult.type = H64VALTYPE_GCVAL;
+            vresult.ptr_value = gcval;
+        }
+        valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+        DELREF_NONHEAP(vcresult);
+        valuecontent_Free(vmthread, vcresult);
+        memcpy(vcresult, &vresult, sizeof(vresult));
+        return 1;
+    }
+
+    // Hand out the items to the workers, and wait until they're done:
+    h64paralleljob *job = NULL;
+    int result = vmschedule_ParallelJobStart(
+        vmthread, func_id, items, keep_results, &job
+    );
+    if (result < 0) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "cannot pass this value type to parallel func"
+        );
+    } else if (result == 0) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory starting parallel job"
+        );
+    }
+    asprogress->job = job;
+    return vmschedule_SuspendFunc(
+        vmthread, SUSPENDTYPE_PARALLELJOBWAIT, (uintptr_t)job
+    );
+}
+
+int corelib_parallel_map(  // $$builtin.parallel_map
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Call a function on each item of a list, spread over all
+     * workers in parallel, and return the results in the same order.
+     * The items and results are copied between the workers, like
+     * for other parallel calls.
+     *
+     * @func parallel_map
+     * @param func the function to call. It must take exactly one
+     *     positional argument, and it must not use global variables.
+     * @param items the @see{list} of items to pass to func, one
+     *     per call.
+     * @returns a @see{list} with the results, in the order of items.
+     * @raises any error func raised for any of the items.
+     */
+    return _corelib_parallel_run(vmthread, 1);
+}
+
+int corelib_parallel_for(  // $$builtin.parallel_for
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Call a function on each item of a list, spread over all
+     * workers in parallel, and wait until all calls are done.
+     * This is like @see{parallel_map}, but drops the results.
+     *
+     * @func parallel_for
+     * @param func the function to call. It must take exactly one
+     *     positional argument, and it must not use global variables.
+     * @param items the @see{list} of items to pass to func, one
+     *     per call.
+     * @raises any error func raised for any of the items.
+     */
+    return _corelib_parallel_run(vmthread, 0);
+}
+
 int corelib_RegisterFuncsAndModules(h64program *p) {
     int64_t idx;
 
@@ -656,6 +913,10 @@ int corelib_RegisterFuncsAndModules(h64program *p) {
     if (!corelib_RegisterContainerFuncs(p))
         return 0;
 
+    // 'channel' module:
+    if (!channellib_RegisterFuncsAndModules(p))
+        return 0;
+
     // 'io' module:
     if (!iolib_RegisterFuncsAndModules(p))
         return 0;
@@ -696,6 +957,10 @@ int corelib_RegisterFuncsAndModules(h64program *p) {
     if (!urilib_RegisterFuncsAndModules(p))
         return 0;
 
+    // Vector func attributes:
+    if (!corelib_RegisterVectorFuncs(p))
+        return 0;
+
     // Now, the stuff without a module:
 
     // 'print' function:
@@ -725,6 +990,28 @@ int corelib_RegisterFuncsAndModules(h64program *p) {
     if (idx < 0)
         return 0;
 
+    // 'parallel_map' function:
+    idx = h64program_RegisterCFunction(
+        p, "parallel_map", &corelib_parallel_map,
+        NULL, 0, 2, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct corelib_parallel_asyncprogress)
+    );
+
+    // 'parallel_for' function:
+    idx = h64program_RegisterCFunction(
+        p, "parallel_for", &corelib_parallel_for,
+        NULL, 0, 2, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].async_progress_struct_size = (
+        sizeof(struct corelib_parallel_asyncprogress)
+    );
+
     // '$$any.is_a' function:
     idx = h64program_RegisterCFunction(
         p, "$$anyis_a", &corelib_obj_is_a,
@@ -10,6 +10,7 @@
 #include "corelib/errors.h"
 #include "corelib/moduleless.h"
 #include "corelib/moduleless_containers.h"
+#include "corelib/moduleless_vectors.h"
 #include "debugsymbols.h"
 #include "stack.h"
 #include "valuecontentstruct.h"
@@ -45,19 +46,40 @@ int corelib_containeradd(  // $$builtin.$$container_add
     return 1;
 }
 
+static int _containerjoin_getstr(
+        valuecontent *v, h64wchar **out_s, int64_t *out_slen
+        ) {
+    if (v->type == H64VALTYPE_SHORTSTR) {
+        *out_s = v->shortstr_value;
+        *out_slen = v->shortstr_len;
+        return 1;
+    } else if (v->type == H64VALTYPE_GCVAL &&
+            ((h64gcvalue *)v->ptr_value)->type ==
+                H64GCVALUETYPE_STRING) {
+        *out_s = ((h64gcvalue *)v->ptr_value)->str_val.s;
+        *out_slen = ((h64gcvalue *)v->ptr_value)->str_val.len;
+        return 1;
+    }
+    return 0;
+}
+
+// Joining runs over the container twice: the first pass checks all
+// types and sums up the exact result length, then the result string
+// is allocated once and the second pass only copies into it.
+
 typedef struct _containerjoin_map_iteratedata {
     genericmap *map;
+    int filling;
     h64wchar *result;
-    int64_t resultlen, resultalloc;
+    int64_t resultlen;
+    int64_t joined;
     int errortype;
-    char *errormsg;
+    const char *errormsg;
 
     h64wchar *keyvaluesep;
     int64_t keyvalueseplen;
     h64wchar *pairsep;
     int64_t pairseplen;
-
-    valuecontent *_previouskey, *_previousvalue;
 } _containerjoin_map_iteratedata;
 
 static int _callback_containerjoin_map(
@@ -69,98 +91,39 @@ static int _callback_containerjoin_map(
     );
     assert(!data->errormsg && data->errortype < 0);
 
-    if ((key->type != H64VALTYPE_GCVAL ||
-            ((h64gcvalue *)key->ptr_value)->type !=
-                H64GCVALUETYPE_STRING) &&
-            key->type != H64VALTYPE_SHORTSTR) {
-        data->errortype = H64STDERROR_TYPEERROR;
-        data->errormsg = strdup(
-            "cannot join on dict with non-string keys"
-        );
-        return 0;
-    }
-    if ((value->type != H64VALTYPE_GCVAL ||
-            ((h64gcvalue *)value->ptr_value)->type !=
-                H64GCVALUETYPE_STRING) &&
-            value->type != H64VALTYPE_SHORTSTR) {
-        data->errortype = H64STDERROR_TYPEERROR;
-        data->errormsg = strdup(
-            "cannot join on dict with non-string values"
-        );
-        return 0;
-    }
     h64wchar *keystr = NULL;
     int64_t keystrlen = 0;
     h64wchar *valuestr = NULL;
     int64_t valuestrlen = 0;
-    if (key->type == H64VALTYPE_GCVAL) {
-        assert(((h64gcvalue *)key->ptr_value)->type ==
-               H64GCVALUETYPE_STRING);
-        keystr = ((h64gcvalue *)key->ptr_value)->str_val.s;
-        keystrlen = ((h64gcvalue *)key->ptr_value)->str_val.len;
-    } else if (key->type == H64VALTYPE_SHORTSTR) {
-        keystr = key->shortstr_value;
-        keystrlen = key->shortstr_len;
-    }
-    if (value->type == H64VALTYPE_GCVAL) {
-        assert(((h64gcvalue *)value->ptr_value)->type ==
-               H64GCVALUETYPE_STRING);
-        valuestr = ((h64gcvalue *)value->ptr_value)->str_val.s;
-        valuestrlen = ((h64gcvalue *)value->ptr_value)->str_val.len;
-    } else if (value->type == H64VALTYPE_SHORTSTR) {
-        valuestr = value->shortstr_value;
-        valuestrlen = value->shortstr_len;
+    if (!_containerjoin_getstr(key, &keystr, &keystrlen)) {
+        data->errortype = H64STDERROR_TYPEERROR;
+        data->errormsg = "cannot join on dict with non-string keys";
+        return 0;
     }
-
-    int64_t addlen = (
-        (data->_previousvalue != NULL ? data->pairseplen : 0) +
-        keystrlen +
-        data->keyvalueseplen +
-        valuestrlen
-    );
-    if (data->resultlen + addlen > data->resultalloc) {
-        int64_t newalloc = (
-            data->resultlen + addlen + 32
-        );
-        if (newalloc < data->resultalloc * 2)
-            newalloc = data->resultalloc * 2;
-        h64wchar *newresult = realloc(
-            data->result,
-            sizeof(*data->result) * newalloc
-        );
-        if (!newresult) {
-            data->errortype = H64STDERROR_OUTOFMEMORYERROR;
-            data->errormsg = strdup(
-                "out of memory expanding string"
-            );
-            return 0;
-        }
-        data->result = newresult;
+    if (!_containerjoin_getstr(value, &valuestr, &valuestrlen)) {
+        data->errortype = H64STDERROR_TYPEERROR;
+        data->errormsg = "cannot join on dict with non-string values";
+        return 0;
     }
-    int64_t o = data->resultlen;
-    if (data->_previousvalue != NULL) {
-        memcpy(
-            data->result + o, data->pairsep,
-            sizeof(*data->pairsep) * data->pairseplen
+    int64_t seplen = (data->joined > 0 ? data->pairseplen : 0);
+    data->joined++;
+    if (!data->filling) {
+        data->resultlen += (
+            seplen + keystrlen + data->keyvalueseplen + valuestrlen
         );
-        o += data->pairseplen;
+        return 1;
     }
-    memcpy(
-        data->result + o, keystr, sizeof(*keystr) * keystrlen
-    );
+
+    h64wchar *o = data->result + data->resultlen;
+    memcpy(o, data->pairsep, sizeof(*o) * seplen);
+    o += seplen;
+    memcpy(o, keystr, sizeof(*o) * keystrlen);
     o += keystrlen;
-    memcpy(
-        data->result + o, data->keyvaluesep,
-        sizeof(*data->keyvaluesep) * data->keyvalueseplen
-    );
+    memcpy(o, data->keyvaluesep, sizeof(*o) * data->keyvalueseplen);
     o += data->keyvalueseplen;
-    memcpy(
-        data->result + o, valuestr, sizeof(*valuestr) * valuestrlen
-    );
+    memcpy(o, valuestr, sizeof(*o) * valuestrlen);
     o += valuestrlen;
-    data->resultlen += addlen;
-    data->_previousvalue = value;
-    data->_previouskey = key;
+    data->resultlen = (o - data->result);
     return 1;
 }
 
@@ -175,37 +138,11 @@ int corelib_containerjoin_map(  // $$builtin.$$container_join_map
     assert(gcvalue->type == H64GCVALUETYPE_MAP);
 
     h64wchar *params1 = NULL; int64_t param1len = 0;
-    valuecontent *vparam1 = STACK_ENTRY(vmthread->stack, 0);
-    if (vparam1->type == H64VALTYPE_SHORTSTR) {
-        params1 = vparam1->shortstr_value;
-        param1len = vparam1->shortstr_len;
-    } else if (vparam1->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue *)vparam1->ptr_value)->type ==
-                H64GCVALUETYPE_STRING) {
-        params1 = ((h64gcvalue *)vparam1->ptr_value)->str_val.s;
-        param1len = (
-            ((h64gcvalue *)vparam1->ptr_value)->str_val.len
-        );
-    } else {
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_TYPEERROR,
-            "arguments for map join must be two strings"
-        );
-    }
-
     h64wchar *params2 = NULL; int64_t param2len = 0;
-    valuecontent *vparam2 = STACK_ENTRY(vmthread->stack, 1);
-    if (vparam2->type == H64VALTYPE_SHORTSTR) {
-        params2 = vparam2->shortstr_value;
-        param2len = vparam2->shortstr_len;
-    } else if (vparam2->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue *)vparam2->ptr_value)->type ==
-                H64GCVALUETYPE_STRING) {
-        params2 = ((h64gcvalue *)vparam2->ptr_value)->str_val.s;
-        param2len = (
-            ((h64gcvalue *)vparam2->ptr_value)->str_val.len
-        );
-    } else {
+    if (!_containerjoin_getstr(
+            STACK_ENTRY(vmthread->stack, 0), &params1, &param1len) ||
+            !_containerjoin_getstr(
+            STACK_ENTRY(vmthread->stack, 1), &params2, &param2len)) {
         return vmexec_ReturnFuncError(
             vmthread, H64STDERROR_TYPEERROR,
             "arguments for map join must be two strings"
@@ -220,51 +157,53 @@ int corelib_containerjoin_map(  // $$builtin.$$container_join_map
     data.keyvalueseplen = param1len;
     data.pairsep = params2;
     data.pairseplen = param2len;
-    int result = vmmap_IteratePairs(
-        map, &data, &_callback_containerjoin_map
-    );
-    if (!result) {
-        assert(data.errortype >= 0);
-        int retvalue = vmexec_ReturnFuncError(
-            vmthread, data.errortype,
-            (data.errormsg ? data.errormsg : "msg alloc fail")
+    if (!vmmap_IteratePairs(
+            map, &data, &_callback_containerjoin_map
+            )) {
+        assert(data.errortype >= 0 && data.errormsg != NULL);
+        return vmexec_ReturnFuncError(
+            vmthread, data.errortype, "%s", data.errormsg
         );
-        free(data.errormsg);
-        if (data.result)
-            free(data.result);
-        return retvalue;
     }
-    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
-    DELREF_NONHEAP(vcresult);
-    valuecontent_Free(vmthread, vcresult);
-    memset(vcresult, 0, sizeof(*vcresult));
-    if (!valuecontent_SetStringU32(
-            vmthread, vcresult,
-            data.result, data.resultlen)) {
-        if (data.result)
-            free(data.result);
+    valuecontent resultvc = {0};
+    if (!valuecontent_AllocStringU32(
+            vmthread, &resultvc, data.resultlen, &data.result
+            )) {
         return vmexec_ReturnFuncError(
             vmthread, H64STDERROR_OUTOFMEMORYERROR,
             "out of memory creating result string"
         );
     }
+    int64_t expectedlen = data.resultlen;
+    data.filling = 1;
+    data.resultlen = 0;
+    data.joined = 0;
+    int result = vmmap_IteratePairs(
+        map, &data, &_callback_containerjoin_map
+    );
+    assert(result != 0 && data.resultlen == expectedlen);
+    (void)result; (void)expectedlen;
+
+    // Only now replace the separator argument, which was in use:
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memcpy(vcresult, &resultvc, sizeof(*vcresult));
     ADDREF_NONHEAP(vcresult);
-    if (data.result)
-        free(data.result);
     return 1;
 }
 
 typedef struct _containerjoin_list_iteratedata {
     genericlist *list;
+    int filling;
     h64wchar *result;
-    int64_t resultlen, resultalloc;
+    int64_t resultlen;
+    int64_t joined;
     int errortype;
-    char *errormsg;
+    const char *errormsg;
 
     h64wchar *valuesep;
     int64_t valueseplen;
-
-    valuecontent *_previousvalue;
 } _containerjoin_list_iteratedata;
 
 static int _callback_containerjoin_list(
@@ -275,65 +214,26 @@ static int _callback_containerjoin_list(
     );
     assert(!data->errormsg && data->errortype < 0);
 
-    if ((value->type != H64VALTYPE_GCVAL ||
-            ((h64gcvalue *)value->ptr_value)->type !=
-                H64GCVALUETYPE_STRING) &&
-            value->type != H64VALTYPE_SHORTSTR) {
+    h64wchar *valuestr = NULL;
+    int64_t valuestrlen = 0;
+    if (!_containerjoin_getstr(value, &valuestr, &valuestrlen)) {
         data->errortype = H64STDERROR_TYPEERROR;
-        data->errormsg = strdup(
-            "cannot join on list with non-string values"
-        );
+        data->errormsg = "cannot join on list with non-string values";
         return 0;
     }
-    h64wchar *valuestr = NULL;
-    int64_t valuestrlen = 0;
-    if (value->type == H64VALTYPE_GCVAL) {
-        assert(((h64gcvalue *)value->ptr_value)->type ==
-               H64GCVALUETYPE_STRING);
-        valuestr = ((h64gcvalue *)value->ptr_value)->str_val.s;
-        valuestrlen = ((h64gcvalue *)value->ptr_value)->str_val.len;
-    } else if (value->type == H64VALTYPE_SHORTSTR) {
-        valuestr = value->shortstr_value;
-        valuestrlen = value->shortstr_len;
+    int64_t seplen = (data->joined > 0 ? data->valueseplen : 0);
+    data->joined++;
+    if (!data->filling) {
+        data->resultlen += seplen + valuestrlen;
+        return 1;
     }
 
-    int64_t addlen = (
-        (data->_previousvalue != NULL ? data->valueseplen : 0) +
-        valuestrlen
-    );
-    if (data->resultlen + addlen > data->resultalloc) {
-        int64_t newalloc = (
-            data->resultlen + addlen + 32
-        );
-        if (newalloc < data->resultalloc * 2)
-            newalloc = data->resultalloc * 2;
-        h64wchar *newresult = realloc(
-            data->result,
-            sizeof(*data->result) * newalloc
-        );
-        if (!newresult) {
-            data->errortype = H64STDERROR_OUTOFMEMORYERROR;
-            data->errormsg = strdup(
-                "out of memory expanding string"
-            );
-            return 0;
-        }
-        data->result = newresult;
-    }
-    int64_t o = data->resultlen;
-    if (data->_previousvalue != NULL) {
-        memcpy(
-            data->result + o, data->valuesep,
-            sizeof(*data->valuesep) * data->valueseplen
-        );
-        o += data->valueseplen;
-    }
-    memcpy(
-        data->result + o, valuestr, sizeof(*valuestr) * valuestrlen
-    );
+    h64wchar *o = data->result + data->resultlen;
+    memcpy(o, data->valuesep, sizeof(*o) * seplen);
+    o += seplen;
+    memcpy(o, valuestr, sizeof(*o) * valuestrlen);
     o += valuestrlen;
-    data->resultlen += addlen;
-    data->_previousvalue = value;
+    data->resultlen = (o - data->result);
     return 1;
 }
 
@@ -348,18 +248,8 @@ int corelib_containerjoin_list(  // $$builtin.$$container_join_list
     assert(gcvalue->type == H64GCVALUETYPE_LIST);
 
     h64wchar *params1 = NULL; int64_t param1len = 0;
-    valuecontent *vparam1 = STACK_ENTRY(vmthread->stack, 0);
-    if (vparam1->type == H64VALTYPE_SHORTSTR) {
-        params1 = vparam1->shortstr_value;
-        param1len = vparam1->shortstr_len;
-    } else if (vparam1->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue *)vparam1->ptr_value)->type ==
-                H64GCVALUETYPE_STRING) {
-        params1 = ((h64gcvalue *)vparam1->ptr_value)->str_val.s;
-        param1len = (
-            ((h64gcvalue *)vparam1->ptr_value)->str_val.len
-        );
-    } else {
+    if (!_containerjoin_getstr(
+            STACK_ENTRY(vmthread->stack, 0), &params1, &param1len)) {
         return vmexec_ReturnFuncError(
             vmthread, H64STDERROR_TYPEERROR,
             "arguments for list join must be string"
@@ -372,37 +262,39 @@ int corelib_containerjoin_list(  // $$builtin.$$container_join_list
     data.errortype = -1;
     data.valuesep = params1;
     data.valueseplen = param1len;
-    int result = vmmap_IterateValues(
-        l, &data, &_callback_containerjoin_list
-    );
-    if (!result) {
-        assert(data.errortype >= 0);
-        int retvalue = vmexec_ReturnFuncError(
-            vmthread, data.errortype,
-            (data.errormsg ? data.errormsg : "msg alloc fail")
+    if (!vmmap_IterateValues(
+            l, &data, &_callback_containerjoin_list
+            )) {
+        assert(data.errortype >= 0 && data.errormsg != NULL);
+        return vmexec_ReturnFuncError(
+            vmthread, data.errortype, "%s", data.errormsg
         );
-        free(data.errormsg);
-        if (data.result)
-            free(data.result);
-        return retvalue;
     }
-    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
-    DELREF_NONHEAP(vcresult);
-    valuecontent_Free(vmthread, vcresult);
-    memset(vcresult, 0, sizeof(*vcresult));
-    if (!valuecontent_SetStringU32(
-            vmthread, vcresult,
-            data.result, data.resultlen)) {
-        if (data.result)
-            free(data.result);
+    valuecontent resultvc = {0};
+    if (!valuecontent_AllocStringU32(
+            vmthread, &resultvc, data.resultlen, &data.result
+            )) {
         return vmexec_ReturnFuncError(
             vmthread, H64STDERROR_OUTOFMEMORYERROR,
             "out of memory creating result string"
         );
     }
+    int64_t expectedlen = data.resultlen;
+    data.filling = 1;
+    data.resultlen = 0;
+    data.joined = 0;
+    int result = vmmap_IterateValues(
+        l, &data, &_callback_containerjoin_list
+    );
+    assert(result != 0 && data.resultlen == expectedlen);
+    (void)result; (void)expectedlen;
+
+    // Only now replace the separator argument, which was in use:
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memcpy(vcresult, &resultvc, sizeof(*vcresult));
     ADDREF_NONHEAP(vcresult);
-    if (data.result)
-        free(data.result);
     return 1;
 }
 
@@ -501,6 +393,10 @@ funcid_t corelib_GetContainerFuncIdx(
             if (container_type == H64GCVALUETYPE_MAP &&
                     strcmp(p->container_indexes.func_name[i], "add") == 0)
                 return -1;  // maps have no .add()
+            if (container_type != H64GCVALUETYPE_LIST &&
+                    strcmp(p->container_indexes.func_name[i],
+                           "as_vector") == 0)
+                return -1;  // only lists have .as_vector()
             if (strcmp(p->container_indexes.func_name[i],
                     "join") == 0) {
                 if (container_type == H64GCVALUETYPE_MAP &&
@@ -573,5 +469,16 @@ int corelib_RegisterContainerFuncs(h64program *p) {
     if (!corelib_RegisterContainersFunc(p, "join", idx))
         return 0;
 
+    // '$$container_as_vector' function:
+    idx = h64program_RegisterCFunction(
+        p, "$$container_as_vector", &corelib_containeras_vector,
+        NULL, 0, 0, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].input_stack_size++;  // for 'self'
+    if (!corelib_RegisterContainersFunc(p, "as_vector", idx))
+        return 0;
+
     return 1;
 }
\ No newline at end of file
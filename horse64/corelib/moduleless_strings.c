@@ -18,6 +18,7 @@
 #include "valuecontentstruct.h"
 #include "vmexec.h"
 #include "vmlist.h"
+#include "vmmap.h"
 #include "vmstrings.h"
 #include "widechar.h"
 
@@ -72,6 +73,123 @@ int corelib_RegisterStringsFunc(
     return 1;
 }
 
+static int _getstrarg(
+        valuecontent *vc, h64wchar **out_s, int64_t *out_slen,
+        h64stringval **out_sval
+        ) {
+    // Returns 1 and the buffer if vc is any kind of string, else 0.
+    if (out_sval) *out_sval = NULL;
+    if (vc->type == H64VALTYPE_SHORTSTR) {
+        *out_s = vc->shortstr_value;
+        *out_slen = vc->shortstr_len;
+        return 1;
+    } else if (vc->type == H64VALTYPE_CONSTPREALLOCSTR) {
+        *out_s = vc->constpreallocstr_value;
+        *out_slen = vc->constpreallocstr_len;
+        return 1;
+    } else if (vc->type == H64VALTYPE_GCVAL &&
+            ((h64gcvalue *)vc->ptr_value)->type ==
+                H64GCVALUETYPE_STRING) {
+        h64stringval *sval = &((h64gcvalue *)vc->ptr_value)->str_val;
+        *out_s = sval->s;
+        *out_slen = sval->len;
+        if (out_sval) *out_sval = sval;
+        return 1;
+    }
+    return 0;
+}
+
+static int _getbytesarg(
+        valuecontent *vc, char **out_s, int64_t *out_slen
+        ) {
+    // Returns 1 and the buffer if vc is any kind of bytes, else 0.
+    if (vc->type == H64VALTYPE_SHORTBYTES) {
+        *out_s = vc->shortbytes_value;
+        *out_slen = vc->shortbytes_len;
+        return 1;
+    } else if (vc->type == H64VALTYPE_GCVAL &&
+            ((h64gcvalue *)vc->ptr_value)->type ==
+                H64GCVALUETYPE_BYTES) {
+        *out_s = ((h64gcvalue *)vc->ptr_value)->bytes_val.s;
+        *out_slen = ((h64gcvalue *)vc->ptr_value)->bytes_val.len;
+        return 1;
+    }
+    return 0;
+}
+
+typedef struct _lettersearch {
+    h64searcher sr;
+    const h64wchar *s;
+    int64_t slen;
+    int letters_are_codepoints;
+
+    // Letter boundary cursors, which only ever move forward:
+    int64_t start_pos, start_letters;
+    int64_t end_pos, end_letters;
+} _lettersearch;
+
+static void _lettersearch_Init(
+        _lettersearch *ls, const h64wchar *s, int64_t slen,
+        h64stringval *sval, const h64wchar *needle, int64_t needlelen
+        ) {
+    memset(ls, 0, sizeof(*ls));
+    vmstrings_SearcherInit(&ls->sr, needle, needlelen);
+    ls->s = s;
+    ls->slen = slen;
+    ls->letters_are_codepoints = (
+        sval != NULL && vmstrings_LettersAreCodepoints(sval)
+    );
+}
+
+static int _lettersearch_AdvanceTo(
+        _lettersearch *ls, int64_t *pos, int64_t *letters,
+        int64_t target
+        ) {
+    while (*pos < target) {
+        int len = utf32_letter_len(ls->s + *pos, ls->slen - *pos);
+        assert(len > 0);
+        *pos += len;
+        (*letters)++;
+    }
+    return (*pos == target);
+}
+
+static int64_t _lettersearch_Next(
+        _lettersearch *ls, int64_t from, int64_t *out_letteridx
+        ) {
+    // Returns the code point offset of the next match at or after
+    // from that starts and ends on a letter boundary, or -1.
+    // Letters are only segmented up to candidate hits.
+    while (from <= ls->slen) {
+        int64_t found = vmstrings_SearcherFind(
+            &ls->sr, ls->s + from, ls->slen - from
+        );
+        if (found < 0)
+            return -1;
+        found += from;
+        if (ls->letters_are_codepoints) {
+            if (out_letteridx) *out_letteridx = found + 1;
+            return found;
+        }
+        if (!_lettersearch_AdvanceTo(
+                ls, &ls->start_pos, &ls->start_letters, found
+                )) {
+            from = ls->start_pos;
+            continue;
+        }
+        if (!_lettersearch_AdvanceTo(
+                ls, &ls->end_pos, &ls->end_letters,
+                found + ls->sr.needlelen
+                )) {
+            from = found + 1;
+            continue;
+        }
+        if (out_letteridx) *out_letteridx = ls->start_letters + 1;
+        return found;
+    }
+    return -1;
+}
+
 static int _contains_or_find(
         h64vmthread *vmthread, int iscontains
         ) {
@@ -79,166 +197,61 @@ static int _contains_or_find(
         iscontains ? "contains check" : "find"
     );
     valuecontent *vc = STACK_ENTRY(vmthread->stack, 1);
-    if (vc->type == H64VALTYPE_SHORTSTR ||
-            ((h64gcvalue *)vc->ptr_value)->type ==
-                H64GCVALUETYPE_STRING) {
+    valuecontent *vparam = STACK_ENTRY(vmthread->stack, 0);
+    int64_t found_at = -1;
+    h64wchar *s = NULL; int64_t slen = 0;
+    h64stringval *sval = NULL;
+    if (_getstrarg(vc, &s, &slen, &sval)) {
         // U32 code path:
-
-        // Get string we work on:
-        h64wchar *s = NULL; int64_t slen = 0;
-        if (vc->type == H64VALTYPE_GCVAL) {
-            h64gcvalue *gcvalue = (h64gcvalue *)vc->ptr_value;
-            s = gcvalue->str_val.s;
-            slen = gcvalue->str_val.len;
-        } else {
-            s = vc->shortstr_value;
-            slen = vc->shortstr_len;
-        }
-
-        // Get parameter which must also be string:
         h64wchar *params = NULL; int64_t paramlen = 0;
-        valuecontent *vparam = STACK_ENTRY(vmthread->stack, 0);
-        if (vparam->type == H64VALTYPE_SHORTSTR) {
-            params = vparam->shortstr_value;
-            paramlen = vparam->shortstr_len;
-        } else if (vparam->type == H64VALTYPE_GCVAL &&
-                ((h64gcvalue *)vparam->ptr_value)->type ==
-                    H64GCVALUETYPE_STRING) {
-            params = ((h64gcvalue *)vparam->ptr_value)->str_val.s;
-            paramlen = (
-                ((h64gcvalue *)vparam->ptr_value)->str_val.len
-            );
-        } else {
+        if (!_getstrarg(vparam, &params, &paramlen, NULL)) {
             return vmexec_ReturnFuncError(
                 vmthread, H64STDERROR_TYPEERROR,
                 "%s on strings needs a string parameter",
                 funcname
             );
         }
-
-        // Return result:
-        if (likely(paramlen) > 0) {
-            int64_t found_at = -1;
-            int64_t charidx = 0;
-            int64_t i = 0;
-            while (i < slen) {
-                charidx++;
-                int charlen = utf32_letter_len(s + i, slen - i);
-                assert(charlen > 0);
-                if ((uint64_t)(paramlen) > (uint64_t)(slen - i))
-                    break;
-                if (memcmp(s + i, params,
-                        paramlen * sizeof(*params)
-                        ) == 0) {
-                    found_at = charidx;
-                    break;
-                }
-                i += charlen;
-            }
-            if (found_at >= 0) {
-                valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
-                DELREF_NONHEAP(vcresult);
-                valuecontent_Free(vmthread, vcresult);
-                memset(vcresult, 0, sizeof(*vcresult));
-                if (iscontains) {
-                    vcresult->type = H64VALTYPE_BOOL;
-                    vcresult->int_value = 1;
-                } else {
-                    vcresult->type = H64VALTYPE_INT64;
-                    vcresult->int_value = found_at;
-                }
-                ADDREF_NONHEAP(vcresult);
-                return 1;
-            }
+        if (likely(paramlen > 0)) {
+            _lettersearch ls;
+            _lettersearch_Init(&ls, s, slen, sval, params, paramlen);
+            int64_t letteridx = -1;
+            if (_lettersearch_Next(&ls, 0, &letteridx) >= 0)
+                found_at = letteridx;
         }
-        valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
-        DELREF_NONHEAP(vcresult);
-        valuecontent_Free(vmthread, vcresult);
-        memset(vcresult, 0, sizeof(*vcresult));
-        if (iscontains) {
-            vcresult->type = H64VALTYPE_BOOL;
-            vcresult->int_value = 0;
-        } else {
-            vcresult->type = H64VALTYPE_INT64;
-            vcresult->int_value = -1;
-        }
-        ADDREF_NONHEAP(vcresult);
-        return 1;
     } else {
-        // Bytes code path
-        char *s = NULL; int64_t slen = 0;
-        if (vc->type == H64VALTYPE_GCVAL) {
-            h64gcvalue *gcvalue = (h64gcvalue *)vc->ptr_value;
-            s = gcvalue->bytes_val.s;
-            slen = gcvalue->bytes_val.len;
-        } else {
-            s = vc->shortbytes_value;
-            slen = vc->shortbytes_len;
-        }
-
-        // Get parameter which must also be bytes:
+        // Bytes code path:
+        char *bs = NULL; int64_t bslen = 0;
+        int result = _getbytesarg(vc, &bs, &bslen);
+        assert(result != 0);
+        (void)result;
         char *params = NULL; int64_t paramlen = 0;
-        valuecontent *vparam = STACK_ENTRY(vmthread->stack, 0);
-        if (vparam->type == H64VALTYPE_SHORTBYTES) {
-            params = vparam->shortbytes_value;
-            paramlen = vparam->shortbytes_len;
-        } else if (vparam->type == H64VALTYPE_GCVAL &&
-                ((h64gcvalue *)vparam->ptr_value)->type ==
-                    H64GCVALUETYPE_BYTES) {
-            params = ((h64gcvalue *)vparam->ptr_value)->bytes_val.s;
-            paramlen = ((h64gcvalue *)vparam->ptr_value)->bytes_val.len;
-        } else {
+        if (!_getbytesarg(vparam, &params, &paramlen)) {
             return vmexec_ReturnFuncError(
                 vmthread, H64STDERROR_TYPEERROR,
                 "%s on bytes needs a bytes parameter",
                 funcname
             );
         }
-
-        // Return result:
-        if (likely(paramlen) > 0) {
-            int64_t found_at = -1;
-            int64_t i = 0;
-            while (i < slen) {
-                if ((uint64_t)(paramlen) >
-                        (uint64_t)(slen - i))
-                    break;
-                if (memcmp(s + i, params, paramlen
-                        ) == 0) {
-                    found_at = i;
-                    break;
-                }
-                i++;
-            }
-            if (found_at >= 0) {
-                valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
-                DELREF_NONHEAP(vcresult);
-                valuecontent_Free(vmthread, vcresult);
-                memset(vcresult, 0, sizeof(*vcresult));
-                if (iscontains) {
-                    vcresult->type = H64VALTYPE_BOOL;
-                    vcresult->int_value = 1;
-                } else {
-                    vcresult->type = H64VALTYPE_INT64;
-                    vcresult->int_value = found_at;
-                }
-                return 1;
-            }
-        }
-        valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
-        DELREF_NONHEAP(vcresult);
-        valuecontent_Free(vmthread, vcresult);
-        memset(vcresult, 0, sizeof(*vcresult));
-        if (iscontains) {
-            vcresult->type = H64VALTYPE_BOOL;
-            vcresult->int_value = 0;
-        } else {
-            vcresult->type = H64VALTYPE_INT64;
-            vcresult->int_value = -1;
+        if (likely(paramlen > 0)) {
+            h64searcher sr;
+            vmbytes_SearcherInit(&sr, params, paramlen);
+            found_at = vmbytes_SearcherFind(&sr, bs, bslen);
         }
-        ADDREF_NONHEAP(vcresult);
-        return 1;
     }
+
+    // Return result:
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memset(vcresult, 0, sizeof(*vcresult));
+    if (iscontains) {
+        vcresult->type = H64VALTYPE_BOOL;
+        vcresult->int_value = (found_at >= 0);
+    } else {
+        vcresult->type = H64VALTYPE_INT64;
+        vcresult->int_value = found_at;
+    }
+    return 1;
 }
 
 int corelib_stringdecode(  // $$builtin.$$string_decode
@@ -541,14 +554,16 @@ int corelib_stringsub(  // $$builtin.$$string_sub
         h64wchar *s = NULL;
         int64_t slen = 0;
         int64_t sletters = 0;
+        h64stringval *sval = NULL;
         if (vc->type == H64VALTYPE_GCVAL) {
             assert(((h64gcvalue *)vc->ptr_value)->type ==
                    H64GCVALUETYPE_STRING);
             h64gcvalue *gcv = ((h64gcvalue *)vc->ptr_value);
-            vmstrings_RequireLetterLen(&gcv->str_val);
-            s = gcv->str_val.s;
-            slen = gcv->str_val.len;
-            sletters = gcv->str_val.letterlen;
+            sval = &gcv->str_val;
+            vmstrings_RequireLetterLen(sval);
+            s = sval->s;
+            slen = sval->len;
+            sletters = sval->letterlen;
         } else {
             assert(vc->type == H64VALTYPE_SHORTSTR);
             s = vc->shortstr_value;
@@ -571,65 +586,60 @@ int corelib_stringsub(  // $$builtin.$$string_sub
             vcresult->shortstr_len = 0;
             return 1;
         }
-        int64_t scopylen = 0;
-        h64wchar *scopy = malloc(
-            (slen > 1 ? slen : 1) * sizeof(*scopy)
-        );
-        if (!scopy)
-            return vmexec_ReturnFuncError(
-                vmthread, H64STDERROR_OUTOFMEMORYERROR,
-                "out of memory returning substring"
-            );
         if (startindex == 1 && endindex == sletters) {
-            memcpy(scopy, s, slen * sizeof(*scopy));
-            scopylen = slen;
+            // Strings are immutable, so just return the same one:
+            memcpy(vcresult, vc, sizeof(*vc));
+            ADDREF_NONHEAP(vcresult);
+            return 1;
+        }
+        int64_t startcodepoint = 0;
+        int64_t endcodepoint = 0;
+        if (sval != NULL) {
+            startcodepoint = vmstrings_LetterOffset(
+                sval, startindex - 1
+            );
+            endcodepoint = vmstrings_LetterOffset(
+                sval, endindex  // EXCLUSIVE end
+            );
         } else {
-            int16_t startcodepoint = 0;
-            {
-                const h64wchar *p = s;
-                int64_t plen = slen;
-                int64_t k = startindex;
-                while (k > 1 && plen > 0) {
-                    int letterlen = utf32_letter_len(
-                        p, plen
-                    );
-                    k--;
-                    startcodepoint += letterlen;
-                    p += letterlen;
-                    plen -= letterlen;
-                }
-            }
-            int16_t endcodepoint = 0;
-            {
-                const h64wchar *p = s;
-                int64_t plen = slen;
-                int64_t k = endindex;
-                while (k > 0 && plen > 0) {  // k > 0 -> EXCLUSIVE end
-                    int letterlen = utf32_letter_len(
-                        p, plen
-                    );
-                    k--;
-                    endcodepoint += letterlen;
-                    p += letterlen;
-                    plen -= letterlen;
-                }
+            const h64wchar *p = s;
+            int64_t plen = slen;
+            int64_t k = 1;
+            while (k < endindex + 1 && plen > 0) {
+                if (k == startindex)
+                    startcodepoint = (p - s);
+                int letterlen = utf32_letter_len(
+                    p, plen
+                );
+                k++;
+                p += letterlen;
+                plen -= letterlen;
             }
-            memcpy(
-                scopy, s + startcodepoint,
-                (endcodepoint - startcodepoint) * sizeof(*scopy)
+            endcodepoint = (p - s);  // EXCLUSIVE end
+        }
+        int result = 0;
+        if (sval != NULL) {
+            // This may share the buffer rather than copy:
+            result = vmstrings_SetSlice(
+                vmthread, vcresult, (h64gcvalue *)vc->ptr_value,
+                startcodepoint, endcodepoint - startcodepoint
+            );
+        } else {
+            result = valuecontent_SetStringU32(
+                vmthread, vcresult, s + startcodepoint,
+                endcodepoint - startcodepoint
             );
-            scopylen = (endcodepoint - startcodepoint);
         }
-        if (!valuecontent_SetStringU32(
-                vmthread, vcresult, scopy, scopylen
-                )) {
-            free(scopy);
+        if (!result) {
             return vmexec_ReturnFuncError(
                 vmthread, H64STDERROR_OUTOFMEMORYERROR,
                 "out of memory returning substring"
             );
         }
-        free(scopy);
+        if (vcresult->type == H64VALTYPE_GCVAL)
+            ((h64gcvalue *)vcresult->ptr_value)->str_val.letterlen = (
+                endindex - startindex + 1
+            );
         ADDREF_NONHEAP(vcresult);
         return 1;
     } else {
@@ -661,35 +671,29 @@ int corelib_stringsub(  // $$builtin.$$string_sub
             vcresult->shortstr_len = 0;
             return 1;
         }
-        int64_t scopylen = 0;
-        char *scopy = malloc(
-            (slen > 1 ? slen : 1) * sizeof(*scopy)
-        );
-        if (!scopy)
-            return vmexec_ReturnFuncError(
-                vmthread, H64STDERROR_OUTOFMEMORYERROR,
-                "out of memory returning substring"
-            );
         if (startindex == 1 && endindex == slen) {
-            memcpy(scopy, s, slen * sizeof(*scopy));
-            scopylen = slen;
+            memcpy(vcresult, vc, sizeof(*vc));
+            ADDREF_NONHEAP(vcresult);
+            return 1;
+        }
+        int result = 0;
+        if (vc->type == H64VALTYPE_GCVAL) {
+            result = vmbytes_SetSlice(
+                vmthread, vcresult, (h64gcvalue *)vc->ptr_value,
+                startindex - 1, (endindex - startindex) + 1
+            );
         } else {
-            memcpy(
-                scopy, s + startindex,
-                ((endindex - startindex) + 1) * sizeof(*scopy)
+            result = valuecontent_SetBytesU8(
+                vmthread, vcresult, (uint8_t *)s + (startindex - 1),
+                (endindex - startindex) + 1
             );
-            scopylen = ((endindex - startindex) + 1);
         }
-        if (!valuecontent_SetBytesU8(
-                vmthread, vcresult, (uint8_t *)scopy, scopylen
-                )) {
-            free(scopy);
+        if (!result) {
             return vmexec_ReturnFuncError(
                 vmthread, H64STDERROR_OUTOFMEMORYERROR,
                 "out of memory returning substring"
             );
         }
-        free(scopy);
         ADDREF_NONHEAP(vcresult);
         return 1;
     }
@@ -729,110 +733,430 @@ int corelib_stringfind(  // $$builtin.$$string_find
     return _contains_or_find(vmthread, 0);
 }
 
-int corelib_stringlower(  // $$builtin.$$string_lower
+int corelib_stringcount(  // $$builtin.$$string_count
         h64vmthread *vmthread
         ) {
-    assert(STACK_TOP(vmthread->stack) == 1);
+    assert(STACK_TOP(vmthread->stack) >= 2);
 
-    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
-    assert(
-        (vc->type == H64VALTYPE_GCVAL &&
-         ((h64gcvalue *)vc->ptr_value)->type == H64GCVALUETYPE_STRING) ||
-        vc->type == H64VALTYPE_SHORTSTR
-    );
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 1);
+    valuecontent *vparam = STACK_ENTRY(vmthread->stack, 0);
+    int64_t count = 0;
+    h64wchar *s = NULL; int64_t slen = 0;
+    h64stringval *sval = NULL;
+    if (_getstrarg(vc, &s, &slen, &sval)) {
+        h64wchar *params = NULL; int64_t paramlen = 0;
+        if (!_getstrarg(vparam, &params, &paramlen, NULL)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_TYPEERROR,
+                "count on strings needs a string parameter"
+            );
+        }
+        if (paramlen <= 0) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "cannot count empty string"
+            );
+        }
+        _lettersearch ls;
+        _lettersearch_Init(&ls, s, slen, sval, params, paramlen);
+        int64_t pos = 0;
+        while ((pos = _lettersearch_Next(&ls, pos, NULL)) >= 0) {
+            count++;
+            pos += paramlen;
+        }
+    } else {
+        char *bs = NULL; int64_t bslen = 0;
+        int result = _getbytesarg(vc, &bs, &bslen);
+        assert(result != 0);
+        (void)result;
+        char *params = NULL; int64_t paramlen = 0;
+        if (!_getbytesarg(vparam, &params, &paramlen)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_TYPEERROR,
+                "count on bytes needs a bytes parameter"
+            );
+        }
+        if (paramlen <= 0) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "cannot count empty bytes"
+            );
+        }
+        h64searcher sr;
+        vmbytes_SearcherInit(&sr, params, paramlen);
+        int64_t pos = 0;
+        int64_t found = -1;
+        while ((found = vmbytes_SearcherFind(
+                &sr, bs + pos, bslen - pos)) >= 0) {
+            count++;
+            pos += found + paramlen;
+        }
+    }
 
-    h64wchar *results = NULL;
-    h64wchar *s = NULL;
-    int64_t slen = 0;
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memset(vcresult, 0, sizeof(*vcresult));
+    vcresult->type = H64VALTYPE_INT64;
+    vcresult->int_value = count;
+    return 1;
+}
 
-    if (vc->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue *)vc->ptr_value)->type == H64GCVALUETYPE_STRING) {
-        s = ((h64gcvalue *)vc->ptr_value)->str_val.s;
-        slen = ((h64gcvalue *)vc->ptr_value)->str_val.len;
-    } else {
-        assert(vc->type == H64VALTYPE_SHORTSTR);
-        s = vc->shortstr_value;
-        slen = vc->shortstr_len;
+static int _appendbuf(
+        char **buf, int64_t *buflen, int64_t *bufalloc,
+        const void *data, int64_t datalen
+        ) {
+    if (*buflen + datalen > *bufalloc) {
+        int64_t new_alloc = (*bufalloc) * 2;
+        if (new_alloc < *buflen + datalen)
+            new_alloc = *buflen + datalen;
+        if (new_alloc < 16)
+            new_alloc = 16;
+        char *new_buf = realloc(*buf, new_alloc);
+        if (!new_buf)
+            return 0;
+        *buf = new_buf;
+        *bufalloc = new_alloc;
     }
-    results = malloc(sizeof(*results) * (slen > 0 ? slen : 1));
-    if (!results) {
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_OUTOFMEMORYERROR,
-            "out of memory allocating lower buffer"
-        );
+    if (datalen > 0)
+        memcpy(*buf + *buflen, data, datalen);
+    *buflen += datalen;
+    return 1;
+}
+
+int corelib_stringreplace(  // $$builtin.$$string_replace
+        h64vmthread *vmthread
+        ) {
+    assert(STACK_TOP(vmthread->stack) >= 3);
+
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 2);
+    valuecontent *vold = STACK_ENTRY(vmthread->stack, 1);
+    valuecontent *vnew = STACK_ENTRY(vmthread->stack, 0);
+    // The result is assembled as raw bytes in both cases, for strings
+    // these are just the h64wchar code points:
+    char *result = NULL;
+    int64_t resultlen = 0;
+    int64_t resultalloc = 0;
+    int isbytes = 0;
+    h64wchar *s = NULL; int64_t slen = 0;
+    h64stringval *sval = NULL;
+    if (_getstrarg(vc, &s, &slen, &sval)) {
+        h64wchar *olds = NULL; int64_t oldlen = 0;
+        h64wchar *news = NULL; int64_t newlen = 0;
+        if (!_getstrarg(vold, &olds, &oldlen, NULL) ||
+                !_getstrarg(vnew, &news, &newlen, NULL)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_TYPEERROR,
+                "replace on strings needs string parameters"
+            );
+        }
+        if (oldlen <= 0) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "cannot replace empty string"
+            );
+        }
+        _lettersearch ls;
+        _lettersearch_Init(&ls, s, slen, sval, olds, oldlen);
+        int64_t pos = 0;
+        int64_t found = -1;
+        while ((found = _lettersearch_Next(&ls, pos, NULL)) >= 0) {
+            if (!_appendbuf(&result, &resultlen, &resultalloc,
+                    s + pos, (found - pos) * sizeof(*s)) ||
+                    !_appendbuf(&result, &resultlen, &resultalloc,
+                    news, newlen * sizeof(*news)))
+                goto oomreplace;
+            pos = found + oldlen;
+        }
+        if (!_appendbuf(&result, &resultlen, &resultalloc,
+                s + pos, (slen - pos) * sizeof(*s)))
+            goto oomreplace;
+    } else {
+        isbytes = 1;
+        char *bs = NULL; int64_t bslen = 0;
+        int isvalid = _getbytesarg(vc, &bs, &bslen);
+        assert(isvalid != 0);
+        (void)isvalid;
+        char *olds = NULL; int64_t oldlen = 0;
+        char *news = NULL; int64_t newlen = 0;
+        if (!_getbytesarg(vold, &olds, &oldlen) ||
+                !_getbytesarg(vnew, &news, &newlen)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_TYPEERROR,
+                "replace on bytes needs bytes parameters"
+            );
+        }
+        if (oldlen <= 0) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "cannot replace empty bytes"
+            );
+        }
+        h64searcher sr;
+        vmbytes_SearcherInit(&sr, olds, oldlen);
+        int64_t pos = 0;
+        int64_t found = -1;
+        while ((found = vmbytes_SearcherFind(
+                &sr, bs + pos, bslen - pos)) >= 0) {
+            if (!_appendbuf(&result, &resultlen, &resultalloc,
+                    bs + pos, found) ||
+                    !_appendbuf(&result, &resultlen, &resultalloc,
+                    news, newlen))
+                goto oomreplace;
+            pos += found + oldlen;
+        }
+        if (!_appendbuf(&result, &resultlen, &resultalloc,
+                bs + pos, bslen - pos))
+            goto oomreplace;
     }
-    memcpy(results, s, sizeof(*s) * slen);
-    utf32_tolower(results, slen);
 
+    // Return result:
     valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
     DELREF_NONHEAP(vcresult);
     valuecontent_Free(vmthread, vcresult);
     memset(vcresult, 0, sizeof(*vcresult));
-    if (!valuecontent_SetStringU32(
-            vmthread, vcresult, results, slen)) {
-        free(results);
-        return vmexec_ReturnFuncError(
-            vmthread, H64STDERROR_OUTOFMEMORYERROR,
-            "out of memory allocating lower result"
+    int setresult = 0;
+    if (isbytes) {
+        setresult = valuecontent_SetBytesU8(
+            vmthread, vcresult, (uint8_t *)result, resultlen
+        );
+    } else {
+        setresult = valuecontent_SetStringU32(
+            vmthread, vcresult, (h64wchar *)result,
+            resultlen / sizeof(h64wchar)
         );
     }
-    free(results);
+    if (!setresult)
+        goto oomreplace;
+    free(result);
     ADDREF_NONHEAP(vcresult);
     return 1;
+
+    oomreplace:
+    free(result);
+    return vmexec_ReturnFuncError(
+        vmthread, H64STDERROR_OUTOFMEMORYERROR,
+        "out of memory computing replace result"
+    );
 }
 
-int corelib_stringupper(  // $$builtin.$$string_upper
-        h64vmthread *vmthread
+static int _addsplitpart(
+        h64vmthread *vmthread, genericlist *l, int isbytes,
+        const void *part, int64_t partlen
         ) {
-    assert(STACK_TOP(vmthread->stack) == 1);
-
-    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
-    assert(
-        (vc->type == H64VALTYPE_GCVAL &&
-         ((h64gcvalue *)vc->ptr_value)->type == H64GCVALUETYPE_STRING) ||
-        vc->type == H64VALTYPE_SHORTSTR
-    );
+    valuecontent vpart = {0};
+    int result = 0;
+    if (isbytes) {
+        result = valuecontent_SetBytesU8(
+            vmthread, &vpart, (uint8_t *)part, partlen
+        );
+    } else {
+        result = valuecontent_SetStringU32(
+            vmthread, &vpart, (const h64wchar *)part, partlen
+        );
+    }
+    if (!result)
+        return 0;
+    ADDREF_NONHEAP(&vpart);
+    result = vmlist_Add(l, &vpart);
+    DELREF_NONHEAP(&vpart);
+    valuecontent_Free(vmthread, &vpart);
+    return result;
+}
 
-    h64wchar *results = NULL;
-    h64wchar *s = NULL;
-    int64_t slen = 0;
+int corelib_stringsplit(  // $$builtin.$$string_split
+        h64vmthread *vmthread
+        ) {
+    assert(STACK_TOP(vmthread->stack) >= 2);
 
-    if (vc->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue *)vc->ptr_value)->type == H64GCVALUETYPE_STRING) {
-        s = ((h64gcvalue *)vc->ptr_value)->str_val.s;
-        slen = ((h64gcvalue *)vc->ptr_value)->str_val.len;
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 1);
+    valuecontent *vparam = STACK_ENTRY(vmthread->stack, 0);
+    h64wchar *s = NULL; int64_t slen = 0;
+    h64stringval *sval = NULL;
+    char *bs = NULL; int64_t bslen = 0;
+    int isbytes = 0;
+    if (_getstrarg(vc, &s, &slen, &sval)) {
+        h64wchar *params = NULL; int64_t paramlen = 0;
+        if (!_getstrarg(vparam, &params, &paramlen, NULL)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_TYPEERROR,
+                "split on strings needs a string parameter"
+            );
+        }
+        if (paramlen <= 0) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "cannot split by empty string"
+            );
+        }
     } else {
-        assert(vc->type == H64VALTYPE_SHORTSTR);
-        s = vc->shortstr_value;
-        slen = vc->shortstr_len;
+        isbytes = 1;
+        int result = _getbytesarg(vc, &bs, &bslen);
+        assert(result != 0);
+        (void)result;
+        char *params = NULL; int64_t paramlen = 0;
+        if (!_getbytesarg(vparam, &params, &paramlen)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_TYPEERROR,
+                "split on bytes needs a bytes parameter"
+            );
+        }
+        if (paramlen <= 0) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "cannot split by empty bytes"
+            );
+        }
     }
-    results = malloc(sizeof(*results) * (slen > 0 ? slen : 1));
-    if (!results) {
+
+    // Assemble the list off-stack first, since the parameter slot
+    // it will be returned in is still needed for searching:
+    valuecontent vlist = {0};
+    vlist.type = H64VALTYPE_GCVAL;
+    h64gcvalue *gcval = poolalloc_malloc(
+        vmthread->heap, 0
+    );
+    if (!gcval) {
         return vmexec_ReturnFuncError(
             vmthread, H64STDERROR_OUTOFMEMORYERROR,
-            "out of memory allocating upper buffer"
+            "out of memory computing split result"
         );
     }
-    memcpy(results, s, sizeof(*s) * slen);
-    utf32_toupper(results, slen);
+    memset(gcval, 0, sizeof(*gcval));
+    vlist.ptr_value = gcval;
+    gcval->type = H64GCVALUETYPE_LIST;
+    gcval->externalreferencecount = 1;
+    gcval->heapreferencecount = 0;
+    gcval->list_values = vmlist_New();
+    if (!gcval->list_values) {
+        poolalloc_free(vmthread->heap, gcval);
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory computing split result"
+        );
+    }
+    genericlist *l = gcval->list_values;
+    if (!isbytes) {
+        h64wchar *params = NULL; int64_t paramlen = 0;
+        _getstrarg(vparam, &params, &paramlen, NULL);
+        _lettersearch ls;
+        _lettersearch_Init(&ls, s, slen, sval, params, paramlen);
+        int64_t pos = 0;
+        int64_t found = -1;
+        while ((found = _lettersearch_Next(&ls, pos, NULL)) >= 0) {
+            if (!_addsplitpart(vmthread, l, 0, s + pos, found - pos))
+                goto oomsplit;
+            pos = found + paramlen;
+        }
+        if (!_addsplitpart(vmthread, l, 0, s + pos, slen - pos))
+            goto oomsplit;
+    } else {
+        char *params = NULL; int64_t paramlen = 0;
+        _getbytesarg(vparam, &params, &paramlen);
+        h64searcher sr;
+        vmbytes_SearcherInit(&sr, params, paramlen);
+        int64_t pos = 0;
+        int64_t found = -1;
+        while ((found = vmbytes_SearcherFind(
+                &sr, bs + pos, bslen - pos)) >= 0) {
+            if (!_addsplitpart(vmthread, l, 1, bs + pos, found))
+                goto oomsplit;
+            pos += found + paramlen;
+        }
+        if (!_addsplitpart(vmthread, l, 1, bs + pos, bslen - pos))
+            goto oomsplit;
+    }
 
+    // Return result, which already holds its reference:
     valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
     DELREF_NONHEAP(vcresult);
     valuecontent_Free(vmthread, vcresult);
-    memset(vcresult, 0, sizeof(*vcresult));
+    memcpy(vcresult, &vlist, sizeof(vlist));
+    return 1;
+
+    oomsplit:
+    DELREF_NONHEAP(&vlist);
+    valuecontent_Free(vmthread, &vlist);
+    return vmexec_ReturnFuncError(
+        vmthread, H64STDERROR_OUTOFMEMORYERROR,
+        "out of memory computing split result"
+    );
+}
+
+static int _lower_or_upper(
+        h64vmthread *vmthread, int islower
+        ) {
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+    h64wchar *s = NULL;
+    int64_t slen = 0;
+    int result = _getstrarg(vc, &s, &slen, NULL);
+    assert(result != 0);
+    (void)result;
+
+    int64_t firstchange = (
+        islower ? utf32_findnonlower(s, slen) :
+        utf32_findnonupper(s, slen)
+    );
+    if (firstchange < 0) {
+        // Nothing to change, so the string itself is the result:
+        return 1;
+    }
+
+    // Copy once into the result value, then convert that in-place:
+    valuecontent vresult = {0};
     if (!valuecontent_SetStringU32(
-            vmthread, vcresult, results, slen)) {
-        free(results);
+            vmthread, &vresult, s, slen)) {
         return vmexec_ReturnFuncError(
             vmthread, H64STDERROR_OUTOFMEMORYERROR,
-            "out of memory allocating upper result"
+            "out of memory allocating %s result",
+            (islower ? "lower" : "upper")
         );
     }
-    free(results);
+    h64wchar *results = (
+        vresult.type == H64VALTYPE_SHORTSTR ? vresult.shortstr_value :
+        ((h64gcvalue *)vresult.ptr_value)->str_val.s
+    );
+    if (islower)
+        utf32_tolower(results + firstchange, slen - firstchange);
+    else
+        utf32_toupper(results + firstchange, slen - firstchange);
+
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memcpy(vcresult, &vresult, sizeof(vresult));
     ADDREF_NONHEAP(vcresult);
     return 1;
 }
 
+int corelib_stringlower(  // $$builtin.$$string_lower
+        h64vmthread *vmthread
+        ) {
+    assert(STACK_TOP(vmthread->stack) == 1);
+
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+    assert(
+        (vc->type == H64VALTYPE_GCVAL &&
+         ((h64gcvalue *)vc->ptr_value)->type == H64GCVALUETYPE_STRING) ||
+        vc->type == H64VALTYPE_SHORTSTR
+    );
+    return _lower_or_upper(vmthread, 1);
+}
+
+int corelib_stringupper(  // $$builtin.$$string_upper
+        h64vmthread *vmthread
+        ) {
+    assert(STACK_TOP(vmthread->stack) == 1);
+
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+    assert(
+        (vc->type == H64VALTYPE_GCVAL &&
+         ((h64gcvalue *)vc->ptr_value)->type == H64GCVALUETYPE_STRING) ||
+        vc->type == H64VALTYPE_SHORTSTR
+    );
+    return _lower_or_upper(vmthread, 0);
+}
+
 int corelib_stringtrim(  // $$builtin.$$string_trim
         h64vmthread *vmthread
         ) {
@@ -848,127 +1172,73 @@ int corelib_stringtrim(  // $$builtin.$$string_trim
         vc->type == H64VALTYPE_SHORTBYTES
     );
 
-    if ((vc->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue *)vc->ptr_value)->type == H64GCVALUETYPE_BYTES) ||
-            vc->type == H64VALTYPE_SHORTBYTES) {
-        // Bytes trim():
-        char *trimmed = NULL;
-        int64_t trimmedlen = 0;
-        char *s = NULL;
-        int64_t slen = 0;
-
-        if (vc->type == H64VALTYPE_GCVAL &&
-                ((h64gcvalue *)vc->ptr_value)->type == H64GCVALUETYPE_BYTES) {
-            s = ((h64gcvalue *)vc->ptr_value)->bytes_val.s;
-            slen = ((h64gcvalue *)vc->ptr_value)->bytes_val.len;
-        } else {
-            assert(vc->type == H64VALTYPE_SHORTBYTES);
-            s = vc->shortbytes_value;
-            slen = vc->shortbytes_len;
-        }
-        trimmed = malloc(slen > 0 ? slen : 1);
-        if (!trimmed) {
-            return vmexec_ReturnFuncError(
-                vmthread, H64STDERROR_OUTOFMEMORYERROR,
-                "out of memory allocating trim buffer"
-            );
-        }
-        int64_t skipstart = 0;
-        while (skipstart < slen &&
-                (s[skipstart] == ' ' || s[skipstart] == '\r' ||
-                s[skipstart] == '\t' || s[skipstart] == '\n')) {
+    #define _ISTRIMSPACE(c) (\
+        (c) == ' ' || (c) == '\r' || (c) == '\t' || (c) == '\n')
+    int isbytes = 0;
+    h64wchar *s = NULL;
+    char *bs = NULL;
+    int64_t slen = 0;
+    int64_t skipstart = 0;
+    int64_t skipend = 0;
+    if (_getstrarg(vc, &s, &slen, NULL)) {
+        while (skipstart < slen && _ISTRIMSPACE(s[skipstart]))
             skipstart++;
-        }
-        int64_t skipend = 0;
-        if (skipstart < slen) {
-            while (skipend < slen &&
-                    (s[slen - skipend - 1] == ' ' ||
-                    s[slen - skipend - 1] == '\r' ||
-                    s[slen - skipend - 1] == '\t' ||
-                    s[slen - skipend - 1] == '\n'))
-                skipend++;
-        }
-        trimmedlen = slen - skipstart - skipend;
-        if (trimmedlen > 0)
-            memcpy(
-                trimmed, s + skipstart,
-                sizeof(*s) * (slen - skipstart - skipend
-            ));
-        valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
-        DELREF_NONHEAP(vcresult);
-        valuecontent_Free(vmthread, vcresult);
-        memset(vcresult, 0, sizeof(*vcresult));
-        if (!valuecontent_SetBytesU8(
-                vmthread, vcresult, (uint8_t *)trimmed, trimmedlen)) {
-            free(trimmed);
-            return vmexec_ReturnFuncError(
-                vmthread, H64STDERROR_OUTOFMEMORYERROR,
-                "out of memory allocating trim result"
-            );
-        }
-        free(trimmed);
-        ADDREF_NONHEAP(vcresult);
-        return 1;
+        while (skipend < slen - skipstart &&
+                _ISTRIMSPACE(s[slen - skipend - 1]))
+            skipend++;
     } else {
-        // U32 trim():
-        h64wchar *trimmed = NULL;
-        int64_t trimmedlen = 0;
-        h64wchar *s = NULL;
-        int64_t slen = 0;
+        isbytes = 1;
+        int result = _getbytesarg(vc, &bs, &slen);
+        assert(result != 0);
+        (void)result;
+        while (skipstart < slen && _ISTRIMSPACE(bs[skipstart]))
+            skipstart++;
+        while (skipend < slen - skipstart &&
+                _ISTRIMSPACE(bs[slen - skipend - 1]))
+            skipend++;
+    }
+    #undef _ISTRIMSPACE
+    if (skipstart == 0 && skipend == 0) {
+        // Nothing to trim, so the value itself is the result:
+        return 1;
+    }
 
-        if (vc->type == H64VALTYPE_GCVAL &&
-                ((h64gcvalue *)vc->ptr_value)->type == H64GCVALUETYPE_STRING) {
-            s = ((h64gcvalue *)vc->ptr_value)->str_val.s;
-            slen = ((h64gcvalue *)vc->ptr_value)->str_val.len;
-        } else {
-            assert(vc->type == H64VALTYPE_SHORTSTR);
-            s = vc->shortstr_value;
-            slen = vc->shortstr_len;
-        }
-        trimmed = malloc(sizeof(*trimmed) * (slen > 0 ? slen : 1));
-        if (!trimmed) {
-            return vmexec_ReturnFuncError(
-                vmthread, H64STDERROR_OUTOFMEMORYERROR,
-                "out of memory allocating trim buffer"
+    // Assemble the result before letting go of the original, since
+    // it may be a slice sharing the original's buffer:
+    int64_t trimmedlen = slen - skipstart - skipend;
+    valuecontent vresult = {0};
+    int result = 0;
+    if (vc->type == H64VALTYPE_GCVAL) {
+        h64gcvalue *gcval = (h64gcvalue *)vc->ptr_value;
+        if (isbytes)
+            result = vmbytes_SetSlice(
+                vmthread, &vresult, gcval, skipstart, trimmedlen
             );
-        }
-        int64_t skipstart = 0;
-        while (skipstart < slen &&
-                (s[skipstart] == ' ' || s[skipstart] == '\r' ||
-                s[skipstart] == '\t' || s[skipstart] == '\n')) {
-            skipstart++;
-        }
-        int64_t skipend = 0;
-        if (skipstart < slen) {
-            while (skipend < slen &&
-                    (s[slen - skipend - 1] == ' ' ||
-                    s[slen - skipend - 1] == '\r' ||
-                    s[slen - skipend - 1] == '\t' ||
-                    s[slen - skipend - 1] == '\n'))
-                skipend++;
-        }
-        trimmedlen = slen - skipstart - skipend;
-        if (trimmedlen > 0)
-            memcpy(
-                trimmed, s + skipstart,
-                sizeof(*s) * (slen - skipstart - skipend
-            ));
-        valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
-        DELREF_NONHEAP(vcresult);
-        valuecontent_Free(vmthread, vcresult);
-        memset(vcresult, 0, sizeof(*vcresult));
-        if (!valuecontent_SetStringU32(
-                vmthread, vcresult, trimmed, trimmedlen)) {
-            free(trimmed);
-            return vmexec_ReturnFuncError(
-                vmthread, H64STDERROR_OUTOFMEMORYERROR,
-                "out of memory allocating trim result"
+        else
+            result = vmstrings_SetSlice(
+                vmthread, &vresult, gcval, skipstart, trimmedlen
             );
-        }
-        free(trimmed);
-        ADDREF_NONHEAP(vcresult);
-        return 1;
+    } else if (isbytes) {
+        result = valuecontent_SetBytesU8(
+            vmthread, &vresult, (uint8_t *)bs + skipstart, trimmedlen
+        );
+    } else {
+        result = valuecontent_SetStringU32(
+            vmthread, &vresult, s + skipstart, trimmedlen
+        );
     }
+    if (!result) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory allocating trim result"
+        );
+    }
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memcpy(vcresult, &vresult, sizeof(vresult));
+    ADDREF_NONHEAP(vcresult);
+    return 1;
 }
 
 int corelib_stringstarts(  // $$builtin.$$string_starts
@@ -1231,6 +1501,252 @@ int corelib_stringends(  // $$builtin.$$string_ends
     }
 }
 
+typedef struct _formatsegment {
+    const h64wchar *s;  // NULL if the contents are in shortbuf
+    int64_t len;
+    int owned;
+    h64wchar shortbuf[VALUECONTENT_SHORTSTRLEN];
+} _formatsegment;
+
+#define FORMAT_STACKSEGMENTS 16
+
+static int _format_addsegment(
+        _formatsegment **segs, int64_t *segcount, int64_t *segalloc,
+        _formatsegment *stacksegs, const h64wchar *s, int64_t len,
+        int owned
+        ) {
+    if (*segcount >= *segalloc) {
+        int64_t new_alloc = (*segalloc) * 2;
+        _formatsegment *new_segs = NULL;
+        if (*segs == stacksegs) {
+            new_segs = malloc(sizeof(*new_segs) * new_alloc);
+            if (new_segs)
+                memcpy(new_segs, *segs, sizeof(*new_segs) * (*segcount));
+        } else {
+            new_segs = realloc(*segs, sizeof(*new_segs) * new_alloc);
+        }
+        if (!new_segs)
+            return 0;
+        *segs = new_segs;
+        *segalloc = new_alloc;
+    }
+    (*segs)[*segcount].s = s;
+    (*segs)[*segcount].len = len;
+    (*segs)[*segcount].owned = owned;
+    (*segcount)++;
+    return 1;
+}
+
+int corelib_stringformat(  // $$builtin.$$string_format
+        h64vmthread *vmthread
+        ) {
+    // Replaces "{}" placeholders with the next list entry, "{N}" with
+    // the N-th list entry, or "{key}" with the given map's value.
+    // "{{" and "}}" are escapes for literal braces.
+    assert(STACK_TOP(vmthread->stack) >= 2);
+
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 1);
+    valuecontent *vvalues = STACK_ENTRY(vmthread->stack, 0);
+    h64wchar *s = NULL; int64_t slen = 0;
+    int isvalid = _getstrarg(vc, &s, &slen, NULL);
+    assert(isvalid != 0);
+    (void)isvalid;
+    genericlist *l = NULL;
+    genericmap *m = NULL;
+    if (vvalues->type == H64VALTYPE_GCVAL &&
+            ((h64gcvalue *)vvalues->ptr_value)->type ==
+                H64GCVALUETYPE_LIST) {
+        l = ((h64gcvalue *)vvalues->ptr_value)->list_values;
+    } else if (vvalues->type == H64VALTYPE_GCVAL &&
+            ((h64gcvalue *)vvalues->ptr_value)->type ==
+                H64GCVALUETYPE_MAP) {
+        m = ((h64gcvalue *)vvalues->ptr_value)->map_values;
+    } else {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "format values must be a list or map"
+        );
+    }
+
+    // Parse the format string once into literal parts and the already
+    // converted values, so the result can be allocated at its final
+    // size and filled without any intermediate strings:
+    _formatsegment stacksegs[FORMAT_STACKSEGMENTS];
+    _formatsegment *segs = stacksegs;
+    int64_t segcount = 0;
+    int64_t segalloc = FORMAT_STACKSEGMENTS;
+    int errortype = -1;
+    const char *errormsg = NULL;
+    int64_t nextidx = 1;
+    int64_t litstart = 0;
+    int64_t pos = 0;
+    while (pos < slen) {
+        if (s[pos] != '{' && s[pos] != '}') {
+            pos++;
+            continue;
+        }
+        if (pos + 1 < slen && s[pos + 1] == s[pos]) {
+            // Escaped brace, keep one of the two:
+            if (!_format_addsegment(
+                    &segs, &segcount, &segalloc, stacksegs,
+                    s + litstart, pos + 1 - litstart, 0))
+                goto oomformat;
+            pos += 2;
+            litstart = pos;
+            continue;
+        }
+        if (s[pos] == '}') {
+            errortype = H64STDERROR_VALUEERROR;
+            errormsg = "unexpected single \"}\" in format string";
+            goto errorformat;
+        }
+        int64_t keystart = pos + 1;
+        int64_t keyend = keystart;
+        while (keyend < slen && s[keyend] != '}' && s[keyend] != '{')
+            keyend++;
+        if (keyend >= slen || s[keyend] != '}') {
+            errortype = H64STDERROR_VALUEERROR;
+            errormsg = "unterminated \"{\" in format string";
+            goto errorformat;
+        }
+        if (pos > litstart && !_format_addsegment(
+                &segs, &segcount, &segalloc, stacksegs,
+                s + litstart, pos - litstart, 0))
+            goto oomformat;
+
+        // Look up the value for this placeholder:
+        valuecontent value = {0};
+        if (l != NULL) {
+            int64_t idx = 0;
+            if (keyend == keystart) {
+                idx = nextidx;
+            } else {
+                int64_t k = keystart;
+                while (k < keyend) {
+                    if (s[k] < '0' || s[k] > '9' ||
+                            idx > (INT64_MAX - 9) / 10) {
+                        errortype = H64STDERROR_VALUEERROR;
+                        errormsg = (
+                            "list format placeholder must be "
+                            "empty or a number"
+                        );
+                        goto errorformat;
+                    }
+                    idx = idx * 10 + (int64_t)(s[k] - '0');
+                    k++;
+                }
+            }
+            if (!vmlist_Get(l, idx, &value)) {
+                errortype = H64STDERROR_INDEXERROR;
+                errormsg = "format placeholder index out of range";
+                goto errorformat;
+            }
+            nextidx = idx + 1;
+        } else {
+            if (keyend == keystart) {
+                errortype = H64STDERROR_VALUEERROR;
+                errormsg = "map format placeholder must have a key";
+                goto errorformat;
+            }
+            valuecontent key = {0};
+            if (!valuecontent_SetStringU32(
+                    vmthread, &key, s + keystart, keyend - keystart))
+                goto oomformat;
+            int oom = 0;
+            int found = vmmap_Get(vmthread, m, &key, &value, &oom);
+            valuecontent_Free(vmthread, &key);
+            if (!found) {
+                if (oom)
+                    goto oomformat;
+                errortype = H64STDERROR_INDEXERROR;
+                errormsg = "format placeholder key not found";
+                goto errorformat;
+            }
+        }
+
+        // Strings are used in-place, everything else gets converted:
+        h64wchar *valuestr = NULL; int64_t valuelen = 0;
+        int owned = 0;
+        if (!_getstrarg(&value, &valuestr, &valuelen, NULL)) {
+            valuestr = corelib_value_to_str(
+                vmthread, &value, NULL, 0, &valuelen
+            );
+            if (!valuestr)
+                goto oomformat;
+            owned = 1;
+        }
+        if (!_format_addsegment(
+                &segs, &segcount, &segalloc, stacksegs,
+                valuestr, valuelen, owned)) {
+            if (owned)
+                free(valuestr);
+            goto oomformat;
+        }
+        if (value.type == H64VALTYPE_SHORTSTR) {
+            // Points into our local value, so it needs a copy:
+            _formatsegment *seg = &segs[segcount - 1];
+            memcpy(seg->shortbuf, valuestr, sizeof(*valuestr) * valuelen);
+            seg->s = NULL;
+        }
+        pos = keyend + 1;
+        litstart = pos;
+    }
+    if (pos > litstart && !_format_addsegment(
+            &segs, &segcount, &segalloc, stacksegs,
+            s + litstart, pos - litstart, 0))
+        goto oomformat;
+
+    // Allocate the result once and fill it:
+    int64_t resultlen = 0;
+    int64_t i = 0;
+    while (i < segcount) {
+        resultlen += segs[i].len;
+        i++;
+    }
+    valuecontent resultvc = {0};
+    h64wchar *result = NULL;
+    if (!valuecontent_AllocStringU32(
+            vmthread, &resultvc, resultlen, &result))
+        goto oomformat;
+    h64wchar *o = result;
+    i = 0;
+    while (i < segcount) {
+        memcpy(o, (segs[i].s ? segs[i].s : segs[i].shortbuf),
+               sizeof(*o) * segs[i].len);
+        o += segs[i].len;
+        if (segs[i].owned)
+            free((h64wchar *)segs[i].s);
+        i++;
+    }
+    assert(o == result + resultlen);
+    if (segs != stacksegs)
+        free(segs);
+
+    // Only now replace the values argument, which was in use:
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memcpy(vcresult, &resultvc, sizeof(*vcresult));
+    ADDREF_NONHEAP(vcresult);
+    return 1;
+
+    oomformat:
+    errortype = H64STDERROR_OUTOFMEMORYERROR;
+    errormsg = "out of memory computing format result";
+    errorformat:
+    i = 0;
+    while (i < segcount) {
+        if (segs[i].owned)
+            free((h64wchar *)segs[i].s);
+        i++;
+    }
+    if (segs != stacksegs)
+        free(segs);
+    return vmexec_ReturnFuncError(
+        vmthread, errortype, "%s", errormsg
+    );
+}
+
 int corelib_RegisterStringFuncs(h64program *p) {
     int64_t idx = -1;
 
@@ -1256,6 +1772,39 @@ int corelib_RegisterStringFuncs(h64program *p) {
     if (!corelib_RegisterStringsFunc(p, "find", idx))
         return 0;
 
+    // '$$string_count' function:
+    idx = h64program_RegisterCFunction(
+        p, "$$string_count", &corelib_stringcount,
+        NULL, 0, 1, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].input_stack_size++;  // for 'self'
+    if (!corelib_RegisterStringsFunc(p, "count", idx))
+        return 0;
+
+    // '$$string_replace' function:
+    idx = h64program_RegisterCFunction(
+        p, "$$string_replace", &corelib_stringreplace,
+        NULL, 0, 2, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].input_stack_size++;  // for 'self'
+    if (!corelib_RegisterStringsFunc(p, "replace", idx))
+        return 0;
+
+    // '$$string_split' function:
+    idx = h64program_RegisterCFunction(
+        p, "$$string_split", &corelib_stringsplit,
+        NULL, 0, 1, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].input_stack_size++;  // for 'self'
+    if (!corelib_RegisterStringsFunc(p, "split", idx))
+        return 0;
+
     // '$$string_trim' function:
     idx = h64program_RegisterCFunction(
         p, "$$string_trim", &corelib_stringtrim,
@@ -1344,6 +1893,17 @@ int corelib_RegisterStringFuncs(h64program *p) {
     if (!corelib_RegisterStringsFunc(p, "upper", idx))
         return 0;
 
+    // '$$string_format' function:
+    idx = h64program_RegisterCFunction(
+        p, "$$string_format", &corelib_stringformat,
+        NULL, 0, 1, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].input_stack_size++;  // for 'self'
+    if (!corelib_RegisterStringsFunc(p, "format", idx))
+        return 0;
+
     return 1;
 }
 
@@ -1355,7 +1915,8 @@ funcid_t corelib_GetStringFuncIdx(
         if (p->string_indexes.func_name_idx[i] == nameidx &&
                 (!isbytes || (
                  strcmp(p->string_indexes.func_name[i], "lower") != 0 &&
-                 strcmp(p->string_indexes.func_name[i], "upper") != 0)) &&
+                 strcmp(p->string_indexes.func_name[i], "upper") != 0 &&
+                 strcmp(p->string_indexes.func_name[i], "format") != 0)) &&
                 (isbytes || (
                  strcmp(p->string_indexes.func_name[i], "decode") != 0))
                 ) {
@@ -0,0 +1,298 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "compileconfig.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "corelib/errors.h"
+#include "corelib/moduleless.h"
+#include "corelib/moduleless_vectors.h"
+#include "debugsymbols.h"
+#include "gcvalue.h"
+#include "poolalloc.h"
+#include "stack.h"
+#include "valuecontentstruct.h"
+#include "vmexec.h"
+#include "vmlist.h"
+#include "vmvector.h"
+
+
+static int corelib_RegisterVectorsFunc(
+            h64program *p, const char *name,
+            funcid_t funcidx
+            ) {
+    char **new_func_name = realloc(
+        p->vector_indexes.func_name,
+        sizeof(*new_func_name) * (p->vector_indexes.func_count + 1)
+    );
+    if (!new_func_name)
+        return 0;
+    p->vector_indexes.func_name = new_func_name;
+    int64_t *new_name_idx = realloc(
+        p->vector_indexes.func_name_idx,
+        sizeof(*new_name_idx) * (p->vector_indexes.func_count + 1)
+    );
+    if (!new_name_idx)
+        return 0;
+    p->vector_indexes.func_name_idx = new_name_idx;
+    funcid_t *new_func_idx = realloc(
+        p->vector_indexes.func_idx,
+        sizeof(*new_func_idx) * (p->vector_indexes.func_count + 1)
+    );
+    if (!new_func_idx)
+        return 0;
+    p->vector_indexes.func_idx = new_func_idx;
+    p->vector_indexes.func_name[
+        p->vector_indexes.func_count
+    ] = strdup(name);
+    if (!p->vector_indexes.func_name[
+            p->vector_indexes.func_count])
+        return 0;
+    p->vector_indexes.func_idx[
+        p->vector_indexes.func_count
+    ] = funcidx;
+    p->vector_indexes.func_name_idx[
+        p->vector_indexes.func_count
+    ] = h64debugsymbols_AttributeNameToAttributeNameId(
+        p->symbols, name, 1, 1
+    );
+    if (p->vector_indexes.func_name_idx[
+            p->vector_indexes.func_count
+            ] < 0) {
+        free(p->vector_indexes.func_name[
+             p->vector_indexes.func_count]);
+        return 0;
+    }
+    p->vector_indexes.func_count++;
+    return 1;
+}
+
+static int _returnvectoropresult(
+        h64vmthread *vmthread, int opresult, valuecontent *result
+        ) {
+    if (opresult != VECTOROP_OK) {
+        if (opresult == VECTOROP_ERR_OOM) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                "out of memory in vector operation"
+            );
+        } else if (opresult == VECTOROP_ERR_OVERFLOW) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_OVERFLOWERROR,
+                "number range overflow"
+            );
+        } else if (opresult == VECTOROP_ERR_LENMISMATCH) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "vectors must have same length"
+            );
+        } else if (opresult == VECTOROP_ERR_EMPTY) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "vector must not be empty"
+            );
+        }
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "invalid types for vector operation"
+        );
+    }
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memcpy(vcresult, result, sizeof(*result));
+    ADDREF_NONHEAP(vcresult);
+    return 1;
+}
+
+int corelib_vectorsum(  // $$builtin.$$vector_sum
+        h64vmthread *vmthread
+        ) {
+    assert(STACK_TOP(vmthread->stack) == 1);
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+    assert(vc->type == H64VALTYPE_VECTOR);
+    valuecontent result = {0};
+    int opresult = vmvector_Sum(vc->vector, &result);
+    return _returnvectoropresult(vmthread, opresult, &result);
+}
+
+int corelib_vectormin(  // $$builtin.$$vector_min
+        h64vmthread *vmthread
+        ) {
+    assert(STACK_TOP(vmthread->stack) == 1);
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+    assert(vc->type == H64VALTYPE_VECTOR);
+    valuecontent result = {0};
+    int opresult = vmvector_MinMax(vc->vector, 0, &result);
+    return _returnvectoropresult(vmthread, opresult, &result);
+}
+
+int corelib_vectormax(  // $$builtin.$$vector_max
+        h64vmthread *vmthread
+        ) {
+    assert(STACK_TOP(vmthread->stack) == 1);
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+    assert(vc->type == H64VALTYPE_VECTOR);
+    valuecontent result = {0};
+    int opresult = vmvector_MinMax(vc->vector, 1, &result);
+    return _returnvectoropresult(vmthread, opresult, &result);
+}
+
+int corelib_vectordot(  // $$builtin.$$vector_dot
+        h64vmthread *vmthread
+        ) {
+    assert(STACK_TOP(vmthread->stack) == 2);
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 1);
+    assert(vc->type == H64VALTYPE_VECTOR);
+    valuecontent *vother = STACK_ENTRY(vmthread->stack, 0);
+    if (vother->type != H64VALTYPE_VECTOR) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "dot product needs a vector parameter"
+        );
+    }
+    valuecontent result = {0};
+    int opresult = vmvector_Dot(vc->vector, vother->vector, &result);
+    return _returnvectoropresult(vmthread, opresult, &result);
+}
+
+int corelib_vectoras_list(  // $$builtin.$$vector_as_list
+        h64vmthread *vmthread
+        ) {
+    assert(STACK_TOP(vmthread->stack) == 1);
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+    assert(vc->type == H64VALTYPE_VECTOR);
+    genericlist *l = vmvector_ToList(vc->vector);
+    if (!l) {
+        oom:
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory converting vector to list"
+        );
+    }
+    h64gcvalue *gcval = poolalloc_malloc(vmthread->heap, 0);
+    if (!gcval) {
+        vmlist_Free(l);
+        goto oom;
+    }
+    memset(gcval, 0, sizeof(*gcval));
+    gcval->type = H64GCVALUETYPE_LIST;
+    gcval->list_values = l;
+
+    // Note: vc is the same slot as the result, so free it only now:
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memset(vcresult, 0, sizeof(*vcresult));
+    vcresult->type = H64VALTYPE_GCVAL;
+    vcresult->ptr_value = gcval;
+    ADDREF_NONHEAP(vcresult);
+    return 1;
+}
+
+int corelib_containeras_vector(  // $$builtin.$$container_as_vector
+        h64vmthread *vmthread
+        ) {
+    assert(STACK_TOP(vmthread->stack) == 1);
+    valuecontent *vc = STACK_ENTRY(vmthread->stack, 0);
+    assert(vc->type == H64VALTYPE_GCVAL);
+    h64gcvalue *gcvalue = (h64gcvalue *)vc->ptr_value;
+    if (gcvalue->type != H64GCVALUETYPE_LIST) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "cannot .as_vector() on this container type"
+        );
+    }
+    h64vector *v = NULL;
+    int opresult = vmvector_FromList(gcvalue->list_values, &v);
+    if (opresult == VECTOROP_ERR_INVALIDTYPES) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_VALUEERROR,
+            "list must only contain numbers to convert to vector"
+        );
+    }
+    valuecontent result = {0};
+    if (opresult == VECTOROP_OK) {
+        result.type = H64VALTYPE_VECTOR;
+        result.vector = v;
+    }
+    return _returnvectoropresult(vmthread, opresult, &result);
+}
+
+int corelib_RegisterVectorFuncs(h64program *p) {
+    int64_t idx = -1;
+
+    // '$$vector_sum' function:
+    idx = h64program_RegisterCFunction(
+        p, "$$vector_sum", &corelib_vectorsum,
+        NULL, 0, 0, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].input_stack_size++;  // for 'self'
+    if (!corelib_RegisterVectorsFunc(p, "sum", idx))
+        return 0;
+
+    // '$$vector_min' function:
+    idx = h64program_RegisterCFunction(
+        p, "$$vector_min", &corelib_vectormin,
+        NULL, 0, 0, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].input_stack_size++;  // for 'self'
+    if (!corelib_RegisterVectorsFunc(p, "min", idx))
+        return 0;
+
+    // '$$vector_max' function:
+    idx = h64program_RegisterCFunction(
+        p, "$$vector_max", &corelib_vectormax,
+        NULL, 0, 0, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].input_stack_size++;  // for 'self'
+    if (!corelib_RegisterVectorsFunc(p, "max", idx))
+        return 0;
+
+    // '$$vector_dot' function:
+    idx = h64program_RegisterCFunction(
+        p, "$$vector_dot", &corelib_vectordot,
+        NULL, 0, 1, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].input_stack_size++;  // for 'self'
+    if (!corelib_RegisterVectorsFunc(p, "dot", idx))
+        return 0;
+
+    // '$$vector_as_list' function:
+    idx = h64program_RegisterCFunction(
+        p, "$$vector_as_list", &corelib_vectoras_list,
+        NULL, 0, 0, NULL, NULL, NULL, 1, -1
+    );
+    if (idx < 0)
+        return 0;
+    p->func[idx].input_stack_size++;  // for 'self'
+    if (!corelib_RegisterVectorsFunc(p, "as_list", idx))
+        return 0;
+
+    return 1;
+}
+
+funcid_t corelib_GetVectorFuncIdx(
+        h64program *p, int64_t nameidx
+        ) {
+    int i = 0;
+    while (i < p->vector_indexes.func_count) {
+        if (p->vector_indexes.func_name_idx[i] == nameidx)
+            return p->vector_indexes.func_idx[i];
+        i++;
+    }
+    return -1;
+}
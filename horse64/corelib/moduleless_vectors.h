@@ -0,0 +1,30 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef HORSE64_CORELIB_MODULELESS_VECTORS_H_
+#define HORSE64_CORELIB_MODULELESS_VECTORS_H_
+
+#include "valuecontentstruct.h"
+
+typedef struct h64program h64program;
+typedef struct h64vmthread h64vmthread;
+
+int corelib_RegisterVectorFuncs(h64program *p);
+
+typedef struct h64moduleless_vectors_indexes {
+    int func_count;
+    char **func_name;
+    funcid_t *func_idx;
+    int64_t *func_name_idx;
+} h64moduleless_vectors_indexes;
+
+funcid_t corelib_GetVectorFuncIdx(
+    h64program *p, int64_t nameidx
+);
+
+int corelib_containeras_vector(  // $$builtin.$$container_as_vector
+    h64vmthread *vmthread
+);
+
+#endif  // HORSE64_CORELIB_MODULELESS_VECTORS_H_
@@ -32,9 +32,16 @@
 
 
 typedef struct _connectionobj_cdata {
+    void (*on_destroy)(h64gcvalue *streamobj);
     h64socket *connection;
 } __attribute__((packed)) _connectionobj_cdata;
 
+static void _connectionobj_Destroy(h64gcvalue *streamobj) {
+    _connectionobj_cdata *cdata = streamobj->cdata;
+    sockets_Destroy(cdata->connection);
+    cdata->connection = NULL;
+}
+
 struct netlib_connect_asyncprogress {
     void (*abortfunc)(void *dataptr);
     h64asyncsysjob *resolve_job;
@@ -612,8 +619,10 @@ int netlib_connect(h64vmthread *vmthread) {
                 );
             }
             memset(cdata, 0, sizeof(*cdata));
+            cdata->on_destroy = &_connectionobj_Destroy;
             cdata->connection = asprogress->connection;
             asprogress->connection = NULL;
+            ((h64gcvalue *)vc->ptr_value)->cdata = cdata;
             if (asprogress->resolve_job) {
                 asyncjob_AbandonJob(asprogress->resolve_job);
                 asprogress->resolve_job = NULL;
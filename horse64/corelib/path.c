@@ -717,7 +717,9 @@ int pathlib_join(
     }
     int64_t i = 1;
     while (i <= len) {
-        valuecontent *component = vmlist_Get(l, i);
+        valuecontent _componentbuf;
+        vmlist_Get(l, i, &_componentbuf);
+        valuecontent *component = &_componentbuf;
         h64wchar *componentstr = NULL;
         int64_t componentlen = 0;
         if (component->type == H64VALTYPE_GCVAL &&
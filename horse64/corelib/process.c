@@ -86,7 +86,9 @@ int processlib_run(
         const int64_t listcount = vmlist_Count(arglist);
         int64_t i = 0;
         while (i < listcount) {
-            valuecontent *item = vmlist_Get(arglist, i);
+            valuecontent _itembuf;
+            vmlist_Get(arglist, i + 1, &_itembuf);
+            valuecontent *item = &_itembuf;
             if (item->type != H64VALTYPE_SHORTSTR &&
                     (item->type != H64VALTYPE_GCVAL ||
                      ((h64gcvalue *)item->ptr_value)->type ==
@@ -179,7 +181,9 @@ int processlib_run(
         asprogress->run_job->runcmd.argcount = argcount;
         int64_t i = 0;
         while (i < asprogress->run_job->runcmd.argcount) {
-            valuecontent *item = vmlist_Get(arglist, i);
+            valuecontent _itembuf;
+            vmlist_Get(arglist, i + 1, &_itembuf);
+            valuecontent *item = &_itembuf;
             h64wchar *args = NULL;
             int64_t arglen = 0;
             if (item->type == H64VALTYPE_SHORTSTR) {
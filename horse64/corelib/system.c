@@ -6,18 +6,26 @@
 #include "compileconfig.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
 #include "corelib/errors.h"
 #include "corelib/system.h"
+#include "datetime.h"
 #include "filesys32.h"
+#include "gcvalue.h"
 #include "osinfo.h"
 #include "packageversion.h"
 #include "poolalloc.h"
 #include "stack.h"
+#include "threading.h"
 #include "valuecontentstruct.h"
 #include "vmexec.h"
+#include "vmlist.h"
+#include "vmmap.h"
+#include "vmschedule.h"
 #include "vmstrings.h"
 #include "widechar.h"
 
@@ -197,6 +205,231 @@ int systemlib_vm_exec_path(
     return 1;
 }
 
+int systemlib_workers(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Get the amount of worker threads the program runs its code on.
+     * This is picked when the program starts, based on the processor
+     * cores or the --vm-workers option of "horsec run".
+     *
+     * @func workers
+     * @returns the worker count as a @see{number}.
+     */
+    assert(STACK_TOP(vmthread->stack) >= 0);
+    if (STACK_TOP(vmthread->stack) < 1) {
+        if (!stack_ToSize(
+                vmthread->stack, vmthread,
+                vmthread->stack->entry_count + 1, 0)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                "out of memory allocating return value"
+            );
+        }
+    }
+
+    valuecontent *retval = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(retval);
+    valuecontent_Free(vmthread, retval);
+    memset(retval, 0, sizeof(*retval));
+    retval->type = H64VALTYPE_INT64;
+    retval->int_value = (
+        vmthread->vmexec_owner->worker_overview->worker_count
+    );
+    return 1;
+}
+
+static int _systemlib_SetMapNumber(
+        h64vmthread *vmthread, genericmap *m,
+        const char *key, int64_t value
+        ) {
+    valuecontent vkey = {0};
+    if (!valuecontent_SetStringU8(vmthread, &vkey, key))
+        return 0;
+    ADDREF_NONHEAP(&vkey);
+    valuecontent vvalue = {0};
+    vvalue.type = H64VALTYPE_INT64;
+    vvalue.int_value = value;
+    int result = vmmap_Set(vmthread, m, &vkey, &vvalue);
+    DELREF_NONHEAP(&vkey);
+    valuecontent_Free(vmthread, &vkey);
+    return result;
+}
+
+int systemlib_worker_stats(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Get utilization counters for each worker thread, for example
+     * to check whether the work is spread out evenly. The counters
+     * start at zero when the program launches.
+     *
+     * @func worker_stats
+     * @returns a @see{list} with a @see{map} for each worker, with
+     *     the keys "runs" (how often it picked up code to run),
+     *     "steals" (how many of those it took from another worker),
+     *     "parks" (how often it went to sleep for lack of work),
+     *     "idle_ms" and "busy_ms" (how long it was asleep or awake
+     *     in milliseconds).
+     */
+    assert(STACK_TOP(vmthread->stack) >= 0);
+    if (STACK_TOP(vmthread->stack) < 1) {
+        if (!stack_ToSize(
+                vmthread->stack, vmthread,
+                vmthread->stack->entry_count + 1, 0)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                "out of memory allocating return value"
+            );
+        }
+    }
+
+    valuecontent vlist = {0};
+    h64gcvalue *gcval = poolalloc_malloc(vmthread->heap, 0);
+    if (!gcval)
+        goto oom;
+    memset(gcval, 0, sizeof(*gcval));
+    gcval->type = H64GCVALUETYPE_LIST;
+    gcval->hash = -1;
+    gcval->externalreferencecount = 1;
+    gcval->list_values = vmlist_New();
+    if (!gcval->list_values) {
+        poolalloc_free(vmthread->heap, gcval);
+        goto oom;
+    }
+    vlist.type = H64VALTYPE_GCVAL;
+    vlist.ptr_value = gcval;
+
+    h64vmworkerset *wset = vmthread->vmexec_owner->worker_overview;
+    int64_t now = datetime_Ticks();
+    int64_t uptime = now - (int64_t)wset->start_ticks;
+    int i = 0;
+    while (i < wset->worker_count) {
+        h64vmworker *w = wset->worker[i];
+        int64_t idle_ms = atomic_load(&w->stat_parked_ms);
+        int64_t parked_since = atomic_load(&w->stat_parked_since);
+        if (parked_since > 0 && now > parked_since)
+            idle_ms += now - parked_since;
+        if (idle_ms > uptime)
+            idle_ms = uptime;
+
+        valuecontent vmap = {0};
+        h64gcvalue *mapval = poolalloc_malloc(vmthread->heap, 0);
+        if (!mapval)
+            goto oom;
+        memset(mapval, 0, sizeof(*mapval));
+        mapval->type = H64GCVALUETYPE_MAP;
+        mapval->hash = -1;
+        mapval->map_values = vmmap_New();
+        if (!mapval->map_values) {
+            poolalloc_free(vmthread->heap, mapval);
+            goto oom;
+        }
+        vmap.type = H64VALTYPE_GCVAL;
+        vmap.ptr_value = mapval;
+        ADDREF_NONHEAP(&vmap);
+        if (!_systemlib_SetMapNumber(vmthread, mapval->map_values,
+                "runs", atomic_load(&w->stat_runs)) ||
+                !_systemlib_SetMapNumber(vmthread, mapval->map_values,
+                "steals", atomic_load(&w->stat_steals)) ||
+                !_systemlib_SetMapNumber(vmthread, mapval->map_values,
+                "parks", atomic_load(&w->stat_parks)) ||
+                !_systemlib_SetMapNumber(vmthread, mapval->map_values,
+                "idle_ms", idle_ms) ||
+                !_systemlib_SetMapNumber(vmthread, mapval->map_values,
+                "busy_ms", uptime - idle_ms) ||
+                !vmlist_Add(gcval->list_values, &vmap)) {
+            DELREF_NONHEAP(&vmap);
+            valuecontent_Free(vmthread, &vmap);
+            goto oom;
+        }
+        DELREF_NONHEAP(&vmap);
+        valuecontent_Free(vmthread, &vmap);
+        i++;
+    }
+
+    valuecontent *retval = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(retval);
+    valuecontent_Free(vmthread, retval);
+    memcpy(retval, &vlist, sizeof(vlist));
+    return 1;
+
+    oom: ;
+    DELREF_NONHEAP(&vlist);
+    valuecontent_Free(vmthread, &vlist);
+    return vmexec_ReturnFuncError(
+        vmthread, H64STDERROR_OUTOFMEMORYERROR,
+        "out of memory allocating return value"
+    );
+}
+
+int systemlib_set_worker_cpus(
+        h64vmthread *vmthread
+        ) {
+    /**
+     * Pin the worker threads to the given processor cores, such that
+     * the program stays off all others. The workers are spread over
+     * the given cores in turn, one core each. This is like the
+     * --vm-worker-cpus option of "horsec run", but can be used while
+     * the program is running.
+     *
+     * @func set_worker_cpus
+     * @param cpus a @see{list} of the core numbers to use, starting
+     *     with 0 for the first core.
+     * @returns yes if the workers were moved, or no if that isn't
+     *     supported on this platform.
+     */
+    assert(STACK_TOP(vmthread->stack) >= 1);
+
+    valuecontent *vccpus = STACK_ENTRY(vmthread->stack, 0);
+    if (vccpus->type != H64VALTYPE_GCVAL ||
+            ((h64gcvalue *)vccpus->ptr_value)->type !=
+                H64GCVALUETYPE_LIST) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_TYPEERROR,
+            "cpus must be a list"
+        );
+    }
+    genericlist *l = ((h64gcvalue *)vccpus->ptr_value)->list_values;
+    threadcpuset cpus = {0};
+    const int64_t listcount = vmlist_Count(l);
+    if (listcount <= 0) {
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_VALUEERROR,
+            "cpus must not be empty"
+        );
+    }
+    int64_t k = 0;
+    while (k < listcount) {
+        valuecontent item = {0};
+        vmlist_Get(l, k + 1, &item);
+        if (item.type != H64VALTYPE_INT64) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_TYPEERROR,
+                "each entry in cpus must be a number"
+            );
+        }
+        if (item.int_value < 0 ||
+                item.int_value >= osinfo_CpuThreads() ||
+                !threadcpuset_Add(&cpus, item.int_value)) {
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_VALUEERROR,
+                "cpu %" PRId64 " does not exist", item.int_value
+            );
+        }
+        k++;
+    }
+    int result = vmschedule_SetWorkerCpus(vmthread->vmexec_owner, &cpus);
+
+    valuecontent *retval = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(retval);
+    valuecontent_Free(vmthread, retval);
+    memset(retval, 0, sizeof(*retval));
+    retval->type = H64VALTYPE_BOOL;
+    retval->int_value = (result != 0);
+    return 1;
+}
+
 int systemlib_RegisterFuncsAndModules(h64program *p) {
     // system.cores:
     const char *system_cores_kw_arg_name[] = {
@@ -223,6 +456,33 @@ int systemlib_RegisterFuncsAndModules(h64program *p) {
     if (idx < 0)
         return 0;
 
+    // system.workers:
+    idx = h64program_RegisterCFunction(
+        p, "workers", &systemlib_workers,
+        NULL, 0, 0, NULL,  // fileuri, args
+        "system", "core.horse64.org", 1, -1
+    );
+    if (idx < 0)
+        return 0;
+
+    // system.worker_stats:
+    idx = h64program_RegisterCFunction(
+        p, "worker_stats", &systemlib_worker_stats,
+        NULL, 0, 0, NULL,  // fileuri, args
+        "system", "core.horse64.org", 1, -1
+    );
+    if (idx < 0)
+        return 0;
+
+    // system.set_worker_cpus:
+    idx = h64program_RegisterCFunction(
+        p, "set_worker_cpus", &systemlib_set_worker_cpus,
+        NULL, 0, 1, NULL,  // fileuri, args
+        "system", "core.horse64.org", 1, -1
+    );
+    if (idx < 0)
+        return 0;
+
     // system.platform:
     const char *system_platform_kw_arg_name[] = {
         ""
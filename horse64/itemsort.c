@@ -12,209 +12,638 @@
 #include <string.h>
 
 #include "itemsort.h"
-#include "secrandom.h"
-#include "valuecontentstruct.h"
+#include "threading.h"
 
-// Job struct used in itemsort_Do:
-typedef struct _itemsort_quicksortjob {
+// Ranges up to this size are finished with insertion sort:
+#define ITEMSORT_INSERTION_MAX 24
+// Ranges above this size use a pseudo median of 9 as pivot:
+#define ITEMSORT_NINTHER_MIN 128
+// Element moves after which a partial insertion sort gives up:
+#define ITEMSORT_PARTIALINSERTION_LIMIT 8
+// Maximum item size, since we need some item-sized scratch buffers:
+#define ITEMSORT_MAX_ITEMSIZE 64
+
+typedef struct _itemsortctx {
+    char *data;
+    int64_t itemsize;
+    int (*compareFunc)(void *item1, void *item2);
+    int error;  // 0, or the CMP_ERR_* code of the first failure
+
+    // (uint64_t to get a suitable alignment for any item type)
+    uint64_t swapbuf[ITEMSORT_MAX_ITEMSIZE / sizeof(uint64_t)];
+    uint64_t pivotbuf[ITEMSORT_MAX_ITEMSIZE / sizeof(uint64_t)];
+} _itemsortctx;
+
+// Job struct used in _itemsort_Range, one per pending sub range:
+typedef struct _itemsort_pdqjob {
     int64_t start, end;
-} _itemsort_quicksortjob;
-
-// Helper macro for itemsort_Do:
-#define SORT_PUSHJOB(start_idx, end_idx) \
-    if (end_idx > start_idx) {\
-        if (jobs_count + 1 > jobs_alloc) {\
-            int64_t new_jobs_alloc = jobs_alloc * 32;\
-            if (new_jobs_alloc < jobs_count + 16)\
-                new_jobs_alloc = jobs_count + 16;\
-            _itemsort_quicksortjob *jobs_new = NULL;\
-            if (jobs_heap) {\
-                jobs_new = realloc(\
-                    jobs,\
-                    sizeof(*jobs) * new_jobs_alloc\
-                );\
-            } else {\
-                jobs_new = malloc(\
-                    sizeof(*jobs) * new_jobs_alloc\
-                );\
-                if (jobs_new && jobs_count > 0)\
-                    memcpy(jobs_new, jobs,\
-                        sizeof(*jobs) * jobs_count);\
-            }\
-            if (!jobs_new) {\
-                if (jobs_heap)\
-                    free(jobs);\
-                return 0;\
-            }\
-            jobs = jobs_new;\
-        }\
-        memset(&jobs[jobs_count], 0, sizeof(*jobs));\
-        jobs[jobs_count].start = start_idx;\
-        jobs[jobs_count].end = end_idx;\
-        jobs_count++;\
-    }\
+    int bad_allowed;
+    int leftmost;
+} _itemsort_pdqjob;
 
-// Helper macro for itemsort_Do:
 #define SORT_GETITEM(idx) \
-    (\
-        ((char*) sortdata) + itemsize * (int64_t)(idx)\
-    )
+    (ctx->data + ctx->itemsize * (int64_t)(idx))
 
-int itemsort_Do(
-        void *sortdata, int64_t sortdatabytes, int64_t itemsize,
-        int (*compareFunc)(void *item1, void *item2),
-        int *oom, int *unsortable
+// Compare helper, bails out of the calling function on error:
+#define SORT_CMP(result, item1, item2) \
+    result = ctx->compareFunc((item1), (item2));\
+    if (unlikely(result < -1)) {\
+        ctx->error = result;\
+        return 0;\
+    }
+
+static inline void _itemsort_Swap(
+        _itemsortctx *ctx, int64_t i, int64_t k
         ) {
-    /// This function is currently based on quick sort with heap
-    /// jobs (so no C stack recursion), and crypto random pivot.
-    /// Should be reworked to fall back to some other algo if taking
-    /// too many iterations, after which faster pseudo random pivots
-    /// could be used.
+    memcpy(ctx->swapbuf, SORT_GETITEM(i), ctx->itemsize);
+    memcpy(SORT_GETITEM(i), SORT_GETITEM(k), ctx->itemsize);
+    memcpy(SORT_GETITEM(k), ctx->swapbuf, ctx->itemsize);
+}
 
-    if (oom) *oom = 0;
-    if (unsortable) *unsortable = 0;
-    if (sortdatabytes <= itemsize)
-        return 1;
-    int64_t itemcount = (sortdatabytes / itemsize);
+static int _itemsort_InsertionSort(
+        _itemsortctx *ctx, int64_t start, int64_t end,
+        int64_t move_limit, int *completed
+        ) {
+    // Insertion sort on [start, end). If move_limit is positive, give
+    // up once more than that many elements were moved and report via
+    // completed whether we got through the whole range.
+    if (completed) *completed = 1;
+    int64_t moved = 0;
+    int64_t i = start + 1;
+    while (i < end) {
+        int64_t k = i;
+        while (k > start) {
+            int cmp;
+            SORT_CMP(cmp, SORT_GETITEM(i), SORT_GETITEM(k - 1));
+            if (cmp >= 0)
+                break;
+            k--;
+        }
+        if (k != i) {
+            memcpy(ctx->swapbuf, SORT_GETITEM(i), ctx->itemsize);
+            memmove(
+                SORT_GETITEM(k + 1), SORT_GETITEM(k),
+                ctx->itemsize * (i - k)
+            );
+            memcpy(SORT_GETITEM(k), ctx->swapbuf, ctx->itemsize);
+            moved += (i - k);
+            if (move_limit > 0 && moved > move_limit) {
+                if (completed) *completed = 0;
+                return 1;
+            }
+        }
+        i++;
+    }
+    return 1;
+}
+
+static int _itemsort_SiftDown(
+        _itemsortctx *ctx, int64_t start, int64_t root, int64_t count
+        ) {
+    while (1) {
+        int64_t child = root * 2 + 1;
+        if (child >= count)
+            return 1;
+        int cmp;
+        if (child + 1 < count) {
+            SORT_CMP(cmp, SORT_GETITEM(start + child),
+                     SORT_GETITEM(start + child + 1));
+            if (cmp < 0)
+                child++;
+        }
+        SORT_CMP(cmp, SORT_GETITEM(start + root),
+                 SORT_GETITEM(start + child));
+        if (cmp >= 0)
+            return 1;
+        _itemsort_Swap(ctx, start + root, start + child);
+        root = child;
+    }
+}
+
+static int _itemsort_HeapSort(
+        _itemsortctx *ctx, int64_t start, int64_t end
+        ) {
+    // Guaranteed O(n log n) fallback for ranges where the quick sort
+    // keeps picking bad pivots.
+    const int64_t count = end - start;
+    int64_t i = count / 2;
+    while (i > 0) {
+        i--;
+        if (!_itemsort_SiftDown(ctx, start, i, count))
+            return 0;
+    }
+    i = count - 1;
+    while (i > 0) {
+        _itemsort_Swap(ctx, start, start + i);
+        if (!_itemsort_SiftDown(ctx, start, 0, i))
+            return 0;
+        i--;
+    }
+    return 1;
+}
+
+static int _itemsort_Sort2(
+        _itemsortctx *ctx, int64_t a, int64_t b
+        ) {
+    int cmp;
+    SORT_CMP(cmp, SORT_GETITEM(b), SORT_GETITEM(a));
+    if (cmp < 0)
+        _itemsort_Swap(ctx, a, b);
+    return 1;
+}
+
+static int _itemsort_Sort3(
+        _itemsortctx *ctx, int64_t a, int64_t b, int64_t c
+        ) {
+    return (_itemsort_Sort2(ctx, a, b) &&
+        _itemsort_Sort2(ctx, b, c) &&
+        _itemsort_Sort2(ctx, a, b));
+}
 
-    // Job queue which starts on stack, migrates to heap if too large:
-    _itemsort_quicksortjob _jobbuf[32];
-    _itemsort_quicksortjob *jobs = _jobbuf;
-    int64_t jobs_alloc = 32;
-    int64_t jobs_heap = 0;
+static int _itemsort_PartitionRight(
+        _itemsortctx *ctx, int64_t start, int64_t end,
+        int64_t *out_pivot_pos, int *out_already_partitioned
+        ) {
+    // Partition [start, end) around the pivot at start: smaller items
+    // go left, items equal or larger go right. All scans are bounds
+    // checked, so inconsistent comparisons (like with NaN) can't make
+    // us run off the range.
+    void *pivot = ctx->pivotbuf;
+    memcpy(pivot, SORT_GETITEM(start), ctx->itemsize);
+    int64_t i = start + 1;
+    int64_t k = end - 1;
+    int cmp;
+    while (i <= k) {
+        SORT_CMP(cmp, SORT_GETITEM(i), pivot);
+        if (cmp >= 0) break;
+        i++;
+    }
+    while (i <= k) {
+        SORT_CMP(cmp, SORT_GETITEM(k), pivot);
+        if (cmp < 0) break;
+        k--;
+    }
+    *out_already_partitioned = (i > k);
+    while (i < k) {
+        _itemsort_Swap(ctx, i, k);
+        i++;
+        k--;
+        while (i <= k) {
+            SORT_CMP(cmp, SORT_GETITEM(i), pivot);
+            if (cmp >= 0) break;
+            i++;
+        }
+        while (i <= k) {
+            SORT_CMP(cmp, SORT_GETITEM(k), pivot);
+            if (cmp < 0) break;
+            k--;
+        }
+    }
+    int64_t pivot_pos = i - 1;
+    memcpy(SORT_GETITEM(start), SORT_GETITEM(pivot_pos), ctx->itemsize);
+    memcpy(SORT_GETITEM(pivot_pos), pivot, ctx->itemsize);
+    *out_pivot_pos = pivot_pos;
+    return 1;
+}
+
+static int _itemsort_PartitionLeft(
+        _itemsortctx *ctx, int64_t start, int64_t end,
+        int64_t *out_pivot_pos
+        ) {
+    // Like _itemsort_PartitionRight, but items equal to the pivot go
+    // left. Used when the pivot equals the item before the range, in
+    // which case the whole left side is equal and needs no more work.
+    void *pivot = ctx->pivotbuf;
+    memcpy(pivot, SORT_GETITEM(start), ctx->itemsize);
+    int64_t i = start + 1;
+    int64_t k = end - 1;
+    int cmp;
+    while (i <= k) {
+        SORT_CMP(cmp, pivot, SORT_GETITEM(k));
+        if (cmp >= 0) break;
+        k--;
+    }
+    while (i <= k) {
+        SORT_CMP(cmp, pivot, SORT_GETITEM(i));
+        if (cmp < 0) break;
+        i++;
+    }
+    while (i < k) {
+        _itemsort_Swap(ctx, i, k);
+        i++;
+        k--;
+        while (i <= k) {
+            SORT_CMP(cmp, pivot, SORT_GETITEM(k));
+            if (cmp >= 0) break;
+            k--;
+        }
+        while (i <= k) {
+            SORT_CMP(cmp, pivot, SORT_GETITEM(i));
+            if (cmp < 0) break;
+            i++;
+        }
+    }
+    int64_t pivot_pos = i - 1;
+    memcpy(SORT_GETITEM(start), SORT_GETITEM(pivot_pos), ctx->itemsize);
+    memcpy(SORT_GETITEM(pivot_pos), pivot, ctx->itemsize);
+    *out_pivot_pos = pivot_pos;
+    return 1;
+}
+
+static void _itemsort_BreakPatterns(
+        _itemsortctx *ctx, int64_t start, int64_t end
+        ) {
+    // Swap some items around to defeat inputs that keep producing
+    // unbalanced partitions:
+    int64_t size = end - start;
+    if (size < ITEMSORT_INSERTION_MAX)
+        return;
+    _itemsort_Swap(ctx, start, start + size / 4);
+    _itemsort_Swap(ctx, end - 1, end - size / 4);
+    if (size > ITEMSORT_NINTHER_MIN) {
+        _itemsort_Swap(ctx, start + 1, start + (size / 4 + 1));
+        _itemsort_Swap(ctx, start + 2, start + (size / 4 + 2));
+        _itemsort_Swap(ctx, end - 2, end - (size / 4 + 1));
+        _itemsort_Swap(ctx, end - 3, end - (size / 4 + 2));
+    }
+}
+
+#define SORT_PUSHJOB(start_idx, end_idx, bad, isleftmost) \
+    if (jobs_count + 1 > jobs_alloc) {\
+        int64_t new_jobs_alloc = jobs_alloc * 2;\
+        _itemsort_pdqjob *jobs_new = NULL;\
+        if (jobs_heap) {\
+            jobs_new = realloc(\
+                jobs, sizeof(*jobs) * new_jobs_alloc\
+            );\
+        } else {\
+            jobs_new = malloc(sizeof(*jobs) * new_jobs_alloc);\
+            if (jobs_new)\
+                memcpy(jobs_new, jobs, sizeof(*jobs) * jobs_count);\
+        }\
+        if (!jobs_new) {\
+            ctx->error = CMP_ERR_OOM;\
+            goto failed;\
+        }\
+        jobs = jobs_new;\
+        jobs_heap = 1;\
+        jobs_alloc = new_jobs_alloc;\
+    }\
+    jobs[jobs_count].start = start_idx;\
+    jobs[jobs_count].end = end_idx;\
+    jobs[jobs_count].bad_allowed = bad;\
+    jobs[jobs_count].leftmost = isleftmost;\
+    jobs_count++;
+
+static int _itemsort_Range(
+        _itemsortctx *ctx, int64_t start, int64_t end
+        ) {
+    /// Pattern-defeating quick sort: median-of-3 (or pseudo median
+    /// of 9) pivots, insertion sort for small ranges, detection of
+    /// already sorted input, and a heap sort fallback once too many
+    /// bad partitions happened so the worst case stays O(n log n).
+    /// Sub ranges are kept in a job stack instead of recursing, and
+    /// the smaller one is always handled first to keep that small.
+    _itemsort_pdqjob _jobbuf[64];
+    _itemsort_pdqjob *jobs = _jobbuf;
+    int64_t jobs_alloc = 64;
+    int jobs_heap = 0;
     int64_t jobs_count = 0;
 
-    char switchbuf[64];
-    if (itemsize > (int64_t)sizeof(switchbuf)) {
-        if (oom) *oom = 1;
-        return 0;
+    int log2size = 0;
+    {
+        int64_t size = end - start;
+        while (size > 1) {
+            log2size++;
+            size /= 2;
+        }
     }
+    SORT_PUSHJOB(start, end, log2size, 1);
 
-    // Add a job for entire range before we start:
-    SORT_PUSHJOB(0, itemcount);
-    assert(jobs_count > 0);
+    while (jobs_count > 0) {
+        jobs_count--;
+        int64_t curr_start = jobs[jobs_count].start;
+        int64_t curr_end = jobs[jobs_count].end;
+        int bad_allowed = jobs[jobs_count].bad_allowed;
+        int leftmost = jobs[jobs_count].leftmost;
+        int64_t size = curr_end - curr_start;
 
-    // Now go through sort jobs:
-    int64_t k = 0;
-    while (k < jobs_count) {
-        // Evaluate the sub range we want to sort in this job:
-        int64_t curr_start = jobs[k].start;
-        int64_t curr_end = jobs[k].end;
-        assert(curr_start <= curr_end);
-        if (curr_end - curr_start <= 1) {
-            k++;
+        if (size < ITEMSORT_INSERTION_MAX) {
+            if (!_itemsort_InsertionSort(
+                    ctx, curr_start, curr_end, 0, NULL
+                    ))
+                goto failed;
             continue;
         }
-        if (curr_end == curr_start + 2) {
-            // It's just two elements to sort, so do direct comparison:
-            int cmp_1to2 = compareFunc(
-                SORT_GETITEM(curr_start),
-                SORT_GETITEM(curr_start + 1)
+
+        // Move pivot candidate to curr_start:
+        int64_t half = size / 2;
+        if (size > ITEMSORT_NINTHER_MIN) {
+            if (!_itemsort_Sort3(ctx, curr_start, curr_start + half,
+                    curr_end - 1) ||
+                    !_itemsort_Sort3(ctx, curr_start + 1,
+                        curr_start + (half - 1), curr_end - 2) ||
+                    !_itemsort_Sort3(ctx, curr_start + 2,
+                        curr_start + (half + 1), curr_end - 3) ||
+                    !_itemsort_Sort3(ctx, curr_start + (half - 1),
+                        curr_start + half, curr_start + (half + 1)))
+                goto failed;
+            _itemsort_Swap(ctx, curr_start, curr_start + half);
+        } else {
+            if (!_itemsort_Sort3(ctx, curr_start + half, curr_start,
+                    curr_end - 1))
+                goto failed;
+        }
+
+        // If the pivot equals the item before this range, which is
+        // the pivot of a previous partition, lots of equal items are
+        // likely. Put those to the left and skip over them:
+        if (!leftmost) {
+            int cmp = ctx->compareFunc(
+                SORT_GETITEM(curr_start - 1), SORT_GETITEM(curr_start)
             );
-            if (cmp_1to2 < -1) {
-                if (cmp_1to2 == CMP_ERR_UNSORTABLE) {
-                    if (unsortable) *unsortable = 1;
-                    if (jobs_heap)
-                        free(jobs);
-                    return 0;
-                }
-                assert(cmp_1to2 == CMP_ERR_OOM);
-                if (oom) *oom = 1;
-                if (jobs_heap)
-                    free(jobs);
-                return 0;
+            if (unlikely(cmp < -1)) {
+                ctx->error = cmp;
+                goto failed;
             }
-            if (cmp_1to2 > 0) {
-                // Need to switch.
-                memcpy(switchbuf, SORT_GETITEM(curr_start + 1),
-                       itemsize);
-                memcpy(SORT_GETITEM(curr_start + 1),
-                       SORT_GETITEM(curr_start), itemsize);
-                memcpy(SORT_GETITEM(curr_start), switchbuf, itemsize);
+            if (cmp >= 0) {
+                int64_t pivot_pos = 0;
+                if (!_itemsort_PartitionLeft(
+                        ctx, curr_start, curr_end, &pivot_pos
+                        ))
+                    goto failed;
+                SORT_PUSHJOB(pivot_pos + 1, curr_end, bad_allowed, 0);
+                continue;
             }
-            k++;
-            continue;
         }
-        int64_t pivot = secrandom_RandIntRange(
-            curr_start, curr_end - 1
-            // (curr_end is exclusive, but secrandom_RandIntRange has
-            // inclusive end)
-        );  // for now sec random to avoid easily exploiting worst cases
-        assert(pivot >= curr_start && pivot <= curr_end);
-        
-        // Go through the entire sub range we're sorting, and
-        // move things according to our pivot (lower elements to below,
-        // higher elements to above);
-        int64_t z = curr_start;
-        while (z < curr_end) {
-            if (z == pivot) {
-                z++;
+
+        int64_t pivot_pos = 0;
+        int already_partitioned = 0;
+        if (!_itemsort_PartitionRight(
+                ctx, curr_start, curr_end, &pivot_pos,
+                &already_partitioned
+                ))
+            goto failed;
+        int64_t left_size = pivot_pos - curr_start;
+        int64_t right_size = curr_end - (pivot_pos + 1);
+        if (left_size < size / 8 || right_size < size / 8) {
+            bad_allowed--;
+            if (bad_allowed <= 0) {
+                if (!_itemsort_HeapSort(ctx, curr_start, curr_end))
+                    goto failed;
                 continue;
             }
-            int cmp_1to2 = compareFunc(
-                SORT_GETITEM(z),
-                SORT_GETITEM(pivot)
-            );
-            if (cmp_1to2 < -1) {
-                if (cmp_1to2 == CMP_ERR_UNSORTABLE) {
-                    if (unsortable) *unsortable = 1;
-                    if (jobs_heap)
-                        free(jobs);
-                    return 0;
-                }
-                assert(cmp_1to2 == CMP_ERR_OOM);
-                if (oom) *oom = 1;
-                if (jobs_heap)
-                    free(jobs);
-                return 0;
-            }
-            if ((cmp_1to2 == 1 && z < pivot) ||
-                    (cmp_1to2 == -1 && z > pivot)) {
-                // Need to switch.
-                if (z <= pivot + 1) {
-                    // Direct swap is enough: pivot can be pulled closer
-                    // since anything above us is unsorted anyway.
-                    memcpy(switchbuf, SORT_GETITEM(z),
-                        itemsize);
-                    memcpy(SORT_GETITEM(z),
-                        SORT_GETITEM(pivot), itemsize);
-                    memcpy(SORT_GETITEM(pivot),
-                        switchbuf, itemsize);
-                    pivot = z;
-                } else {
-                    // Stuff up to pivot and beyond is already
-                    // sorted, so we can't just move pivot wildly, so
-                    // instead pull this element towards the pivot:
-                    // We swap pivot with neighbor in our direction,
-                    // then swap z element (us) with that neighbor.
-                    int64_t dir = (z - pivot);
-                    assert(dir > 0);
-                    assert(pivot + 1 < curr_end);
-                    memcpy(switchbuf, SORT_GETITEM(pivot + 1),
-                        itemsize);
-                    memcpy(SORT_GETITEM(pivot + 1),
-                        SORT_GETITEM(pivot), itemsize);
-                    memcpy(SORT_GETITEM(pivot),
-                        switchbuf, itemsize);
-                    pivot += 1;
-                    memcpy(switchbuf, SORT_GETITEM(pivot - 1),
-                        itemsize);
-                    memcpy(SORT_GETITEM(pivot - 1),
-                        SORT_GETITEM(z), itemsize);
-                    memcpy(SORT_GETITEM(z),
-                        switchbuf, itemsize);
-                }
-            }
-            z++;
+            _itemsort_BreakPatterns(ctx, curr_start, pivot_pos);
+            _itemsort_BreakPatterns(ctx, pivot_pos + 1, curr_end);
+        } else if (already_partitioned) {
+            // Possibly (nearly) sorted input, try to finish cheaply:
+            int left_done = 0;
+            int right_done = 0;
+            if (!_itemsort_InsertionSort(
+                    ctx, curr_start, pivot_pos,
+                    ITEMSORT_PARTIALINSERTION_LIMIT, &left_done
+                    ))
+                goto failed;
+            if (left_done && !_itemsort_InsertionSort(
+                    ctx, pivot_pos + 1, curr_end,
+                    ITEMSORT_PARTIALINSERTION_LIMIT, &right_done
+                    ))
+                goto failed;
+            if (left_done && right_done)
+                continue;
+        }
+
+        // Push larger range first, so the smaller one is done next:
+        if (left_size > right_size) {
+            SORT_PUSHJOB(curr_start, pivot_pos, bad_allowed, leftmost);
+            SORT_PUSHJOB(pivot_pos + 1, curr_end, bad_allowed, 0);
+        } else {
+            SORT_PUSHJOB(pivot_pos + 1, curr_end, bad_allowed, 0);
+            SORT_PUSHJOB(curr_start, pivot_pos, bad_allowed, leftmost);
         }
-        // Post follow-up jobs for sub ranges around pivot:
-        SORT_PUSHJOB(curr_start, pivot);
-        SORT_PUSHJOB(pivot, curr_end);
-        k++;
     }
+    if (jobs_heap)
+        free(jobs);
+    return 1;
 
+    failed:
     if (jobs_heap)
         free(jobs);
+    return 0;
+}
+
+static void _itemsort_SetError(
+        int error, int *oom, int *unsortable
+        ) {
+    if (error == CMP_ERR_UNSORTABLE) {
+        if (unsortable) *unsortable = 1;
+    } else {
+        assert(error == CMP_ERR_OOM);
+        if (oom) *oom = 1;
+    }
+}
+
+int itemsort_Do(
+        void *sortdata, int64_t sortdatabytes, int64_t itemsize,
+        int (*compareFunc)(void *item1, void *item2),
+        int *oom, int *unsortable
+        ) {
+    if (oom) *oom = 0;
+    if (unsortable) *unsortable = 0;
+    if (sortdatabytes <= itemsize)
+        return 1;
+    if (itemsize > ITEMSORT_MAX_ITEMSIZE) {
+        if (oom) *oom = 1;
+        return 0;
+    }
+    _itemsortctx ctx = {0};
+    ctx.data = sortdata;
+    ctx.itemsize = itemsize;
+    ctx.compareFunc = compareFunc;
+    if (!_itemsort_Range(&ctx, 0, sortdatabytes / itemsize)) {
+        _itemsort_SetError(ctx.error, oom, unsortable);
+        return 0;
+    }
+    return 1;
+}
+
+typedef struct _itemsort_paralleljob {
+    _itemsortctx ctx;
+    char *target;  // merge target buffer, same layout as ctx.data
+    int64_t start, mid, end;
+    thread *t;
+} _itemsort_paralleljob;
+
+static void _itemsort_ParallelSortJob(void *userdata) {
+    _itemsort_paralleljob *job = userdata;
+    _itemsort_Range(&job->ctx, job->start, job->end);
+}
+
+static int _itemsort_Merge(_itemsort_paralleljob *job) {
+    // Merge the sorted runs [start, mid) and [mid, end) from ctx.data
+    // into the same range of target. Stable, left run wins on ties.
+    _itemsortctx *ctx = &job->ctx;
+    const int64_t itemsize = ctx->itemsize;
+    int64_t i = job->start;
+    int64_t k = job->mid;
+    char *out = job->target + itemsize * job->start;
+    while (i < job->mid && k < job->end) {
+        int cmp;
+        SORT_CMP(cmp, SORT_GETITEM(k), SORT_GETITEM(i));
+        if (cmp < 0) {
+            memcpy(out, SORT_GETITEM(k), itemsize);
+            k++;
+        } else {
+            memcpy(out, SORT_GETITEM(i), itemsize);
+            i++;
+        }
+        out += itemsize;
+    }
+    if (i < job->mid) {
+        memcpy(out, SORT_GETITEM(i), itemsize * (job->mid - i));
+    } else if (k < job->end) {
+        memcpy(out, SORT_GETITEM(k), itemsize * (job->end - k));
+    }
+    return 1;
+}
+
+static void _itemsort_ParallelMergeJob(void *userdata) {
+    _itemsort_Merge((_itemsort_paralleljob *)userdata);
+}
+
+static void _itemsort_RunJobs(
+        _itemsort_paralleljob *jobs, int job_count,
+        void (*func)(void *userdata)
+        ) {
+    // Run all jobs but the first on helper threads, and the first one
+    // on ours. If spawning a thread fails, run that job inline instead.
+    int i = 1;
+    while (i < job_count) {
+        jobs[i].t = thread_Spawn(func, &jobs[i]);
+        if (!jobs[i].t)
+            func(&jobs[i]);
+        i++;
+    }
+    func(&jobs[0]);
+    i = 1;
+    while (i < job_count) {
+        if (jobs[i].t) {
+            thread_Join(jobs[i].t);
+            jobs[i].t = NULL;
+        }
+        i++;
+    }
+}
+
+int itemsort_DoParallel(
+        void *sortdata, int64_t sortdatabytes, int64_t itemsize,
+        int (*compareFunc)(void *item1, void *item2),
+        int max_threads, int *oom, int *unsortable
+        ) {
+    /// Sorts chunks of the input on separate threads, then merges them
+    /// pairwise (again in parallel) until one sorted run remains.
+    /// The compareFunc must be safe to call from other threads.
+    /// Inputs that are too small for this to pay off, or failure to get
+    /// the merge buffer, fall back to the regular itemsort_Do().
+    const int64_t itemcount = (
+        itemsize > 0 ? sortdatabytes / itemsize : 0
+    );
+    if (max_threads > ITEMSORT_PARALLEL_MAX_THREADS)
+        max_threads = ITEMSORT_PARALLEL_MAX_THREADS;
+    if (max_threads < 2 || itemcount < ITEMSORT_PARALLEL_MIN_ITEMS ||
+            itemsize > ITEMSORT_MAX_ITEMSIZE)
+        return itemsort_Do(
+            sortdata, sortdatabytes, itemsize, compareFunc,
+            oom, unsortable
+        );
+    if (oom) *oom = 0;
+    if (unsortable) *unsortable = 0;
+    char *mergebuf = malloc(sortdatabytes);
+    _itemsort_paralleljob *jobs = malloc(sizeof(*jobs) * max_threads);
+    int64_t *bounds = malloc(sizeof(*bounds) * (max_threads + 1));
+    if (!mergebuf || !jobs || !bounds) {
+        free(mergebuf);
+        free(jobs);
+        free(bounds);
+        return itemsort_Do(
+            sortdata, sortdatabytes, itemsize, compareFunc,
+            oom, unsortable
+        );
+    }
+
+    // Sort all chunks:
+    int run_count = max_threads;
+    int i = 0;
+    while (i <= run_count) {
+        bounds[i] = (itemcount * i) / run_count;
+        i++;
+    }
+    memset(jobs, 0, sizeof(*jobs) * max_threads);
+    i = 0;
+    while (i < run_count) {
+        jobs[i].ctx.data = sortdata;
+        jobs[i].ctx.itemsize = itemsize;
+        jobs[i].ctx.compareFunc = compareFunc;
+        jobs[i].start = bounds[i];
+        jobs[i].end = bounds[i + 1];
+        i++;
+    }
+    _itemsort_RunJobs(jobs, run_count, _itemsort_ParallelSortJob);
+    int error = 0;
+    i = 0;
+    while (i < run_count) {
+        if (jobs[i].ctx.error != 0 && error == 0)
+            error = jobs[i].ctx.error;
+        i++;
+    }
 
+    // Merge runs pairwise, ping-ponging between input and merge buffer:
+    char *src = sortdata;
+    char *dst = mergebuf;
+    while (error == 0 && run_count > 1) {
+        int merge_count = 0;
+        i = 0;
+        while (i < run_count) {
+            _itemsort_paralleljob *job = &jobs[merge_count];
+            memset(job, 0, sizeof(*job));
+            job->ctx.data = src;
+            job->ctx.itemsize = itemsize;
+            job->ctx.compareFunc = compareFunc;
+            job->target = dst;
+            job->start = bounds[i];
+            if (i + 1 < run_count) {
+                job->mid = bounds[i + 1];
+                job->end = bounds[i + 2];
+            } else {
+                // Odd run out, gets copied over as-is:
+                job->mid = bounds[i + 1];
+                job->end = bounds[i + 1];
+            }
+            bounds[merge_count] = job->start;
+            merge_count++;
+            i += 2;
+        }
+        bounds[merge_count] = itemcount;
+        _itemsort_RunJobs(jobs, merge_count, _itemsort_ParallelMergeJob);
+        i = 0;
+        while (i < merge_count) {
+            if (jobs[i].ctx.error != 0 && error == 0)
+                error = jobs[i].ctx.error;
+            i++;
+        }
+        run_count = merge_count;
+        char *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (error == 0 && src != sortdata)
+        memcpy(sortdata, src, sortdatabytes);
+    free(mergebuf);
+    free(jobs);
+    free(bounds);
+    if (error != 0) {
+        _itemsort_SetError(error, oom, unsortable);
+        return 0;
+    }
     return 1;
-}
\ No newline at end of file
+}
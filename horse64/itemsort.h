@@ -12,11 +12,21 @@
 #define CMP_ERR_UNSORTABLE -3
 #define CMP_ERR_OOM -2
 
+// itemsort_DoParallel() only uses threads for at least this many items:
+#define ITEMSORT_PARALLEL_MIN_ITEMS (1 << 16)
+#define ITEMSORT_PARALLEL_MAX_THREADS 16
+
 int itemsort_Do(
     void *sortdata, int64_t sortdatabytes, int64_t itemsize,
     int (*compareFunc)(void *item1, void *item2),
     int *oom, int *unsortable
 );
 
+int itemsort_DoParallel(
+    void *sortdata, int64_t sortdatabytes, int64_t itemsize,
+    int (*compareFunc)(void *item1, void *item2),
+    int max_threads, int *oom, int *unsortable
+);
+
 
 #endif  // HORSE64_ITEMSORT_H_
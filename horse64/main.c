@@ -25,7 +25,6 @@
 #include "vfs.h"
 #include "widechar.h"
 
-void _load_unicode_data();  // widechar.c
 
 
 #define NOBETTERARGPARSE 1
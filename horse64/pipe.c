@@ -6,14 +6,22 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "bytecode.h"
 #include "gcvalue.h"
+#include "hash.h"
 #include "pipe.h"
+#include "poolalloc.h"
 #include "stack.h"
 #include "valuecontentstruct.h"
 #include "vmexec.h"
+#include "vmchannel.h"
+#include "vmlist.h"
+#include "vmmap.h"
+#include "vmstrings.h"
+#include "vmvector.h"
 
 typedef struct h64pipe {
     
@@ -21,26 +29,602 @@ typedef struct h64pipe {
 } h64pipe;
 
 
-#define DUPOBJECT_SETTO_OBJINSTANCE 1
-#define DUPOBJECT_SETTO_LIST 2
-#define DUPOBJECT_SETTO_MAP 3
-#define DUPOBJECT_SETTO_SET 4
+// ABOUT PIPING:
+// Values passed to a parallel vmthread must end up on the target
+// thread's heap, since heaps aren't shared across parallel threads.
+// There are two ways a gc value gets there:
+//
+// 1. MOVE: if the value is only referenced once, by the slot we pipe
+//    from (or by a container that is itself moved), nobody else can
+//    observe it. In that case only the h64gcvalue header gets a new
+//    home on the target heap, while the payload (list blocks, map
+//    buckets, large string buffers, ...) is taken over as-is.
+//    The compiler helps here by clearing temporaries and last uses
+//    of local variables passed to async calls, see _codegen_call_to.
+//
+// 2. COPY: anything that is shared gets copied, in one pass over the
+//    object graph using a work list (no C recursion). Shared objects
+//    are only copied once, which also keeps reference cycles intact.
+//
+// Before anything is moved, the whole graph is checked for values that
+// can't be piped. That way, a TypeError never leaves a value half-moved
+// behind, and only running out of memory can still do that.
+//
+// Channel objects are the exception, since the channel itself is meant
+// to be shared: the target just gets its own object for the same
+// channel, see vmchannel.h.
 
-typedef struct _dopipe_dupobjectinfo {
-    uint8_t setto_type;
-    h64gcvalue *setto_obj;
-    union {
-        struct {
-            int64_t setto_attrslot;
-        };
-        struct {
-            int64_t map_bucketidx;
-            int map_bucketslot;
-        };
-    };
-    h64gcvalue *setfrom_obj;
-} _dopipe_dupobjectinfo;
+typedef struct _dopipe_workitem {
+    h64gcvalue *from, *to;
+    int moved, keepshell;
+} _dopipe_workitem;
 
+typedef struct _dopipe_ctx {
+    h64vmthread *source_thread, *target_thread;
+    hashmap *copied_map;  // source h64gcvalue ptr -> copy on target
+    hashset *checked_set;  // shared containers seen by _pipe_CheckGraph
+    int toplevel_refs;  // references the piped slot holds, usually 1
+    int toplevel_keepshell;  // moved top-level container stays, empty
+
+    _dopipe_workitem _todobuf[64];
+    _dopipe_workitem *todo;
+    int todo_fill, todo_alloc, todo_onheap;
+
+    int result;  // for use in iteration callbacks
+} _dopipe_ctx;
+
+
+static int _pipe_PushWork(
+        _dopipe_ctx *ctx, h64gcvalue *from, h64gcvalue *to, int moved,
+        int keepshell
+        ) {
+    if (ctx->todo_fill + 1 > ctx->todo_alloc) {
+        int new_alloc = ctx->todo_alloc * 2;
+        _dopipe_workitem *new_todo = NULL;
+        if (ctx->todo_onheap) {
+            new_todo = realloc(ctx->todo, sizeof(*new_todo) * new_alloc);
+        } else {
+            new_todo = malloc(sizeof(*new_todo) * new_alloc);
+            if (new_todo)
+                memcpy(new_todo, ctx->todo,
+                       sizeof(*new_todo) * ctx->todo_fill);
+        }
+        if (!new_todo)
+            return 0;
+        ctx->todo = new_todo;
+        ctx->todo_alloc = new_alloc;
+        ctx->todo_onheap = 1;
+    }
+    ctx->todo[ctx->todo_fill].from = from;
+    ctx->todo[ctx->todo_fill].to = to;
+    ctx->todo[ctx->todo_fill].moved = moved;
+    ctx->todo[ctx->todo_fill].keepshell = keepshell;
+    ctx->todo_fill++;
+    return 1;
+}
+
+static int _pipe_IsPlainType(int type) {
+    // Value types that are piped without looking at any gc value:
+    return (type == H64VALTYPE_INT64 ||
+            type == H64VALTYPE_FLOAT64 ||
+            type == H64VALTYPE_NONE ||
+            type == H64VALTYPE_BOOL ||
+            type == H64VALTYPE_SHORTSTR ||
+            type == H64VALTYPE_SHORTBYTES ||
+            type == H64VALTYPE_CLASSREF ||
+            type == H64VALTYPE_FUNCREF ||
+            type == H64VALTYPE_UNSPECIFIED_KWARG ||
+            type == H64VALTYPE_CONSTPREALLOCSTR ||
+            type == H64VALTYPE_CONSTPREALLOCBYTES ||
+            type == H64VALTYPE_VECTOR);
+}
+
+static int _pipe_CheckValue(_dopipe_ctx *ctx, valuecontent *v) {
+    // Checks if v can be piped, and queues containers to have their
+    // contents checked as well.
+    // Return value: 1 = ok, 0 = oom, -1 = value type can't be piped.
+    if (v->type != H64VALTYPE_GCVAL)
+        return (_pipe_IsPlainType(v->type) ? 1 : -1);
+    h64gcvalue *gcval = v->ptr_value;
+    if (gcval->type == H64GCVALUETYPE_STRING ||
+            gcval->type == H64GCVALUETYPE_BYTES)
+        return 1;
+    if (gcval->type == H64GCVALUETYPE_OBJINSTANCE &&
+            vmchannel_IsChannelObject(ctx->source_thread, gcval))
+        return 1;
+    if (gcval->type != H64GCVALUETYPE_LIST &&
+            gcval->type != H64GCVALUETYPE_MAP)
+        return -1;
+    if (gcval->externalreferencecount +
+            gcval->heapreferencecount > 1) {
+        // Might be reached again, or be part of a cycle:
+        if (!ctx->checked_set) {
+            ctx->checked_set = hashset_New(64);
+            if (!ctx->checked_set)
+                return 0;
+        }
+        if (hashset_Contains(ctx->checked_set, &gcval, sizeof(gcval)))
+            return 1;
+        if (!hashset_Add(ctx->checked_set, &gcval, sizeof(gcval)))
+            return 0;
+    }
+    if (!_pipe_PushWork(ctx, gcval, NULL, 0, 0))
+        return 0;
+    return 1;
+}
+
+static int _pipe_CheckListEntryCb(void *udata, valuecontent *value) {
+    _dopipe_ctx *ctx = udata;
+    ctx->result = _pipe_CheckValue(ctx, value);
+    return (ctx->result > 0);
+}
+
+static int _pipe_CheckMapPairCb(
+        void *udata, valuecontent *key, valuecontent *value
+        ) {
+    return (_pipe_CheckListEntryCb(udata, key) &&
+            _pipe_CheckListEntryCb(udata, value));
+}
+
+static int _pipe_CheckGraph(_dopipe_ctx *ctx, valuecontent *v) {
+    // Checks the entire graph reachable from v before anything of it is
+    // moved. Return value: 1 = ok, 0 = oom, -1 = value type can't be
+    // piped.
+    int result = _pipe_CheckValue(ctx, v);
+    while (result > 0 && ctx->todo_fill > 0) {
+        ctx->todo_fill--;
+        h64gcvalue *gcval = ctx->todo[ctx->todo_fill].from;
+        ctx->result = 1;
+        if (gcval->type == H64GCVALUETYPE_LIST) {
+            if (gcval->list_values->packed_type == LISTPACKED_NONE &&
+                    !vmmap_IterateValues(
+                        gcval->list_values, ctx, _pipe_CheckListEntryCb
+                    ))
+                result = ctx->result;
+        } else {
+            assert(gcval->type == H64GCVALUETYPE_MAP);
+            if (!vmmap_IteratePairs(
+                    gcval->map_values, ctx, _pipe_CheckMapPairCb
+                    ))
+                result = ctx->result;
+        }
+    }
+    ctx->todo_fill = 0;
+    if (ctx->checked_set) {
+        hashset_Free(ctx->checked_set);
+        ctx->checked_set = NULL;
+    }
+    return result;
+}
+
+int _pipe_CheckPipeable(
+        h64vmthread *source_thread, valuecontent *v
+        ) {
+    _dopipe_ctx ctx = {0};
+    ctx.source_thread = source_thread;
+    ctx.todo = ctx._todobuf;
+    ctx.todo_alloc = sizeof(ctx._todobuf) / sizeof(ctx._todobuf[0]);
+    int result = _pipe_CheckGraph(&ctx, v);
+    if (ctx.todo_onheap)
+        free(ctx.todo);
+    return result;
+}
+
+static int _pipe_IsSoleOwner(
+        _dopipe_ctx *ctx, valuecontent *v, int is_toplevel
+        ) {
+    // Top-level values are owned by the piped stack slot, nested ones
+    // by the (moved) container they are in:
+    if (v->type == H64VALTYPE_VECTOR)
+        return (v->vector->refcount ==
+                (is_toplevel ? ctx->toplevel_refs : 1));
+    assert(v->type == H64VALTYPE_GCVAL);
+    h64gcvalue *gcval = v->ptr_value;
+    if (is_toplevel)
+        return (gcval->externalreferencecount == ctx->toplevel_refs &&
+                gcval->heapreferencecount == 0);
+    return (gcval->externalreferencecount == 0 &&
+            gcval->heapreferencecount == 1);
+}
+
+static int _pipe_TransferValue(
+        _dopipe_ctx *ctx, valuecontent *src, valuecontent *dst,
+        int is_toplevel, int parent_moved, int *out_moved
+        ) {
+    // Sets a version of src usable by the target thread into dst, with
+    // no reference added yet. If *out_moved is set, the reference held
+    // by src was handed over and src must not be DELREF'ed anymore.
+    // Container contents are filled in later via the work list.
+    // Return value: 1 = ok, 0 = oom, -1 = value type can't be piped.
+    *out_moved = 0;
+    memset(dst, 0, sizeof(*dst));
+    if (likely(src->type == H64VALTYPE_INT64 ||
+            src->type == H64VALTYPE_FLOAT64 ||
+            src->type == H64VALTYPE_NONE ||
+            src->type == H64VALTYPE_BOOL ||
+            src->type == H64VALTYPE_SHORTSTR ||
+            src->type == H64VALTYPE_SHORTBYTES ||
+            src->type == H64VALTYPE_CLASSREF ||
+            src->type == H64VALTYPE_FUNCREF ||
+            src->type == H64VALTYPE_UNSPECIFIED_KWARG)) {
+        memcpy(dst, src, sizeof(*src));
+        return 1;
+    } else if (src->type == H64VALTYPE_CONSTPREALLOCSTR) {
+        dst->type = H64VALTYPE_CONSTPREALLOCSTR;
+        dst->constpreallocstr_value = malloc(
+            sizeof(*src->constpreallocstr_value) *
+            (src->constpreallocstr_len > 0 ?
+             src->constpreallocstr_len : 1)
+        );
+        if (!dst->constpreallocstr_value)
+            return 0;
+        dst->constpreallocstr_len = src->constpreallocstr_len;
+        memcpy(
+            dst->constpreallocstr_value, src->constpreallocstr_value,
+            sizeof(*src->constpreallocstr_value) *
+            src->constpreallocstr_len
+        );
+        return 1;
+    } else if (src->type == H64VALTYPE_CONSTPREALLOCBYTES) {
+        dst->type = H64VALTYPE_CONSTPREALLOCBYTES;
+        dst->constpreallocbytes_value = malloc(
+            src->constpreallocbytes_len > 0 ?
+            src->constpreallocbytes_len : 1
+        );
+        if (!dst->constpreallocbytes_value)
+            return 0;
+        dst->constpreallocbytes_len = src->constpreallocbytes_len;
+        memcpy(
+            dst->constpreallocbytes_value, src->constpreallocbytes_value,
+            src->constpreallocbytes_len
+        );
+        return 1;
+    } else if (src->type == H64VALTYPE_VECTOR) {
+        // Vectors are plain malloc() memory, so moving one is just
+        // handing over the pointer:
+        dst->type = H64VALTYPE_VECTOR;
+        if ((is_toplevel || parent_moved) &&
+                (!is_toplevel || !ctx->toplevel_keepshell) &&
+                _pipe_IsSoleOwner(ctx, src, is_toplevel)) {
+            dst->vector = src->vector;
+            dst->vector->refcount--;
+            *out_moved = 1;
+            return 1;
+        }
+        h64vector *v = vmvector_New(src->vector->is_float, src->vector->len);
+        if (!v)
+            return 0;
+        if (src->vector->len > 0)
+            memcpy(
+                v->int_values, src->vector->int_values,
+                sizeof(*v->int_values) * src->vector->len
+            );
+        v->len = src->vector->len;
+        dst->vector = v;
+        return 1;
+    } else if (src->type != H64VALTYPE_GCVAL) {
+        return -1;
+    }
+
+    h64gcvalue *gsrc = src->ptr_value;
+    if (gsrc->type == H64GCVALUETYPE_OBJINSTANCE &&
+            vmchannel_IsChannelObject(ctx->source_thread, gsrc)) {
+        h64gcvalue *gdst = vmchannel_NewObject(
+            ctx->target_thread, vmchannel_FromObject(gsrc)
+        );
+        if (!gdst)
+            return 0;
+        dst->type = H64VALTYPE_GCVAL;
+        dst->ptr_value = gdst;
+        return 1;
+    }
+    if (gsrc->type != H64GCVALUETYPE_STRING &&
+            gsrc->type != H64GCVALUETYPE_BYTES &&
+            gsrc->type != H64GCVALUETYPE_LIST &&
+            gsrc->type != H64GCVALUETYPE_MAP) {
+        // FIXME: object instances need their .on_piped() called,
+        // and sets and closures aren't supported yet.
+        return -1;
+    }
+    if (ctx->copied_map) {
+        // This must come before the sole owner check, since copying a
+        // shared value out of a moved container drops a reference:
+        uint64_t number = 0;
+        if (hash_BytesMapGet(
+                ctx->copied_map, (const char *)&gsrc, sizeof(gsrc),
+                &number)) {
+            // Already copied as part of this pipe, reuse that copy:
+            dst->type = H64VALTYPE_GCVAL;
+            dst->ptr_value = (h64gcvalue *)(uintptr_t)number;
+            return 1;
+        }
+    }
+    int keepshell = (is_toplevel && ctx->toplevel_keepshell);
+    int move = ((is_toplevel || parent_moved) &&
+        (!keepshell || gsrc->type == H64GCVALUETYPE_LIST ||
+         gsrc->type == H64GCVALUETYPE_MAP) &&
+        _pipe_IsSoleOwner(ctx, src, is_toplevel));
+    h64gcvalue *gdst = poolalloc_malloc(ctx->target_thread->heap, 0);
+    if (!gdst)
+        return 0;
+    memset(gdst, 0, sizeof(*gdst));
+    gdst->type = gsrc->type;
+    gdst->hash = gsrc->hash;
+    if (!move) {
+        if (!ctx->copied_map) {
+            ctx->copied_map = hash_NewBytesMap(64);
+            if (!ctx->copied_map) {
+                poolalloc_free(ctx->target_thread->heap, gdst);
+                return 0;
+            }
+        }
+        if (!hash_BytesMapSet(
+                ctx->copied_map, (const char *)&gsrc, sizeof(gsrc),
+                (uint64_t)(uintptr_t)gdst)) {
+            poolalloc_free(ctx->target_thread->heap, gdst);
+            return 0;
+        }
+    }
+    dst->type = H64VALTYPE_GCVAL;
+    dst->ptr_value = gdst;
+
+    if (gsrc->type == H64GCVALUETYPE_STRING) {
+        if (move && !vmstrings_IsPooled(&gsrc->str_val) &&
+                !gsrc->str_val.slice_parent) {
+            gdst->str_val.s = gsrc->str_val.s;
+            gdst->str_val.len = gsrc->str_val.len;
+            gdst->str_val.letter_offsets = gsrc->str_val.letter_offsets;
+            gsrc->str_val.s = NULL;
+            gsrc->str_val.len = 0;
+            gsrc->str_val.letter_offsets = NULL;
+        } else {
+            // Pooled buffers belong to the source thread's str_pile,
+            // and slices share their parent's buffer, so these always
+            // need a copy:
+            if (!vmstrings_AllocBuffer(
+                    ctx->target_thread, &gdst->str_val,
+                    gsrc->str_val.len)) {
+                // (If registered in copied_map, it stays there but
+                // this whole pipe fails anyway.)
+                return 0;
+            }
+            memcpy(
+                gdst->str_val.s, gsrc->str_val.s,
+                sizeof(*gsrc->str_val.s) * gsrc->str_val.len
+            );
+            if (move)
+                vmstrings_Free(ctx->source_thread, &gsrc->str_val);
+        }
+        gdst->str_val.letterlen = gsrc->str_val.letterlen;
+    } else if (gsrc->type == H64GCVALUETYPE_BYTES) {
+        if (move && !vmbytes_IsPooled(&gsrc->bytes_val) &&
+                !gsrc->bytes_val.slice_parent) {
+            gdst->bytes_val.s = gsrc->bytes_val.s;
+            gdst->bytes_val.len = gsrc->bytes_val.len;
+            gsrc->bytes_val.s = NULL;
+            gsrc->bytes_val.len = 0;
+        } else {
+            if (!vmbytes_AllocBuffer(
+                    ctx->target_thread, &gdst->bytes_val,
+                    gsrc->bytes_val.len))
+                return 0;
+            memcpy(
+                gdst->bytes_val.s, gsrc->bytes_val.s,
+                gsrc->bytes_val.len
+            );
+            if (move)
+                vmbytes_Free(ctx->source_thread, &gsrc->bytes_val);
+        }
+    } else {
+        // Containers get their contents transferred via the work list:
+        if (!_pipe_PushWork(ctx, gsrc, gdst, move, keepshell))
+            return 0;
+        *out_moved = (move && !keepshell);
+        return 1;
+    }
+    if (move) {
+        poolalloc_free(ctx->source_thread->heap, gsrc);
+        *out_moved = 1;
+    }
+    return 1;
+}
+
+static int _pipe_TransferInPlace(
+        _dopipe_ctx *ctx, valuecontent *entry
+        ) {
+    // For entries of a moved container: replace the entry with the
+    // target thread version of itself.
+    valuecontent newentry;
+    int moved = 0;
+    int result = _pipe_TransferValue(
+        ctx, entry, &newentry, 0, 1, &moved
+    );
+    if (result <= 0) {
+        ctx->result = result;
+        return 0;
+    }
+    if (!moved) {
+        // Shared value that was copied, so drop our old reference:
+        DELREF_HEAP(entry);
+        valuecontent_Free(ctx->source_thread, entry);
+    }
+    memcpy(entry, &newentry, sizeof(*entry));
+    ADDREF_HEAP(entry);
+    return 1;
+}
+
+static int _pipe_TransferListEntryCb(void *udata, valuecontent *value) {
+    return _pipe_TransferInPlace((_dopipe_ctx *)udata, value);
+}
+
+static int _pipe_TransferMapPairCb(
+        void *udata, valuecontent *key, valuecontent *value
+        ) {
+    return (_pipe_TransferInPlace((_dopipe_ctx *)udata, key) &&
+            _pipe_TransferInPlace((_dopipe_ctx *)udata, value));
+}
+
+typedef struct _pipe_copymapinfo {
+    _dopipe_ctx *ctx;
+    genericmap *target;
+} _pipe_copymapinfo;
+
+static int _pipe_CopyMapPairCb(
+        void *udata, valuecontent *key, valuecontent *value
+        ) {
+    _pipe_copymapinfo *info = udata;
+    valuecontent newkey, newvalue;
+    int moved = 0;
+    int result = _pipe_TransferValue(
+        info->ctx, key, &newkey, 0, 0, &moved
+    );
+    if (result > 0)
+        result = _pipe_TransferValue(
+            info->ctx, value, &newvalue, 0, 0, &moved
+        );
+    if (result > 0 && !vmmap_Set(
+            info->ctx->target_thread, info->target, &newkey, &newvalue
+            ))
+        result = 0;
+    if (result <= 0) {
+        info->ctx->result = result;
+        return 0;
+    }
+    return 1;
+}
+
+static int _pipe_ProcessWork(
+        _dopipe_ctx *ctx, _dopipe_workitem *item
+        ) {
+    // Return value: 1 = ok, 0 = oom, -1 = value type can't be piped.
+    h64gcvalue *from = item->from;
+    h64gcvalue *to = item->to;
+    ctx->result = 1;
+    if (from->type == H64GCVALUETYPE_LIST) {
+        if (item->moved) {
+            genericlist *shell_l = NULL;
+            if (item->keepshell) {
+                shell_l = vmlist_New();
+                if (!shell_l)
+                    return 0;
+            }
+            to->list_values = from->list_values;
+            from->list_values = shell_l;
+            if (to->list_values->packed_type == LISTPACKED_NONE &&
+                    !vmmap_IterateValues(
+                        to->list_values, ctx, _pipe_TransferListEntryCb
+                    ))
+                return ctx->result;
+        } else {
+            genericlist *l = vmlist_New();
+            if (!l)
+                return 0;
+            to->list_values = l;
+            const int64_t count = vmlist_Count(from->list_values);
+            int64_t i = 1;
+            while (i <= count) {
+                valuecontent entry, newentry;
+                int moved = 0;
+                vmlist_Get(from->list_values, i, &entry);
+                int result = _pipe_TransferValue(
+                    ctx, &entry, &newentry, 0, 0, &moved
+                );
+                if (result <= 0)
+                    return result;
+                if (!vmlist_Add(l, &newentry))
+                    return 0;
+                i++;
+            }
+        }
+    } else {
+        assert(from->type == H64GCVALUETYPE_MAP);
+        if (item->moved) {
+            genericmap *shell_m = NULL;
+            if (item->keepshell) {
+                shell_m = vmmap_New();
+                if (!shell_m)
+                    return 0;
+            }
+            to->map_values = from->map_values;
+            from->map_values = shell_m;
+            if (!vmmap_IteratePairs(
+                    to->map_values, ctx, _pipe_TransferMapPairCb
+                    ))
+                return ctx->result;
+        } else {
+            genericmap *m = vmmap_New();
+            if (!m)
+                return 0;
+            to->map_values = m;
+            _pipe_copymapinfo info = {0};
+            info.ctx = ctx;
+            info.target = m;
+            if (!vmmap_IteratePairs(
+                    from->map_values, &info, _pipe_CopyMapPairCb
+                    ))
+                return ctx->result;
+        }
+    }
+    if (item->moved && !item->keepshell)
+        poolalloc_free(ctx->source_thread->heap, from);
+    return 1;
+}
+
+int _pipe_DoPipeValue(
+        h64vmthread *source_thread, h64vmthread *target_thread,
+        valuecontent *vcsource, pipesource source_kind,
+        valuecontent *vctarget
+        ) {
+    memset(vctarget, 0, sizeof(*vctarget));
+    if (source_thread->heap == target_thread->heap) {
+        // Not a parallel thread, so values can simply be shared:
+        memcpy(vctarget, vcsource, sizeof(*vcsource));
+        ADDREF_NONHEAP(vctarget);
+        return 1;
+    }
+
+    _dopipe_ctx ctx = {0};
+    ctx.source_thread = source_thread;
+    ctx.target_thread = target_thread;
+    ctx.toplevel_refs = (source_kind == PIPESOURCE_CFUNCSLOT0 ? 2 : 1);
+    ctx.toplevel_keepshell = (source_kind == PIPESOURCE_CFUNCSLOT0);
+    int is_toplevel = (source_kind == PIPESOURCE_SLOT ||
+                       source_kind == PIPESOURCE_CFUNCSLOT0);
+    ctx.todo = ctx._todobuf;
+    ctx.todo_alloc = sizeof(ctx._todobuf) / sizeof(ctx._todobuf[0]);
+
+    valuecontent newvalue;
+    int moved = 0;
+    int result = _pipe_CheckGraph(&ctx, vcsource);
+    if (result > 0)
+        result = _pipe_TransferValue(
+            &ctx, vcsource, &newvalue, is_toplevel,
+            (source_kind == PIPESOURCE_OWNEDENTRY), &moved
+        );
+    if (moved) {
+        // Our reference was handed over, so the source slot must
+        // forget about the value without a DELREF. (If we run out of
+        // memory later on, the half-moved value is unreachable and
+        // leaks, which is still better than a dangling reference.)
+        memset(vcsource, 0, sizeof(*vcsource));
+        vcsource->type = H64VALTYPE_NONE;
+    }
+    while (result > 0 && ctx.todo_fill > 0) {
+        ctx.todo_fill--;
+        _dopipe_workitem item = ctx.todo[ctx.todo_fill];
+        result = _pipe_ProcessWork(&ctx, &item);
+    }
+    if (ctx.todo_onheap)
+        free(ctx.todo);
+    if (ctx.copied_map)
+        hash_FreeMap(ctx.copied_map);
+    if (result <= 0)
+        return result;
+
+    memcpy(vctarget, &newvalue, sizeof(newvalue));
+    ADDREF_NONHEAP(vctarget);
+    return 1;
+}
 
 int _pipe_DoPipeObject(
         h64vmthread *source_thread,
@@ -51,12 +635,6 @@ int _pipe_DoPipeObject(
         int *object_instances_transferlist_alloc,
         int *object_instances_transferlist_onheap
         ) {
-    _dopipe_dupobjectinfo _dupobjlistbuf[128];
-    _dopipe_dupobjectinfo *dup_todo_list = _dupobjlistbuf;
-    int dup_todo_list_heap = 0;
-    int dup_todo_list_fill = 0;
-    int dup_todo_list_alloc = 128;
-
     valuecontent *vcsource = STACK_ENTRY(
         source_thread->stack,
         slot_from - source_thread->stack->current_func_floor
@@ -67,37 +645,7 @@ int _pipe_DoPipeObject(
     );
     DELREF_NONHEAP(vctarget);
     valuecontent_Free(target_thread, vctarget);
-    memset(vctarget, 0, sizeof(*vctarget));
-
-    if (likely(vcsource->type == H64VALTYPE_INT64 ||
-            vcsource->type == H64VALTYPE_FLOAT64 ||
-            vcsource->type == H64VALTYPE_NONE ||
-            vcsource->type == H64VALTYPE_BOOL ||
-            vcsource->type == H64VALTYPE_SHORTSTR ||
-            vcsource->type == H64VALTYPE_SHORTBYTES ||
-            vcsource->type == H64VALTYPE_CLASSREF ||
-            vcsource->type == H64VALTYPE_FUNCREF ||
-            vcsource->type == H64VALTYPE_UNSPECIFIED_KWARG)) {
-        memcpy(vctarget, vcsource, sizeof(*vcsource));
-        ADDREF_NONHEAP(vctarget);
-    } else if (vcsource->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue*)vcsource->ptr_value)->type ==
-            H64GCVALUETYPE_OBJINSTANCE) {
-        assert(0);
-    } else if (vcsource->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue*)vcsource->ptr_value)->type ==
-            H64GCVALUETYPE_SET) {
-        assert(0);
-    } else if (vcsource->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue*)vcsource->ptr_value)->type ==
-            H64GCVALUETYPE_LIST) {
-        assert(0);
-    } else if (vcsource->type == H64VALTYPE_GCVAL &&
-            ((h64gcvalue*)vcsource->ptr_value)->type ==
-            H64GCVALUETYPE_MAP) {
-        assert(0);
-    } else {
-        assert(0);
-    }
-    return 1;
-}
\ No newline at end of file
+    return _pipe_DoPipeValue(
+        source_thread, target_thread, vcsource, PIPESOURCE_SLOT, vctarget
+    );
+}
@@ -10,6 +10,32 @@
 typedef struct h64gcvalue h64gcvalue;
 typedef struct h64pipe h64pipe;
 typedef struct h64vmthread h64vmthread;
+typedef struct valuecontent valuecontent;
+
+typedef enum pipesource {
+    PIPESOURCE_SLOT = 0,  // a stack slot, holding the only reference
+    PIPESOURCE_CFUNCSLOT0,  // slot 0 of a running C func, see vmexec.c
+    PIPESOURCE_ENTRY,  // a container entry, always copied if shared
+    PIPESOURCE_OWNEDENTRY  // entry of a container only we hold
+} pipesource;
+
+int _pipe_DoPipeValue(
+    h64vmthread *source_thread, h64vmthread *target_thread,
+    valuecontent *vcsource, pipesource source_kind,
+    valuecontent *vctarget
+);  // Sets vctarget to a version of vcsource for target_thread, holding
+    // one reference. Values only vcsource references are moved, which
+    // sets vcsource to none, except for PIPESOURCE_CFUNCSLOT0 since
+    // vmexec.c holds on to that slot: there, a container's contents
+    // are moved while it stays behind empty.
+    // Returns 1 on success, 0 on oom, -1 for unsupported value types.
+
+int _pipe_CheckPipeable(
+    h64vmthread *source_thread, valuecontent *v
+);  // Checks everything reachable from v without piping anything, like
+    // _pipe_DoPipeValue() does first. Object instances other than
+    // channels are rejected, since their .on_piped() isn't supported.
+    // Returns 1 if pipeable, 0 on oom, -1 for unsupported value types.
 
 
 int _pipe_DoPipeObject(
@@ -20,6 +46,6 @@ int _pipe_DoPipeObject(
     int *object_instances_transferlist_count,
     int *object_instances_transferlist_alloc,
     int *object_instances_transferlist_onheap
-);
+);  // returns 1 on success, 0 on oom, -1 for unsupported value types
 
 #endif  // HORSE64_PIPE_H_
\ No newline at end of file
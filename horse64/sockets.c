@@ -17,6 +17,9 @@ typedef int socklen_t;
 #include <netinet/in.h>
 #include <errno.h>
 #endif
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,6 +34,12 @@ typedef int socklen_t;
 #include "widechar.h"
 
 void _sockets_CloseNoLock(h64socket *s);
+#if defined(CANUSEEPOLL)
+static int _sockset_EpollSetMask(
+    h64sockset *set, h64sockfd_t fd, uint32_t waittypes, int rearm
+);
+static int _sockset_EpollWait(h64sockset *set, int64_t timeout_ms);
+#endif
 
 extern int _vmsockets_debug;
 static volatile _Atomic int _sockinitdone = 0;
@@ -1438,7 +1447,7 @@ void sockset_Remove(
     while (i < set->fds_count) {
         if (set->fds[i] == fd) {
             if (i + 1 < set->fds_count)
-                memcpy(
+                memmove(
                     &set->fds[i],
                     &set->fds[i + 1],
                     sizeof(*set->fds) * (
@@ -1451,6 +1460,12 @@ void sockset_Remove(
         i++;
     }
     #else
+    #if defined(CANUSEEPOLL)
+    if (set->isepoll) {
+        _sockset_EpollSetMask(set, fd, 0, 0);
+        return;
+    }
+    #endif
     int i = 0;
     const int count = set->fill;
     struct pollfd *delset = (
@@ -1459,7 +1474,7 @@ void sockset_Remove(
     while (i < count) {
         if (delset[i].fd == fd) {
             if (i + 1 < count)
-                memcpy(
+                memmove(
                     &delset[i],
                     &delset[i + 1],
                     sizeof(*set->set) * (count - i - 1)
@@ -1564,6 +1579,15 @@ void sockset_RemoveWithMask(
     }
     return;
     #else
+    #if defined(CANUSEEPOLL)
+    if (set->isepoll) {
+        if (fd >= 0 && fd < set->epollmask_size)
+            _sockset_EpollSetMask(
+                set, fd, set->epollmask[fd] & ~((uint32_t)waittypes), 0
+            );
+        return;
+    }
+    #endif
     int i = 0;
     const int count = set->fill;
     struct pollfd *delset = (
@@ -1578,7 +1602,7 @@ void sockset_RemoveWithMask(
             );
             if (delset[i].events == 0) {
                 if (i + 1 < count)
-                    memcpy(
+                    memmove(
                         &delset[i],
                         &delset[i + 1],
                         sizeof(*set->set) * (count - i - 1)
@@ -1610,6 +1634,10 @@ int sockset_Wait(
     if (timeout_ms < 0)
         timeout_ms = -1;
     set->resultfill = 0;
+    #if defined(CANUSEEPOLL)
+    if (set->isepoll)
+        return _sockset_EpollWait(set, timeout_ms);
+    #endif
     struct pollfd *pollset = (
         set->size == 0 ? (struct pollfd*)set->smallset : set->set
     );
@@ -1641,6 +1669,148 @@ int sockset_Wait(
     #endif
 }
 
+int sockset_InitPersistent(h64sockset *set) {
+    sockset_Init(set);
+    #if defined(CANUSEEPOLL)
+    set->result = malloc(sizeof(*set->result) * _epollresultsize);
+    if (!set->result)
+        return 0;
+    set->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (set->epollfd < 0) {
+        free(set->result);
+        set->result = NULL;
+        return 0;
+    }
+    set->size = _epollresultsize;
+    set->isepoll = 1;
+    #endif
+    return 1;
+}
+
+#if defined(CANUSEEPOLL)
+static uint32_t _sockset_ToEpollEvents(uint32_t waittypes) {
+    uint32_t events = EPOLLET;
+    if ((waittypes & H64SOCKSET_WAITREAD) != 0)
+        events |= EPOLLIN;
+    if ((waittypes & H64SOCKSET_WAITWRITE) != 0)
+        events |= EPOLLOUT;
+    // EPOLLERR and EPOLLHUP are always reported by the kernel.
+    return events;
+}
+
+static int _sockset_EpollSetMask(
+        h64sockset *set, h64sockfd_t fd, uint32_t waittypes, int rearm
+        ) {
+    if (fd < 0)
+        return 0;
+    if (fd >= set->epollmask_size) {
+        if (waittypes == 0)
+            return 1;
+        int newsize = set->epollmask_size * 2;
+        if (newsize < fd + 64)
+            newsize = fd + 64;
+        uint32_t *newmask = realloc(
+            set->epollmask, sizeof(*newmask) * newsize
+        );
+        if (!newmask)
+            return 0;
+        memset(
+            &newmask[set->epollmask_size], 0,
+            sizeof(*newmask) * (newsize - set->epollmask_size)
+        );
+        set->epollmask = newmask;
+        set->epollmask_size = newsize;
+    }
+    uint32_t oldtypes = set->epollmask[fd];
+    if (oldtypes == waittypes && (!rearm || waittypes == 0))
+        return 1;
+    struct epoll_event ev = {0};
+    ev.events = _sockset_ToEpollEvents(waittypes);
+    ev.data.fd = fd;
+    int result = 0;
+    if (waittypes == 0) {
+        result = epoll_ctl(set->epollfd, EPOLL_CTL_DEL, fd, &ev);
+        if (result < 0 && (errno == EBADF || errno == ENOENT))
+            result = 0;  // fd was closed already, which drops it
+    } else if (oldtypes == 0) {
+        result = epoll_ctl(set->epollfd, EPOLL_CTL_ADD, fd, &ev);
+        if (result < 0 && errno == EEXIST)
+            result = epoll_ctl(set->epollfd, EPOLL_CTL_MOD, fd, &ev);
+    } else {
+        // Note: this re-arms the edge, so a still ready fd is
+        // reported once more.
+        result = epoll_ctl(set->epollfd, EPOLL_CTL_MOD, fd, &ev);
+        if (result < 0 && errno == ENOENT)
+            result = epoll_ctl(set->epollfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    if (result < 0)
+        return 0;
+    set->epollmask[fd] = waittypes;
+    return 1;
+}
+
+int _sockset_EpollAdd(
+        h64sockset *set, h64sockfd_t fd, int waittypes
+        ) {
+    if (waittypes == 0)
+        return 1;
+    uint32_t oldtypes = (
+        (fd >= 0 && fd < set->epollmask_size) ? set->epollmask[fd] : 0
+    );
+    // Always re-arm, since whoever adds this expects to hear about
+    // the fd if it's ready right now, even if the edge already passed:
+    return _sockset_EpollSetMask(
+        set, fd, oldtypes | (uint32_t)waittypes, 1
+    );
+}
+
+void _sockset_EpollClear(h64sockset *set) {
+    int fd = 0;
+    while (fd < set->epollmask_size) {
+        if (set->epollmask[fd] != 0)
+            _sockset_EpollSetMask(set, fd, 0, 0);
+        fd++;
+    }
+    set->resultfill = 0;
+}
+
+static int _sockset_EpollWait(
+        h64sockset *set, int64_t timeout_ms
+        ) {
+    struct epoll_event events[_epollresultsize];
+    int timeouti32 = (
+        (int64_t)timeout_ms > (int64_t)INT32_MAX ?
+        (int32_t)INT32_MAX : (int32_t)timeout_ms
+    );
+    int result = epoll_wait(
+        set->epollfd, events, _epollresultsize, timeouti32
+    );
+    set->resultfill = 0;
+    int i = 0;
+    while (i < result) {
+        int fd = events[i].data.fd;
+        short revents = 0;
+        if ((events[i].events & EPOLLIN) != 0)
+            revents |= POLLIN;
+        if ((events[i].events & EPOLLOUT) != 0)
+            revents |= POLLOUT;
+        if ((events[i].events & EPOLLERR) != 0)
+            revents |= POLLERR;
+        if ((events[i].events & EPOLLHUP) != 0)
+            revents |= POLLHUP;
+        set->result[set->resultfill].fd = fd;
+        set->result[set->resultfill].events = (
+            (fd >= 0 && fd < set->epollmask_size) ?
+            set->epollmask[fd] : 0
+        );
+        set->result[set->resultfill].revents = revents;
+        set->resultfill++;
+        i++;
+    }
+    return (result > 0 ? result : 0);
+}
+#endif
+
 int _sockset_Expand(
         ATTR_UNUSED h64sockset *set
         ) {
@@ -1656,6 +1826,11 @@ int _sockset_Expand(
     if (set->size == 0) {
         if (newsize < _pollsmallsetsize * 2)
             newsize = _pollsmallsetsize * 2;
+        set->result = malloc(
+            sizeof(*set->result) * newsize
+        );
+        if (!set->result)
+            return 0;
         set->set = malloc(
             sizeof(*set->set) * newsize
         );
@@ -1665,6 +1840,8 @@ int _sockset_Expand(
                 sizeof(*set->set) * _pollsmallsetsize
             );
         } else {
+            free(set->result);
+            set->result = NULL;
             return 0;
         }
     } else {
@@ -16,6 +16,7 @@
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <unistd.h>
 #endif
 #include <assert.h>
 #include <openssl/ssl.h>
@@ -42,6 +43,10 @@
 #undef CANUSEPOLL
 #endif
 #endif
+#if defined(CANUSEPOLL) && defined(__linux__) && \
+    defined(USE_EPOLL_ON_LINUX) && USE_EPOLL_ON_LINUX != 0
+#define CANUSEEPOLL
+#endif
 
 #if defined(_WIN32) || defined(_WIN64)
 typedef uintptr_t h64sockfd_t;
@@ -65,6 +70,7 @@ typedef struct h64socket {
 typedef struct h64threadevent h64threadevent;
 
 #define _pollsmallsetsize 12
+#define _epollresultsize 256
 
 typedef struct h64sockset {
     #if defined(_WIN32) || defined(_WIN64) || !defined(CANUSEPOLL)
@@ -80,6 +86,13 @@ typedef struct h64sockset {
     struct pollfd smallresult[_pollsmallsetsize];
     struct pollfd *result;
     int resultfill;
+    #if defined(CANUSEEPOLL)
+    // Only used for sets made with sockset_InitPersistent():
+    uint8_t isepoll;
+    int epollfd;
+    uint32_t *epollmask;  // registered wait types, indexed by fd
+    int epollmask_size;
+    #endif
     #endif
 } h64sockset;
 
@@ -109,6 +122,18 @@ int _sockset_Expand(
     ATTR_UNUSED h64sockset *set
 );
 
+int sockset_InitPersistent(
+    h64sockset *set
+);  // returns 1 on success, 0 on failure
+
+#if defined(CANUSEEPOLL)
+int _sockset_EpollAdd(
+    h64sockset *set, h64sockfd_t fd, int waittypes
+);
+
+void _sockset_EpollClear(h64sockset *set);
+#endif
+
 typedef enum h64sockerror {
     H64SOCKERROR_SUCCESS = 0,
     H64SOCKERROR_CONNECTIONDISCONNECTED = -1,
@@ -201,10 +226,14 @@ ATTR_UNUSED static inline int sockset_Add(
         FD_SET(fd, &set->errorset);
     return 1;
     #else
-    if (set->size == 0)
-        if (set->fill + 1 > _pollsmallsetsize)
-            if (!_sockset_Expand(set))
-                return 0;
+    #if defined(CANUSEEPOLL)
+    if (set->isepoll)
+        return _sockset_EpollAdd(set, fd, waittypes);
+    #endif
+    if (set->fill + 1 > (
+            set->size == 0 ? _pollsmallsetsize : set->size))
+        if (!_sockset_Expand(set))
+            return 0;
     if (set->size == 0) {
         set->smallset[set->fill].fd = fd;
         set->smallset[set->fill].events = waittypes;
@@ -236,6 +265,12 @@ ATTR_UNUSED static inline void sockset_Clear(
     FD_ZERO(&set->errorset);
     set->fds_count = 0;
     #else
+    #if defined(CANUSEEPOLL)
+    if (set->isepoll) {
+        _sockset_EpollClear(set);
+        return;
+    }
+    #endif
     set->fill = 0;
     #endif
 }
@@ -250,16 +285,21 @@ ATTR_UNUSED static inline void sockset_Uninit(
     }
     set->fds_count = 0;
     #else
-    if (set->size != 0) {
-        assert(set->set != NULL);
-        free(set->set);
-        set->set = NULL;
-        set->size = 0;
-    } else if (set->set != NULL) {
-        free(set->set);
-        set->set = NULL;
+    #if defined(CANUSEEPOLL)
+    if (set->isepoll) {
+        close(set->epollfd);
+        free(set->epollmask);
+        set->epollmask = NULL;
+        set->epollmask_size = 0;
+        set->isepoll = 0;
     }
     #endif
+    free(set->set);
+    set->set = NULL;
+    free(set->result);
+    set->result = NULL;
+    set->size = 0;
+    #endif
 }
 
 h64sockfd_t *sockset_GetResultList(
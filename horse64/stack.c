@@ -17,11 +17,15 @@
 #include "stack.h"
 
 
+void stack_Init(h64stack *st) {
+    memset(st, 0, sizeof(*st));
+}
+
 h64stack *stack_New() {
     h64stack *st = malloc(sizeof(*st));
     if (!st)
         return NULL;
-    memset(st, 0, sizeof(*st));
+    stack_Init(st);
 
     return st;
 }
@@ -35,15 +39,20 @@ HOTSPOT static inline void stack_FreeEntry(
     valuecontent_Free(vmthread, &st->entry[slot]);
 }
 
-void stack_Free(h64stack *st, h64vmthread *vmthread) {
-    if (!st)
-        return;
+void stack_Uninit(h64stack *st, h64vmthread *vmthread) {
     int64_t k = 0;
     while (k < st->entry_count) {
         stack_FreeEntry(st, vmthread, k);
         k++;
     }
     free(st->entry);
+    memset(st, 0, sizeof(*st));
+}
+
+void stack_Free(h64stack *st, h64vmthread *vmthread) {
+    if (!st)
+        return;
+    stack_Uninit(st, vmthread);
     free(st);
 }
 
@@ -27,6 +27,10 @@ typedef struct h64stack {
 
 h64stack *stack_New();
 
+void stack_Init(h64stack *st);
+
+void stack_Uninit(h64stack *st, h64vmthread *vmthread);
+
 int stack_IncreaseAlloc(
     h64stack *st, ATTR_UNUSED h64vmthread *vmthread,
     int64_t total_entries, int alloc_needed_margin
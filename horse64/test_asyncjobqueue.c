@@ -0,0 +1,117 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <assert.h>
+#include <check.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "asyncjobqueue.h"
+#include "mainpreinit.h"
+#include "threading.h"
+
+#include "testmain.h"
+
+#define RACETEST_ITEMS_PER_PUSHER 50000
+#define RACETEST_PUSHERS 3
+#define RACETEST_POPPERS 3
+#define RACETEST_ITEMS (RACETEST_ITEMS_PER_PUSHER * RACETEST_PUSHERS)
+
+static asyncjobqueue racetest_queue;
+static _Atomic int racetest_pushers_done = 0;
+static _Atomic int racetest_seen[RACETEST_ITEMS + 1];
+
+static void _racetest_pusher(void *userdata) {
+    uintptr_t first = (uintptr_t)userdata;
+    uintptr_t i = first;
+    while (i < first + RACETEST_ITEMS_PER_PUSHER) {
+        if (!asyncjobqueue_Push(&racetest_queue, (h64asyncsysjob *)i))
+            continue;  // full, try again
+        i++;
+    }
+    atomic_fetch_add(&racetest_pushers_done, 1);
+}
+
+static void _racetest_popper(ATTR_UNUSED void *userdata) {
+    while (1) {
+        h64asyncsysjob *job = asyncjobqueue_Pop(&racetest_queue);
+        if (job) {
+            atomic_fetch_add(&racetest_seen[(uintptr_t)job], 1);
+            continue;
+        }
+        if (atomic_load(&racetest_pushers_done) >= RACETEST_PUSHERS &&
+                asyncjobqueue_Count(&racetest_queue) == 0)
+            return;
+    }
+}
+
+START_TEST (test_asyncjobqueue)
+{
+    main_PreInit();
+
+    // Single thread, FIFO order and refusing to push when full:
+    asyncjobqueue q;
+    ck_assert(asyncjobqueue_Init(&q, 5));
+    ck_assert(q.size == 8);
+    ck_assert(asyncjobqueue_Pop(&q) == NULL);
+    uintptr_t i = 1;
+    while (i <= 8) {
+        ck_assert(asyncjobqueue_Push(&q, (h64asyncsysjob *)i));
+        i++;
+    }
+    ck_assert(!asyncjobqueue_Push(&q, (h64asyncsysjob *)9));
+    ck_assert(asyncjobqueue_Count(&q) == 8);
+    ck_assert(asyncjobqueue_Pop(&q) == (h64asyncsysjob *)1);
+    ck_assert(asyncjobqueue_Pop(&q) == (h64asyncsysjob *)2);
+    ck_assert(asyncjobqueue_Push(&q, (h64asyncsysjob *)9));
+    ck_assert(asyncjobqueue_Push(&q, (h64asyncsysjob *)10));
+    i = 3;
+    while (i <= 10) {
+        ck_assert(asyncjobqueue_Pop(&q) == (h64asyncsysjob *)i);
+        i++;
+    }
+    ck_assert(asyncjobqueue_Pop(&q) == NULL);
+    ck_assert(asyncjobqueue_Count(&q) == 0);
+    asyncjobqueue_Uninit(&q);
+
+    // Several pushers racing several poppers on a small queue must
+    // hand over every entry exactly once:
+    ck_assert(asyncjobqueue_Init(&racetest_queue, 64));
+    thread *pushers[RACETEST_PUSHERS];
+    thread *poppers[RACETEST_POPPERS];
+    int k = 0;
+    while (k < RACETEST_POPPERS) {
+        poppers[k] = thread_Spawn(_racetest_popper, NULL);
+        ck_assert(poppers[k] != NULL);
+        k++;
+    }
+    k = 0;
+    while (k < RACETEST_PUSHERS) {
+        pushers[k] = thread_Spawn(
+            _racetest_pusher,
+            (void *)(uintptr_t)(1 + k * RACETEST_ITEMS_PER_PUSHER)
+        );
+        ck_assert(pushers[k] != NULL);
+        k++;
+    }
+    k = 0;
+    while (k < RACETEST_PUSHERS) {
+        thread_Join(pushers[k]);
+        k++;
+    }
+    k = 0;
+    while (k < RACETEST_POPPERS) {
+        thread_Join(poppers[k]);
+        k++;
+    }
+    i = 1;
+    while (i <= RACETEST_ITEMS) {
+        ck_assert(atomic_load(&racetest_seen[i]) == 1);
+        i++;
+    }
+    asyncjobqueue_Uninit(&racetest_queue);
+}
+END_TEST
+
+TESTS_MAIN(test_asyncjobqueue)
@@ -0,0 +1,85 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <assert.h>
+#include <check.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mainpreinit.h"
+#include "sockets.h"
+
+#include "testmain.h"
+
+#define SOCKETTEST_PAIRS 20
+
+static void _sockettest_CheckSet(h64sockset *set, int persistent) {
+    h64socket *a[SOCKETTEST_PAIRS];
+    h64socket *b[SOCKETTEST_PAIRS];
+    int i = 0;
+    while (i < SOCKETTEST_PAIRS) {
+        ck_assert(sockets_NewPair(&a[i], &b[i]));
+        ck_assert(sockset_Add(set, a[i]->fd, H64SOCKSET_WAITREAD));
+        i++;
+    }
+
+    // Nothing was sent yet, so nothing is ready:
+    ck_assert(sockset_Wait(set, 0) == 0);
+    ck_assert(sockset_GetResult(set, a[7]->fd, H64SOCKSET_WAITREAD) == 0);
+
+    // Only the one pair we write to becomes readable:
+    char c = 'x';
+    ck_assert(send(b[13]->fd, &c, 1, 0) == 1);
+    ck_assert(sockset_Wait(set, 1000) == 1);
+    ck_assert(sockset_GetResult(set, a[13]->fd, H64SOCKSET_WAITREAD) != 0);
+    ck_assert(sockset_GetResult(set, a[12]->fd, H64SOCKSET_WAITREAD) == 0);
+    h64sockfd_t buf[8];
+    int count = 0;
+    h64sockfd_t *list = sockset_GetResultList(
+        set, buf, 8, H64SOCKSET_WAITALL, &count
+    );
+    ck_assert(list == buf && count == 1 && buf[0] == a[13]->fd);
+
+    if (persistent) {
+        #if defined(CANUSEEPOLL)
+        // Edge-triggered: no new report until something changes,
+        // or until the fd is added again:
+        ck_assert(sockset_Wait(set, 0) == 0);
+        ck_assert(sockset_Add(set, a[13]->fd, H64SOCKSET_WAITREAD));
+        ck_assert(sockset_Wait(set, 0) == 1);
+        #endif
+    }
+
+    // Removed fds are no longer reported:
+    sockset_RemoveWithMask(set, a[13]->fd, H64SOCKSET_WAITREAD);
+    sockset_Remove(set, a[2]->fd);
+    ck_assert(send(b[2]->fd, &c, 1, 0) == 1);
+    ck_assert(sockset_Wait(set, 0) == 0);
+
+    i = 0;
+    while (i < SOCKETTEST_PAIRS) {
+        sockets_Destroy(a[i]);
+        sockets_Destroy(b[i]);
+        i++;
+    }
+}
+
+START_TEST (test_sockets_sockset)
+{
+    main_PreInit();
+
+    // Plain set, which needs to grow past its small built-in storage:
+    h64sockset set;
+    sockset_Init(&set);
+    _sockettest_CheckSet(&set, 0);
+    sockset_Uninit(&set);
+
+    // Long-lived set, which uses epoll where available:
+    ck_assert(sockset_InitPersistent(&set));
+    _sockettest_CheckSet(&set, 1);
+    sockset_Uninit(&set);
+}
+END_TEST
+
+TESTS_MAIN(test_sockets_sockset)
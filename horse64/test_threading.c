@@ -0,0 +1,50 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <assert.h>
+#include <check.h>
+#include <stdint.h>
+
+#include "mainpreinit.h"
+#include "threading.h"
+
+#include "testmain.h"
+
+START_TEST (test_threadcpuset)
+{
+    main_PreInit();
+
+    threadcpuset set;
+    ck_assert(threadcpuset_FromStr(&set, "0-3,6,64"));
+    ck_assert(threadcpuset_Count(&set) == 6);
+    ck_assert(threadcpuset_Has(&set, 2));
+    ck_assert(!threadcpuset_Has(&set, 4));
+    ck_assert(threadcpuset_Has(&set, 64));
+    ck_assert(threadcpuset_Nth(&set, 0) == 0);
+    ck_assert(threadcpuset_Nth(&set, 4) == 6);
+    ck_assert(threadcpuset_Nth(&set, 5) == 64);
+    ck_assert(threadcpuset_Nth(&set, 6) == -1);
+    threadcpuset_Remove(&set, 6);
+    ck_assert(threadcpuset_Count(&set) == 5);
+    ck_assert(threadcpuset_Nth(&set, 4) == 64);
+
+    ck_assert(threadcpuset_FromStr(&set, "5"));
+    ck_assert(threadcpuset_Count(&set) == 1);
+    ck_assert(!threadcpuset_FromStr(&set, ""));
+    ck_assert(!threadcpuset_FromStr(&set, "3-1"));
+    ck_assert(!threadcpuset_FromStr(&set, "1,,2"));
+    ck_assert(!threadcpuset_FromStr(&set, "1,"));
+    ck_assert(!threadcpuset_FromStr(&set, "a"));
+    ck_assert(!threadcpuset_FromStr(&set, "99999"));
+    ck_assert(!threadcpuset_Add(&set, THREAD_MAX_CPUS));
+
+    #if defined(__linux__)
+    // Pinning ourselves to the first CPU should always work:
+    ck_assert(threadcpuset_FromStr(&set, "0"));
+    ck_assert(thread_SetCpuAffinity(thread_GetOurThreadId(), &set));
+    #endif
+}
+END_TEST
+
+TESTS_MAIN(test_threadcpuset)
@@ -0,0 +1,388 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <assert.h>
+#include <check.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "gcvalue.h"
+#include "mainpreinit.h"
+#include "pipe.h"
+#include "poolalloc.h"
+#include "threading.h"
+#include "valuecontentstruct.h"
+#include "vmchannel.h"
+#include "vmexec.h"
+#include "vmlist.h"
+#include "vmschedule.h"
+#include "vmstrings.h"
+
+#include "testmain.h"
+
+#define STRESSTEST_PER_PRODUCER 20000
+#define STRESSTEST_PRODUCERS 2
+#define STRESSTEST_CONSUMERS 2
+
+static h64gcvalue *_newlist(h64vmthread *vt) {
+    h64gcvalue *gcval = poolalloc_malloc(vt->heap, 0);
+    ck_assert(gcval != NULL);
+    memset(gcval, 0, sizeof(*gcval));
+    gcval->type = H64GCVALUETYPE_LIST;
+    gcval->hash = -1;
+    gcval->list_values = vmlist_New();
+    ck_assert(gcval->list_values != NULL);
+    return gcval;
+}
+
+static void _addstr(h64vmthread *vt, h64gcvalue *list, int64_t len) {
+    // Adds a string that isn't pooled, so moving it keeps the buffer:
+    assert(len * (int64_t)sizeof(h64wchar) > POOLEDSTRSIZE);
+    h64gcvalue *gcval = poolalloc_malloc(vt->heap, 0);
+    ck_assert(gcval != NULL);
+    memset(gcval, 0, sizeof(*gcval));
+    gcval->type = H64GCVALUETYPE_STRING;
+    ck_assert(vmstrings_AllocBuffer(vt, &gcval->str_val, len));
+    int64_t i = 0;
+    while (i < len) {
+        gcval->str_val.s[i] = 'a' + (i % 26);
+        i++;
+    }
+    gcval->str_val.letterlen = len;
+    valuecontent v = {0};
+    v.type = H64VALTYPE_GCVAL;
+    v.ptr_value = gcval;
+    ck_assert(vmlist_Add(list->list_values, &v) > 0);
+}
+
+static void _addgcval(h64gcvalue *list, h64gcvalue *gcval) {
+    valuecontent v = {0};
+    v.type = H64VALTYPE_GCVAL;
+    v.ptr_value = gcval;
+    ck_assert(vmlist_Add(list->list_values, &v) > 0);
+}
+
+static h64gcvalue *_listgcval(genericlist *l, int64_t i) {
+    valuecontent v = {0};
+    ck_assert(vmlist_Get(l, i, &v));
+    ck_assert(v.type == H64VALTYPE_GCVAL);
+    return v.ptr_value;
+}
+
+static h64wchar *_liststr(genericlist *l, int64_t i) {
+    valuecontent v = {0};
+    ck_assert(vmlist_Get(l, i, &v));
+    ck_assert(v.type == H64VALTYPE_GCVAL);
+    ck_assert(((h64gcvalue *)v.ptr_value)->type ==
+              H64GCVALUETYPE_STRING);
+    return ((h64gcvalue *)v.ptr_value)->str_val.s;
+}
+
+static h64channel *stresstest_ch = NULL;
+static _Atomic int64_t stresstest_sum = 0;
+static _Atomic int64_t stresstest_received = 0;
+
+static void _stresstest_producer(void *userdata) {
+    h64vmthread *vt = userdata;
+    int64_t i = 1;
+    while (i <= STRESSTEST_PER_PRODUCER) {
+        valuecontent v = {0};
+        v.type = H64VALTYPE_INT64;
+        v.int_value = i;
+        vmchannelresult result;
+        while ((result = vmchannel_Send(
+                stresstest_ch, vt, &v, PIPESOURCE_SLOT
+                )) == VMCHANNEL_MUSTWAIT) {
+            vmchannel_ForgetWaiter(stresstest_ch, vt);
+            thread_Yield();
+        }
+        assert(result == VMCHANNEL_DONE);
+        i++;
+    }
+}
+
+static void _stresstest_consumer(void *userdata) {
+    h64vmthread *vt = userdata;
+    while (1) {
+        valuecontent out[8];
+        int64_t got = 0;
+        vmchannelresult result = vmchannel_Receive(
+            stresstest_ch, vt, out, 8, &got
+        );
+        if (result == VMCHANNEL_CLOSED)
+            break;
+        if (result == VMCHANNEL_MUSTWAIT) {
+            vmchannel_ForgetWaiter(stresstest_ch, vt);
+            thread_Yield();
+            continue;
+        }
+        assert(result == VMCHANNEL_DONE && got >= 1 && got <= 8);
+        int64_t k = 0;
+        while (k < got) {
+            assert(out[k].type == H64VALTYPE_INT64);
+            atomic_fetch_add(&stresstest_sum, out[k].int_value);
+            k++;
+        }
+        atomic_fetch_add(&stresstest_received, got);
+    }
+}
+
+START_TEST (test_vmchannel)
+{
+    main_PreInit();
+
+    h64vmexec *vmexec = vmexec_New();
+    ck_assert(vmexec != NULL);
+    vmexec->worker_overview->worker_mutex = mutex_Create();
+    ck_assert(vmexec->worker_overview->worker_mutex != NULL);
+    h64class channelclass = {0};
+    h64program pr = {0};
+    pr.classes = &channelclass;
+    pr.classes_count = 1;
+    pr._channel_class_idx = 0;
+    vmexec->program = &pr;
+
+    // Two parallel threads, so nothing is shared between heaps:
+    h64vmthread *a = vmthread_New(vmexec, 0);
+    h64vmthread *b = vmthread_New(vmexec, 0);
+    ck_assert(a != NULL && b != NULL);
+    h64channel *ch = vmchannel_New(vmexec, 2);
+    ck_assert(ch != NULL);
+    h64gcvalue *chobj = vmchannel_NewObject(a, ch);
+    ck_assert(chobj != NULL);
+    chobj->externalreferencecount = 1;
+    ck_assert(atomic_load(&ch->refcount) == 1);
+
+    // Full and empty channel, and the waiters it tracks:
+    valuecontent v = {0};
+    valuecontent out[4];
+    int64_t got = 0;
+    v.type = H64VALTYPE_INT64;
+    v.int_value = 1;
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_DONE);
+    v.int_value = 2;
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_DONE);
+    ck_assert(!vmchannel_CanSend(ch));
+    v.int_value = 3;
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_MUSTWAIT);
+    ck_assert(ch->send_waiters.count == 1);
+    ck_assert(vmchannel_Receive(ch, b, out, 4, &got) == VMCHANNEL_DONE);
+    ck_assert(got == 2);
+    ck_assert(out[0].type == H64VALTYPE_INT64 && out[0].int_value == 1);
+    ck_assert(out[1].type == H64VALTYPE_INT64 && out[1].int_value == 2);
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_DONE);
+    ck_assert(ch->send_waiters.count == 0);
+    ck_assert(vmchannel_Receive(ch, b, out, 4, &got) == VMCHANNEL_DONE);
+    ck_assert(got == 1 && out[0].int_value == 3);
+    ck_assert(vmchannel_Receive(ch, b, out, 4, &got) ==
+              VMCHANNEL_MUSTWAIT);
+    ck_assert(ch->receive_waiters.count == 1);
+    vmchannel_ForgetWaiter(ch, b);
+    ck_assert(ch->receive_waiters.count == 0);
+
+    // A value nobody else holds is moved in and out without a copy:
+    h64gcvalue *l = _newlist(a);
+    _addstr(a, l, 100);
+    l->externalreferencecount = 1;
+    genericlist *payload = l->list_values;
+    h64wchar *strbuf = _liststr(payload, 1);
+    v.type = H64VALTYPE_GCVAL;
+    v.ptr_value = l;
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_DONE);
+    ck_assert(v.type == H64VALTYPE_NONE);
+    ck_assert(vmchannel_Receive(ch, b, out, 1, &got) == VMCHANNEL_DONE);
+    ck_assert(got == 1 && out[0].type == H64VALTYPE_GCVAL);
+    ck_assert(((h64gcvalue *)out[0].ptr_value)->list_values == payload);
+    ck_assert(_liststr(payload, 1) == strbuf);
+    DELREF_NONHEAP(&out[0]);
+    valuecontent_Free(b, &out[0]);
+
+    // Slot 0 of a C func keeps its container, but emptied out:
+    l = _newlist(a);
+    _addstr(a, l, 100);
+    l->externalreferencecount = 2;
+    payload = l->list_values;
+    v.type = H64VALTYPE_GCVAL;
+    v.ptr_value = l;
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_CFUNCSLOT0) ==
+              VMCHANNEL_DONE);
+    ck_assert(v.type == H64VALTYPE_GCVAL && v.ptr_value == l);
+    ck_assert(l->list_values != payload &&
+              vmlist_Count(l->list_values) == 0);
+    ck_assert(vmchannel_Receive(ch, b, out, 1, &got) == VMCHANNEL_DONE);
+    ck_assert(((h64gcvalue *)out[0].ptr_value)->list_values == payload);
+    DELREF_NONHEAP(&out[0]);
+    valuecontent_Free(b, &out[0]);
+
+    // A shared value is copied and stays intact:
+    _addstr(a, l, 100);
+    payload = l->list_values;
+    strbuf = _liststr(payload, 1);
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_DONE);
+    ck_assert(v.type == H64VALTYPE_GCVAL && l->list_values == payload);
+    ck_assert(vmchannel_Receive(ch, b, out, 1, &got) == VMCHANNEL_DONE);
+    genericlist *received = ((h64gcvalue *)out[0].ptr_value)->list_values;
+    ck_assert(received != payload && vmlist_Count(received) == 1);
+    ck_assert(_liststr(received, 1) != strbuf);
+    ck_assert(memcmp(_liststr(received, 1), strbuf,
+                     sizeof(*strbuf) * 100) == 0);
+    DELREF_NONHEAP(&out[0]);
+    valuecontent_Free(b, &out[0]);
+
+    // Batches move the entries of a list only we hold, and wait
+    // once the channel is full:
+    l = _newlist(a);
+    _addstr(a, l, 100);
+    _addstr(a, l, 100);
+    _addstr(a, l, 100);
+    h64wchar *strbuf2 = _liststr(l->list_values, 2);
+    int64_t next = 0;
+    ck_assert(vmchannel_SendList(ch, a, l->list_values, 1, &next) ==
+              VMCHANNEL_MUSTWAIT);
+    ck_assert(next == 2);
+    ck_assert(vmlist_Get(l->list_values, 1, &v) &&
+              v.type == H64VALTYPE_NONE);
+    ck_assert(vmchannel_Receive(ch, b, out, 4, &got) == VMCHANNEL_DONE);
+    ck_assert(got == 2);
+    ck_assert(((h64gcvalue *)out[1].ptr_value)->str_val.s == strbuf2);
+    ck_assert(vmchannel_SendList(ch, a, l->list_values, 1, &next) ==
+              VMCHANNEL_DONE);
+    ck_assert(next == 3 && ch->send_waiters.count == 0);
+    ck_assert(vmchannel_Receive(ch, b, &out[2], 2, &got) ==
+              VMCHANNEL_DONE);
+    ck_assert(got == 1);
+    int k = 0;
+    while (k < 3) {
+        DELREF_NONHEAP(&out[k]);
+        valuecontent_Free(b, &out[k]);
+        k++;
+    }
+
+    // A value found twice in a moved list is still one value after:
+    l = _newlist(a);
+    l->externalreferencecount = 1;
+    h64gcvalue *inner = _newlist(a);
+    _addgcval(l, inner);
+    _addgcval(l, inner);
+    v.type = H64VALTYPE_GCVAL;
+    v.ptr_value = l;
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_DONE);
+    ck_assert(vmchannel_Receive(ch, b, out, 1, &got) == VMCHANNEL_DONE);
+    received = ((h64gcvalue *)out[0].ptr_value)->list_values;
+    ck_assert(vmlist_Count(received) == 2);
+    ck_assert(_listgcval(received, 1) == _listgcval(received, 2));
+    ck_assert(_listgcval(received, 1)->heapreferencecount == 2);
+    DELREF_NONHEAP(&out[0]);
+    valuecontent_Free(b, &out[0]);
+
+    // Nothing is moved if a nested value can't be piped:
+    l = _newlist(a);
+    l->externalreferencecount = 1;
+    _addstr(a, l, 100);
+    h64gcvalue *closure = poolalloc_malloc(a->heap, 0);
+    ck_assert(closure != NULL);
+    memset(closure, 0, sizeof(*closure));
+    closure->type = H64GCVALUETYPE_FUNCREF_CLOSURE;
+    _addgcval(l, closure);
+    payload = l->list_values;
+    strbuf = _liststr(payload, 1);
+    v.type = H64VALTYPE_GCVAL;
+    v.ptr_value = l;
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_UNSUPPORTEDTYPE);
+    ck_assert(v.type == H64VALTYPE_GCVAL && v.ptr_value == l);
+    ck_assert(l->list_values == payload && vmlist_Count(payload) == 2);
+    ck_assert(_liststr(payload, 1) == strbuf);
+    ck_assert(atomic_load(&ch->count) == 0);
+
+    // Channel objects passed through refer to the same channel:
+    v.type = H64VALTYPE_GCVAL;
+    v.ptr_value = chobj;
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_DONE);
+    ck_assert(v.ptr_value == chobj && atomic_load(&ch->refcount) == 2);
+    ck_assert(vmchannel_Receive(ch, b, out, 1, &got) == VMCHANNEL_DONE);
+    ck_assert(out[0].type == H64VALTYPE_GCVAL &&
+              out[0].ptr_value != chobj);
+    ck_assert(vmchannel_IsChannelObject(b, out[0].ptr_value));
+    ck_assert(vmchannel_FromObject(out[0].ptr_value) == ch);
+    ck_assert(atomic_load(&ch->refcount) == 2);
+    DELREF_NONHEAP(&out[0]);
+    valuecontent_Free(b, &out[0]);
+    ck_assert(atomic_load(&ch->refcount) == 1);
+
+    // Closed channels still hand out what is left:
+    v.type = H64VALTYPE_INT64;
+    v.int_value = 5;
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_DONE);
+    vmchannel_Close(ch);
+    ck_assert(vmchannel_Send(ch, a, &v, PIPESOURCE_SLOT) ==
+              VMCHANNEL_CLOSED);
+    ck_assert(vmchannel_Receive(ch, b, out, 4, &got) == VMCHANNEL_DONE);
+    ck_assert(got == 1 && out[0].int_value == 5);
+    ck_assert(vmchannel_Receive(ch, b, out, 4, &got) ==
+              VMCHANNEL_CLOSED);
+    ck_assert(ch->receive_waiters.count == 0);
+
+    // Dropping the last object frees the channel:
+    chobj->externalreferencecount--;
+    v.type = H64VALTYPE_GCVAL;
+    v.ptr_value = chobj;
+    valuecontent_Free(a, &v);
+
+    // Racing senders and receivers must see each value exactly once:
+    stresstest_ch = vmchannel_New(vmexec, 4);
+    ck_assert(stresstest_ch != NULL);
+    thread *producers[STRESSTEST_PRODUCERS];
+    thread *consumers[STRESSTEST_CONSUMERS];
+    k = 0;
+    while (k < STRESSTEST_CONSUMERS) {
+        h64vmthread *vt = vmthread_New(vmexec, 0);
+        ck_assert(vt != NULL);
+        consumers[k] = thread_Spawn(_stresstest_consumer, vt);
+        ck_assert(consumers[k] != NULL);
+        k++;
+    }
+    k = 0;
+    while (k < STRESSTEST_PRODUCERS) {
+        h64vmthread *vt = vmthread_New(vmexec, 0);
+        ck_assert(vt != NULL);
+        producers[k] = thread_Spawn(_stresstest_producer, vt);
+        ck_assert(producers[k] != NULL);
+        k++;
+    }
+    k = 0;
+    while (k < STRESSTEST_PRODUCERS) {
+        thread_Join(producers[k]);
+        k++;
+    }
+    vmchannel_Close(stresstest_ch);
+    k = 0;
+    while (k < STRESSTEST_CONSUMERS) {
+        thread_Join(consumers[k]);
+        k++;
+    }
+    ck_assert(atomic_load(&stresstest_received) ==
+              STRESSTEST_PER_PRODUCER * STRESSTEST_PRODUCERS);
+    ck_assert(atomic_load(&stresstest_sum) ==
+              (int64_t)STRESSTEST_PER_PRODUCER *
+              (STRESSTEST_PER_PRODUCER + 1) / 2 * STRESSTEST_PRODUCERS);
+    vmchannel_Free(stresstest_ch);
+
+    vmexec->program = NULL;
+    vmexec_Free(vmexec);
+}
+END_TEST
+
+TESTS_MAIN(test_vmchannel)
@@ -0,0 +1,116 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <assert.h>
+#include <check.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "mainpreinit.h"
+#include "threading.h"
+#include "vmrunqueue.h"
+
+#include "testmain.h"
+
+#define STEALTEST_ITEMS 100000
+#define STEALTEST_THIEVES 3
+
+static vmrunqueue stealtest_queue;
+static _Atomic int stealtest_done = 0;
+static _Atomic int stealtest_seen[STEALTEST_ITEMS + 1];
+
+static void _stealtest_thief(ATTR_UNUSED void *userdata) {
+    while (!atomic_load(&stealtest_done)) {
+        h64vmthread *vt = vmrunqueue_Steal(&stealtest_queue);
+        if (vt)
+            atomic_fetch_add(&stealtest_seen[(uintptr_t)vt], 1);
+    }
+}
+
+START_TEST (test_vmrunqueue)
+{
+    main_PreInit();
+
+    // Owner side only, LIFO order and growing past the first buffer:
+    vmrunqueue q;
+    ck_assert(vmrunqueue_Init(&q));
+    ck_assert(vmrunqueue_Pop(&q) == NULL);
+    ck_assert(vmrunqueue_Steal(&q) == NULL);
+    uintptr_t i = 1;
+    while (i <= 200) {
+        ck_assert(vmrunqueue_Push(&q, (h64vmthread *)i));
+        i++;
+    }
+    ck_assert(vmrunqueue_Count(&q) == 200);
+    ck_assert(vmrunqueue_Steal(&q) == (h64vmthread *)1);
+    ck_assert(vmrunqueue_Pop(&q) == (h64vmthread *)200);
+    ck_assert(vmrunqueue_Count(&q) == 198);
+    i = 199;
+    while (i >= 2) {
+        ck_assert(vmrunqueue_Pop(&q) == (h64vmthread *)i);
+        i--;
+    }
+    ck_assert(vmrunqueue_Pop(&q) == NULL);
+    vmrunqueue_Uninit(&q);
+
+    // Thieves racing the owner must see every entry exactly once:
+    ck_assert(vmrunqueue_Init(&stealtest_queue));
+    thread *thieves[STEALTEST_THIEVES];
+    int k = 0;
+    while (k < STEALTEST_THIEVES) {
+        thieves[k] = thread_Spawn(_stealtest_thief, NULL);
+        ck_assert(thieves[k] != NULL);
+        k++;
+    }
+    i = 1;
+    while (i <= STEALTEST_ITEMS) {
+        ck_assert(vmrunqueue_Push(&stealtest_queue, (h64vmthread *)i));
+        if (i % 3 == 0) {
+            h64vmthread *vt = vmrunqueue_Pop(&stealtest_queue);
+            if (vt)
+                atomic_fetch_add(&stealtest_seen[(uintptr_t)vt], 1);
+        }
+        i++;
+    }
+    h64vmthread *vt = NULL;
+    while ((vt = vmrunqueue_Pop(&stealtest_queue)) != NULL)
+        atomic_fetch_add(&stealtest_seen[(uintptr_t)vt], 1);
+    atomic_store(&stealtest_done, 1);
+    k = 0;
+    while (k < STEALTEST_THIEVES) {
+        thread_Join(thieves[k]);
+        k++;
+    }
+    i = 1;
+    while (i <= STEALTEST_ITEMS) {
+        ck_assert(atomic_load(&stealtest_seen[i]) == 1);
+        i++;
+    }
+    vmrunqueue_Uninit(&stealtest_queue);
+
+    // The ready ring keeps FIFO order across wrap-around and growth:
+    vmreadyring r = {0};
+    ck_assert(vmreadyring_Pop(&r) == NULL);
+    i = 1;
+    while (i <= 10) {
+        ck_assert(vmreadyring_Push(&r, (h64vmthread *)i));
+        i++;
+    }
+    ck_assert(vmreadyring_Pop(&r) == (h64vmthread *)1);
+    ck_assert(vmreadyring_Pop(&r) == (h64vmthread *)2);
+    while (i <= 40) {
+        ck_assert(vmreadyring_Push(&r, (h64vmthread *)i));
+        i++;
+    }
+    i = 3;
+    while (i <= 40) {
+        ck_assert(vmreadyring_Pop(&r) == (h64vmthread *)i);
+        i++;
+    }
+    ck_assert(vmreadyring_Pop(&r) == NULL);
+    vmreadyring_Uninit(&r);
+}
+END_TEST
+
+TESTS_MAIN(test_vmrunqueue)
@@ -0,0 +1,103 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <assert.h>
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include "datetime.h"
+#include "mainpreinit.h"
+#include "vmexec.h"
+#include "vmschedule.h"
+#include "vmsuspendtypeenum.h"
+#include "vmtimerheap.h"
+
+#include "testmain.h"
+
+#define SPAWNTEST_TASKS 100000
+#define SPAWNTEST_MAXBYTESPERTASK (8 * 1024)
+
+static int64_t _residentbytes() {
+    #if defined(__linux__)
+    FILE *f = fopen("/proc/self/statm", "rb");
+    if (!f)
+        return -1;
+    long long pages_total = 0;
+    long long pages_resident = 0;
+    int result = fscanf(f, "%lld %lld", &pages_total, &pages_resident);
+    fclose(f);
+    if (result != 2)
+        return -1;
+    long pagesize = sysconf(_SC_PAGESIZE);
+    if (pagesize <= 0)
+        return -1;
+    return (int64_t)pages_resident * (int64_t)pagesize;
+    #else
+    return -1;
+    #endif
+}
+
+START_TEST (test_vmthread_spawnmany)
+{
+    main_PreInit();
+
+    h64vmexec *vmexec = vmexec_New();
+    ck_assert(vmexec != NULL);
+
+    // Spawn lots of non-parallel tasks that all go to sleep:
+    int64_t mem_before = _residentbytes();
+    int64_t start = datetime_Ticks();
+    int i = 0;
+    while (i < SPAWNTEST_TASKS) {
+        h64vmthread *vt = vmthread_New(vmexec, 1);
+        ck_assert(vt != NULL);
+        vmthread_SetSuspendState(
+            vt, SUSPENDTYPE_FIXEDTIME, start + 3600000 + i
+        );
+        i++;
+    }
+    int64_t mem_after = _residentbytes();
+    if (mem_before >= 0 && mem_after >= 0)
+        ck_assert((mem_after - mem_before) / SPAWNTEST_TASKS <
+                  SPAWNTEST_MAXBYTESPERTASK);
+    ck_assert(vmexec->thread_count == SPAWNTEST_TASKS);
+    ck_assert(vmexec->worker_overview->timers.count == SPAWNTEST_TASKS);
+    ck_assert(vmexec->suspend_overview->waittypes_currently_active[
+        SUSPENDTYPE_FIXEDTIME] == SPAWNTEST_TASKS);
+    ck_assert(vmtimerheap_NextDeadline(
+        &vmexec->worker_overview->timers) == start + 3600000);
+
+    // Finish every other task, which must keep the thread list intact:
+    i = 0;
+    while (i < vmexec->thread_count) {
+        h64vmthread *vt = vmexec->thread[i];
+        if ((vt->suspend_info->suspendarg - start) % 2 == 0) {
+            vmthread_SetSuspendState(vt, SUSPENDTYPE_DONE, 0);
+            vmthread_Free(vt);
+            continue;
+        }
+        i++;
+    }
+    ck_assert(vmexec->thread_count == SPAWNTEST_TASKS / 2);
+    ck_assert(vmexec->worker_overview->timers.count ==
+              SPAWNTEST_TASKS / 2);
+    ck_assert(vmexec->suspend_overview->waittypes_currently_active[
+        SUSPENDTYPE_DONE] == 0);
+    i = 0;
+    while (i < vmexec->thread_count) {
+        ck_assert(vmexec->thread[i]->thread_index == i);
+        ck_assert((vmexec->thread[i]->suspend_info->suspendarg -
+                   start) % 2 == 1);
+        i++;
+    }
+
+    vmexec_Free(vmexec);
+}
+END_TEST
+
+TESTS_MAIN(test_vmthread_spawnmany)
@@ -0,0 +1,83 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <assert.h>
+#include <check.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mainpreinit.h"
+#include "vmexec.h"
+#include "vmtimerheap.h"
+
+#include "testmain.h"
+
+#define TIMERTEST_THREADS 500
+
+static h64vmthread timertest_thread[TIMERTEST_THREADS];
+
+START_TEST (test_vmtimerheap)
+{
+    main_PreInit();
+
+    memset(timertest_thread, 0, sizeof(timertest_thread));
+    vmtimerheap heap = {0};
+    ck_assert(vmtimerheap_NextDeadline(&heap) == -1);
+    ck_assert(vmtimerheap_PopExpired(&heap, INT64_MAX) == NULL);
+    ck_assert(vmtimerheap_Reserve(&heap, TIMERTEST_THREADS));
+
+    // Insert with scrambled deadlines, some of them equal:
+    int i = 0;
+    while (i < TIMERTEST_THREADS) {
+        int64_t deadline = (i * 7919) % 1000;
+        vmtimerheap_Insert(&heap, &timertest_thread[i], deadline);
+        ck_assert(timertest_thread[i].timer_heap_pos > 0);
+        i++;
+    }
+    ck_assert(heap.count == TIMERTEST_THREADS);
+
+    // Remove every third thread again, like a cancelled sleep:
+    i = 0;
+    while (i < TIMERTEST_THREADS) {
+        vmtimerheap_Remove(&heap, &timertest_thread[i]);
+        ck_assert(timertest_thread[i].timer_heap_pos == 0);
+        vmtimerheap_Remove(&heap, &timertest_thread[i]);  // no-op
+        i += 3;
+    }
+
+    // Re-inserting moves a thread to its new deadline:
+    vmtimerheap_Insert(&heap, &timertest_thread[1], 5000);
+    vmtimerheap_Insert(&heap, &timertest_thread[1], -5);
+    ck_assert(vmtimerheap_NextDeadline(&heap) == -5);
+
+    // Only expired ones come out, and in deadline order:
+    ck_assert(vmtimerheap_PopExpired(&heap, -6) == NULL);
+    ck_assert(vmtimerheap_PopExpired(&heap, -5) == &timertest_thread[1]);
+    int64_t last = -1;
+    int popped = 0;
+    h64vmthread *vt = NULL;
+    while ((vt = vmtimerheap_PopExpired(&heap, 499)) != NULL) {
+        int k = (int)(vt - timertest_thread);
+        ck_assert(k % 3 != 0 && k != 1);
+        int64_t deadline = (k * 7919) % 1000;
+        ck_assert(deadline >= last && deadline <= 499);
+        ck_assert(vt->timer_heap_pos == 0);
+        last = deadline;
+        popped++;
+    }
+    ck_assert(vmtimerheap_NextDeadline(&heap) >= 500);
+    while ((vt = vmtimerheap_PopExpired(&heap, INT64_MAX)) != NULL) {
+        int k = (int)(vt - timertest_thread);
+        int64_t deadline = (k * 7919) % 1000;
+        ck_assert(deadline >= last);
+        last = deadline;
+        popped++;
+    }
+    ck_assert(popped == TIMERTEST_THREADS - (TIMERTEST_THREADS + 2) / 3 - 1);
+    ck_assert(heap.count == 0);
+    vmtimerheap_Uninit(&heap);
+}
+END_TEST
+
+TESTS_MAIN(test_vmtimerheap)
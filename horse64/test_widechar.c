@@ -5,6 +5,7 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "mainpreinit.h"
 #include "widechar.h"
@@ -69,6 +70,72 @@ START_TEST (test_widechar)
     ck_assert(!is_valid_utf8_char(
         (uint8_t*)"\xc3\xc3", 2
     ));
+
+    // Long ASCII runs mixed with multi-byte chars, to go through
+    // both the ASCII run fast path and the regular decoder:
+    const char *mixed = (
+        "abcdefghijklmnopqrstuvwxyz0123456789\xc3\xb6"
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZ\xf0\x9f\x98\x80xyz"
+    );
+    s = NULL;
+    out_len = 0;
+    ck_assert((s = utf8_to_utf32(
+        mixed, strlen(mixed), NULL, NULL, &out_len
+    )) != NULL);
+    ck_assert(out_len == 36 + 1 + 26 + 1 + 3);
+    ck_assert(s[0] == 'a');
+    ck_assert(s[35] == '9');
+    ck_assert(s[36] == 0xF6ULL);
+    ck_assert(s[37] == 'A');
+    ck_assert(s[63] == 0x1F600ULL);
+    ck_assert(s[66] == 'z');
+    char back[128];
+    int64_t back_len = 0;
+    ck_assert(utf32_to_utf8(
+        s, out_len, back, sizeof(back), &back_len, 1, 0
+    ));
+    ck_assert(back_len == (int64_t)strlen(mixed));
+    ck_assert(memcmp(back, mixed, back_len) == 0);
+    ck_assert(!utf32_to_utf8(
+        s, out_len, back, back_len - 1, &back_len, 1, 0
+    ));
+    free(s);
+
+    ck_assert(is_valid_utf8(mixed, strlen(mixed)));
+    ck_assert(!is_valid_utf8(
+        "abcdefghijklmnopqrstuvwxyz0123456789\xc3", 37
+    ));
+    ck_assert(!is_valid_utf8(
+        "abcdefghijklmnopqrstuvwxyz0123456789\x80xyz", 40
+    ));
+
+    // Grapheme clusters: CR LF, combining marks, Hangul syllables
+    // and regional indicator pairs:
+    h64wchar letters[] = {
+        'a', '\r', '\n', 'e', 0x301, 0x301, '\r', 0x301,
+        0x1100, 0x1161, 0x11A8, 0xAC00, 0x11A8,
+        0x1F1E9, 0x1F1EA, 0x1F1EB, 0x1F1F7, 0x1F1EE, 'z'
+    };
+    int64_t letters_len = sizeof(letters) / sizeof(*letters);
+    ck_assert(utf32_letter_len(letters, letters_len) == 1);
+    ck_assert(utf32_letter_len(letters + 1, letters_len - 1) == 2);
+    ck_assert(utf32_letter_len(letters + 3, letters_len - 3) == 3);
+    ck_assert(utf32_letter_len(letters + 6, letters_len - 6) == 1);
+    ck_assert(utf32_letter_len(letters + 8, letters_len - 8) == 3);
+    ck_assert(utf32_letter_len(letters + 11, letters_len - 11) == 2);
+    ck_assert(utf32_letter_len(letters + 13, letters_len - 13) == 2);
+    ck_assert(utf32_letter_len(letters + 17, letters_len - 17) == 1);
+    ck_assert(utf32_letters_count(letters, letters_len) == 11);
+    int64_t offsets[6];
+    ck_assert(utf32_letters_segment(
+        letters, letters_len, offsets, 2
+    ) == 11);
+    ck_assert(offsets[0] == 0);
+    ck_assert(offsets[1] == 3);
+    ck_assert(offsets[2] == 7);
+    ck_assert(offsets[3] == 11);
+    ck_assert(offsets[4] == 15);
+    ck_assert(offsets[5] == 18);
 }
 END_TEST
 
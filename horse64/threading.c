@@ -95,211 +95,41 @@ typedef struct threadinfo {
     uint64_t id;
 } thread;
 
-#define IDTOSTORAGEMAP_BUCKETS 64
-
-typedef struct threadlocalstoragetype {
-    uint64_t bytes;
-    void (*clearHandler)(
-        uint32_t storage_type_id, void *storageptr,
-        uint64_t storage_bytes
-    );
-    int idtostoragemap_bucketitems[IDTOSTORAGEMAP_BUCKETS];
-    uint64_t *idtostoragemap_bucketidlist[IDTOSTORAGEMAP_BUCKETS];
-    char **idtostoragemap_bucketbytes[IDTOSTORAGEMAP_BUCKETS];
-} threadlocalstoragetype;
-
-mutex *_tls_type_access = NULL;
-int32_t _tls_type_count = 0;
-threadlocalstoragetype *_tls_type = NULL;
-
-void *threadlocalstorage_GetByType(int32_t type) {
-    uint64_t tid = thread_GetOurThreadId();
-    mutex_Lock(_tls_type_access);
-    if (type < 0 || type >= _tls_type_count) {
-        mutex_Release(_tls_type_access);
-        return NULL;
-    }
-    int bucket = (int)(
-        (uint64_t)tid % (uint64_t)IDTOSTORAGEMAP_BUCKETS
-    );
-    threadlocalstoragetype *tltype = &_tls_type[type];
-    int k = 0;
-    while (k < tltype->idtostoragemap_bucketitems[bucket]) {
-        if (tltype->idtostoragemap_bucketidlist[bucket][k] == tid) {
-            char *resultptr = (
-                tltype->idtostoragemap_bucketbytes[bucket][k]
-            );
-            mutex_Release(_tls_type_access);
-            return resultptr;
-        }
-        k++;
-    }
-    // Ok, not found in bucket. Need to add new entry to bucket!
-    // 1. Add space in the actual data pointer list of the bucket:
-    int current_id_count = tltype->idtostoragemap_bucketitems[bucket];
-    char **new_bytes = realloc(
-        tltype->idtostoragemap_bucketbytes[bucket],
-        sizeof(*tltype->idtostoragemap_bucketbytes[bucket]) *
-            (current_id_count + 1)
-    );
-    if (!new_bytes) {
-        mutex_Release(_tls_type_access);
-        return NULL;
-    }
-    tltype->idtostoragemap_bucketbytes[bucket] = new_bytes;
-    // 2. Add space in the thread id list of the bucket:
-    uint64_t *new_idtostoragemap_bucketidlist = realloc(
-        tltype->idtostoragemap_bucketidlist[bucket],
-        sizeof(*tltype->idtostoragemap_bucketidlist[bucket]) *
-            (current_id_count + 1)
-    );
-    if (!new_idtostoragemap_bucketidlist) {
-        mutex_Release(_tls_type_access);
-        return NULL;
-    }
-    tltype->idtostoragemap_bucketidlist[bucket] = (
-        new_idtostoragemap_bucketidlist
-    );
-    // 3. Allocate data pointer for this bucket:
-    tltype->idtostoragemap_bucketbytes[bucket][current_id_count] = (
-        malloc(tltype->bytes)
-    );
-    if (!tltype->idtostoragemap_bucketbytes[bucket][current_id_count]) {
-        mutex_Release(_tls_type_access);
-        return NULL;
-    }
-
-    // Ok, everything allocated. Clear out new data for this thread,
-    // remember that we added a new thread's data, and return:
-    char *resultdata = (
-        tltype->idtostoragemap_bucketbytes[bucket][current_id_count]
-    );
-    memset(
-        resultdata, 0, tltype->bytes
-    );
-    tltype->idtostoragemap_bucketidlist[bucket][current_id_count] = tid;
-    tltype->idtostoragemap_bucketitems[bucket]++;
-    mutex_Release(_tls_type_access);
-    return resultdata;
-}
-
-int threadlocalstorage_CleanTypeForThread(
-        uint64_t tid, int32_t type
-        ) {
-    mutex_Lock(_tls_type_access);
-    if (type < 0 || type >= _tls_type_count) {
-        mutex_Release(_tls_type_access);
-        return 1;
-    }
-    int bucket = (int)(
-        (uint64_t)tid % (uint64_t)IDTOSTORAGEMAP_BUCKETS
-    );
-    // Call the clean function on all this thread's data:
-    threadlocalstoragetype *tltype = &_tls_type[type];
-    int k = 0;
-    while (k < tltype->idtostoragemap_bucketitems[bucket]) {
-        if (tltype->idtostoragemap_bucketidlist[bucket][k] == tid) {
-            char *dataptr = (
-                tltype->idtostoragemap_bucketbytes[bucket][k]
-            );
-            if (!dataptr) {
-                k++;
-                continue;
-            }
-            void (*clearHandler)(
-                uint32_t storage_type_id, void *storageptr,
-                uint64_t storage_bytes
-            ) = tltype->clearHandler;
-            tltype->idtostoragemap_bucketbytes[bucket][k] = (
-                NULL
-            );
-            uint64_t bytesamount = tltype->bytes;
-            mutex_Release(_tls_type_access);
-            clearHandler(type, dataptr, bytesamount);
-            free(dataptr);
-            return 1;
-        }
-        k++;
-    }
-    mutex_Release(_tls_type_access);
-    return 0;
-}
-
-int threadlocalstorage_UnallocateTypeForThread(
-        uint64_t tid, int32_t type
-        ) {
-    mutex_Lock(_tls_type_access);
-    if (type < 0 || type >= _tls_type_count) {
-        mutex_Release(_tls_type_access);
-        return 1;
+// Scratch buffers live in native thread-local storage, so getting one
+// needs no lock:
+typedef struct threadscratch {
+    char *buf;
+    uint64_t bufsize;
+} threadscratch;
+
+static __thread threadscratch _tls_scratch[THREADLOCALSTORAGE_SCRATCH_SLOTS];
+static __thread int _tls_scratch_next = 0;
+
+void *threadlocalstorage_GetScratch(uint64_t bytes) {
+    threadscratch *scratch = &_tls_scratch[_tls_scratch_next];
+    if (scratch->bufsize < bytes || !scratch->buf) {
+        uint64_t new_size = (bytes > 64 ? bytes : 64);
+        char *new_buf = malloc(new_size);
+        if (!new_buf)
+            return NULL;
+        free(scratch->buf);
+        scratch->buf = new_buf;
+        scratch->bufsize = new_size;
     }
-    int bucket = (int)(
-        (uint64_t)tid % (uint64_t)IDTOSTORAGEMAP_BUCKETS
+    _tls_scratch_next = (
+        (_tls_scratch_next + 1) % THREADLOCALSTORAGE_SCRATCH_SLOTS
     );
-    // Call the clean function on all this thread's data:
-    threadlocalstoragetype *tltype = &_tls_type[type];
-    int k = 0;
-    while (k < tltype->idtostoragemap_bucketitems[bucket]) {
-        if (tltype->idtostoragemap_bucketidlist[bucket][k] == tid) {
-            if (tltype->idtostoragemap_bucketbytes[bucket][k]) {
-                mutex_Release(_tls_type_access);
-                return 0;
-            }
-            if (k + 1 < tltype->idtostoragemap_bucketitems[bucket]) {
-                memmove(
-                    &tltype->idtostoragemap_bucketbytes[bucket][k],
-                    &tltype->idtostoragemap_bucketbytes[bucket][k + 1],
-                    sizeof(tltype->idtostoragemap_bucketbytes[bucket][k])
-                );
-                memmove(
-                    &tltype->idtostoragemap_bucketidlist[bucket][k],
-                    &tltype->idtostoragemap_bucketidlist[bucket][k + 1],
-                    sizeof(tltype->idtostoragemap_bucketidlist[bucket][k])
-                );
-            }
-            tltype->idtostoragemap_bucketitems[bucket]--;
-            continue;
-        }
-        k++;
-    }
-    mutex_Release(_tls_type_access);
-    return 1;
+    return scratch->buf;
 }
 
-void threadlocalstorage_CleanForThread(uint64_t tid) {
-    // Clean out all the registered local storage we can find:
-    int cleaned_something = 1;
-    while (cleaned_something) {
-        cleaned_something = 0;
-        mutex_Lock(_tls_type_access);
-        uint32_t type_id = 0;
-        while (type_id < (uint64_t)_tls_type_count) {
-            mutex_Release(_tls_type_access);
-            cleaned_something = (
-                cleaned_something ||
-                threadlocalstorage_CleanTypeForThread(tid, type_id)
-            );
-            mutex_Lock(_tls_type_access);
-            type_id++;
-        }
-        mutex_Release(_tls_type_access);
-    }
-    // Now, actually remove the thread from the buckets:
-    // (The thread should no longer be running any code right now,
-    // so it should be impossible for any storage to have popped
-    // back up in parallel after the above cleaning ended)
-    mutex_Lock(_tls_type_access);
-    uint32_t type_id = 0;
-    while (type_id < (uint64_t)_tls_type_count) {
-        mutex_Release(_tls_type_access);
-        int unallocate_result = (
-            threadlocalstorage_UnallocateTypeForThread(tid, type_id)
-        );
-        assert(unallocate_result != 0);  // that should be impossible
-        mutex_Lock(_tls_type_access);
-        type_id++;
+static void _threadlocalstorage_CleanOurThread() {
+    int i = 0;
+    while (i < THREADLOCALSTORAGE_SCRATCH_SLOTS) {
+        free(_tls_scratch[i].buf);
+        _tls_scratch[i].buf = NULL;
+        _tls_scratch[i].bufsize = 0;
+        i++;
     }
-    mutex_Release(_tls_type_access);
 }
 
 
@@ -536,7 +366,7 @@ static void* spawnthread(void *data) {
     void (*cbfunc)(void *) = sinfo->func;
     free(sinfo);
     cbfunc(udata);
-    threadlocalstorage_CleanForThread(tid);
+    _threadlocalstorage_CleanOurThread();
 #ifdef ISWIN
     return 0;
 #else
@@ -566,11 +396,6 @@ thread *thread_SpawnWithPriority(
     // some things are set up:
     if (!_markedmainthread)
         thread_MarkAsMainThread();
-    if (!_tls_type_access) {
-        _tls_type_access = mutex_Create();
-        if (!_tls_type_access)
-            return NULL;
-    }
 
     // Ok, allocate info for spawning:
     struct spawninfo* sinfo = malloc(sizeof(*sinfo));
@@ -659,6 +484,117 @@ uint64_t thread_GetOurThreadId() {
     #endif
 }
 
+int threadcpuset_Add(threadcpuset *set, int cpu) {
+    if (cpu < 0 || cpu >= THREAD_MAX_CPUS)
+        return 0;
+    set->bits[cpu / 64] |= ((uint64_t)1 << (uint64_t)(cpu % 64));
+    return 1;
+}
+
+void threadcpuset_Remove(threadcpuset *set, int cpu) {
+    if (cpu < 0 || cpu >= THREAD_MAX_CPUS)
+        return;
+    set->bits[cpu / 64] &= ~((uint64_t)1 << (uint64_t)(cpu % 64));
+}
+
+int threadcpuset_Has(const threadcpuset *set, int cpu) {
+    if (cpu < 0 || cpu >= THREAD_MAX_CPUS)
+        return 0;
+    return ((set->bits[cpu / 64] >> (uint64_t)(cpu % 64)) & 1) != 0;
+}
+
+int threadcpuset_Count(const threadcpuset *set) {
+    int count = 0;
+    int i = 0;
+    while (i < THREAD_MAX_CPUS) {
+        if (threadcpuset_Has(set, i))
+            count++;
+        i++;
+    }
+    return count;
+}
+
+int threadcpuset_Nth(const threadcpuset *set, int n) {
+    int i = 0;
+    while (i < THREAD_MAX_CPUS) {
+        if (threadcpuset_Has(set, i)) {
+            if (n <= 0)
+                return i;
+            n--;
+        }
+        i++;
+    }
+    return -1;
+}
+
+static int _threadcpuset_ParseNum(const char **s) {
+    if (**s < '0' || **s > '9')
+        return -1;
+    int value = 0;
+    while (**s >= '0' && **s <= '9') {
+        value = value * 10 + (**s - '0');
+        if (value >= THREAD_MAX_CPUS)
+            return -1;
+        (*s)++;
+    }
+    return value;
+}
+
+int threadcpuset_FromStr(threadcpuset *set, const char *s) {
+    memset(set, 0, sizeof(*set));
+    while (1) {
+        int first = _threadcpuset_ParseNum(&s);
+        if (first < 0)
+            return 0;
+        int last = first;
+        if (*s == '-') {
+            s++;
+            last = _threadcpuset_ParseNum(&s);
+            if (last < first)
+                return 0;
+        }
+        while (first <= last) {
+            threadcpuset_Add(set, first);
+            first++;
+        }
+        if (*s == '\0')
+            return 1;
+        if (*s != ',')
+            return 0;
+        s++;
+    }
+}
+
+int thread_SetCpuAffinity(
+        uint64_t thread_id, const threadcpuset *set
+        ) {
+    #if defined(__LINUX__) || defined(__linux__)
+    // Use the syscall directly, since the glibc wrappers would
+    // need _GNU_SOURCE and a cpu_set_t of fixed size:
+    return (syscall(
+        __NR_sched_setaffinity, (pid_t)thread_id,
+        sizeof(set->bits), set->bits
+    ) == 0);
+    #elif defined(_WIN32) || defined(_WIN64)
+    // Windows affinity masks only cover the first processor group:
+    if (set->bits[0] == 0)
+        return 0;
+    HANDLE h = OpenThread(
+        THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION,
+        FALSE, (DWORD)thread_id
+    );
+    if (!h)
+        return 0;
+    int result = (SetThreadAffinityMask(
+        h, (DWORD_PTR)set->bits[0]
+    ) != 0);
+    CloseHandle(h);
+    return result;
+    #else
+    return 0;
+    #endif
+}
+
 void thread_Join(thread *t) {
 #ifdef ISWIN
     WaitForMultipleObjects(1, &t->t, TRUE, INFINITE);
@@ -668,6 +604,14 @@ void thread_Join(thread *t) {
     free(t);
 }
 
+void thread_Yield() {
+#ifdef ISWIN
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
 
 typedef struct threadevent {
     h64socket *_targetside, *_sourceside;
@@ -728,35 +672,6 @@ int mutex_IsLocked(mutex *m) {
     return (result == 0);
 }
 
-int32_t threadlocalstorage_RegisterType(
-        uint64_t bytes, void (*clearHandler)(
-            uint32_t storage_type_id, void *storageptr,
-            uint64_t storage_bytes
-        )) {
-    if (!_tls_type_access) {
-        _tls_type_access = mutex_Create();
-        if (!_tls_type_access)
-            return -1;
-    }
-    mutex_Lock(_tls_type_access);
-    threadlocalstoragetype *new_types = realloc(
-        _tls_type, sizeof(*_tls_type) * (_tls_type_count + 1)
-    );
-    if (!new_types) {
-        mutex_Release(_tls_type_access);
-        return -1;
-    }
-    _tls_type = new_types;
-    memset(&_tls_type[_tls_type_count], 0,
-           sizeof(_tls_type[_tls_type_count]));
-    _tls_type[_tls_type_count].bytes = bytes;
-    _tls_type[_tls_type_count].clearHandler = clearHandler;
-    int64_t id = _tls_type_count;
-    _tls_type_count++;
-    mutex_Release(_tls_type_access);
-    return id;
-}
-
 int threadevent_PollIsSet(threadevent *te, int unsetifset) {
     mutex_Lock(te->datalock);
     if (te->set) {
@@ -56,18 +56,47 @@ void thread_Detach(thread *t);
 
 void thread_Join(thread *t);
 
+void thread_Yield();
+
 int thread_InMainThread();
 
 uint64_t thread_GetOurThreadId();
 
-int32_t threadlocalstorage_RegisterType(
-    uint64_t bytes, void (*clearHandler)(
-        uint32_t storage_type_id, void *storageptr,
-        uint64_t storage_bytes
-    )
-);
+#define THREAD_MAX_CPUS 1024
+
+typedef struct threadcpuset {
+    uint64_t bits[THREAD_MAX_CPUS / 64];
+} threadcpuset;
+
+int threadcpuset_Add(
+    threadcpuset *set, int cpu
+);  // returns 1 on success, 0 if cpu is out of range
+
+void threadcpuset_Remove(threadcpuset *set, int cpu);
+
+int threadcpuset_Has(const threadcpuset *set, int cpu);
+
+int threadcpuset_Count(const threadcpuset *set);
+
+int threadcpuset_Nth(
+    const threadcpuset *set, int n
+);  // returns the n-th (0-based) cpu in the set, or -1
+
+int threadcpuset_FromStr(
+    threadcpuset *set, const char *s
+);  // parses lists like "0-3,6", returns 1 on success, 0 if invalid
+
+int thread_SetCpuAffinity(
+    uint64_t thread_id, const threadcpuset *set
+);  // thread_id as from thread_GetOurThreadId(), returns 1 on success,
+    // 0 if it failed or the platform doesn't support it
+
+#define THREADLOCALSTORAGE_SCRATCH_SLOTS 4
 
-void *threadlocalstorage_GetByType(int32_t type);
+void *threadlocalstorage_GetScratch(
+    uint64_t bytes
+);  // returns a buffer owned by the calling thread, which stays valid
+    // until THREADLOCALSTORAGE_SCRATCH_SLOTS more calls on that thread
 
 typedef struct threadevent threadevent;
 typedef struct h64socket h64socket;
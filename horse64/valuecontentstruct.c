@@ -19,6 +19,7 @@
 #include "vmlist.h"
 #include "vmmap.h"
 #include "vmstrings.h"
+#include "vmvector.h"
 #include "widechar.h"
 
 
@@ -34,7 +35,7 @@ int valuecontent_SetBytesU8(
         if (byteslen > 0)
             memcpy(
                 v->shortbytes_value, bytes,
-                byteslen * sizeof(h64wchar)
+                byteslen
             );
         v->shortstr_len = byteslen;
         return 1;
@@ -68,21 +69,17 @@ int valuecontent_SetBytesU8(
 }
 
 
-int valuecontent_SetStringU32(
+int valuecontent_AllocStringU32(
         h64vmthread *vmthread, valuecontent *v,
-        const h64wchar *s, int64_t slen
+        int64_t slen, h64wchar **out_s
         ) {
     valuecontent_Free(vmthread, v);
     memset(v, 0, sizeof(*v));
 
     if (slen < VALUECONTENT_SHORTSTRLEN) {
         v->type = H64VALTYPE_SHORTSTR;
-        if (slen > 0)
-            memcpy(
-                v->shortstr_value, s,
-                slen * sizeof(h64wchar)
-            );
         v->shortstr_len = slen;
+        *out_s = v->shortstr_value;
         return 1;
     }
 
@@ -105,13 +102,22 @@ int valuecontent_SetStringU32(
         v->type = H64VALTYPE_NONE;
         return 0;
     }
-    memcpy(
-        gcstr->str_val.s, s,
-        sizeof(*s) * slen
-    );
     assert(gcstr->str_val.len == (uint64_t)slen);
     assert(gcstr->str_val.letterlen == 0);
     gcstr->type = H64GCVALUETYPE_STRING;
+    *out_s = gcstr->str_val.s;
+    return 1;
+}
+
+int valuecontent_SetStringU32(
+        h64vmthread *vmthread, valuecontent *v,
+        const h64wchar *s, int64_t slen
+        ) {
+    h64wchar *buf = NULL;
+    if (!valuecontent_AllocStringU32(vmthread, v, slen, &buf))
+        return 0;
+    if (slen > 0)
+        memcpy(buf, s, sizeof(*s) * slen);
     return 1;
 }
 
@@ -182,6 +188,8 @@ int valuecontent_IsMutable(valuecontent *v) {
         h64gcvalue *gcval = ((h64gcvalue *)v->ptr_value);
         return (gcval->type != H64GCVALUETYPE_BYTES &&
                 gcval->type != H64GCVALUETYPE_STRING);
+    } else if (v->type == H64VALTYPE_VECTOR) {
+        return 1;
     }
     return 0;
 }
@@ -282,13 +290,15 @@ uint32_t _valuecontent_Hash_Do(
                 upto = 32;
             uint64_t i = 0;
             while (i < upto) {
-                valuecontent *item = vmlist_Get(gcval->list_values, i);
-                if (valuecontent_IsMutable(item)) {
+                valuecontent item;
+                int gotentry = vmlist_Get(gcval->list_values, i + 1, &item);
+                assert(gotentry);
+                if (valuecontent_IsMutable(&item)) {
                     i++;
                     continue;
                 }
                 h = (h + _valuecontent_Hash_Do(
-                    item, depth + 1
+                    &item, depth + 1
                 ) % INT32_MAX) % INT32_MAX;
                 i++;
             }
@@ -312,6 +322,9 @@ uint32_t _valuecontent_Hash_Do(
     } else if (v->type == H64VALTYPE_ERROR) {
         uint64_t h = (v->error_class_id % INT32_MAX);
         return h;
+    } else if (v->type == H64VALTYPE_VECTOR) {
+        uint64_t h = (vmvector_Count(v->vector) % INT32_MAX);
+        return h;
     } else {
         assert(0);  // Should be unreachable
         return 0;
@@ -480,12 +493,27 @@ int valuecontent_CheckContainerEquality(
                 hash_FreeMap(seen);
                 return 0;
             }
-            int64_t k = 1;
-            while (k <= len) {
-                valuecontent *v1 = vmlist_Get(g1->list_values, k);
-                valuecontent *v2 = vmlist_Get(g2->list_values, k);
-                _VALUECONTENTEQ_CMP(v1, v2);
-                k++;
+            genericlist *l1 = g1->list_values;
+            genericlist *l2 = g2->list_values;
+            if (l1->packed_type == LISTPACKED_INT64 &&
+                    l2->packed_type == LISTPACKED_INT64) {
+                // Fast path: packed ints compare bit-wise.
+                if (len > 0 && memcmp(
+                        l1->packed_int_values, l2->packed_int_values,
+                        sizeof(*l1->packed_int_values) * len
+                        ) != 0)
+                    goto notequal;
+            } else {
+                int64_t k = 1;
+                while (k <= len) {
+                    valuecontent _v1buf, _v2buf;
+                    vmlist_Get(l1, k, &_v1buf);
+                    vmlist_Get(l2, k, &_v2buf);
+                    valuecontent *v1 = &_v1buf;
+                    valuecontent *v2 = &_v2buf;
+                    _VALUECONTENTEQ_CMP(v1, v2);
+                    k++;
+                }
             }
         } else if (g1->type == H64GCVALUETYPE_OBJINSTANCE) {
             if (g2->type != H64GCVALUETYPE_OBJINSTANCE ||
@@ -517,61 +545,28 @@ int valuecontent_CheckContainerEquality(
                 goto notequal;
             genericmap *m = g1->map_values;
             genericmap *m2 = g2->map_values;
-            if ((m->flags & GENERICMAP_FLAG_LINEAR) != 0) {
-                int64_t k = 0;
-                while (k < m->linear.entry_count) {
-                    valuecontent *v1 = &(
-                        m->linear.entry[k]
-                    );
-                    valuecontent v2s = {0};
-                    int inneroom = 0;
-                    int result = vmmap_Get(
-                        vmthread, m2, &m->linear.key[k],
-                        &v2s, &inneroom
-                    );
-                    if (!result) {
-                        if (!inneroom) {
-                            if (oom) *oom = 1;
+            int64_t k = 1;
+            while (k <= len) {
+                valuecontent *v1 = NULL;
+                valuecontent *key1 = vmmap_GetPair(m, k, &v1);
+                assert(key1 != NULL);
+                valuecontent v2s = {0};
+                int inneroom = 0;
+                int result = vmmap_Get(
+                    vmthread, m2, key1, &v2s, &inneroom
+                );
+                if (!result) {
+                    if (inneroom) {
+                        if (oom) *oom = 1;
                         if (jobs_onheap) free(jobs);
                         hash_FreeMap(seen);
-                        }
-                        goto notequal;
-                    }
-                    valuecontent *v2 = &v2s;
-                    _VALUECONTENTEQ_CMP(v1, v2);
-                    k++;
-                }
-            } else {
-                int64_t k = 0;
-                while (k < m->hashed.bucket_count) {
-                    genericmapbucket *bucket = &(
-                        m->hashed.bucket[k]
-                    );
-                    int64_t k2 = 0;
-                    while (k2 < bucket->entry_count) {
-                        valuecontent *v1 = &(
-                            bucket->entry[i]
-                        );
-                        valuecontent v2s = {0};
-                        int inneroom = 0;
-                        int result = vmmap_Get(
-                            vmthread, m2, &bucket->key[k2],
-                            &v2s, &inneroom
-                        );
-                        if (!result) {
-                            if (!inneroom) {
-                                if (oom) *oom = 1;
-                            if (jobs_onheap) free(jobs);
-                            hash_FreeMap(seen);
-                            }
-                            goto notequal;
-                        }
-                        valuecontent *v2 = &v2s;
-                        _VALUECONTENTEQ_CMP(v1, v2);
-                        k2++;
+                        return 0;
                     }
-                    k++;
+                    goto notequal;
                 }
+                valuecontent *v2 = &v2s;
+                _VALUECONTENTEQ_CMP(v1, v2);
+                k++;
             }
         } else if (g1->type == H64GCVALUETYPE_SET) {
             fprintf(
@@ -657,6 +652,8 @@ HOTSPOT int valuecontent_CheckEquality(
                 return 1;
             } else if (v1->type == H64VALTYPE_UNSPECIFIED_KWARG) {
                 return (v2->type == H64VALTYPE_UNSPECIFIED_KWARG);
+            } else if (v1->type == H64VALTYPE_VECTOR) {
+                return vmvector_Equality(v1->vector, v2->vector);
             } else if (v1->type == H64VALTYPE_GCVAL && (
                     ((h64gcvalue *)v1->ptr_value)->type ==
                     H64GCVALUETYPE_LIST ||
@@ -740,9 +737,9 @@ HOTSPOT int valuecontent_CompareValues(
         } else {
             v2f = v2->float_value;
         }
-        if (v1 > v2)
+        if (v1f > v2f)
             *result = 1;
-        else if (v1 < v2)
+        else if (v1f < v2f)
             *result = -1;
         else
             *result = 0;
@@ -39,7 +39,7 @@ typedef enum valuetype {
 
 typedef struct h64errorinfo h64errorinfo;
 typedef struct valuecontent valuecontent;
-typedef struct vectorentry vectorentry;
+typedef struct h64vector h64vector;
 typedef struct h64iteratorstruct h64iteratorstruct;
 
 typedef struct valuecontent {
@@ -72,9 +72,8 @@ typedef struct valuecontent {
             classid_t error_class_id;
             h64errorinfo *einfo;
         };
-        struct {  // 12 bytes
-            int32_t vector_len;
-            vectorentry *vector_values;
+        struct {  // 8 bytes
+            h64vector *vector;
         };
         struct {  // 12 bytes
             int suspend_type;
@@ -101,6 +100,11 @@ int valuecontent_SetStringU32(
     const h64wchar *u32, int64_t u32len
 );
 
+int valuecontent_AllocStringU32(
+    h64vmthread *vmthread, valuecontent *v,
+    int64_t u32len, h64wchar **out_u32
+);  // like SetStringU32, but leaves the contents for the caller to fill
+
 int valuecontent_SetBytesU8(
     h64vmthread *vmthread, valuecontent *v,
     uint8_t *bytes, int64_t byteslen
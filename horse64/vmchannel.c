@@ -0,0 +1,354 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "compileconfig.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "gcvalue.h"
+#include "pipe.h"
+#include "poolalloc.h"
+#include "threading.h"
+#include "valuecontentstruct.h"
+#include "vmchannel.h"
+#include "vmexec.h"
+#include "vmlist.h"
+#include "vmschedule.h"
+#include "vmsuspendtypeenum.h"
+
+
+typedef struct _channelobj_cdata {
+    void (*on_destroy)(h64gcvalue *channelobj);
+    h64channel *channel;
+} __attribute__((packed)) _channelobj_cdata;
+
+void vmchannel_Free(h64channel *ch) {
+    if (ch->carrier) {
+        int64_t i = 0;
+        while (i < atomic_load(&ch->count)) {
+            valuecontent *v = &ch->value[(ch->start + i) % ch->capacity];
+            DELREF_NONHEAP(v);
+            valuecontent_Free(ch->carrier, v);
+            i++;
+        }
+        // It was never one of the vmexec's threads:
+        ch->carrier->vmexec_owner = NULL;
+        vmthread_Free(ch->carrier);
+    }
+    free(ch->value);
+    free(ch->send_waiters.entry);
+    free(ch->receive_waiters.entry);
+    if (ch->lock)
+        mutex_Destroy(ch->lock);
+    free(ch);
+}
+
+h64channel *vmchannel_New(h64vmexec *vmexec, int64_t capacity) {
+    assert(capacity >= 1);
+    if (capacity > INT64_MAX / (int64_t)sizeof(valuecontent))
+        return NULL;
+    h64channel *ch = malloc(sizeof(*ch));
+    if (!ch)
+        return NULL;
+    memset(ch, 0, sizeof(*ch));
+    atomic_init(&ch->refcount, 0);
+    atomic_init(&ch->count, 0);
+    atomic_init(&ch->closed, 0);
+    ch->capacity = capacity;
+    ch->lock = mutex_Create();
+    ch->value = malloc(sizeof(*ch->value) * capacity);
+    ch->carrier = vmthread_New(NULL, 0);
+    if (!ch->lock || !ch->value || !ch->carrier) {
+        vmchannel_Free(ch);
+        return NULL;
+    }
+    // (Only set for class lookups, it never runs.)
+    ch->carrier->vmexec_owner = vmexec;
+    return ch;
+}
+
+void vmchannel_Unref(h64channel *ch) {
+    if (atomic_fetch_sub(&ch->refcount, 1) == 1)
+        vmchannel_Free(ch);
+}
+
+static void _channelobj_Destroy(h64gcvalue *channelobj) {
+    _channelobj_cdata *cdata = channelobj->cdata;
+    if (cdata->channel)
+        vmchannel_Unref(cdata->channel);
+    cdata->channel = NULL;
+}
+
+h64gcvalue *vmchannel_NewObject(h64vmthread *vt, h64channel *ch) {
+    h64gcvalue *channelobj = poolalloc_malloc(vt->heap, 0);
+    if (!channelobj)
+        return NULL;
+    memset(channelobj, 0, sizeof(*channelobj));
+    channelobj->type = H64GCVALUETYPE_OBJINSTANCE;
+    channelobj->class_id = (
+        vt->vmexec_owner->program->_channel_class_idx
+    );
+    channelobj->cdata = malloc(sizeof(_channelobj_cdata));
+    if (!channelobj->cdata) {
+        poolalloc_free(vt->heap, channelobj);
+        return NULL;
+    }
+    memset(channelobj->cdata, 0, sizeof(_channelobj_cdata));
+    ((_channelobj_cdata *)channelobj->cdata)->on_destroy = (
+        &_channelobj_Destroy
+    );
+    ((_channelobj_cdata *)channelobj->cdata)->channel = ch;
+    atomic_fetch_add(&ch->refcount, 1);
+    return channelobj;
+}
+
+int vmchannel_IsChannelObject(h64vmthread *vt, h64gcvalue *gcval) {
+    return (gcval->type == H64GCVALUETYPE_OBJINSTANCE &&
+            gcval->class_id ==
+                vt->vmexec_owner->program->_channel_class_idx);
+}
+
+h64channel *vmchannel_FromObject(h64gcvalue *gcval) {
+    return ((_channelobj_cdata *)gcval->cdata)->channel;
+}
+
+static int _vmchannel_WaitListAdd(
+        vmchannelwaitlist *wl, h64vmthread *vt
+        ) {
+    if (wl->count >= wl->alloc) {
+        int new_alloc = wl->alloc * 2;
+        if (new_alloc < 8)
+            new_alloc = 8;
+        vmchannelwaiter *new_entry = realloc(
+            wl->entry, sizeof(*new_entry) * new_alloc
+        );
+        if (!new_entry)
+            return 0;
+        wl->entry = new_entry;
+        wl->alloc = new_alloc;
+    }
+    wl->entry[wl->count].vt = vt;
+    wl->entry[wl->count].woken = 0;
+    wl->count++;
+    return 1;
+}
+
+static void _vmchannel_WaitListRemove(
+        vmchannelwaitlist *wl, h64vmthread *vt
+        ) {
+    int i = 0;
+    while (i < wl->count) {
+        if (wl->entry[i].vt == vt) {
+            if (i + 1 < wl->count)
+                memmove(
+                    &wl->entry[i], &wl->entry[i + 1],
+                    sizeof(*wl->entry) * (wl->count - i - 1)
+                );
+            wl->count--;
+            return;
+        }
+        i++;
+    }
+}
+
+static void _vmchannel_WakeWaiters(
+        h64channel *ch, vmchannelwaitlist *wl, suspendtype stype,
+        int64_t amount
+        ) {
+    // IMPORTANT: channel lock must be LOCKED entering this.
+    // Wakes up to amount waiters not woken yet, or all if amount < 0.
+    int i = 0;
+    while (i < wl->count && amount != 0) {
+        if (!wl->entry[i].woken) {
+            // If it isn't suspended yet, it will check the channel
+            // itself once it is, so that one doesn't count:
+            if (vmschedule_ChannelWaiterWake(
+                    wl->entry[i].vt, stype, ch
+                    ) != 0) {
+                wl->entry[i].woken = 1;
+                if (amount > 0)
+                    amount--;
+            }
+        }
+        i++;
+    }
+}
+
+static vmchannelresult _vmchannel_PutNoLock(
+        h64channel *ch, h64vmthread *vt, valuecontent *value,
+        pipesource source_kind
+        ) {
+    // IMPORTANT: channel lock must be LOCKED entering this.
+    assert(atomic_load(&ch->count) < ch->capacity);
+    valuecontent *slot = &ch->value[
+        (ch->start + atomic_load(&ch->count)) % ch->capacity
+    ];
+    int result = _pipe_DoPipeValue(
+        vt, ch->carrier, value, source_kind, slot
+    );
+    if (result == 0)
+        return VMCHANNEL_OUTOFMEMORY;
+    else if (result < 0)
+        return VMCHANNEL_UNSUPPORTEDTYPE;
+    atomic_fetch_add(&ch->count, 1);
+    return VMCHANNEL_DONE;
+}
+
+vmchannelresult vmchannel_Send(
+        h64channel *ch, h64vmthread *vt, valuecontent *value,
+        pipesource source_kind
+        ) {
+    mutex_Lock(ch->lock);
+    _vmchannel_WaitListRemove(&ch->send_waiters, vt);
+    if (atomic_load(&ch->closed)) {
+        mutex_Release(ch->lock);
+        return VMCHANNEL_CLOSED;
+    }
+    if (atomic_load(&ch->count) >= ch->capacity) {
+        vmchannelresult result = VMCHANNEL_MUSTWAIT;
+        if (!_vmchannel_WaitListAdd(&ch->send_waiters, vt))
+            result = VMCHANNEL_OUTOFMEMORY;
+        mutex_Release(ch->lock);
+        return result;
+    }
+    vmchannelresult result = _vmchannel_PutNoLock(
+        ch, vt, value, source_kind
+    );
+    if (result == VMCHANNEL_DONE)
+        _vmchannel_WakeWaiters(
+            ch, &ch->receive_waiters, SUSPENDTYPE_CHANNELRECEIVEWAIT, 1
+        );
+    mutex_Release(ch->lock);
+    return result;
+}
+
+vmchannelresult vmchannel_SendList(
+        h64channel *ch, h64vmthread *vt, genericlist *l, int l_owned,
+        int64_t *next
+        ) {
+    mutex_Lock(ch->lock);
+    _vmchannel_WaitListRemove(&ch->send_waiters, vt);
+    if (atomic_load(&ch->closed)) {
+        mutex_Release(ch->lock);
+        return VMCHANNEL_CLOSED;
+    }
+    vmchannelresult result = VMCHANNEL_DONE;
+    const int64_t count = vmlist_Count(l);
+    int64_t sent = 0;
+    while (*next < count) {
+        if (atomic_load(&ch->count) >= ch->capacity) {
+            result = VMCHANNEL_MUSTWAIT;
+            if (!_vmchannel_WaitListAdd(&ch->send_waiters, vt))
+                result = VMCHANNEL_OUTOFMEMORY;
+            break;
+        }
+        valuecontent packedentry;
+        valuecontent *entry = &packedentry;
+        pipesource source_kind = PIPESOURCE_ENTRY;
+        if (l->packed_type != LISTPACKED_NONE) {
+            vmlist_Get(l, *next + 1, &packedentry);
+        } else {
+            // Get the entry itself, so it can be moved out:
+            listblock *block = NULL;
+            int64_t blockoffset = -1;
+            vmlist_GetEntryBlock(l, *next + 1, &block, &blockoffset);
+            assert(block != NULL && blockoffset >= 0);
+            entry = &block->entry_values[*next - blockoffset];
+            if (l_owned)
+                source_kind = PIPESOURCE_OWNEDENTRY;
+        }
+        result = _vmchannel_PutNoLock(ch, vt, entry, source_kind);
+        if (result != VMCHANNEL_DONE)
+            break;
+        (*next)++;
+        sent++;
+    }
+    if (sent > 0)
+        _vmchannel_WakeWaiters(
+            ch, &ch->receive_waiters, SUSPENDTYPE_CHANNELRECEIVEWAIT,
+            sent
+        );
+    mutex_Release(ch->lock);
+    return result;
+}
+
+vmchannelresult vmchannel_Receive(
+        h64channel *ch, h64vmthread *vt, valuecontent *out_values,
+        int64_t max, int64_t *out_count
+        ) {
+    assert(max >= 1);
+    *out_count = 0;
+    mutex_Lock(ch->lock);
+    _vmchannel_WaitListRemove(&ch->receive_waiters, vt);
+    vmchannelresult result = VMCHANNEL_DONE;
+    int64_t got = 0;
+    while (got < max && atomic_load(&ch->count) > 0) {
+        valuecontent *entry = &ch->value[ch->start];
+        int pipe_result = _pipe_DoPipeValue(
+            ch->carrier, vt, entry, PIPESOURCE_SLOT, &out_values[got]
+        );
+        if (pipe_result <= 0) {
+            // If it was moved out before failing, it's gone and must
+            // go from the ring:
+            result = (pipe_result == 0 ? VMCHANNEL_OUTOFMEMORY :
+                      VMCHANNEL_UNSUPPORTEDTYPE);
+            if (entry->type != H64VALTYPE_NONE)
+                break;
+        } else {
+            got++;
+        }
+        // If it was copied rather than moved, drop the carrier's copy:
+        DELREF_NONHEAP(entry);
+        valuecontent_Free(ch->carrier, entry);
+        memset(entry, 0, sizeof(*entry));
+        ch->start = (ch->start + 1) % ch->capacity;
+        atomic_fetch_sub(&ch->count, 1);
+        if (result != VMCHANNEL_DONE)
+            break;
+    }
+    *out_count = got;
+    if (got > 0 || result != VMCHANNEL_DONE) {
+        // Even a failed move made room:
+        _vmchannel_WakeWaiters(
+            ch, &ch->send_waiters, SUSPENDTYPE_CHANNELSENDWAIT,
+            (got > 0 ? got : 1)
+        );
+        mutex_Release(ch->lock);
+        return (got > 0 ? VMCHANNEL_DONE : result);
+    }
+    if (atomic_load(&ch->closed)) {
+        mutex_Release(ch->lock);
+        return VMCHANNEL_CLOSED;
+    }
+    if (!_vmchannel_WaitListAdd(&ch->receive_waiters, vt))
+        result = VMCHANNEL_OUTOFMEMORY;
+    else
+        result = VMCHANNEL_MUSTWAIT;
+    mutex_Release(ch->lock);
+    return result;
+}
+
+void vmchannel_Close(h64channel *ch) {
+    mutex_Lock(ch->lock);
+    atomic_store(&ch->closed, 1);
+    _vmchannel_WakeWaiters(
+        ch, &ch->send_waiters, SUSPENDTYPE_CHANNELSENDWAIT, -1
+    );
+    _vmchannel_WakeWaiters(
+        ch, &ch->receive_waiters, SUSPENDTYPE_CHANNELRECEIVEWAIT, -1
+    );
+    mutex_Release(ch->lock);
+}
+
+void vmchannel_ForgetWaiter(h64channel *ch, h64vmthread *vt) {
+    mutex_Lock(ch->lock);
+    _vmchannel_WaitListRemove(&ch->send_waiters, vt);
+    _vmchannel_WaitListRemove(&ch->receive_waiters, vt);
+    mutex_Release(ch->lock);
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef HORSE64_VMCHANNEL_H_
+#define HORSE64_VMCHANNEL_H_
+
+#include "compileconfig.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "pipe.h"
+
+typedef struct genericlist genericlist;
+typedef struct h64gcvalue h64gcvalue;
+typedef struct h64vmexec h64vmexec;
+typedef struct h64vmthread h64vmthread;
+typedef struct mutex mutex;
+typedef struct valuecontent valuecontent;
+
+// ABOUT CHANNELS:
+// A channel is a bounded queue that any number of vmthreads, parallel
+// or not, send values into and receive values from. The queued values
+// live on the heap of a carrier vmthread that never runs, which makes
+// sending and receiving one pipe each (see pipe.c): values nobody else
+// references are moved rather than copied both times.
+// If a channel is full or empty, the vmthread registers as waiter and
+// suspends with SUSPENDTYPE_CHANNELSENDWAIT or CHANNELRECEIVEWAIT.
+// Every send or receive wakes as many waiters of the opposite kind as
+// it made room for, in the order they arrived.
+//
+// IMPORTANT: waiters are woken with the channel lock held, which means
+// the lock order is channel lock -> worker_mutex. Never lock a channel
+// while holding the worker_mutex.
+
+typedef struct vmchannelwaiter {
+    h64vmthread *vt;
+    int woken;  // set once queued to run, vt then removes itself
+} vmchannelwaiter;
+
+typedef struct vmchannelwaitlist {
+    vmchannelwaiter *entry;
+    int count, alloc;
+} vmchannelwaitlist;
+
+typedef struct h64channel {
+    mutex *lock;
+    _Atomic int64_t refcount;  // one per channel object on any heap
+    h64vmthread *carrier;  // holds the queued values
+
+    valuecontent *value;  // ring of capacity entries
+    int64_t capacity, start;
+    _Atomic int64_t count;
+    _Atomic int closed;
+
+    vmchannelwaitlist send_waiters, receive_waiters;
+} h64channel;
+
+typedef enum vmchannelresult {
+    VMCHANNEL_DONE = 1,
+    VMCHANNEL_MUSTWAIT = 0,  // now registered as waiter, so suspend
+    VMCHANNEL_CLOSED = -1,
+    VMCHANNEL_OUTOFMEMORY = -2,
+    VMCHANNEL_UNSUPPORTEDTYPE = -3
+} vmchannelresult;
+
+h64channel *vmchannel_New(h64vmexec *vmexec, int64_t capacity);
+    // returns NULL on oom, the channel starts out with no reference
+
+void vmchannel_Unref(h64channel *ch);  // frees it with the last ref
+
+void vmchannel_Free(h64channel *ch);  // only if it has no refs yet
+
+h64gcvalue *vmchannel_NewObject(h64vmthread *vt, h64channel *ch);
+    // returns a new object for ch on vt's heap with no reference added
+    // yet, or NULL on oom
+
+int vmchannel_IsChannelObject(h64vmthread *vt, h64gcvalue *gcval);
+
+h64channel *vmchannel_FromObject(h64gcvalue *gcval);
+
+vmchannelresult vmchannel_Send(
+    h64channel *ch, h64vmthread *vt, valuecontent *value,
+    pipesource source_kind
+);
+
+vmchannelresult vmchannel_SendList(
+    h64channel *ch, h64vmthread *vt, genericlist *l, int l_owned,
+    int64_t *next
+);  // sends the entries from index *next on, advancing *next. If
+    // l_owned is set, nobody else references l and entries may be
+    // moved out, leaving none behind.
+
+vmchannelresult vmchannel_Receive(
+    h64channel *ch, h64vmthread *vt, valuecontent *out_values,
+    int64_t max, int64_t *out_count
+);  // receives up to max values, each holding one reference. Only
+    // waits if none are available. Returns VMCHANNEL_CLOSED once the
+    // channel is closed and drained.
+
+void vmchannel_Close(h64channel *ch);
+
+void vmchannel_ForgetWaiter(h64channel *ch, h64vmthread *vt);
+    // for when vt stops waiting without another send or receive
+
+static inline int vmchannel_CanSend(h64channel *ch) {
+    return (atomic_load(&ch->count) < ch->capacity ||
+            atomic_load(&ch->closed));
+}
+
+static inline int vmchannel_CanReceive(h64channel *ch) {
+    return (atomic_load(&ch->count) > 0 ||
+            atomic_load(&ch->closed));
+}
+
+#endif  // HORSE64_VMCHANNEL_H_
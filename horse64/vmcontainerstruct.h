@@ -17,12 +17,6 @@
 
 typedef struct listblock listblock;
 
-typedef struct vectorentry {
-    int64_t int_value;
-    double float_value;
-    uint8_t is_float;
-} vectorentry;
-
 typedef struct listblock {
     int entry_count;
     listblock *next_block;
@@ -35,7 +29,20 @@ typedef struct _listblock_minisize {
     valuecontent entry_values[LISTBLOCK_MINSIZE];
 } _listblock_minisize;
 
+#define LISTPACKED_NONE 0
+#define LISTPACKED_INT64 1
+#define LISTPACKED_FLOAT64 2
+
 typedef struct genericlist {
+    // While all entries are of one number type, the list keeps them
+    // unboxed in a flat packed array and the blocks below stay empty:
+    uint8_t packed_type;
+    int64_t packed_alloc;
+    union {
+        int64_t *packed_int_values;
+        double *packed_float_values;
+    };
+
     int64_t last_accessed_block_offset;
     listblock *last_accessed_block;
 
@@ -56,35 +63,36 @@ typedef struct genericset {
     uint64_t contentrevisionid;
 } genericset;
 
-static const uint8_t GENERICMAP_FLAG_LINEAR = 0x1;
+// Maps use a compact layout: key/value pairs live in dense arrays in
+// insertion order, and a separate open addressing index table maps
+// hashes to positions in these arrays. Removed pairs leave a tombstone
+// behind until the next compaction. Small maps have no index table
+// and are simply scanned.
+#define GENERICMAP_INDEX_EMPTY (-1)
+#define GENERICMAP_INDEX_DELETED (-2)
 
-typedef struct genericmapbucket {
-    int32_t entry_count;
+typedef struct genericmap {
+    int64_t entry_count;  // live pairs, without tombstones
+    int64_t entry_fill;  // used dense slots, including tombstones
+    int64_t entry_alloc;
     valuecontent *key, *entry;
     uint32_t *entry_hash;
-} genericmapbucket;
 
-typedef struct genericmap {
-    uint8_t flags;
-    union {
-        struct hashed {
-            int64_t entry_count;
-            int32_t bucket_count;
-            genericmapbucket *bucket;
-        } hashed;
-        struct linear {
-            int16_t entry_count, entry_alloc;
-            valuecontent *key, *entry;
-            uint32_t *entry_hash;
-        } linear;
-    };
+    int64_t index_size;  // power of two, or 0 when there's no index
+    int32_t *index;
+
     uint64_t contentrevisionid;
 } genericmap;
 
-typedef struct genericvector {
-    int entries_count;
-    vectorentry *values;
-} genericvector;
+typedef struct h64vector {
+    int32_t refcount;
+    uint8_t is_float;
+    int64_t len, alloc;
+    union {  // packed homogeneous storage, depending on is_float:
+        int64_t *int_values;
+        double *float_values;
+    };
+} h64vector;
 
 
 #endif  // HORSE64_VMCONTAINERSTRUCT_H_
\ No newline at end of file
@@ -38,12 +38,25 @@
 #include "vmschedule.h"
 #include "vmstrings.h"
 #include "vmsuspendtypeenum.h"
+#include "vmvector.h"
 #include "widechar.h"
 
 #define DEBUGVMEXEC
 
 
 poolalloc *mainthread_shared_heap = NULL;
+static poolalloc *mainthread_shared_str_pile = NULL;
+static poolalloc *mainthread_shared_iteratorstruct_pile = NULL;
+static int64_t mainthread_shared_users = 0;
+
+// Everything a vm thread needs up front, so that spawning a task is
+// a single allocation:
+typedef struct h64vmthreadblock {
+    h64vmthread vmthread;
+    vmthreadsuspendinfo suspend_info;
+    vmthreadresumeinfo upcoming_resume_info;
+    h64stack stack;
+} h64vmthreadblock;
 
 void vmthread_SetSuspendState(
         h64vmthread *vmthread,
@@ -72,14 +85,16 @@ void vmthread_SetSuspendState(
         assert(vmthread->vmexec_owner->suspend_overview->
             waittypes_currently_active[old_type] >= 0);
     }
-    if (old_type == SUSPENDTYPE_SOCKWAIT_READABLEORERROR ||
+    if (old_type == SUSPENDTYPE_FIXEDTIME) {
+        vmtimerheap_Remove(
+            &vmthread->vmexec_owner->worker_overview->timers, vmthread
+        );
+    } else if (old_type == SUSPENDTYPE_SOCKWAIT_READABLEORERROR ||
             old_type == SUSPENDTYPE_SOCKWAIT_WRITABLEORERROR) {
         int fd = (
             (int)vmthread->suspend_info->suspendarg
         );
-        _vmschedule_UnregisterSocketForWaiting(
-            fd, H64SOCKSET_WAITALL
-        );
+        _vmschedule_UnregisterSocketForWaiting(vmthread, fd);
     }
     vmthread->suspend_info->suspendtype = suspend_type;
     vmthread->suspend_info->suspendarg = suspend_arg;
@@ -106,20 +121,26 @@ void vmthread_SetSuspendState(
         vmthread->upcoming_resume_info->precall_errorframesbefore = -1;
         #endif
     }
-    if (suspend_type == SUSPENDTYPE_SOCKWAIT_READABLEORERROR) {
-        int fd = (
-            (int)vmthread->suspend_info->suspendarg
-        );
-        _vmschedule_RegisterSocketForWaiting(
-            fd, H64SOCKSET_WAITREAD | H64SOCKSET_WAITERROR
+    if (suspend_type == SUSPENDTYPE_FIXEDTIME) {
+        vmtimerheap_Insert(
+            &vmthread->vmexec_owner->worker_overview->timers, vmthread,
+            suspend_arg
         );
-    } else if (suspend_type == SUSPENDTYPE_SOCKWAIT_WRITABLEORERROR) {
+    } else if (suspend_type == SUSPENDTYPE_SOCKWAIT_READABLEORERROR ||
+            suspend_type == SUSPENDTYPE_SOCKWAIT_WRITABLEORERROR) {
         int fd = (
             (int)vmthread->suspend_info->suspendarg
         );
-        _vmschedule_RegisterSocketForWaiting(
-            fd, H64SOCKSET_WAITWRITE | H64SOCKSET_WAITERROR
-        );
+        if (!_vmschedule_RegisterSocketForWaiting(
+                vmthread, fd,
+                (suspend_type == SUSPENDTYPE_SOCKWAIT_READABLEORERROR ?
+                 H64SOCKSET_WAITREAD : H64SOCKSET_WAITWRITE) |
+                H64SOCKSET_WAITERROR
+                )) {
+            // We can't watch the socket, so let the thread just
+            // retry its operation instead:
+            vmthread->suspend_info->suspenditemready = 1;
+        }
     }
     #ifndef NDEBUG
     if (vmthread->vmexec_owner->moptions.vmscheduler_verbose_debug) {
@@ -251,22 +272,63 @@ int vmexec_ValueEqualityCheck(
     return 1;
 }
 
+static int _vmthread_UseMainThreadSharedPiles(h64vmthread *vmthread) {
+    // Non-parallel threads all run on the main worker, so they can
+    // share all their pools rather than each getting their own:
+    if (!mainthread_shared_heap)
+        mainthread_shared_heap = poolalloc_New(sizeof(h64gcvalue));
+    if (!mainthread_shared_str_pile)
+        mainthread_shared_str_pile = poolalloc_New(POOLEDSTRSIZE);
+    if (!mainthread_shared_iteratorstruct_pile)
+        mainthread_shared_iteratorstruct_pile = poolalloc_New(
+            sizeof(h64iteratorstruct)
+        );
+    if (!mainthread_shared_heap || !mainthread_shared_str_pile ||
+            !mainthread_shared_iteratorstruct_pile)
+        return 0;
+    vmthread->heap = mainthread_shared_heap;
+    vmthread->str_pile = mainthread_shared_str_pile;
+    vmthread->iteratorstruct_pile = mainthread_shared_iteratorstruct_pile;
+    mainthread_shared_users++;
+    return 1;
+}
+
+static void _vmthread_DropMainThreadSharedPiles() {
+    assert(mainthread_shared_users > 0);
+    mainthread_shared_users--;
+    if (mainthread_shared_users > 0)
+        return;
+    poolalloc_Destroy(mainthread_shared_heap);
+    mainthread_shared_heap = NULL;
+    poolalloc_Destroy(mainthread_shared_str_pile);
+    mainthread_shared_str_pile = NULL;
+    poolalloc_Destroy(mainthread_shared_iteratorstruct_pile);
+    mainthread_shared_iteratorstruct_pile = NULL;
+}
+
 h64vmthread *vmthread_New(h64vmexec *owner, int is_on_main_thread) {
-    h64vmthread *vmthread = malloc(sizeof(*vmthread));
-    if (!vmthread)
+    h64vmthreadblock *block = malloc(sizeof(*block));
+    if (!block)
         return NULL;
-    memset(vmthread, 0, sizeof(*vmthread));
+    memset(block, 0, sizeof(*block));
+    h64vmthread *vmthread = &block->vmthread;
     vmthread->foreground_async_work_funcid = -1;
+    vmthread->thread_index = -1;
+    vmthread->call_settop_reverse = -1;
+    vmthread->is_on_main_thread = (is_on_main_thread != 0);
+    vmthread->suspend_info = &block->suspend_info;
+    vmthread->upcoming_resume_info = &block->upcoming_resume_info;
+    vmthread->upcoming_resume_info->func_id = -1;
+    stack_Init(&block->stack);
+    vmthread->stack = &block->stack;
 
     if (is_on_main_thread) {
-        if (!mainthread_shared_heap)
-            mainthread_shared_heap = poolalloc_New(sizeof(h64gcvalue));
-        if (!mainthread_shared_heap) {
+        if (!_vmthread_UseMainThreadSharedPiles(vmthread)) {
             vmthread_Free(vmthread);
             return NULL;
         }
-        vmthread->heap = mainthread_shared_heap;
     } else {
+        // (The other pools are created on first use.)
         vmthread->heap = poolalloc_New(sizeof(h64gcvalue));
         if (!vmthread->heap) {
             vmthread_Free(vmthread);
@@ -274,63 +336,38 @@ h64vmthread *vmthread_New(h64vmexec *owner, int is_on_main_thread) {
         }
     }
 
-    vmthread->iteratorstruct_pile = poolalloc_New(
-        sizeof(h64iteratorstruct)
-    );
-    if (!vmthread->iteratorstruct_pile) {
-        vmthread_Free(vmthread);
-        return NULL;
-    }
-
-    vmthread->stack = stack_New();
-    if (!vmthread->stack) {
-        vmthread_Free(vmthread);
-        return NULL;
-    }
-    vmthread->call_settop_reverse = -1;
-    vmthread->is_on_main_thread = 0;
-
-    vmthread->upcoming_resume_info = malloc(
-        sizeof(*vmthread->upcoming_resume_info)
-    );
-    if (!vmthread->upcoming_resume_info) {
-        vmthread_Free(vmthread);
-        return NULL;
-    }
-    memset(vmthread->upcoming_resume_info, 0,
-           sizeof(*vmthread->upcoming_resume_info));
-    vmthread->upcoming_resume_info->func_id = -1;
-
-    vmthread->suspend_info = malloc(
-        sizeof(*vmthread->suspend_info)
-    );
-    if (!vmthread->suspend_info) {
-        vmthread_Free(vmthread);
-        return NULL;
-    }
-    memset(vmthread->suspend_info, 0,
-            sizeof(*vmthread->suspend_info));
-    vmthread->vmexec_owner = owner;
-    assert(owner->suspend_overview != NULL);
-    owner->suspend_overview->
-        waittypes_currently_active[
-            SUSPENDTYPE_ASYNCCALLSCHEDULED
-        ]++;
-
     if (owner) {
-        h64vmthread **new_thread = realloc(
-            owner->thread, sizeof(*new_thread) * (
-            owner->thread_count + 1
-            )
-        );
-        if (!new_thread) {
-            vmthread_Free(vmthread);
-            return NULL;
+        if (owner->thread_count >= owner->thread_alloc) {
+            int new_alloc = owner->thread_alloc * 2;
+            if (new_alloc < 16)
+                new_alloc = 16;
+            h64vmthread **new_thread = realloc(
+                owner->thread, sizeof(*new_thread) * new_alloc
+            );
+            if (!new_thread) {
+                vmthread_Free(vmthread);
+                return NULL;
+            }
+            owner->thread = new_thread;
+            owner->thread_alloc = new_alloc;
         }
-        owner->thread = new_thread;
+        vmthread->vmexec_owner = owner;
+        vmthread->thread_index = owner->thread_count;
         owner->thread[owner->thread_count] = vmthread;
         owner->thread_count++;
-        vmthread->vmexec_owner = owner;
+        assert(owner->suspend_overview != NULL);
+        owner->suspend_overview->
+            waittypes_currently_active[
+                SUSPENDTYPE_UNINITIALIZED
+            ]++;
+
+        // Make sure every thread can sleep without an allocation:
+        if (!vmtimerheap_Reserve(
+                &owner->worker_overview->timers, owner->thread_count
+                )) {
+            vmthread_Free(vmthread);
+            return NULL;
+        }
     }
 
     return vmthread;
@@ -389,12 +426,8 @@ void vmexec_Free(h64vmexec *vmexec) {
     if (!vmexec)
         return;
     if (vmexec->thread) {
-        int i = 0;
-        while (i < vmexec->thread_count) {
-            if (vmexec->thread[i])
-                vmthread_Free(vmexec->thread[i]);
-            i++;
-        }
+        while (vmexec->thread_count > 0)
+            vmthread_Free(vmexec->thread[vmexec->thread_count - 1]);
         free(vmexec->thread);
     }
     if (vmexec->suspend_overview) {
@@ -410,20 +443,31 @@ void vmthread_Free(h64vmthread *vmthread) {
         return;
 
     if (vmthread->vmexec_owner) {
-        int i = 0;
-        while (i < vmthread->vmexec_owner->thread_count) {
-            if (vmthread->vmexec_owner->thread[i] == vmthread) {
-                if (i + 1 < vmthread->vmexec_owner->thread_count)
-                    memcpy(
-                        &vmthread->vmexec_owner->thread[i],
-                        &vmthread->vmexec_owner->thread[i + 1],
-                        (vmthread->vmexec_owner->thread_count - i - 1) *
-                            sizeof(*vmthread->vmexec_owner->thread)
-                    );
-                vmthread->vmexec_owner->thread_count--;
-                continue;
-            }
-            i++;
+        h64vmexec *owner = vmthread->vmexec_owner;
+        if (vmthread->suspend_info->suspendtype != SUSPENDTYPE_NONE)
+            owner->suspend_overview->
+                waittypes_currently_active[
+                    vmthread->suspend_info->suspendtype
+                ]--;
+        vmtimerheap_Remove(
+            &owner->worker_overview->timers, vmthread
+        );
+        if (vmthread->suspend_info->suspendtype ==
+                SUSPENDTYPE_SOCKWAIT_READABLEORERROR ||
+                vmthread->suspend_info->suspendtype ==
+                SUSPENDTYPE_SOCKWAIT_WRITABLEORERROR)
+            _vmschedule_UnregisterSocketForWaiting(
+                vmthread, (int)vmthread->suspend_info->suspendarg
+            );
+        int i = vmthread->thread_index;
+        if (i >= 0) {
+            // Move the last thread into our slot:
+            assert(i < owner->thread_count &&
+                   owner->thread[i] == vmthread);
+            owner->thread[i] = owner->thread[owner->thread_count - 1];
+            owner->thread[i]->thread_index = i;
+            owner->thread_count--;
+            vmthread->thread_index = -1;
         }
     }
 
@@ -434,30 +478,28 @@ void vmthread_Free(h64vmthread *vmthread) {
         i++;
     }
     free(vmthread->arg_reorder_space);
-    if (vmthread->heap && vmthread->heap != mainthread_shared_heap) {
-        // Free items on heap, FIXME
-
-        // Free heap:
-        poolalloc_Destroy(vmthread->heap);
-    }
-    if (vmthread->iteratorstruct_pile)
-        poolalloc_Destroy(vmthread->iteratorstruct_pile);
-    if (vmthread->stack) {
-        stack_Free(vmthread->stack, vmthread);
-    }
+    stack_Uninit(vmthread->stack, vmthread);
     free(vmthread->funcframe);
     free(vmthread->errorframe);
     free(vmthread->kwarg_index_track_map);
-    if (vmthread->str_pile) {
-        poolalloc_Destroy(vmthread->str_pile);
-    }
-    if (vmthread->suspend_info) {
-        free(vmthread->suspend_info);
-    }
-    if (vmthread->upcoming_resume_info) {
-        free(vmthread->upcoming_resume_info);
+    if (vmthread->cfunc_asyncdata_pile)
+        poolalloc_Destroy(vmthread->cfunc_asyncdata_pile);
+    if (vmthread->heap == mainthread_shared_heap &&
+            vmthread->heap != NULL) {
+        _vmthread_DropMainThreadSharedPiles();
+    } else {
+        if (vmthread->heap) {
+            // Free items on heap, FIXME
+
+            // Free heap:
+            poolalloc_Destroy(vmthread->heap);
+        }
+        if (vmthread->iteratorstruct_pile)
+            poolalloc_Destroy(vmthread->iteratorstruct_pile);
+        if (vmthread->str_pile)
+            poolalloc_Destroy(vmthread->str_pile);
     }
-    free(vmthread);
+    free((h64vmthreadblock *)vmthread);
 }
 
 void vmthread_WipeFuncStack(h64vmthread *vmthread) {
@@ -1738,6 +1780,27 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
                     gcval->map_values,
                     vcindex, vcset))
                 goto triggeroom;
+        } else if (vc->type == H64VALTYPE_VECTOR) {
+            if (index_value < 1 || index_value >
+                    vmvector_Count(vc->vector) + 1) {
+                RAISE_ERROR(
+                    H64STDERROR_INDEXERROR,
+                    "index %" PRId64 " is out of range",
+                    index_value
+                );
+                goto *jumptable[((h64instructionany *)p)->type];
+            }
+            if (vcset->type != H64VALTYPE_INT64 &&
+                    vcset->type != H64VALTYPE_FLOAT64) {
+                RAISE_ERROR(
+                    H64STDERROR_TYPEERROR,
+                    "vector entries must be numbers"
+                );
+                goto *jumptable[((h64instructionany *)p)->type];
+            }
+            // Note: like for lists, appending at the end is allowed.
+            if (vmvector_Set(vc->vector, index_value, vcset) < 0)
+                goto triggeroom;
         } else if ((vc->type == H64VALTYPE_GCVAL &&
                 ((h64gcvalue*)vc->ptr_value)->type ==
                 H64GCVALUETYPE_STRING) ||
@@ -2253,17 +2316,12 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
                     int64_t count = vmlist_Count(l);
                     int64_t k2 = 0;
                     while (k2 < count) {
-                        valuecontent *vlistentry = vmlist_Get(
-                            l, k2
-                        );
-                        assert(vlistentry != NULL);
-                        memcpy(
-                            &vmthread->arg_reorder_space[
+                        int gotentry = vmlist_Get(
+                            l, k2 + 1, &vmthread->arg_reorder_space[
                                 reformat_slots_used
-                            ],
-                            vlistentry,
-                            sizeof(valuecontent)
+                            ]
                         );
+                        assert(gotentry);
                         ADDREF_NONHEAP(
                             &vmthread->arg_reorder_space[
                                 reformat_slots_used
@@ -2791,7 +2849,16 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
                     new_func_floor, target_func_id,
                     parallelasync
                 );
-                if (!result) {
+                if (result < 0) {
+                    if (!vmthread_ResetCallTempStack(vmthread)) {
+                        goto triggeroom;
+                    }
+                    RAISE_ERROR(
+                        H64STDERROR_TYPEERROR,
+                        "cannot pass this value type to parallel func"
+                    );
+                    goto *jumptable[((h64instructionany *)p)->type];
+                } else if (!result) {
                     vmthread_ResetCallTempStack(vmthread);
                     goto triggeroom;
                 }
@@ -3177,9 +3244,13 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
         valuecontent_Free(vmthread, v);
         if (likely(vlist->type == H64VALTYPE_GCVAL)) {
             v->type = H64VALTYPE_ITERATOR;
-            v->iterator = poolalloc_malloc(
-                vmthread->iteratorstruct_pile, 0
-            );
+            if (unlikely(!vmthread->iteratorstruct_pile))
+                vmthread->iteratorstruct_pile = poolalloc_New(
+                    sizeof(h64iteratorstruct)
+                );
+            v->iterator = (vmthread->iteratorstruct_pile ?
+                poolalloc_malloc(vmthread->iteratorstruct_pile, 0) :
+                NULL);
             if (!v->iterator) {
                 RAISE_ERROR(H64STDERROR_OUTOFMEMORYERROR,
                     "out of memory creating iterator");
@@ -3214,9 +3285,13 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
         } else {
             assert(vlist->type == H64VALTYPE_VECTOR);
             v->type = H64VALTYPE_ITERATOR;
-            v->iterator = poolalloc_malloc(
-                vmthread->iteratorstruct_pile, 0
-            );
+            if (unlikely(!vmthread->iteratorstruct_pile))
+                vmthread->iteratorstruct_pile = poolalloc_New(
+                    sizeof(h64iteratorstruct)
+                );
+            v->iterator = (vmthread->iteratorstruct_pile ?
+                poolalloc_malloc(vmthread->iteratorstruct_pile, 0) :
+                NULL);
             if (!v->iterator) {
                 RAISE_ERROR(H64STDERROR_OUTOFMEMORYERROR,
                     "out of memory creating iterator");
@@ -3229,8 +3304,7 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
                 vlist, sizeof(*vlist)
             );
             ADDREF_NONHEAP(&v->iterator->iterated_vector);
-            v->iterator->len = vlist->vector_len;
-            return 0;
+            v->iterator->len = vmvector_Count(vlist->vector);
         }
 
         p += sizeof(h64instruction_newiterator);
@@ -3302,46 +3376,45 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
         if (iter->iterated_isgcvalue) {
             if (iter->iterated_gcvalue->type ==
                     H64GCVALUETYPE_LIST) {
-                valuecontent *v = vmlist_Get(
-                    iter->iterated_gcvalue->list_values, iter->idx
-                );
-                assert(v != NULL);
-                memcpy(vcresult, v, sizeof(*vcresult));
-                ADDREF_NONHEAP(vcresult);
+                genericlist *l = iter->iterated_gcvalue->list_values;
+                if (l->packed_type == LISTPACKED_INT64) {
+                    // Fast path, no tag checks or refcounting needed:
+                    vcresult->type = H64VALTYPE_INT64;
+                    vcresult->int_value = (
+                        l->packed_int_values[iter->idx - 1]
+                    );
+                } else if (l->packed_type == LISTPACKED_FLOAT64) {
+                    vcresult->type = H64VALTYPE_FLOAT64;
+                    vcresult->float_value = (
+                        l->packed_float_values[iter->idx - 1]
+                    );
+                } else {
+                    int gotentry = vmlist_Get(l, iter->idx, vcresult);
+                    assert(gotentry);
+                    ADDREF_NONHEAP(vcresult);
+                }
             } else if (iter->iterated_gcvalue->type ==
                     H64GCVALUETYPE_MAP) {
-                int inneroom = 0;
-                int result = vmmap_Get(
-                    vmthread,
+                // Pairs are stored densely in insertion order, so this
+                // is a plain array access without any hash lookup:
+                valuecontent *value = NULL;
+                valuecontent *key = vmmap_GetPair(
                     iter->iterated_gcvalue->map_values,
-                    vmmap_GetKeyByIdx(
-                        iter->iterated_gcvalue->map_values,
-                        iter->idx
-                    ), vcresult, &inneroom
+                    iter->idx, &value
                 );
-                if (!result) {
-                    assert(inneroom != 0);
-                    RAISE_ERROR(H64STDERROR_OUTOFMEMORYERROR,
-                        "out of memory while iterating map");
-                    goto *jumptable[((h64instructionany *)p)->type];
-                }
-                assert(result != 0);
+                assert(key != NULL && value != NULL);
+                (void)key;
+                memcpy(vcresult, value, sizeof(*value));
                 ADDREF_NONHEAP(vcresult);
             } else {
                 h64fprintf(stderr, "container not implemented\n");
                 return 0;
             }
         } else {
-            vectorentry *ve = &(
-                iter->iterated_vector.vector_values[iter->idx]
+            int result = vmvector_Get(
+                iter->iterated_vector.vector, iter->idx, vcresult
             );
-            if (ve->int_value) {
-                vcresult->type = H64VALTYPE_INT64;
-                vcresult->int_value = ve->int_value;
-            } else {
-                vcresult->type = H64VALTYPE_FLOAT64;
-                vcresult->int_value = ve->float_value;
-            }
+            assert(result != 0);
         }
 
         p += sizeof(h64instruction_iterate);
@@ -3835,6 +3908,7 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
             gcval->type = H64GCVALUETYPE_BYTES;
             gcval->heapreferencecount = 0;
             gcval->externalreferencecount = 1;
+            memset(&gcval->bytes_val, 0, sizeof(gcval->bytes_val));
             if (!vmbytes_AllocBuffer(
                     vmthread, &gcval->bytes_val, bytesvaluelen)) {
                 if (bytesvalue != _bytesvalue_buf)
@@ -3935,7 +4009,7 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
             } else if (vc->type == H64VALTYPE_SHORTBYTES) {
                 len = vc->shortbytes_len;
             } else if (vc->type == H64VALTYPE_VECTOR) {
-                len = vc->vector_len;
+                len = vmvector_Count(vc->vector);
             }
             if (len < 0) {
                 RAISE_ERROR(
@@ -4005,6 +4079,50 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
                 (h64gcvalue *)vc->ptr_value
             );
             ADDREF_HEAP(vc);  // for ref by closure
+        } else if (vc->type == H64VALTYPE_VECTOR &&
+                (lookup_func_idx = corelib_GetVectorFuncIdx(
+                    pr, nameidx
+                )) >= 0) {  // vector attrs
+            target->type = H64VALTYPE_GCVAL;
+            target->ptr_value = poolalloc_malloc(
+                heap, 0
+            );
+            if (!target->ptr_value)
+                goto triggeroom;
+            h64gcvalue *gcval = (h64gcvalue *)target->ptr_value;
+            gcval->hash = 0;
+            gcval->type = H64GCVALUETYPE_FUNCREF_CLOSURE;
+            gcval->heapreferencecount = 0;
+            gcval->externalreferencecount = 1;
+            gcval->closure_info = (
+                malloc(sizeof(*gcval->closure_info))
+            );
+            if (!gcval->closure_info) {
+                poolalloc_free(heap, gcval);
+                target->ptr_value = NULL;
+                goto triggeroom;
+            }
+            memset(gcval->closure_info, 0,
+                    sizeof(*gcval->closure_info));
+            gcval->closure_info->closure_func_id = (
+                lookup_func_idx
+            );
+            gcval->closure_info->closure_bound_values = malloc(
+                sizeof(*gcval->closure_info->closure_bound_values) *
+                1
+            );
+            if (!gcval->closure_info->closure_bound_values) {
+                free(gcval->closure_info);
+                poolalloc_free(heap, gcval);
+                target->ptr_value = NULL;
+                goto triggeroom;
+            }
+            gcval->closure_info->closure_bound_values_count = 1;
+            memcpy(
+                &gcval->closure_info->closure_bound_values[0],
+                vc, sizeof(*vc)
+            );
+            ADDREF_HEAP(vc);  // for ref by closure
         } else if ((((vc->type == H64VALTYPE_GCVAL && (
                 ((h64gcvalue *)vc->ptr_value)->type ==
                     H64GCVALUETYPE_BYTES)) ||
@@ -4242,8 +4360,32 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
         goto *jumptable[((h64instructionany *)p)->type];
     }
     inst_newvector: {
-        h64fprintf(stderr, "newvector not implemented\n");
-        return 0;
+        h64instruction_newvector *inst = (
+            (h64instruction_newvector *)p
+        );
+        #ifndef NDEBUG
+        if (vmthread->vmexec_owner->moptions.vmexec_debug &&
+                !vmthread_PrintExec(vmthread, func_id, (void*)inst))
+            goto triggeroom;
+        #endif
+
+        valuecontent *vc = STACK_ENTRY(stack, inst->slotto);
+        DELREF_NONHEAP(vc);
+        valuecontent_Free(vmthread, vc);
+        memset(vc, 0, sizeof(*vc));
+        h64vector *vector = vmvector_New(0, 0);
+        if (!vector)
+            goto triggeroom;
+        vc->type = H64VALTYPE_VECTOR;
+        vc->vector = vector;
+        ADDREF_NONHEAP(vc);
+
+        #ifndef NDEBUG
+        vmexec_VerifyStack(vmthread);
+        #endif
+
+        p += sizeof(h64instruction_newvector);
+        goto *jumptable[((h64instructionany *)p)->type];
     }
     {
         // WARNING: ALL UNINITIALIZED, since goto jumps over them:
@@ -4323,6 +4465,7 @@ HOTSPOT int _vmthread_RunFunction_NoPopFuncFrames(
             gcval->heapreferencecount = 0;
             gcval->externalreferencecount = 1;
             gcval->class_id = class_id;
+            gcval->cdata = NULL;
             int32_t varattr_count = (
                 vmexec->program->classes[class_id].varattr_count
             );
@@ -60,6 +60,7 @@ typedef struct vmsuspendoverview vmsuspendoverview;
 typedef struct vmthreadsuspendinfo vmthreadsuspendinfo;
 typedef struct h64vmworker h64vmworker;
 typedef struct h64asyncsysjob h64asyncsysjob;
+typedef struct h64paralleljob h64paralleljob;
 
 struct asyncprogress_base_struct {
     void (*abortfunc)(void *dataptr);
@@ -69,6 +70,12 @@ typedef struct h64vmthread {
     h64vmexec *vmexec_owner;
     h64vmworker *_Atomic volatile run_by_worker;
     uint8_t is_on_main_thread, is_original_main;
+    _Atomic volatile uint8_t queued_for_run;
+    int64_t timer_heap_pos;  // 1-based, 0 if not in the timer heap
+    int thread_index;  // position in vmexec_owner->thread
+    h64vmthread *sockwait_next;  // next thread waiting on same fd
+    h64paralleljob *parallel_job;  // set if running a parallel_map chunk
+    int parallel_chunk;
 
     int kwarg_index_track_count;
     int32_t *kwarg_index_track_map;
@@ -103,7 +110,7 @@ typedef struct h64vmexec {
     volatile int supervisor_stop_signal;
 
     h64vmthread **thread;
-    int thread_count;
+    int thread_count, thread_alloc;
     h64vmthread *active_thread;
 
     int program_return_value;
@@ -58,7 +58,47 @@ inst_binop: {
         #endif
         int invalidtypes = 1;
         int divisionbyzero = 0;
+        if (unlikely((v1->type == H64VALTYPE_VECTOR ||
+                v2->type == H64VALTYPE_VECTOR) &&
+                inst->optype != H64OP_INDEXBYEXPR &&
+                inst->optype != H64OP_CMP_EQUAL &&
+                inst->optype != H64OP_CMP_NOTEQUAL &&
+                inst->optype != H64OP_BOOLCOND_AND &&
+                inst->optype != H64OP_BOOLCOND_OR))
+            goto binop_vectormath;
         goto *op_jumptable[inst->optype];
+        binop_vectormath: {
+            // Elementwise math and comparisons, handled by the
+            // SIMD kernels in vmvector.c:
+            int vresult = vmvector_BinOp(
+                inst->optype, v1, v2, tmpresult
+            );
+            if (unlikely(vresult != VECTOROP_OK)) {
+                if (vresult == VECTOROP_ERR_OOM) {
+                    goto triggeroom;
+                } else if (vresult == VECTOROP_ERR_DIVISIONBYZERO) {
+                    invalidtypes = 0;
+                    divisionbyzero = 1;
+                } else if (vresult == VECTOROP_ERR_LENMISMATCH) {
+                    RAISE_ERROR(
+                        H64STDERROR_VALUEERROR,
+                        "vectors must have same length for %s operator",
+                        operator_OpPrintedAsStr(inst->optype)
+                    );
+                    goto *jumptable[((h64instructionany *)p)->type];
+                } else if (vresult == VECTOROP_ERR_OVERFLOW) {
+                    RAISE_ERROR(
+                        H64STDERROR_OVERFLOWERROR,
+                        "number range overflow"
+                    );
+                    goto *jumptable[((h64instructionany *)p)->type];
+                }
+                goto binop_done;
+            }
+            invalidtypes = 0;
+            ADDREF_NONHEAP(tmpresult);
+            goto binop_done;
+        }
         binop_divide: {
             if (unlikely((v1->type != H64VALTYPE_INT64 &&
                     v1->type != H64VALTYPE_FLOAT64) ||
@@ -750,10 +790,10 @@ inst_binop: {
                     ((h64gcvalue *)v1->ptr_value)->type ==
                     H64GCVALUETYPE_LIST
                     )) {
-                valuecontent *v = vmlist_Get(
-                    ((h64gcvalue *)v1->ptr_value)->list_values, index_by
-                );
-                if (!v) {
+                if (!vmlist_Get(
+                        ((h64gcvalue *)v1->ptr_value)->list_values,
+                        index_by, tmpresult
+                        )) {
                     RAISE_ERROR(
                         H64STDERROR_INDEXERROR,
                         "index %" PRId64 " is out of range",
@@ -761,7 +801,6 @@ inst_binop: {
                     );
                     goto *jumptable[((h64instructionany *)p)->type];
                 }
-                memcpy(tmpresult, v, sizeof(*v));
                 ADDREF_NONHEAP(tmpresult);
             } else if (v1->type == H64VALTYPE_GCVAL && (
                     ((h64gcvalue *)v1->ptr_value)->type ==
@@ -789,6 +828,15 @@ inst_binop: {
                 }
                 memcpy(tmpresult, &v, sizeof(v));
                 ADDREF_NONHEAP(tmpresult);
+            } else if (v1->type == H64VALTYPE_VECTOR) {
+                if (!vmvector_Get(v1->vector, index_by, tmpresult)) {
+                    RAISE_ERROR(
+                        H64STDERROR_INDEXERROR,
+                        "index %" PRId64 " is out of range",
+                        (int64_t)index_by
+                    );
+                    goto *jumptable[((h64instructionany *)p)->type];
+                }
             } else if ((v1->type == H64VALTYPE_GCVAL &&
                     ((h64gcvalue *)v1->ptr_value)->type ==
                     H64GCVALUETYPE_STRING
@@ -797,18 +845,17 @@ inst_binop: {
                 char *s = NULL;
                 int64_t slen = -1;
                 int64_t sletters = -1;
+                h64stringval *sval = NULL;
                 if (v1->type == H64VALTYPE_GCVAL) {
                     assert(
                         ((h64gcvalue *)v1->ptr_value)->type ==
                         H64GCVALUETYPE_STRING
                     );
-                    s = (char *)((h64gcvalue *)v1->ptr_value)->str_val.s;
-                    slen = ((h64gcvalue *)v1->ptr_value)->str_val.len;
-                    vmstrings_RequireLetterLen(
-                        &(((h64gcvalue *)v1->ptr_value)->str_val)
-                    );
-                    sletters = ((h64gcvalue *)v1->ptr_value)->str_val.
-                        letterlen;
+                    sval = &((h64gcvalue *)v1->ptr_value)->str_val;
+                    s = (char *)sval->s;
+                    slen = sval->len;
+                    vmstrings_RequireLetterLen(sval);
+                    sletters = sval->letterlen;
                 } else {
                     if (v1->type == H64VALTYPE_CONSTPREALLOCSTR) {
                         s = (char *)v1->constpreallocstr_value;
@@ -826,6 +873,17 @@ inst_binop: {
                         (int64_t)index_by
                     );
                 }
+                if (sval != NULL) {
+                    // Use the string's letter index, rather than
+                    // walking all previous letters every time:
+                    int64_t start = vmstrings_LetterOffset(
+                        sval, index_by - 1
+                    );
+                    s += start * sizeof(h64wchar);
+                    // ^ Multiply, since char * (not h64wchar *)
+                    slen -= start;
+                    index_by = 1;
+                }
                 while (index_by > 1) {
                     int64_t len = utf32_letter_len((h64wchar *)s, slen);
                     assert(len > 0);
@@ -32,10 +32,173 @@ genericlist *vmlist_New() {
     return l;
 }
 
+void vmlist_Free(genericlist *l) {
+    if (!l)
+        return;
+    if (l->packed_type != LISTPACKED_NONE)
+        free(l->packed_int_values);
+    listblock *block = l->first_block;
+    while (block) {
+        int i = 0;
+        while (i < block->entry_count) {
+            DELREF_HEAP(&block->entry_values[i]);
+            i++;
+        }
+        listblock *next = block->next_block;
+        free(block);
+        block = next;
+    }
+    free(l);
+}
+
+static int _vmlist_PackedTypeOf(valuecontent *vc) {
+    if (vc->type == H64VALTYPE_INT64)
+        return LISTPACKED_INT64;
+    else if (vc->type == H64VALTYPE_FLOAT64)
+        return LISTPACKED_FLOAT64;
+    return LISTPACKED_NONE;
+}
+
+static void _vmlist_PackedGet(
+        genericlist *l, int64_t entry_idx, valuecontent *out
+        ) {
+    // Note: entry_idx is 0-based here.
+    memset(out, 0, sizeof(*out));
+    if (l->packed_type == LISTPACKED_INT64) {
+        out->type = H64VALTYPE_INT64;
+        out->int_value = l->packed_int_values[entry_idx];
+    } else {
+        assert(l->packed_type == LISTPACKED_FLOAT64);
+        out->type = H64VALTYPE_FLOAT64;
+        out->float_value = l->packed_float_values[entry_idx];
+    }
+}
+
+static void _vmlist_PackedPut(
+        genericlist *l, int64_t entry_idx, valuecontent *vc
+        ) {
+    // Note: entry_idx is 0-based here.
+    if (l->packed_type == LISTPACKED_INT64) {
+        assert(vc->type == H64VALTYPE_INT64);
+        l->packed_int_values[entry_idx] = vc->int_value;
+    } else {
+        assert(l->packed_type == LISTPACKED_FLOAT64 &&
+               vc->type == H64VALTYPE_FLOAT64);
+        l->packed_float_values[entry_idx] = vc->float_value;
+    }
+}
+
+static int _vmlist_PackedReserve(genericlist *l, int64_t count) {
+    if (count <= l->packed_alloc)
+        return 1;
+    int64_t new_alloc = l->packed_alloc * 2;
+    if (new_alloc < 16)
+        new_alloc = 16;
+    if (new_alloc < count)
+        new_alloc = count;
+    // (Both int64_t and double are 8 bytes, so one realloc serves both.)
+    int64_t *new_values = realloc(
+        l->packed_int_values, sizeof(*new_values) * new_alloc
+    );
+    if (!new_values)
+        return 0;
+    l->packed_int_values = new_values;
+    l->packed_alloc = new_alloc;
+    return 1;
+}
+
+static int _vmlist_TryStartPacked(genericlist *l, valuecontent *vc) {
+    // An empty list picks up packed storage from the first number
+    // added, as long as no leftover empty blocks are around:
+    if (l->list_total_entry_count != 0)
+        return 0;
+    int packed_type = _vmlist_PackedTypeOf(vc);
+    if (packed_type == LISTPACKED_NONE)
+        return 0;
+    if (l->packed_type == LISTPACKED_NONE &&
+            (l->first_block->entry_count != 0 ||
+             l->first_block->next_block != NULL))
+        return 0;
+    l->packed_type = packed_type;
+    return 1;
+}
+
+static int _vmlist_Unpack(genericlist *l) {
+    // Move all packed entries over into regular valuecontent blocks,
+    // which is needed once an entry of any other type is stored.
+    assert(l->packed_type != LISTPACKED_NONE);
+    assert(l->first_block->entry_count == 0 &&
+           l->first_block->next_block == NULL);
+    const int64_t count = l->list_total_entry_count;
+    if (count > l->first_block_shrunk_size) {
+        // Need regular sized blocks for this, allocate all upfront so
+        // we can bail out cleanly on oom:
+        listblock *first = NULL;
+        listblock *last = NULL;
+        int64_t block_count = 0;
+        int64_t remaining = count;
+        while (remaining > 0) {
+            listblock *block = malloc(sizeof(*block));
+            if (!block) {
+                while (first) {
+                    listblock *next = first->next_block;
+                    free(first);
+                    first = next;
+                }
+                return 0;
+            }
+            block->entry_count = 0;
+            block->next_block = NULL;
+            if (last)
+                last->next_block = block;
+            else
+                first = block;
+            last = block;
+            block_count++;
+            remaining -= LISTBLOCK_SIZE;
+        }
+        free(l->first_block);
+        l->first_block = first;
+        l->last_block = last;
+        l->list_block_count = block_count;
+        l->first_block_shrunk_size = LISTBLOCK_SIZE;
+    }
+    listblock *block = l->first_block;
+    int64_t i = 0;
+    while (i < count) {
+        if (block->entry_count >= LISTBLOCK_SIZE)
+            block = block->next_block;
+        assert(block != NULL);
+        _vmlist_PackedGet(
+            l, i, &block->entry_values[block->entry_count]
+        );
+        block->entry_count++;
+        i++;
+    }
+    free(l->packed_int_values);
+    l->packed_int_values = NULL;
+    l->packed_alloc = 0;
+    l->packed_type = LISTPACKED_NONE;
+    l->last_accessed_block = NULL;
+    l->last_accessed_block_offset = -1;
+    return 1;
+}
+
 int vmmap_IterateValues(
         genericlist *l, void *userdata,
         int (*cb)(void *udata, valuecontent *value)
         ) {
+    if (l->packed_type != LISTPACKED_NONE) {
+        int64_t i = 0;
+        while (i < l->list_total_entry_count) {
+            valuecontent v;
+            _vmlist_PackedGet(l, i, &v);
+            if (!cb(userdata, &v))
+                return 0;
+            i++;
+        }
+        return 1;
+    }
     listblock *block = l->first_block;
     while (block) {
         int i = 0;
@@ -52,6 +215,42 @@ int vmmap_IterateValues(
 int vmlist_Contains(h64vmthread *vt,
         genericlist *l, valuecontent *v, int *oom) {
     *oom = 0;
+    if (l->packed_type != LISTPACKED_NONE) {
+        // Fast path: plain number compares, same semantics as
+        // valuecontent_CheckEquality() (so 1 == 1.0):
+        const int64_t count = l->list_total_entry_count;
+        int64_t i = 0;
+        if (v->type == H64VALTYPE_INT64 &&
+                l->packed_type == LISTPACKED_INT64) {
+            const int64_t needle = v->int_value;
+            const int64_t *values = l->packed_int_values;
+            while (i < count) {
+                if (values[i] == needle)
+                    return 1;
+                i++;
+            }
+        } else if (v->type == H64VALTYPE_INT64 ||
+                v->type == H64VALTYPE_FLOAT64) {
+            const double needle = (v->type == H64VALTYPE_INT64 ?
+                (double)v->int_value : v->float_value);
+            if (l->packed_type == LISTPACKED_INT64) {
+                const int64_t *values = l->packed_int_values;
+                while (i < count) {
+                    if ((double)values[i] == needle)
+                        return 1;
+                    i++;
+                }
+            } else {
+                const double *values = l->packed_float_values;
+                while (i < count) {
+                    if (values[i] == needle)
+                        return 1;
+                    i++;
+                }
+            }
+        }
+        return 0;
+    }
     listblock *block = l->first_block;
     while (block) {
         int i = 0;
@@ -116,6 +315,20 @@ int vmlist_Add(
     assert(l != NULL);
     assert(vc != NULL);
 
+    _vmlist_TryStartPacked(l, vc);
+    if (l->packed_type != LISTPACKED_NONE) {
+        if (likely(_vmlist_PackedTypeOf(vc) == l->packed_type)) {
+            if (!_vmlist_PackedReserve(l, l->list_total_entry_count + 1))
+                return 0;
+            _vmlist_PackedPut(l, l->list_total_entry_count, vc);
+            l->list_total_entry_count++;
+            l->contentrevisionid++;
+            return 1;
+        }
+        if (!_vmlist_Unpack(l))
+            return 0;
+    }
+
     // If this is the first block, it might be shrunk (to save space for
     // mini lists):
     int first_grown = _grow_shrunk_first_block(
@@ -137,6 +350,7 @@ int vmlist_Add(
         newblock->next_block = NULL;
         l->last_block->next_block = newblock;
         l->last_block = newblock;
+        l->list_block_count++;
     }
     assert(l->last_block->next_block == NULL &&
            l->last_block->entry_count < LISTBLOCK_SIZE);
@@ -160,6 +374,18 @@ int vmlist_Add(
 int vmlist_Remove(genericlist *l, int64_t index) {
     if (index < 1 || index > l->list_total_entry_count)
         return 0;
+    if (l->packed_type != LISTPACKED_NONE) {
+        memmove(
+            &l->packed_int_values[index - 1],
+            &l->packed_int_values[index],
+            sizeof(*l->packed_int_values) * (
+                l->list_total_entry_count - index
+            )
+        );
+        l->list_total_entry_count--;
+        l->contentrevisionid++;
+        return 1;
+    }
     int64_t blockoffset = -1;
     listblock *block = NULL;
     vmlist_GetEntryBlock(
@@ -181,7 +407,10 @@ int vmlist_Remove(genericlist *l, int64_t index) {
         );
     }
     block->entry_count--;
+    l->list_total_entry_count--;
     l->contentrevisionid++;
+    l->last_accessed_block = NULL;
+    l->last_accessed_block_offset = -1;
     return 1;
 }
 
@@ -190,6 +419,14 @@ int vmlist_Set(genericlist *l, int64_t index, valuecontent *vc) {
         return 0;
     if (index == l->list_total_entry_count + 1)
         return (vmlist_Add(l, vc) ? 1 : -1);
+    if (l->packed_type != LISTPACKED_NONE) {
+        if (likely(_vmlist_PackedTypeOf(vc) == l->packed_type)) {
+            _vmlist_PackedPut(l, index - 1, vc);
+            return 1;
+        }
+        if (!_vmlist_Unpack(l))
+            return -1;
+    }
     int64_t blockoffset = -1;
     listblock *block = NULL;
     vmlist_GetEntryBlock(
@@ -217,6 +454,25 @@ int vmlist_Insert(
         return 0;
     if (index == l->list_total_entry_count + 1)
         return (vmlist_Add(l, vc) ? 1 : -1);
+    if (l->packed_type != LISTPACKED_NONE) {
+        if (likely(_vmlist_PackedTypeOf(vc) == l->packed_type)) {
+            if (!_vmlist_PackedReserve(l, l->list_total_entry_count + 1))
+                return -1;
+            memmove(
+                &l->packed_int_values[index],
+                &l->packed_int_values[index - 1],
+                sizeof(*l->packed_int_values) * (
+                    l->list_total_entry_count - (index - 1)
+                )
+            );
+            _vmlist_PackedPut(l, index - 1, vc);
+            l->list_total_entry_count++;
+            l->contentrevisionid++;
+            return 1;
+        }
+        if (!_vmlist_Unpack(l))
+            return -1;
+    }
 
     // Get the block into which to insert:
     int64_t blockoffset = -1;
@@ -255,9 +511,11 @@ int vmlist_Insert(
         newblock->entry_count = pushout_items;
         assert(newblock->entry_count > 0 &&
                newblock->entry_count <= LISTBLOCK_SIZE);
+        newblock->next_block = block->next_block;
         if (!block->next_block)
             l->last_block = newblock;
         block->next_block = newblock;
+        l->list_block_count++;
     }
     if (local_index < LISTBLOCK_SIZE) {
         memmove(
@@ -9,12 +9,15 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "bytecode.h"
 #include "vmcontainerstruct.h"
 
 genericlist *vmlist_New();
 
+void vmlist_Free(genericlist *l);
+
 ATTR_UNUSED static inline uint64_t vmlist_Revision(genericlist *l) {
     return l->contentrevisionid;
 }
@@ -86,9 +89,22 @@ typedef struct h64gcvalue2 {
     uint8_t type;
 } h64gcvalue2;
 
-ATTR_UNUSED static valuecontent *vmlist_Get(genericlist *l, int64_t i) {
+ATTR_UNUSED static inline int vmlist_Get(
+        genericlist *l, int64_t i, valuecontent *out
+        ) {
+    // Returns 1 and sets a borrowed copy of the entry (no ref added)
+    // into out, or 0 if the index is out of range.
     if (i < 1 || i > l->list_total_entry_count)
-        return NULL;
+        return 0;
+    if (l->packed_type == LISTPACKED_INT64) {
+        out->type = H64VALTYPE_INT64;
+        out->int_value = l->packed_int_values[i - 1];
+        return 1;
+    } else if (l->packed_type == LISTPACKED_FLOAT64) {
+        out->type = H64VALTYPE_FLOAT64;
+        out->float_value = l->packed_float_values[i - 1];
+        return 1;
+    }
     int64_t blockoffset = -1;
     listblock *block = NULL;
     vmlist_GetEntryBlock(
@@ -97,8 +113,8 @@ ATTR_UNUSED static valuecontent *vmlist_Get(genericlist *l, int64_t i) {
     assert(block != NULL && blockoffset >= 0);
     i -= blockoffset;
     assert(i >= 1 && i <= block->entry_count);
-    valuecontent *result = &block->entry_values[i - 1];
-    return result;
+    memcpy(out, &block->entry_values[i - 1], sizeof(*out));
+    return 1;
 }
 
 int vmlist_Set(
@@ -6,15 +6,23 @@
 #include "compileconfig.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "bytecode.h"
 #include "valuecontentstruct.h"
 #include "vmcontainerstruct.h"
 #include "vmmap.h"
 
-#define GENERICMAP_MIGRATE_HASHED 16
-#define GENERICMAP_DEFAULT_BUCKETS 64
+#define GENERICMAP_LINEAR_MAX 8
+#define GENERICMAP_MIN_ALLOC 4
+
+// Removed pairs are marked by this key type in the dense arrays,
+// since it can never be a legitimate key:
+#define _ISTOMBSTONE(m, i) (\
+    (m)->key[i].type == H64VALTYPE_UNSPECIFIED_KWARG)
 
 
 genericmap *vmmap_New() {
@@ -22,140 +30,123 @@ genericmap *vmmap_New() {
     if (!map)
         return NULL;
     memset(map, 0, sizeof(*map));
-    map->flags |= GENERICMAP_FLAG_LINEAR;
     return map;
 }
 
-int _vmmap_AddToBucket(
-        genericmapbucket *buck, uint32_t hash,
-        valuecontent *key, valuecontent *value
-        ) {
-    valuecontent *entries = realloc(
-        buck->entry,
-        sizeof(*buck->entry) * (buck->entry_count + 1)
-    );
-    if (!entries)
-        return 0;
-    buck->entry = entries;
-    valuecontent *keys = realloc(
-        buck->key,
-        sizeof(*buck->key) * (buck->entry_count + 1)
-    );
-    if (!entries)
-        return 0;
-    buck->key = keys;
-    uint32_t *entries_hash = realloc(
-        buck->entry_hash,
-        sizeof(*buck->entry_hash) * (buck->entry_count + 1)
-    );
-    if (!entries_hash)
-        return 0;
-    buck->entry_hash = entries_hash;
-    memcpy(
-        &buck->key[buck->entry_count],
-        key, sizeof(*key)
-    );
-    ADDREF_HEAP(&buck->key[buck->entry_count]);
-    memcpy(
-        &buck->entry[buck->entry_count],
-        value, sizeof(*value)
-    );
-    ADDREF_HEAP(&buck->entry[buck->entry_count]);
-    buck->entry_hash[buck->entry_count] = hash;
-    buck->entry_count++;
-    return 1;
-}
-
-void _vmmap_ClearBuckets(genericmap *map, h64vmthread *vmthread) {
-    if ((map->flags & GENERICMAP_FLAG_LINEAR) != 0) {
-        int32_t i = 0;
-        while (i < map->linear.entry_count) {
-            DELREF_HEAP(&map->linear.entry[i]);
-            valuecontent_Free(vmthread, &map->linear.entry[i]);
-            DELREF_HEAP(&map->linear.key[i]);
-            valuecontent_Free(vmthread, &map->linear.key[i]);
-            i++;
-        }
-        free(map->linear.entry);
-        map->linear.entry = NULL;
-        free(map->linear.key);
-        map->linear.key = NULL;
+void vmmap_Free(h64vmthread *vt, genericmap *m) {
+    if (!m)
         return;
-    }
-    int32_t i = 0;
-    while (i < map->hashed.bucket_count) {
-        genericmapbucket *b = &map->hashed.bucket[i];
-        int k = 0;
-        while (k < b->entry_count) {
-            DELREF_HEAP(&b->key[k]);
-            valuecontent_Free(vmthread, &b->key[k]);
-            DELREF_HEAP(&b->entry[k]);
-            valuecontent_Free(vmthread, &b->entry[k]);
-            k++;
+    int64_t i = 0;
+    while (i < m->entry_fill) {
+        if (!_ISTOMBSTONE(m, i)) {
+            DELREF_HEAP(&m->key[i]);
+            valuecontent_Free(vt, &m->key[i]);
+            DELREF_HEAP(&m->entry[i]);
+            valuecontent_Free(vt, &m->entry[i]);
         }
-        free(b->key);
-        b->key = NULL;
-        free(b->entry);
-        b->entry = NULL;
-        b->entry_count = 0;
         i++;
     }
+    free(m->key);
+    free(m->entry);
+    free(m->entry_hash);
+    free(m->index);
+    free(m);
 }
 
-int vmmap_Contains(
-        h64vmthread *vt,
-        genericmap *m, valuecontent *key, int *oom
+static void _vmmap_IndexInsert(
+        int32_t *index, int64_t index_size,
+        uint32_t hash, int64_t entry_idx
         ) {
-    return vmmap_Get(vt, m, key, NULL, oom);
+    // Place entry_idx into the first free index slot on the probe
+    // sequence. The caller must guarantee that there is one.
+    uint64_t mask = (uint64_t)index_size - 1;
+    uint64_t perturb = hash;
+    uint64_t slot = hash & mask;
+    while (index[slot] >= 0) {
+        perturb >>= 5;
+        slot = (slot * 5 + perturb + 1) & mask;
+    }
+    index[slot] = (int32_t)entry_idx;
 }
 
-int vmmap_IteratePairs(
-        genericmap *m, void *userdata,
-        int (*cb)(void *udata, valuecontent *key, valuecontent *value)
-        ) {
-    assert(m != NULL);
-    if ((m->flags & GENERICMAP_FLAG_LINEAR) != 0) {
-        int i = 0;
-        while (i < m->linear.entry_count) {
-            valuecontent *key = &m->linear.key[i];
-            valuecontent *value = &m->linear.entry[i];
-            if (!cb(userdata, key, value))
-                return 0;
-            i++;
-        }
-    } else {
-        int k = 0;
-        while (k < m->hashed.bucket_count) {
-            genericmapbucket *b = &m->hashed.bucket[k];
-            int i = 0;
-            while (i < b->entry_count) {
-                valuecontent *key = &b->key[i];
-                valuecontent *value = &b->entry[i];
-                if (!cb(userdata, key, value))
-                    return 0;
-                i++;
+static int _vmmap_RebuildIndex(genericmap *m, int64_t min_size) {
+    // (Re-)creates the index table, making sure it has at least
+    // twice as many slots as there may ever be dense entries to keep
+    // probe sequences short.
+    int64_t new_size = 16;
+    while (new_size < min_size * 2)
+        new_size *= 2;
+    int32_t *new_index = m->index;
+    if (new_size != m->index_size) {
+        new_index = malloc(sizeof(*new_index) * new_size);
+        if (!new_index)
+            return 0;
+        free(m->index);
+        m->index = new_index;
+        m->index_size = new_size;
+    }
+    int64_t i = 0;
+    while (i < new_size) {
+        new_index[i] = GENERICMAP_INDEX_EMPTY;
+        i++;
+    }
+    i = 0;
+    while (i < m->entry_fill) {
+        if (!_ISTOMBSTONE(m, i))
+            _vmmap_IndexInsert(
+                new_index, new_size, m->entry_hash[i], i
+            );
+        i++;
+    }
+    return 1;
+}
+
+static void _vmmap_Compact(genericmap *m) {
+    // Squeezes out all tombstones, keeping the insertion order. This
+    // can't fail, since the index keeps its size.
+    if (m->entry_fill == m->entry_count)
+        return;
+    int64_t writeto = 0;
+    int64_t i = 0;
+    while (i < m->entry_fill) {
+        if (!_ISTOMBSTONE(m, i)) {
+            if (writeto != i) {
+                memcpy(&m->key[writeto], &m->key[i], sizeof(*m->key));
+                memcpy(&m->entry[writeto], &m->entry[i],
+                       sizeof(*m->entry));
+                m->entry_hash[writeto] = m->entry_hash[i];
             }
-            k++;
+            writeto++;
         }
+        i++;
+    }
+    assert(writeto == m->entry_count);
+    m->entry_fill = writeto;
+    if (m->index) {
+        int result = _vmmap_RebuildIndex(m, m->index_size / 2);
+        assert(result != 0);  // same size, so no allocation
+        (void)result;
     }
-    return 1;
 }
 
-int vmmap_Get(
-        h64vmthread *vt,
-        genericmap *m, valuecontent *key, valuecontent *value,
+static int _vmmap_Find(
+        h64vmthread *vt, genericmap *m,
+        valuecontent *key, uint32_t hash,
+        int64_t *out_entry_idx, int64_t *out_index_slot,
         int *oom
         ) {
-    uint32_t hash = valuecontent_Hash(key);
-    if ((m->flags & GENERICMAP_FLAG_LINEAR) != 0) {
-        int i = 0;
-        while (i < m->linear.entry_count) {
+    // Returns 1 if found, otherwise 0 and sets *oom if that's the
+    // reason it wasn't found.
+    *oom = 0;
+    if (!m->index) {
+        int64_t i = 0;
+        while (i < m->entry_fill) {
             int inneroom = 0;
-            if (unlikely(m->linear.entry_hash[i] == hash) &&
+            if (m->entry_hash[i] == hash && !_ISTOMBSTONE(m, i) &&
                     likely(valuecontent_CheckEquality(
-                    vt, key, &m->linear.key[i], &inneroom))) {
-                if (value)
-                    memcpy(value, &m->linear.entry[i], sizeof(*value));
+                    vt, key, &m->key[i], &inneroom))) {
+                *out_entry_idx = i;
+                if (out_index_slot) *out_index_slot = -1;
                 return 1;
             }
             if (unlikely(inneroom)) {
@@ -164,98 +155,67 @@ int vmmap_Get(
             }
             i++;
         }
-    } else {
-        uint32_t bucket = (
-            hash % m->hashed.bucket_count
-        );
-        genericmapbucket *b = &m->hashed.bucket[bucket];
-        int i = 0;
-        while (i < b->entry_count) {
+        return 0;
+    }
+    uint64_t mask = (uint64_t)m->index_size - 1;
+    uint64_t perturb = hash;
+    uint64_t slot = hash & mask;
+    while (1) {
+        int32_t entry_idx = m->index[slot];
+        if (entry_idx == GENERICMAP_INDEX_EMPTY)
+            return 0;
+        if (entry_idx >= 0 && m->entry_hash[entry_idx] == hash) {
             int inneroom = 0;
-            if (likely(b->entry_hash[i] == hash &&
-                    valuecontent_CheckEquality(
-                    vt, key, &b->key[i], &inneroom))) {
+            if (likely(valuecontent_CheckEquality(
+                    vt, key, &m->key[entry_idx], &inneroom))) {
+                *out_entry_idx = entry_idx;
+                if (out_index_slot) *out_index_slot = (int64_t)slot;
                 return 1;
             }
             if (unlikely(inneroom)) {
                 *oom = 1;
                 return 0;
             }
-            i++;
         }
+        perturb >>= 5;
+        slot = (slot * 5 + perturb + 1) & mask;
     }
-    *oom = 0;
-    return 0;
 }
 
-int _vmmap_RemoveByHash(
+int vmmap_Contains(
         h64vmthread *vt,
-        genericmap *m, uint32_t hash, valuecontent *key,
-        int *oom
+        genericmap *m, valuecontent *key, int *oom
         ) {
-    int found = 0;
-    if ((m->flags & GENERICMAP_FLAG_LINEAR) != 0) {
-        int i = 0;
-        while (i < m->linear.entry_count) {
-            int inneroom = 0;
-            if (m->linear.entry_hash[i] == hash &&
-                    valuecontent_CheckEquality(
-                    vt, key, &m->linear.key[i],
-                    &inneroom)) {
-                found = 1;
-                DELREF_HEAP(&m->linear.entry[i]);
-                valuecontent_Free(vt, &m->linear.entry[i]);
-                if (i + 1 < m->linear.entry_count)
-                    memmove(
-                        &m->linear.entry[i],
-                        &m->linear.entry[i + 1],
-                        sizeof(*m->linear.entry) *
-                            (m->linear.entry_count - i - 1)
-                    );
-                m->linear.entry_count--;
-                m->contentrevisionid++;
-                continue;
-            }
-            if (unlikely(inneroom)) {
-                *oom = 1;
-                return 0;
-            }
-            i++;
-        }
-    } else {
-        uint32_t bucket = (
-            hash % m->hashed.bucket_count
-        );
-        genericmapbucket *b = &m->hashed.bucket[bucket];
-        int i = 0;
-        while (i < b->entry_count) {
-            int inneroom = 0;
-            if (b->entry_hash[i] == hash &&
-                    valuecontent_CheckEquality(
-                    vt, key, &b->key[i], &inneroom)) {
-                found = 1;
-                DELREF_HEAP(&b->entry[i]);
-                valuecontent_Free(vt, &b->entry[i]);
-                if (i + 1 < b->entry_count)
-                    memmove(
-                        &b->entry[i],
-                        &b->entry[i + 1],
-                        sizeof(*b->entry) *
-                            (b->entry_count - i - 1)
-                    );
-                b->entry_count--;
-                m->contentrevisionid++;
-                continue;
-            }
-            if (unlikely(inneroom)) {
-                *oom = 1;
-                return 0;
-            }
-            i++;
-        }
+    return vmmap_Get(vt, m, key, NULL, oom);
+}
+
+int vmmap_IteratePairs(
+        genericmap *m, void *userdata,
+        int (*cb)(void *udata, valuecontent *key, valuecontent *value)
+        ) {
+    assert(m != NULL);
+    int64_t i = 0;
+    while (i < m->entry_fill) {
+        if (!_ISTOMBSTONE(m, i) &&
+                !cb(userdata, &m->key[i], &m->entry[i]))
+            return 0;
+        i++;
     }
-    *oom = 0;
-    return found;
+    return 1;
+}
+
+int vmmap_Get(
+        h64vmthread *vt,
+        genericmap *m, valuecontent *key, valuecontent *value,
+        int *oom
+        ) {
+    uint32_t hash = valuecontent_Hash(key);
+    int64_t entry_idx = -1;
+    if (!_vmmap_Find(vt, m, key, hash, &entry_idx, NULL, oom))
+        return 0;
+    if (value)
+        memcpy(value, &m->entry[entry_idx], sizeof(*value));
+    return 1;
 }
 
 int vmmap_Remove(h64vmthread *vt,
@@ -265,42 +225,88 @@ int vmmap_Remove(h64vmthread *vt,
         return 0;
     }
     uint32_t hash = valuecontent_Hash(key);
-    return _vmmap_RemoveByHash(vt, m, hash, key, oom);
+    int64_t entry_idx = -1;
+    int64_t index_slot = -1;
+    if (!_vmmap_Find(vt, m, key, hash, &entry_idx, &index_slot, oom))
+        return 0;
+    DELREF_HEAP(&m->key[entry_idx]);
+    valuecontent_Free(vt, &m->key[entry_idx]);
+    DELREF_HEAP(&m->entry[entry_idx]);
+    valuecontent_Free(vt, &m->entry[entry_idx]);
+    memset(&m->key[entry_idx], 0, sizeof(*m->key));
+    m->key[entry_idx].type = H64VALTYPE_UNSPECIFIED_KWARG;
+    memset(&m->entry[entry_idx], 0, sizeof(*m->entry));
+    if (index_slot >= 0)
+        m->index[index_slot] = GENERICMAP_INDEX_DELETED;
+    m->entry_count--;
+    m->contentrevisionid++;
+    // Note: the dense fill must only shrink by compacting, since that
+    // also rebuilds the index. Otherwise, deleted index slots could
+    // pile up until probing never finds an empty slot.
+    if (m->entry_fill > GENERICMAP_LINEAR_MAX &&
+            m->entry_count < m->entry_fill / 4)
+        _vmmap_Compact(m);
+    return 1;
 }
 
-valuecontent *vmmap_GetKeyByIdx(genericmap *m, int64_t idx) {
-    if (!m)
-        return NULL;
-    int64_t c = vmmap_Count(m);
-    if (idx < 1 || idx > c)
+valuecontent *vmmap_GetPair(
+        genericmap *m, int64_t idx, valuecontent **value
+        ) {
+    if (!m || idx < 1 || idx > m->entry_count)
         return NULL;
-    if ((m->flags & GENERICMAP_FLAG_LINEAR) != 0) {
-        return &m->linear.key[idx];
+    // Positions only match the dense arrays without tombstones.
+    // Compacting is fine here, since iteration by index isn't allowed
+    // to overlap with modifications anyway:
+    if (unlikely(m->entry_fill != m->entry_count))
+        _vmmap_Compact(m);
+    if (value)
+        *value = &m->entry[idx - 1];
+    return &m->key[idx - 1];
+}
+
+valuecontent *vmmap_GetKeyByIdx(genericmap *m, int64_t idx) {
+    return vmmap_GetPair(m, idx, NULL);
+}
+
+static int _vmmap_Grow(genericmap *m) {
+    // Makes room for at least one more dense entry. Reclaims
+    // tombstones if there are enough of them, otherwise doubles.
+    if (m->entry_fill - m->entry_count >= m->entry_fill / 2 &&
+            m->entry_fill > 0) {
+        _vmmap_Compact(m);
+        if (m->entry_fill < m->entry_alloc)
+            return 1;
     }
-    int64_t cmp_idx = 0;
-    int64_t i = 0;
-    while (i < m->hashed.bucket_count) {
-        genericmapbucket *bucket = &(
-            m->hashed.bucket[i]
-        );
-        if (cmp_idx + bucket->entry_count < idx) {
-            cmp_idx += bucket->entry_count;
-            i++;
-            continue;
-        }
-        int64_t k = 0;
-        while (k < bucket->entry_count) {
-            cmp_idx++;
-            if (cmp_idx == idx)
-                return &bucket->key[k];
-            k++;
-        }
-        i++;
+    int64_t new_alloc = m->entry_alloc * 2;
+    if (new_alloc < GENERICMAP_MIN_ALLOC)
+        new_alloc = GENERICMAP_MIN_ALLOC;
+    if (new_alloc > INT32_MAX)
+        return 0;
+    valuecontent *keys = realloc(
+        m->key, sizeof(*m->key) * new_alloc
+    );
+    if (!keys)
+        return 0;
+    m->key = keys;
+    valuecontent *entries = realloc(
+        m->entry, sizeof(*m->entry) * new_alloc
+    );
+    if (!entries)
+        return 0;
+    m->entry = entries;
+    uint32_t *hashes = realloc(
+        m->entry_hash, sizeof(*m->entry_hash) * new_alloc
+    );
+    if (!hashes)
+        return 0;
+    m->entry_hash = hashes;
+    if (new_alloc > GENERICMAP_LINEAR_MAX) {
+        // Hashed lookup pays off from here on:
+        if (!_vmmap_RebuildIndex(m, new_alloc))
+            return 0;
     }
-    // This should be unreachable since we checked idx boundaries.
-    fprintf(stderr, "vmmap_GetKeyByIdx: corrupt map.");
-    assert(0);
-    return NULL;
+    m->entry_alloc = new_alloc;
+    return 1;
 }
 
 int vmmap_Set(
@@ -310,115 +316,35 @@ int vmmap_Set(
     if (!m)
         return 0;
     uint32_t hash = valuecontent_Hash(key);
+    int64_t entry_idx = -1;
     int inneroom = 0;
-    if (!vmmap_Remove(vt, m, key, &inneroom)) {
-        if (unlikely(inneroom)) {
-            return 0;
-        }
-    }
-    if ((m->flags & GENERICMAP_FLAG_LINEAR) != 0) {
-        int64_t c = vmmap_Count(m);
-        if (c + 1 < GENERICMAP_MIGRATE_HASHED) {
-            // Add to linear map:
-            if (c + 1 > m->linear.entry_alloc) {
-                int16_t new_alloc = (c + 1) * 2;
-                if (new_alloc < GENERICMAP_MIGRATE_HASHED)
-                    new_alloc = GENERICMAP_MIGRATE_HASHED;
-                valuecontent *entries = realloc(
-                    m->linear.entry,
-                    sizeof(*m->linear.entry) * new_alloc
-                );
-                if (!entries)
-                    return 0;
-                m->linear.entry = entries;
-                valuecontent *keys = realloc(
-                    m->linear.key,
-                    sizeof(*m->linear.key) * new_alloc
-                );
-                if (!keys)
-                    return 0;
-                m->linear.key = keys;
-                uint32_t *hashes = realloc(
-                    m->linear.entry_hash,
-                    sizeof(*m->linear.entry_hash) * new_alloc
-                );
-                if (!hashes)
-                    return 0;
-                m->linear.entry_hash = hashes;
-                m->linear.entry_alloc = new_alloc;
-            }
-            m->linear.entry_hash[m->linear.entry_count] = hash;
-            memcpy(
-                &m->linear.key[m->linear.entry_count],
-                key, sizeof(*key)
-            );
-            ADDREF_HEAP(&m->linear.key[m->linear.entry_count]);
-            memcpy(
-                &m->linear.entry[m->linear.entry_count],
-                value, sizeof(*value)
-            );
-            ADDREF_HEAP(&m->linear.entry[m->linear.entry_count]);
-            m->linear.entry_count++;
-            m->contentrevisionid++;
-            return 1;
-        } else {
-            m->flags &= ~GENERICMAP_FLAG_LINEAR;
-            // Since linear space and bucket are a union,
-            // we need to create the bucket space separately and
-            // then copy it over:
-            genericmap m2 = {0};
-            m2.hashed.bucket_count = GENERICMAP_DEFAULT_BUCKETS;
-            m2.hashed.bucket = malloc(
-                sizeof(*m2.hashed.bucket) * m2.hashed.bucket_count
-            );
-            if (!m2.hashed.bucket)
-                return 0;
-            memset(
-                m2.hashed.bucket, 0,
-                sizeof(*m2.hashed.bucket) * m2.hashed.bucket_count
-            );
-            // Now, insert into our new buckets:
-            int i = 0;
-            while (i < m->linear.entry_count) {
-                uint32_t bucket = (
-                    m->linear.entry_hash[i] % m2.hashed.bucket_count
-                );
-                if (!_vmmap_AddToBucket(
-                        &m2.hashed.bucket[bucket],
-                        m->linear.entry_hash[i],
-                        &m->linear.key[i],
-                        &m->linear.entry[i])) {
-                    _vmmap_ClearBuckets(&m2, vt);
-                    free(m2.hashed.bucket);
-                    return 0;
-                }
-                i++;
-            }
-            // If it worked, free our old linear space:
-            free(m->linear.entry_hash);
-            i = 0;
-            while (i < m->linear.entry_count) {
-                DELREF_HEAP(&m->linear.key[i]);
-                valuecontent_Free(vt, &m->linear.key[i]);
-                DELREF_HEAP(&m->linear.entry[i]);
-                valuecontent_Free(vt, &m->linear.entry[i]);
-                i++;
-            }
-            free(m->linear.key);
-            free(m->linear.entry);
-            // Now copy in our bucket space:
-            memcpy(&m->hashed, &m2.hashed, sizeof(m2.hashed));
-        }
+    if (_vmmap_Find(vt, m, key, hash, &entry_idx, NULL, &inneroom)) {
+        // Existing key, so replace the value in-place to keep the order:
+        valuecontent oldvalue;
+        memcpy(&oldvalue, &m->entry[entry_idx], sizeof(oldvalue));
+        memcpy(&m->entry[entry_idx], value, sizeof(*value));
+        ADDREF_HEAP(&m->entry[entry_idx]);
+        DELREF_HEAP(&oldvalue);
+        valuecontent_Free(vt, &oldvalue);
+        m->contentrevisionid++;
+        return 1;
     }
-    // If we arrive here, we need to add to regular buckets:
-    uint32_t bucket = (
-        hash % m->hashed.bucket_count
-    );
-    if (!_vmmap_AddToBucket(
-            &m->hashed.bucket[bucket],
-            hash, key, value)) {
+    if (unlikely(inneroom))
         return 0;
+    if (m->entry_fill + 1 > m->entry_alloc) {
+        if (!_vmmap_Grow(m))
+            return 0;
     }
+    entry_idx = m->entry_fill;
+    memcpy(&m->key[entry_idx], key, sizeof(*key));
+    ADDREF_HEAP(&m->key[entry_idx]);
+    memcpy(&m->entry[entry_idx], value, sizeof(*value));
+    ADDREF_HEAP(&m->entry[entry_idx]);
+    m->entry_hash[entry_idx] = hash;
+    if (m->index)
+        _vmmap_IndexInsert(m->index, m->index_size, hash, entry_idx);
+    m->entry_fill++;
+    m->entry_count++;
     m->contentrevisionid++;
     return 1;
-}
\ No newline at end of file
+}
@@ -15,17 +15,19 @@
 
 genericmap *vmmap_New();
 
+void vmmap_Free(h64vmthread *vt, genericmap *m);
+
 ATTR_UNUSED static inline int64_t vmmap_Count(genericmap *m) {
-    if ((m->flags & GENERICMAP_FLAG_LINEAR) != 0)
-        return m->linear.entry_count;
-    return m->hashed.entry_count;
+    return m->entry_count;
 }
 
 ATTR_UNUSED static inline uint64_t vmmap_Revision(genericmap *l) {
     return l->contentrevisionid;
 }
 
-valuecontent *vmmap_GetKeyByIdx(genericmap *l, int64_t idx);
+valuecontent *vmmap_GetKeyByIdx(
+    genericmap *l, int64_t idx
+);  // idx is 1-based and in insertion order
 
 int vmmap_Set(
     h64vmthread *vt,
@@ -48,7 +50,7 @@ int vmmap_Get(
 
 valuecontent *vmmap_GetPair(
     genericmap *m, int64_t idx, valuecontent **value
-);
+);  // like vmmap_GetKeyByIdx(), but also returns the value
 
 int vmmap_IteratePairs(
     genericmap *m, void *userdata,
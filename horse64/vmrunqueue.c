@@ -0,0 +1,203 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "compileconfig.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmrunqueue.h"
+
+#define RUNQUEUE_MIN_SIZE 64
+#define READYRING_MIN_ALLOC 16
+
+
+static vmrunqueuebuf *_vmrunqueuebuf_New(int64_t size) {
+    vmrunqueuebuf *buf = malloc(sizeof(*buf));
+    if (!buf)
+        return NULL;
+    memset(buf, 0, sizeof(*buf));
+    buf->entry = malloc(sizeof(*buf->entry) * size);
+    if (!buf->entry) {
+        free(buf);
+        return NULL;
+    }
+    int64_t i = 0;
+    while (i < size) {
+        atomic_init(&buf->entry[i], NULL);
+        i++;
+    }
+    buf->size = size;
+    return buf;
+}
+
+int vmrunqueue_Init(vmrunqueue *q) {
+    memset(q, 0, sizeof(*q));
+    vmrunqueuebuf *buf = _vmrunqueuebuf_New(RUNQUEUE_MIN_SIZE);
+    if (!buf)
+        return 0;
+    atomic_init(&q->top, 0);
+    atomic_init(&q->bottom, 0);
+    atomic_init(&q->buf, buf);
+    return 1;
+}
+
+void vmrunqueue_Uninit(vmrunqueue *q) {
+    vmrunqueuebuf *buf = atomic_load_explicit(
+        &q->buf, memory_order_relaxed
+    );
+    while (buf) {
+        vmrunqueuebuf *retired = buf->retired;
+        free(buf->entry);
+        free(buf);
+        buf = retired;
+    }
+    atomic_store_explicit(&q->buf, NULL, memory_order_relaxed);
+}
+
+static vmrunqueuebuf *_vmrunqueue_Grow(
+        vmrunqueue *q, vmrunqueuebuf *buf, int64_t top, int64_t bottom
+        ) {
+    // The old buffer stays around until the queue is freed, since a
+    // thief may still be reading from it:
+    vmrunqueuebuf *newbuf = _vmrunqueuebuf_New(buf->size * 2);
+    if (!newbuf)
+        return NULL;
+    int64_t i = top;
+    while (i < bottom) {
+        atomic_store_explicit(
+            &newbuf->entry[i & (newbuf->size - 1)],
+            atomic_load_explicit(
+                &buf->entry[i & (buf->size - 1)], memory_order_relaxed
+            ), memory_order_relaxed
+        );
+        i++;
+    }
+    newbuf->retired = buf;
+    atomic_store_explicit(&q->buf, newbuf, memory_order_release);
+    return newbuf;
+}
+
+int vmrunqueue_Push(vmrunqueue *q, h64vmthread *vt) {
+    int64_t bottom = atomic_load_explicit(
+        &q->bottom, memory_order_relaxed
+    );
+    int64_t top = atomic_load_explicit(&q->top, memory_order_acquire);
+    vmrunqueuebuf *buf = atomic_load_explicit(
+        &q->buf, memory_order_relaxed
+    );
+    if (bottom - top > buf->size - 1) {
+        buf = _vmrunqueue_Grow(q, buf, top, bottom);
+        if (!buf)
+            return 0;
+    }
+    atomic_store_explicit(
+        &buf->entry[bottom & (buf->size - 1)], vt, memory_order_relaxed
+    );
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, bottom + 1, memory_order_relaxed);
+    return 1;
+}
+
+h64vmthread *vmrunqueue_Pop(vmrunqueue *q) {
+    int64_t bottom = atomic_load_explicit(
+        &q->bottom, memory_order_relaxed
+    ) - 1;
+    vmrunqueuebuf *buf = atomic_load_explicit(
+        &q->buf, memory_order_relaxed
+    );
+    atomic_store_explicit(&q->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&q->top, memory_order_relaxed);
+    if (top > bottom) {
+        // Was empty already:
+        atomic_store_explicit(
+            &q->bottom, bottom + 1, memory_order_relaxed
+        );
+        return NULL;
+    }
+    h64vmthread *vt = atomic_load_explicit(
+        &buf->entry[bottom & (buf->size - 1)], memory_order_relaxed
+    );
+    if (top == bottom) {
+        // Last entry, so race any thieves for it:
+        if (!atomic_compare_exchange_strong_explicit(
+                &q->top, &top, top + 1,
+                memory_order_seq_cst, memory_order_relaxed))
+            vt = NULL;
+        atomic_store_explicit(
+            &q->bottom, bottom + 1, memory_order_relaxed
+        );
+    }
+    return vt;
+}
+
+h64vmthread *vmrunqueue_Steal(vmrunqueue *q) {
+    int64_t top = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(
+        &q->bottom, memory_order_acquire
+    );
+    if (top >= bottom)
+        return NULL;
+    vmrunqueuebuf *buf = atomic_load_explicit(
+        &q->buf, memory_order_acquire
+    );
+    h64vmthread *vt = atomic_load_explicit(
+        &buf->entry[top & (buf->size - 1)], memory_order_relaxed
+    );
+    if (!atomic_compare_exchange_strong_explicit(
+            &q->top, &top, top + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+    return vt;
+}
+
+int64_t vmrunqueue_Count(vmrunqueue *q) {
+    int64_t bottom = atomic_load_explicit(
+        &q->bottom, memory_order_relaxed
+    );
+    int64_t top = atomic_load_explicit(&q->top, memory_order_relaxed);
+    return (bottom > top ? bottom - top : 0);
+}
+
+int vmreadyring_Push(vmreadyring *r, h64vmthread *vt) {
+    if (r->count >= r->alloc) {
+        int64_t new_alloc = r->alloc * 2;
+        if (new_alloc < READYRING_MIN_ALLOC)
+            new_alloc = READYRING_MIN_ALLOC;
+        h64vmthread **new_entry = malloc(sizeof(*new_entry) * new_alloc);
+        if (!new_entry)
+            return 0;
+        int64_t i = 0;
+        while (i < r->count) {
+            new_entry[i] = r->entry[(r->start + i) % r->alloc];
+            i++;
+        }
+        free(r->entry);
+        r->entry = new_entry;
+        r->alloc = new_alloc;
+        r->start = 0;
+    }
+    r->entry[(r->start + r->count) % r->alloc] = vt;
+    r->count++;
+    return 1;
+}
+
+h64vmthread *vmreadyring_Pop(vmreadyring *r) {
+    if (r->count <= 0)
+        return NULL;
+    h64vmthread *vt = r->entry[r->start];
+    r->start = (r->start + 1) % r->alloc;
+    r->count--;
+    return vt;
+}
+
+void vmreadyring_Uninit(vmreadyring *r) {
+    free(r->entry);
+    memset(r, 0, sizeof(*r));
+}
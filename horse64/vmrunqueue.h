@@ -0,0 +1,70 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef HORSE64_VMRUNQUEUE_H_
+#define HORSE64_VMRUNQUEUE_H_
+
+#include "compileconfig.h"
+
+#include <stdint.h>
+
+typedef struct h64vmthread h64vmthread;
+
+// A work-stealing deque of runnable vm threads, as described by
+// Chase & Lev. Only the owning worker may push and pop at the bottom,
+// while any other worker may steal from the top without a lock.
+
+typedef struct vmrunqueuebuf vmrunqueuebuf;
+
+typedef struct vmrunqueuebuf {
+    int64_t size;  // always a power of two
+    h64vmthread *_Atomic *entry;
+    vmrunqueuebuf *retired;  // older, smaller buffers thieves may read
+} vmrunqueuebuf;
+
+typedef struct vmrunqueue {
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    vmrunqueuebuf *_Atomic buf;
+} vmrunqueue;
+
+int vmrunqueue_Init(vmrunqueue *q);  // returns 1 on success, 0 on oom
+
+void vmrunqueue_Uninit(vmrunqueue *q);
+
+int vmrunqueue_Push(
+    vmrunqueue *q, h64vmthread *vt
+);  // owner only, returns 1 on success, 0 on oom
+
+h64vmthread *vmrunqueue_Pop(
+    vmrunqueue *q
+);  // owner only, returns NULL if empty
+
+h64vmthread *vmrunqueue_Steal(
+    vmrunqueue *q
+);  // returns NULL if empty or if another thread won the race
+
+int64_t vmrunqueue_Count(vmrunqueue *q);  // only a snapshot
+
+
+// A plain FIFO of vm threads, which callers must guard with a lock.
+// This is used for handing threads to workers that don't own the
+// thread that becomes runnable.
+
+typedef struct vmreadyring {
+    h64vmthread **entry;
+    int64_t start, count, alloc;
+} vmreadyring;
+
+int vmreadyring_Push(
+    vmreadyring *r, h64vmthread *vt
+);  // returns 1 on success, 0 on oom
+
+h64vmthread *vmreadyring_Pop(
+    vmreadyring *r
+);  // returns NULL if empty
+
+void vmreadyring_Uninit(vmreadyring *r);
+
+#endif  // HORSE64_VMRUNQUEUE_H_
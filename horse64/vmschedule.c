@@ -10,13 +10,16 @@
 #endif
 #include <assert.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 
 #include "asyncsysjob.h"
 #include "bytecode.h"
+#include "corelib/errors.h"
 #include "datetime.h"
 #include "debugsymbols.h"
 #include "nonlocale.h"
@@ -27,14 +30,23 @@
 #include "stack.h"
 #include "threading.h"
 #include "valuecontentstruct.h"
+#include "vmchannel.h"
 #include "vmexec.h"
 #include "vmlist.h"
 #include "vmschedule.h"
 #include "vmsuspendtypeenum.h"
+#include "widechar.h"
 
 
+#define VMSCHEDULE_IDLE_SPINS 32
+
 static char _unexpectedlookupfail[] = "<unexpected lookup fail>";
 
+int _vmschedule_QueueThread(
+    h64vmexec *vmexec, h64vmthread *vt,
+    h64vmworker *current_worker
+);
+
 mutex *_waited_for_socklist_mutex = NULL;
 mutex *_waited_for_socklist_supervisorPREmutex = NULL;
 h64sockset _waited_for_socklist = {0};
@@ -44,50 +56,134 @@ int _vmsockets_debug = 0;
 int _vmasyncjobs_debug = 0;
 #endif
 
-int _vmschedule_RegisterSocketForWaiting(
-        int fd, int waittypes
-        ) {
-    mutex_Lock(_waited_for_socklist_supervisorPREmutex);
-    threadevent_Set(_waited_for_socklist_supervisorunlockevent);
-    mutex_Lock(_waited_for_socklist_mutex);
-    if (!sockset_Add(
-            &_waited_for_socklist, fd, waittypes
-            )) {
-        mutex_Release(_waited_for_socklist_mutex);
-        mutex_Release(_waited_for_socklist_supervisorPREmutex);
-        return 0;
+// Threads waiting on each fd, chained via sockwait_next. Guarded by
+// the worker_mutex:
+static h64vmthread **_sockwait_waiters = NULL;
+static int _sockwait_waiters_size = 0;
+
+static int _vmschedule_SockWaitTypes(h64vmthread *vt) {
+    if (vt->suspend_info->suspendtype ==
+            SUSPENDTYPE_SOCKWAIT_READABLEORERROR)
+        return H64SOCKSET_WAITREAD | H64SOCKSET_WAITERROR;
+    if (vt->suspend_info->suspendtype ==
+            SUSPENDTYPE_SOCKWAIT_WRITABLEORERROR)
+        return H64SOCKSET_WAITWRITE | H64SOCKSET_WAITERROR;
+    return 0;
+}
+
+static int _vmschedule_SockWaitUnion(int fd, h64vmthread *except) {
+    int waittypes = 0;
+    h64vmthread *vt = _sockwait_waiters[fd];
+    while (vt) {
+        if (vt != except)
+            waittypes |= _vmschedule_SockWaitTypes(vt);
+        vt = vt->sockwait_next;
     }
-    #ifndef NDEBUG
-    if (_vmsockets_debug)
-        h64fprintf(stderr, "horsevm: verbose: "
-            "_vmschedule_RegisterSocketForWaiting fd %d types %d\n",
-            fd, waittypes);
-    #endif
-    mutex_Release(_waited_for_socklist_mutex);
-    mutex_Release(_waited_for_socklist_supervisorPREmutex);
-    return 1;
+    return waittypes;
 }
 
-int _vmschedule_UnregisterSocketForWaiting(
-        int fd, int waittypes
+static int _vmschedule_SetSockWaitTypes(
+        int fd, int oldwaittypes, int waittypes
         ) {
+    // Get the sockset lock away from the supervisor's wait:
     mutex_Lock(_waited_for_socklist_supervisorPREmutex);
     threadevent_Set(_waited_for_socklist_supervisorunlockevent);
     mutex_Lock(_waited_for_socklist_mutex);
-    sockset_RemoveWithMask(
-        &_waited_for_socklist, fd, waittypes
-    );
+    if (oldwaittypes != 0)
+        sockset_Remove(&_waited_for_socklist, fd);
+    int result = 1;
+    if (waittypes != 0)
+        result = sockset_Add(&_waited_for_socklist, fd, waittypes);
     #ifndef NDEBUG
     if (_vmsockets_debug)
         h64fprintf(stderr, "horsevm: verbose: "
-            "_vmschedule_UnregisterSocketForWaiting fd %d types %d\n",
-            fd, waittypes);
+            "_vmschedule_SetSockWaitTypes fd %d types %d -> %d%s\n",
+            fd, oldwaittypes, waittypes, (result ? "" : " (oom)"));
     #endif
     mutex_Release(_waited_for_socklist_mutex);
     mutex_Release(_waited_for_socklist_supervisorPREmutex);
+    return result;
+}
+
+int _vmschedule_RegisterSocketForWaiting(
+        h64vmthread *vt, int fd, int waittypes
+        ) {
+    if (fd < 0)
+        return 0;
+    if (fd >= _sockwait_waiters_size) {
+        int newsize = _sockwait_waiters_size * 2;
+        if (newsize < fd + 64)
+            newsize = fd + 64;
+        h64vmthread **new_waiters = realloc(
+            _sockwait_waiters, sizeof(*new_waiters) * newsize
+        );
+        if (!new_waiters)
+            return 0;
+        memset(
+            &new_waiters[_sockwait_waiters_size], 0,
+            sizeof(*new_waiters) * (newsize - _sockwait_waiters_size)
+        );
+        _sockwait_waiters = new_waiters;
+        _sockwait_waiters_size = newsize;
+    }
+    int oldwaittypes = _vmschedule_SockWaitUnion(fd, NULL);
+    // Note: always set this again even if the wait types didn't change,
+    // such that a socket that is ready already is reported again:
+    if (!_vmschedule_SetSockWaitTypes(
+            fd, oldwaittypes, oldwaittypes | waittypes
+            )) {
+        if (oldwaittypes != 0)
+            _vmschedule_SetSockWaitTypes(fd, 0, oldwaittypes);
+        return 0;
+    }
+    vt->sockwait_next = _sockwait_waiters[fd];
+    _sockwait_waiters[fd] = vt;
     return 1;
 }
 
+void _vmschedule_UnregisterSocketForWaiting(
+        h64vmthread *vt, int fd
+        ) {
+    if (fd < 0 || fd >= _sockwait_waiters_size)
+        return;
+    h64vmthread **prevnext = &_sockwait_waiters[fd];
+    while (*prevnext && *prevnext != vt)
+        prevnext = &(*prevnext)->sockwait_next;
+    if (!*prevnext)
+        return;  // registration failed earlier
+    *prevnext = vt->sockwait_next;
+    vt->sockwait_next = NULL;
+    int waittypes = _vmschedule_SockWaitUnion(fd, NULL);
+    int oldwaittypes = waittypes | _vmschedule_SockWaitTypes(vt);
+    if (waittypes != oldwaittypes)
+        _vmschedule_SetSockWaitTypes(fd, oldwaittypes, waittypes);
+}
+
+static int _vmschedule_ReleaseSockWaiters(
+        h64vmexec *vmexec, h64sockfd_t *ready, int readycount
+        ) {
+    // IMPORTANT: access mutex must be LOCKED entering this.
+    int allqueued = 1;
+    int i = 0;
+    while (i < readycount) {
+        int fd = ready[i * 2];
+        int events = ready[i * 2 + 1];
+        i++;
+        if (fd < 0 || fd >= _sockwait_waiters_size)
+            continue;
+        h64vmthread *vt = _sockwait_waiters[fd];
+        while (vt) {
+            if ((_vmschedule_SockWaitTypes(vt) & events) != 0) {
+                vt->suspend_info->suspenditemready = 1;
+                if (!_vmschedule_QueueThread(vmexec, vt, NULL))
+                    allqueued = 0;
+            }
+            vt = vt->sockwait_next;
+        }
+    }
+    return allqueued;
+}
+
 static const char *_classnamelookup(h64program *pr, int64_t classid) {
     h64classsymbol *csymbol = h64debugsymbols_GetClassSymbolById(
         pr->symbols, classid
@@ -178,13 +274,13 @@ int vmschedule_AsyncScheduleFunc(
             &object_instances_transferlist_alloc,
             &object_instances_transferlist_onheap
         );
-        if (!result) {
+        if (result <= 0) {
             if (object_instances_transferlist_onheap)
                 free(object_instances_transferlist);
             mutex_Lock(access_mutex);
             vmthread_Free(newthread);
             mutex_Release(access_mutex);
-            return 0;
+            return result;
         }
         i++;
     }
@@ -212,7 +308,518 @@ int vmschedule_AsyncScheduleFunc(
     newthread->upcoming_resume_info->run_from_start = 1;
     assert(newthread->upcoming_resume_info->func_id >= 0);
     mutex_Release(access_mutex);
+    if (!_vmschedule_QueueThread(
+            vmexec, newthread, vmthread->run_by_worker
+            )) {
+        mutex_Lock(access_mutex);
+        vmthread_Free(newthread);
+        mutex_Release(access_mutex);
+        return 0;
+    }
+    return 1;
+}
+
+// A parallel_map/parallel_for call splits its list into one chunk per
+// worker. Each chunk gets a single parallel vm thread which runs the
+// func on all its items one after another, so the thread setup is only
+// paid once per chunk. The job is guarded by the worker_mutex, except
+// for piping values in and out while the chunk threads are all idle.
+
+typedef struct h64parallelchunk {
+    h64vmthread *vt;
+    int64_t count, next;
+    valuecontent *value;  // each item, later its result, on vt's heap
+} h64parallelchunk;
+
+typedef struct h64paralleljob {
+    h64vmthread *parent;  // NULL once abandoned
+    int64_t func_id;
+    int keep_results;
+    int chunk_count, chunks_pending;
+    h64parallelchunk *chunk;
+
+    classid_t error_class_id;  // first error raised by func, or -1
+    h64wchar *error_msg;
+    int64_t error_msglen;
+} h64paralleljob;
+
+static void _vmschedule_ParallelJobFree(h64paralleljob *job) {
+    // IMPORTANT: access mutex must be LOCKED entering this.
+    int i = 0;
+    while (i < job->chunk_count) {
+        h64parallelchunk *chunk = &job->chunk[i];
+        if (chunk->value) {
+            int64_t k = 0;
+            while (k < chunk->count) {
+                DELREF_NONHEAP(&chunk->value[k]);
+                valuecontent_Free(chunk->vt, &chunk->value[k]);
+                k++;
+            }
+            free(chunk->value);
+        }
+        if (chunk->vt)
+            vmthread_Free(chunk->vt);
+        i++;
+    }
+    free(job->chunk);
+    free(job->error_msg);
+    free(job);
+}
+
+static void _vmschedule_ParallelJobSetError(
+        h64paralleljob *job, classid_t error_class_id,
+        const h64wchar *msg, int64_t msglen
+        ) {
+    // IMPORTANT: access mutex must be LOCKED entering this.
+    if (job->error_class_id >= 0)
+        return;  // only the first one is reported
+    job->error_class_id = error_class_id;
+    if (msg && msglen > 0) {
+        job->error_msg = malloc(sizeof(*msg) * msglen);
+        if (job->error_msg) {
+            memcpy(job->error_msg, msg, sizeof(*msg) * msglen);
+            job->error_msglen = msglen;
+        }
+    }
+}
+
+static int _vmschedule_ParallelChunkLaunch(
+        h64vmexec *vmexec, h64paralleljob *job, h64parallelchunk *chunk,
+        h64vmworker *current_worker
+        ) {
+    // IMPORTANT: access mutex must be LOCKED entering this.
+    h64vmthread *vt = chunk->vt;
+    assert(chunk->next < chunk->count);
+    if (!stack_ToSize(vt->stack, vt, 1, 0))
+        return 0;
+    valuecontent *vc = STACK_ENTRY(vt->stack, 0);
+    DELREF_NONHEAP(vc);
+    valuecontent_Free(vt, vc);
+    memcpy(vc, &chunk->value[chunk->next], sizeof(*vc));
+    memset(&chunk->value[chunk->next], 0, sizeof(*vc));
+    vmthread_SetSuspendState(vt, SUSPENDTYPE_ASYNCCALLSCHEDULED, -1);
+    vt->upcoming_resume_info->func_id = job->func_id;
+    vt->upcoming_resume_info->run_from_start = 1;
+    vt->upcoming_resume_info->precall_old_stack = 0;  // just the item
+    if (!_vmschedule_QueueThread(vmexec, vt, current_worker)) {
+        memcpy(&chunk->value[chunk->next], vc, sizeof(*vc));
+        memset(vc, 0, sizeof(*vc));
+        vmthread_SetSuspendState(vt, SUSPENDTYPE_DONE, 0);
+        return 0;
+    }
+    return 1;
+}
+
+static void _vmschedule_ParallelChunkStep(
+        h64vmworker *worker, h64vmthread *vt,
+        int succeeded, h64errorinfo *einfo  // einfo may be NULL
+        ) {
+    // IMPORTANT: access mutex must be LOCKED entering this.
+    h64paralleljob *job = vt->parallel_job;
+    h64parallelchunk *chunk = &job->chunk[vt->parallel_chunk];
+    vmthread_SetSuspendState(vt, SUSPENDTYPE_DONE, 0);
+    if (succeeded) {
+        // The return value took the item's place on the stack:
+        assert(vt->stack->entry_count == 1);
+        if (job->keep_results) {
+            valuecontent *vc = STACK_ENTRY(vt->stack, 0);
+            memcpy(&chunk->value[chunk->next], vc, sizeof(*vc));
+            memset(vc, 0, sizeof(*vc));
+            vc->type = H64VALTYPE_NONE;
+        }
+        chunk->next++;
+    } else if (einfo != NULL && einfo->error_class_id >= 0) {
+        _vmschedule_ParallelJobSetError(
+            job, einfo->error_class_id, einfo->msg, einfo->msglen
+        );
+    } else {
+        _vmschedule_ParallelJobSetError(
+            job, H64STDERROR_OUTOFMEMORYERROR, NULL, 0
+        );
+    }
+    int result = stack_ToSize(vt->stack, vt, 0, 0);
+    assert(result != 0);
+    if (succeeded && chunk->next < chunk->count &&
+            job->error_class_id < 0 && job->parent != NULL) {
+        if (_vmschedule_ParallelChunkLaunch(
+                worker->vmexec, job, chunk, worker
+                ))
+            return;
+        _vmschedule_ParallelJobSetError(
+            job, H64STDERROR_OUTOFMEMORYERROR, NULL, 0
+        );
+    }
+    job->chunks_pending--;
+    if (job->chunks_pending > 0)
+        return;
+    if (!job->parent) {
+        _vmschedule_ParallelJobFree(job);
+        return;
+    }
+    if (job->parent->suspend_info->suspendtype ==
+            SUSPENDTYPE_PARALLELJOBWAIT) {
+        // (If it's still running, it'll notice once it suspends.)
+        job->parent->suspend_info->suspenditemready = 1;
+        if (!_vmschedule_QueueThread(
+                worker->vmexec, job->parent, worker
+                ))
+            asyncjob_TriggerSupervisorWakeupEvent();  // it'll rescan
+    }
+}
+
+int vmschedule_AsyncSysJobDone(
+        h64vmexec *vmexec, h64asyncsysjob *job
+        ) {
+    // IMPORTANT: access mutex must be LOCKED entering this.
+    int result = 1;
+    if (job->waitrefs > 0) {
+        // Other threads wait for it too, the supervisor will find them:
+        atomic_store(&vmexec->worker_overview->supervisor_rescan, 1);
+        result = 0;
+    }
+    if (job->abandoned)
+        return result;  // the requesting thread is gone
+    h64vmthread *vt = job->request_thread;
+    if (vt->suspend_info->suspendtype != SUSPENDTYPE_ASYNCSYSJOBWAIT ||
+            vt->suspend_info->suspendarg != (int64_t)(uintptr_t)job)
+        return result;  // not waiting yet, it'll notice once it suspends
+    vt->suspend_info->suspenditemready = 1;
+    if (!_vmschedule_QueueThread(vmexec, vt, NULL)) {
+        atomic_store(&vmexec->worker_overview->supervisor_rescan, 1);
+        return 0;
+    }
+    return result;
+}
+
+int vmschedule_ChannelWaiterWake(
+        h64vmthread *vt, suspendtype stype, h64channel *ch
+        ) {
+    h64vmexec *vmexec = vt->vmexec_owner;
+    mutex_Lock(vmexec->worker_overview->worker_mutex);
+    if (vt->suspend_info->suspendtype != stype ||
+            vt->suspend_info->suspendarg != (int64_t)(uintptr_t)ch) {
+        // Not suspended yet, it'll check the channel once it suspends.
+        mutex_Release(vmexec->worker_overview->worker_mutex);
+        return 0;
+    }
+    vt->suspend_info->suspenditemready = 1;
+    if (!_vmschedule_QueueThread(vmexec, vt, NULL)) {
+        atomic_store(&vmexec->worker_overview->supervisor_rescan, 1);
+        mutex_Release(vmexec->worker_overview->worker_mutex);
+        asyncjob_TriggerSupervisorWakeupEvent();  // it'll rescan
+        return -1;
+    }
+    mutex_Release(vmexec->worker_overview->worker_mutex);
+    return 1;
+}
+
+int vmschedule_ParallelJobStart(
+        h64vmthread *vmthread, int64_t func_id, genericlist *items,
+        int keep_results, h64paralleljob **out_job
+        ) {
+    h64vmexec *vmexec = vmthread->vmexec_owner;
+    mutex *access_mutex = vmexec->worker_overview->worker_mutex;
+    int64_t item_count = vmlist_Count(items);
+    assert(item_count > 0);
+    assert(vmexec->program->func[func_id].is_threadable);
+
+    // Object instances can't be piped yet, so refuse any item that
+    // contains one before a single item is handed out:
+    int64_t item = 1;
+    while (item <= item_count) {
+        valuecontent vcitem = {0};
+        int gotitem = vmlist_Get(items, item, &vcitem);
+        assert(gotitem != 0);
+        int checkresult = _pipe_CheckPipeable(vmthread, &vcitem);
+        if (checkresult <= 0)
+            return checkresult;
+        item++;
+    }
+
+    h64paralleljob *job = malloc(sizeof(*job));
+    if (!job)
+        return 0;
+    memset(job, 0, sizeof(*job));
+    job->parent = vmthread;
+    job->func_id = func_id;
+    job->keep_results = (keep_results != 0);
+    job->error_class_id = -1;
+    job->chunk_count = vmexec->worker_overview->worker_count;
+    if (job->chunk_count > item_count)
+        job->chunk_count = item_count;
+    if (job->chunk_count < 1)
+        job->chunk_count = 1;
+    job->chunk = malloc(sizeof(*job->chunk) * job->chunk_count);
+    if (!job->chunk) {
+        free(job);
+        return 0;
+    }
+    memset(job->chunk, 0, sizeof(*job->chunk) * job->chunk_count);
+
+    // Items get piped over through a temporary slot on top of our stack:
+    int64_t tempslot = STACK_TOTALSIZE(vmthread->stack);
+    if (!stack_ToSize(vmthread->stack, vmthread, tempslot + 1, 0)) {
+        free(job->chunk);
+        free(job);
+        return 0;
+    }
+    int result = 1;
+    item = 1;
+    int i = 0;
+    while (i < job->chunk_count) {
+        h64parallelchunk *chunk = &job->chunk[i];
+        chunk->count = (
+            (item_count - item + 1) / (job->chunk_count - i)
+        );
+        assert(chunk->count > 0);
+        mutex_Lock(access_mutex);
+        chunk->vt = vmthread_New(vmexec, 0);
+        mutex_Release(access_mutex);
+        if (!chunk->vt) {
+            result = 0;
+            break;
+        }
+        chunk->vt->parallel_job = job;
+        chunk->vt->parallel_chunk = i;
+        chunk->value = malloc(sizeof(*chunk->value) * chunk->count);
+        if (!chunk->value ||
+                !stack_ToSize(chunk->vt->stack, chunk->vt, 1, 0)) {
+            result = 0;
+            break;
+        }
+        memset(chunk->value, 0, sizeof(*chunk->value) * chunk->count);
+        int64_t k = 0;
+        while (k < chunk->count) {
+            valuecontent *vctemp = &vmthread->stack->entry[tempslot];
+            DELREF_NONHEAP(vctemp);
+            valuecontent_Free(vmthread, vctemp);
+            int gotitem = vmlist_Get(items, item, vctemp);
+            assert(gotitem != 0);
+            ADDREF_NONHEAP(vctemp);
+            result = _pipe_DoPipeObject(
+                vmthread, chunk->vt, tempslot, 0,
+                NULL, NULL, NULL, NULL
+            );
+            if (result <= 0)
+                break;
+            valuecontent *vc = STACK_ENTRY(chunk->vt->stack, 0);
+            memcpy(&chunk->value[k], vc, sizeof(*vc));
+            memset(vc, 0, sizeof(*vc));
+            k++;
+            item++;
+        }
+        if (result <= 0)
+            break;
+        i++;
+    }
+    int sizeresult = stack_ToSize(vmthread->stack, vmthread, tempslot, 0);
+    assert(sizeresult != 0);
+    mutex_Lock(access_mutex);
+    if (result <= 0) {
+        _vmschedule_ParallelJobFree(job);
+        mutex_Release(access_mutex);
+        return result;
+    }
+
+    // Get all chunks going:
+    job->chunks_pending = job->chunk_count;
+    i = 0;
+    while (i < job->chunk_count) {
+        if (!_vmschedule_ParallelChunkLaunch(
+                vmexec, job, &job->chunk[i], vmthread->run_by_worker
+                )) {
+            _vmschedule_ParallelJobSetError(
+                job, H64STDERROR_OUTOFMEMORYERROR, NULL, 0
+            );
+            job->chunks_pending--;
+        }
+        i++;
+    }
+    mutex_Release(access_mutex);
+    *out_job = job;
+    return 1;
+}
+
+int vmschedule_ParallelJobReturn(
+        h64vmthread *vmthread, h64paralleljob *job
+        ) {
+    mutex *access_mutex = (
+        vmthread->vmexec_owner->worker_overview->worker_mutex
+    );
+    assert(job->parent == vmthread && job->chunks_pending == 0);
+    if (job->error_class_id >= 0) {
+        classid_t error_class_id = job->error_class_id;
+        char *msg = NULL;
+        if (job->error_msg) {
+            msg = malloc(job->error_msglen * 5 + 1);
+            int64_t msglen = 0;
+            if (msg && utf32_to_utf8(
+                    job->error_msg, job->error_msglen,
+                    msg, job->error_msglen * 5 + 1, &msglen, 1, 1
+                    )) {
+                msg[msglen] = '\0';
+            } else {
+                free(msg);
+                msg = NULL;
+            }
+        }
+        mutex_Lock(access_mutex);
+        _vmschedule_ParallelJobFree(job);
+        mutex_Release(access_mutex);
+        int result = vmexec_ReturnFuncError(
+            vmthread, error_class_id, "%s",
+            (msg ? msg : "error in parallel func")
+        );
+        free(msg);
+        return result;
+    }
+
+    // Like with the items, refuse results with object instances in
+    // them before any of them is piped back:
+    int i = 0;
+    while (job->keep_results && i < job->chunk_count) {
+        h64parallelchunk *chunk = &job->chunk[i];
+        int64_t k = 0;
+        while (k < chunk->count) {
+            int checkresult = _pipe_CheckPipeable(
+                chunk->vt, &chunk->value[k]
+            );
+            if (checkresult <= 0) {
+                mutex_Lock(access_mutex);
+                _vmschedule_ParallelJobFree(job);
+                mutex_Release(access_mutex);
+                if (checkresult < 0)
+                    return vmexec_ReturnFuncError(
+                        vmthread, H64STDERROR_TYPEERROR,
+                        "cannot pass this value type from parallel func"
+                    );
+                return vmexec_ReturnFuncError(
+                    vmthread, H64STDERROR_OUTOFMEMORYERROR,
+                    "out of memory collecting parallel results"
+                );
+            }
+            k++;
+        }
+        i++;
+    }
+
+    // Pipe the results back over in order, chunk by chunk. The chunk
+    // threads are all done, so their heaps are ours to use now:
+    valuecontent vlist = {0};
+    vlist.type = H64VALTYPE_NONE;
+    if (job->keep_results) {
+        h64gcvalue *gcval = poolalloc_malloc(vmthread->heap, 0);
+        if (!gcval)
+            goto oomreturn;
+        memset(gcval, 0, sizeof(*gcval));
+        gcval->type = H64GCVALUETYPE_LIST;
+        gcval->hash = -1;
+        gcval->externalreferencecount = 1;
+        gcval->list_values = vmlist_New();
+        if (!gcval->list_values) {
+            poolalloc_free(vmthread->heap, gcval);
+            goto oomreturn;
+        }
+        vlist.type = H64VALTYPE_GCVAL;
+        vlist.ptr_value = gcval;
+    }
+    int64_t tempslot = STACK_TOTALSIZE(vmthread->stack);
+    if (job->keep_results &&
+            !stack_ToSize(vmthread->stack, vmthread, tempslot + 1, 0))
+        goto oomreturn;
+    int result = 1;
+    i = 0;
+    while (job->keep_results && i < job->chunk_count) {
+        h64parallelchunk *chunk = &job->chunk[i];
+        h64vmthread *vt = chunk->vt;
+        if (!stack_ToSize(vt->stack, vt, 1, 0)) {
+            result = 0;
+            break;
+        }
+        int64_t k = 0;
+        while (k < chunk->count) {
+            valuecontent *vc = STACK_ENTRY(vt->stack, 0);
+            memcpy(vc, &chunk->value[k], sizeof(*vc));
+            memset(&chunk->value[k], 0, sizeof(*vc));
+            result = _pipe_DoPipeObject(
+                vt, vmthread, 0, tempslot,
+                NULL, NULL, NULL, NULL
+            );
+            DELREF_NONHEAP(vc);
+            valuecontent_Free(vt, vc);
+            memset(vc, 0, sizeof(*vc));
+            if (result <= 0)
+                break;
+            valuecontent *vctemp = &vmthread->stack->entry[tempslot];
+            if (vmlist_Add(((h64gcvalue *)vlist.ptr_value)->list_values,
+                    vctemp) <= 0) {
+                result = 0;
+                break;
+            }
+            DELREF_NONHEAP(vctemp);
+            valuecontent_Free(vmthread, vctemp);
+            memset(vctemp, 0, sizeof(*vctemp));
+            k++;
+        }
+        if (result <= 0)
+            break;
+        i++;
+    }
+    if (job->keep_results) {
+        int sizeresult = stack_ToSize(
+            vmthread->stack, vmthread, tempslot, 0
+        );
+        assert(sizeresult != 0);
+    }
+    mutex_Lock(access_mutex);
+    _vmschedule_ParallelJobFree(job);
+    mutex_Release(access_mutex);
+    if (result <= 0) {
+        DELREF_NONHEAP(&vlist);
+        valuecontent_Free(vmthread, &vlist);
+        if (result < 0)
+            return vmexec_ReturnFuncError(
+                vmthread, H64STDERROR_TYPEERROR,
+                "cannot pass this value type from parallel func"
+            );
+        return vmexec_ReturnFuncError(
+            vmthread, H64STDERROR_OUTOFMEMORYERROR,
+            "out of memory collecting parallel results"
+        );
+    }
+
+    // Return result, which already holds its reference:
+    valuecontent *vcresult = STACK_ENTRY(vmthread->stack, 0);
+    DELREF_NONHEAP(vcresult);
+    valuecontent_Free(vmthread, vcresult);
+    memcpy(vcresult, &vlist, sizeof(vlist));
     return 1;
+
+    oomreturn: ;
+    DELREF_NONHEAP(&vlist);
+    valuecontent_Free(vmthread, &vlist);
+    mutex_Lock(access_mutex);
+    _vmschedule_ParallelJobFree(job);
+    mutex_Release(access_mutex);
+    return vmexec_ReturnFuncError(
+        vmthread, H64STDERROR_OUTOFMEMORYERROR,
+        "out of memory collecting parallel results"
+    );
+}
+
+void vmschedule_ParallelJobAbandon(
+        h64vmthread *vmthread, h64paralleljob *job
+        ) {
+    mutex *access_mutex = (
+        vmthread->vmexec_owner->worker_overview->worker_mutex
+    );
+    mutex_Lock(access_mutex);
+    assert(job->parent == vmthread);
+    job->parent = NULL;
+    if (job->chunks_pending == 0)
+        _vmschedule_ParallelJobFree(job);
+    // (Otherwise, the last chunk to finish will free it.)
+    mutex_Release(access_mutex);
 }
 
 void vmschedule_FreeWorkerSet(
@@ -228,6 +835,7 @@ void vmschedule_FreeWorkerSet(
                 thread_Join(wset->worker[i]->worker_thread);
                 wset->worker[i]->worker_thread = NULL;
             }
+            vmrunqueue_Uninit(&wset->worker[i]->runqueue);
             free(wset->worker[i]);
         }
         i++;
@@ -237,17 +845,74 @@ void vmschedule_FreeWorkerSet(
         mutex_Destroy(wset->worker_mutex);
         wset->worker_mutex = NULL;
     }
+    vmreadyring_Uninit(&wset->shared_ready);
+    vmreadyring_Uninit(&wset->mainonly_ready);
+    vmtimerheap_Uninit(&wset->timers);
+    if (wset->readyqueue_mutex) {
+        mutex_Destroy(wset->readyqueue_mutex);
+        wset->readyqueue_mutex = NULL;
+    }
 
     free(wset);
 }
 
-int vmschedule_WorkerCount() {
+static int _vmschedule_WorkerCpus(
+        h64misccompileroptions *moptions, threadcpuset *out_cpus
+        ) {
+    // Returns 0 if workers float, otherwise fills in the CPUs to use.
+    if (!moptions->vm_pin_workers && !moptions->vm_pin_supervisor)
+        return 0;
+    if (moptions->vm_pin_workers) {
+        memcpy(
+            out_cpus, &moptions->vm_worker_cpus, sizeof(*out_cpus)
+        );
+    } else {
+        memset(out_cpus, 0, sizeof(*out_cpus));
+        int i = 0;
+        while (i < osinfo_CpuThreads()) {
+            threadcpuset_Add(out_cpus, i);
+            i++;
+        }
+    }
+    // A pinned supervisor gets its CPU to itself:
+    if (moptions->vm_pin_supervisor)
+        threadcpuset_Remove(out_cpus, moptions->vm_supervisor_cpu);
+    return 1;
+}
+
+int vmschedule_WorkerCount(h64misccompileroptions *moptions) {
+    if (moptions->vm_worker_count > 0)
+        return moptions->vm_worker_count;
+    threadcpuset cpus;
+    if (_vmschedule_WorkerCpus(moptions, &cpus)) {
+        int count = threadcpuset_Count(&cpus);
+        return (count >= 1 ? count : 1);
+    }
     int thread_count = osinfo_CpuThreads();
     if (thread_count < 4)
         return 4;
     return thread_count;
 }
 
+int vmschedule_SetWorkerCpus(
+        h64vmexec *vmexec, const threadcpuset *cpus
+        ) {
+    int cpu_count = threadcpuset_Count(cpus);
+    if (cpu_count <= 0)
+        return 0;
+    h64vmworkerset *wset = vmexec->worker_overview;
+    int result = 1;
+    int i = 0;
+    while (i < wset->worker_count) {
+        threadcpuset single = {0};
+        threadcpuset_Add(&single, threadcpuset_Nth(cpus, i % cpu_count));
+        if (!thread_SetCpuAffinity(wset->worker[i]->os_thread_id, &single))
+            result = 0;
+        i++;
+    }
+    return result;
+}
+
 int vmschedule_CanThreadResume_UnguardedCheck(
         h64vmthread *vt, uint64_t now
         ) {
@@ -275,45 +940,35 @@ int vmschedule_CanThreadResume_UnguardedCheck(
             }
             return 0;
         } else if (vt->suspend_info->suspendtype ==
-                SUSPENDTYPE_SOCKWAIT_READABLEORERROR) {
+                SUSPENDTYPE_SOCKWAIT_READABLEORERROR ||
+                vt->suspend_info->suspendtype ==
+                SUSPENDTYPE_SOCKWAIT_WRITABLEORERROR) {
+            // The supervisor marks these once the socket is ready:
+            return (vt->suspend_info->suspenditemready != 0);
+        } else if (vt->suspend_info->suspendtype ==
+                SUSPENDTYPE_PARALLELJOBWAIT) {
             if (unlikely(vt->suspend_info->suspenditemready))
                 return 1;
-            int fd = (int)vt->suspend_info->suspendarg;
-            h64sockset s = {0};
-            sockset_Init(&s);
-            int result = sockset_Add(
-                &s, fd,
-                H64SOCKSET_WAITERROR | H64SOCKSET_WAITREAD
-            );
-            assert(result != 0);
-            sockset_Wait(&s, 0);
-            int isready = sockset_GetResult(
-                &s, fd, H64SOCKSET_WAITERROR | H64SOCKSET_WAITREAD
+            h64paralleljob *job = (h64paralleljob *)(
+                (uintptr_t)vt->suspend_info->suspendarg
             );
-            sockset_Uninit(&s);
-            if (isready != 0) {
+            if (job->chunks_pending == 0) {
                 vt->suspend_info->suspenditemready = 1;
                 return 1;
             }
             return 0;
         } else if (vt->suspend_info->suspendtype ==
-                SUSPENDTYPE_SOCKWAIT_WRITABLEORERROR) {
+                SUSPENDTYPE_CHANNELSENDWAIT ||
+                vt->suspend_info->suspendtype ==
+                SUSPENDTYPE_CHANNELRECEIVEWAIT) {
             if (unlikely(vt->suspend_info->suspenditemready))
                 return 1;
-            int fd = (int)vt->suspend_info->suspendarg;
-            h64sockset s = {0};
-            sockset_Init(&s);
-            int result = sockset_Add(
-                &s, (int)vt->suspend_info->suspendarg,
-                H64SOCKSET_WAITERROR | H64SOCKSET_WAITWRITE
-            );
-            assert(result != 0);
-            sockset_Wait(&s, 0);
-            int isready = sockset_GetResult(
-                &s, fd, H64SOCKSET_WAITERROR | H64SOCKSET_WAITWRITE
+            h64channel *ch = (h64channel *)(
+                (uintptr_t)vt->suspend_info->suspendarg
             );
-            sockset_Uninit(&s);
-            if (isready != 0) {
+            if (vt->suspend_info->suspendtype ==
+                    SUSPENDTYPE_CHANNELSENDWAIT ?
+                    vmchannel_CanSend(ch) : vmchannel_CanReceive(ch)) {
                 vt->suspend_info->suspenditemready = 1;
                 return 1;
             }
@@ -395,6 +1050,160 @@ static int vmschedule_RunMainThreadLaunchFunc(
     return 1;
 }
 
+static int _vmschedule_UnparkWorker(
+        h64vmworkerset *wset, h64vmworker *worker
+        ) {
+    int expected = 1;
+    if (!atomic_compare_exchange_strong(&worker->parked, &expected, 0))
+        return 0;  // not parked, or somebody else woke it already
+    atomic_fetch_sub(&wset->idle_workers, 1);
+    threadevent_Set(worker->wakeupevent);
+    return 1;
+}
+
+static void _vmschedule_UnparkSelf(h64vmworker *worker) {
+    if (atomic_exchange(&worker->parked, 0) != 0)
+        atomic_fetch_sub(
+            &worker->vmexec->worker_overview->idle_workers, 1
+        );
+}
+
+static void _vmschedule_WakeIdleWorkers(h64vmexec *vmexec, int count) {
+    h64vmworkerset *wset = vmexec->worker_overview;
+    if (atomic_load(&wset->idle_workers) <= 0)
+        return;
+    // Try worker 0 last, since it's the only one that can run
+    // threads bound to the main thread:
+    int wc = wset->worker_count;
+    int i = 1;
+    while (i <= wc && count > 0) {
+        if (_vmschedule_UnparkWorker(wset, wset->worker[i % wc]))
+            count--;
+        i++;
+    }
+}
+
+int _vmschedule_QueueThread(
+        h64vmexec *vmexec, h64vmthread *vt,
+        h64vmworker *current_worker
+        ) {
+    h64vmworkerset *wset = vmexec->worker_overview;
+    if (atomic_exchange(&vt->queued_for_run, 1) != 0)
+        return 1;  // already waiting in some queue
+    if (!vt->is_on_main_thread && current_worker != NULL) {
+        // Keep it on our own deque, idle workers can steal it:
+        if (!vmrunqueue_Push(&current_worker->runqueue, vt)) {
+            atomic_store(&vt->queued_for_run, 0);
+            return 0;
+        }
+        atomic_thread_fence(memory_order_seq_cst);
+        _vmschedule_WakeIdleWorkers(vmexec, 1);
+        return 1;
+    }
+    mutex_Lock(wset->readyqueue_mutex);
+    if (vt->is_on_main_thread) {
+        if (!vmreadyring_Push(&wset->mainonly_ready, vt)) {
+            mutex_Release(wset->readyqueue_mutex);
+            atomic_store(&vt->queued_for_run, 0);
+            return 0;
+        }
+        atomic_fetch_add(&wset->mainonly_ready_count, 1);
+    } else {
+        if (!vmreadyring_Push(&wset->shared_ready, vt)) {
+            mutex_Release(wset->readyqueue_mutex);
+            atomic_store(&vt->queued_for_run, 0);
+            return 0;
+        }
+        atomic_fetch_add(&wset->shared_ready_count, 1);
+    }
+    mutex_Release(wset->readyqueue_mutex);
+    if (vt->is_on_main_thread)
+        _vmschedule_UnparkWorker(wset, wset->worker[0]);
+    else
+        _vmschedule_WakeIdleWorkers(vmexec, 1);
+    return 1;
+}
+
+static h64vmthread *_vmschedule_PopReadyRing(
+        h64vmworkerset *wset, vmreadyring *r,
+        _Atomic volatile int64_t *count
+        ) {
+    if (atomic_load(count) <= 0)
+        return NULL;
+    mutex_Lock(wset->readyqueue_mutex);
+    h64vmthread *vt = vmreadyring_Pop(r);
+    if (vt)
+        atomic_fetch_sub(count, 1);
+    mutex_Release(wset->readyqueue_mutex);
+    return vt;
+}
+
+static h64vmthread *_vmschedule_NextRunnable(h64vmworker *worker) {
+    h64vmworkerset *wset = worker->vmexec->worker_overview;
+    h64vmthread *vt = NULL;
+    if (worker->no == 0) {
+        vt = _vmschedule_PopReadyRing(
+            wset, &wset->mainonly_ready, &wset->mainonly_ready_count
+        );
+        if (vt)
+            return vt;
+    }
+    vt = vmrunqueue_Pop(&worker->runqueue);
+    if (vt)
+        return vt;
+    vt = _vmschedule_PopReadyRing(
+        wset, &wset->shared_ready, &wset->shared_ready_count
+    );
+    if (vt)
+        return vt;
+
+    // Nothing of our own, so try to steal from the others:
+    int wc = wset->worker_count;
+    int k = 0;
+    while (k < wc) {
+        h64vmworker *victim = wset->worker[
+            (worker->steal_offset + k) % wc
+        ];
+        k++;
+        if (victim == worker)
+            continue;
+        vt = vmrunqueue_Steal(&victim->runqueue);
+        if (vt) {
+            worker->steal_offset = (worker->steal_offset + k) % wc;
+            atomic_fetch_add(&worker->stat_steals, 1);
+            return vt;
+        }
+    }
+    return NULL;
+}
+
+static void _vmschedule_AfterRun(
+        h64vmworker *worker, h64vmthread *vt
+        ) {
+    // IMPORTANT: access mutex must be LOCKED entering this.
+    suspendtype stype = vt->suspend_info->suspendtype;
+    if (stype == SUSPENDTYPE_DONE || stype == SUSPENDTYPE_NONE)
+        return;
+    if (vmschedule_CanThreadResume_UnguardedCheck(
+            vt, datetime_Ticks()
+            )) {
+        if (_vmschedule_QueueThread(worker->vmexec, vt, worker))
+            return;
+    }
+    // The supervisor needs to watch this one, and may need to
+    // shorten its current wait for it:
+    asyncjob_TriggerSupervisorWakeupEvent();
+}
+
+static int _vmschedule_HaveNotDoneThread(h64vmworker *worker) {
+    // IMPORTANT: access mutex must be LOCKED entering this.
+    if (!worker->vmexec->worker_overview->workers_ran_main)
+        return 1;
+    return (worker->vmexec->thread_count >
+            worker->vmexec->suspend_overview->
+                waittypes_currently_active[SUSPENDTYPE_DONE]);
+}
+
 void vmschedule_WorkerRun(void *userdata) {
     h64vmworker *worker = (h64vmworker *)userdata;
     h64program *pr = worker->vmexec->program;
@@ -521,6 +1330,7 @@ void vmschedule_WorkerRun(void *userdata) {
             if (result) {
                 worker->vmexec->worker_overview->
                     workers_ran_main = 1;
+                _vmschedule_AfterRun(worker, mainthread);
             } else {
                 worker->vmexec->worker_overview->fatalerror = 1;
                 mutex_Release(access_mutex);
@@ -539,74 +1349,117 @@ void vmschedule_WorkerRun(void *userdata) {
                 worker->no
             );
         #endif
-        mutex_Lock(access_mutex);
-        threadevent_Unset(worker->wakeupevent);
-        int have_notdone_thread = 0;
-        int ransomething = 0;
-        int tc = worker->vmexec->thread_count;
-        int i = 0;
-        while (i < tc) {
-            h64vmthread *vt = worker->vmexec->thread[i];
-            if (likely(vt->suspend_info->suspendtype !=
-                       SUSPENDTYPE_DONE))
-                have_notdone_thread = 1;
-            if (worker->no != 0 && vt->is_on_main_thread) {
-                i++;
-                continue;
-            }
-            if (vmschedule_CanThreadResume_UnguardedCheck(
+        h64vmthread *vt = _vmschedule_NextRunnable(worker);
+        int spins = 0;
+        while (!vt && spins < VMSCHEDULE_IDLE_SPINS &&
+                !worker->vmexec->worker_overview->fatalerror) {
+            // New work often follows right away, so don't park yet:
+            thread_Yield();
+            vt = _vmschedule_NextRunnable(worker);
+            spins++;
+        }
+        if (!vt) {
+            // Announce we're parked first, such that anyone queueing
+            // work after our last check will wake us up:
+            threadevent_Unset(worker->wakeupevent);
+            atomic_store(&worker->parked, 1);
+            atomic_fetch_add(
+                &worker->vmexec->worker_overview->idle_workers, 1
+            );
+            vt = _vmschedule_NextRunnable(worker);
+            if (vt)
+                _vmschedule_UnparkSelf(worker);
+        }
+        if (vt) {
+            atomic_fetch_add(&worker->stat_runs, 1);
+            mutex_Lock(access_mutex);
+            atomic_store(&vt->queued_for_run, 0);
+            if (!vmschedule_CanThreadResume_UnguardedCheck(
                     vt, now
                     )) {
-                ransomething = 1;
-                #ifndef NDEBUG
-                if (worker->moptions->vmscheduler_debug)
-                    h64fprintf(
-                        stderr, "horsevm: debug: vmschedule.c: "
-                        "[w%d] RESUME picking up vm thread %p\n",
-                        worker->no, vt
-                    );
-                #endif
-                h64program *pr = worker->vmexec->program;
-                h64errorinfo einfo = {0};
-                vmthreadsuspendinfo sinfo = {0};
-                int hadsuspendevent = 0;
-                int haduncaughterror = 0;
-                int rval = 0;
-                vt->run_by_worker = worker;
-                if (!vmthread_RunFunctionWithReturnInt(
-                        worker, vt,
-                        1,  // assume locked mutex & will return LOCKED
-                        -1,  // func_id = -1 since we resume
-                        worker->no,
-                        &hadsuspendevent, &sinfo,
-                        &haduncaughterror, &einfo, &rval
-                        ) || haduncaughterror) {
-                    // Mutex will be locked again, here.
-                    if (!haduncaughterror) {
-                        h64fprintf(stderr,
-                            "horsevm: error: vmschedule.c: "
-                            " fatal error in function, "
-                            "out of memory?\n"
-                        );
-                    } else {
-                        assert(einfo.error_class_id >= 0);
-                        _printuncaughterror(pr, &einfo);
-                    }
-                    vt->suspend_info->suspendtype = (
-                        SUSPENDTYPE_DONE
+                // Stale entry, the supervisor will queue it again.
+                mutex_Release(access_mutex);
+                continue;
+            }
+            #ifndef NDEBUG
+            if (worker->moptions->vmscheduler_debug)
+                h64fprintf(
+                    stderr, "horsevm: debug: vmschedule.c: "
+                    "[w%d] RESUME picking up vm thread %p\n",
+                    worker->no, vt
+                );
+            #endif
+            h64program *pr = worker->vmexec->program;
+            h64errorinfo einfo = {0};
+            vmthreadsuspendinfo sinfo = {0};
+            int hadsuspendevent = 0;
+            int haduncaughterror = 0;
+            int rval = 0;
+            vt->run_by_worker = worker;
+            int runresult = vmthread_RunFunctionWithReturnInt(
+                worker, vt,
+                1,  // assume locked mutex & will return LOCKED
+                -1,  // func_id = -1 since we resume
+                worker->no,
+                &hadsuspendevent, &sinfo,
+                &haduncaughterror, &einfo, &rval
+            );
+            if (vt->parallel_job != NULL && (!runresult ||
+                    haduncaughterror || !hadsuspendevent)) {
+                // A parallel_map chunk is done with one of its items:
+                _vmschedule_ParallelChunkStep(
+                    worker, vt, (runresult && !haduncaughterror),
+                    (haduncaughterror ? &einfo : NULL)
+                );
+                mutex_Release(access_mutex);
+                continue;
+            }
+            if (!runresult || haduncaughterror) {
+                // Mutex will be locked again, here.
+                if (!haduncaughterror) {
+                    h64fprintf(stderr,
+                        "horsevm: error: vmschedule.c: "
+                        " fatal error in function, "
+                        "out of memory?\n"
                     );
-                    worker->vmexec->program_return_value = -1;
-                } else if (!hadsuspendevent && !haduncaughterror) {
-                    worker->vmexec->program_return_value = rval;
+                } else {
+                    assert(einfo.error_class_id >= 0);
+                    _printuncaughterror(pr, &einfo);
                 }
-                break;
+                vmthread_SetSuspendState(
+                    vt, SUSPENDTYPE_DONE, 0
+                );
+                worker->vmexec->program_return_value = -1;
+            } else if (!hadsuspendevent && !haduncaughterror) {
+                worker->vmexec->program_return_value = rval;
+            } else {
+                _vmschedule_AfterRun(worker, vt);
             }
-            i++;
+            if (vt->suspend_info->suspendtype == SUSPENDTYPE_DONE &&
+                    !vt->is_original_main) {
+                // Nothing refers to a finished task anymore, so free
+                // it right away rather than keeping it until the end:
+                vmthread_Free(vt);
+            }
+            mutex_Release(access_mutex);
+            // We're still busy with work, so try to pick up next work
+            // immediately with no pause:
+            continue;
         }
-        mutex_Release(access_mutex);
+
         // Nothing we can run -> sleep, or exit if program is done:
+        mutex_Lock(access_mutex);
+        int have_notdone_thread = _vmschedule_HaveNotDoneThread(worker);
+        mutex_Release(access_mutex);
         if (!have_notdone_thread) {
-            // We reached the end of the program.
+            // We reached the end of the program. Make sure worker 0
+            // notices too, since it will shut down everything else:
+            _vmschedule_UnparkSelf(worker);
+            if (worker->no != 0)
+                _vmschedule_UnparkWorker(
+                    worker->vmexec->worker_overview,
+                    worker->vmexec->worker_overview->worker[0]
+                );
             #ifndef NDEBUG
             if (worker->moptions->vmscheduler_debug)
                 h64fprintf(
@@ -617,12 +1470,9 @@ void vmschedule_WorkerRun(void *userdata) {
             #endif
             return;
         }
-        if (worker->vmexec->worker_overview->fatalerror)
+        if (worker->vmexec->worker_overview->fatalerror) {
+            _vmschedule_UnparkSelf(worker);
             break;  // could have changed right before threadevent_Unset()
-        if (ransomething) {
-            // We're still busy with work, so try to pick up next work
-            // immediately with no pause:
-            continue;
         }
         #ifndef NDEBUG
         if (worker->moptions->vmscheduler_verbose_debug)
@@ -632,9 +1482,17 @@ void vmschedule_WorkerRun(void *userdata) {
                 worker->no
             );
         #endif
+        int64_t parked_since = datetime_Ticks();
+        atomic_store(&worker->stat_parked_since, parked_since);
+        atomic_fetch_add(&worker->stat_parks, 1);
         int result = threadevent_WaitUntilSet(
             worker->wakeupevent, 10000, 1
         );
+        atomic_fetch_add(
+            &worker->stat_parked_ms, datetime_Ticks() - parked_since
+        );
+        atomic_store(&worker->stat_parked_since, 0);
+        _vmschedule_UnparkSelf(worker);  // in case we timed out
         if (result) {
             #ifndef NDEBUG
             if (worker->moptions->vmscheduler_debug)
@@ -670,31 +1528,70 @@ void vmschedule_WorkerSupervisorRun(void *userdata) {
         );
     #endif
     mutex *access_mutex = vmexec->worker_overview->worker_mutex;
+    int retryscan = 0;
     while (1) {
         int64_t now = (int64_t)datetime_Ticks();
         mutex_Lock(access_mutex);
 
-        // See how long we can wait according to internal timer waits:
-        int64_t timerwaitsmin = -1;
+        // Release all threads whose sleep has expired:
+        int64_t timerwaitsmin = (retryscan ? 1 : -1);
+        h64vmthread *vt = NULL;
+        while ((vt = vmtimerheap_PopExpired(
+                &vmexec->worker_overview->timers, now)) != NULL) {
+            vt->suspend_info->suspenditemready = 1;
+            if (unlikely(!_vmschedule_QueueThread(vmexec, vt, NULL))) {
+                // Out of memory, so put it back and retry soon:
+                vmtimerheap_Insert(
+                    &vmexec->worker_overview->timers, vt,
+                    vt->suspend_info->suspendarg
+                );
+                timerwaitsmin = 1;
+                break;
+            }
+        }
+        int64_t nextdeadline = vmtimerheap_NextDeadline(
+            &vmexec->worker_overview->timers
+        );
+        if (nextdeadline >= 0 && (timerwaitsmin < 0 ||
+                nextdeadline - now < timerwaitsmin)) {
+            timerwaitsmin = nextdeadline - now;
+            if (timerwaitsmin < 1)
+                timerwaitsmin = 1;
+        }
+
+        // Queue up all threads whose parallel job is done, or whose
+        // wakeup got lost. This still needs a scan, so skip it if not
+        // needed. (Socket waits are released right after the sockset
+        // wait, async system jobs queue their waiter directly, and
+        // parallel jobs usually do too.)
+        int needscan = (
+            vmexec->suspend_overview->waittypes_currently_active[
+                SUSPENDTYPE_PARALLELJOBWAIT
+            ] > 0 || retryscan ||
+            atomic_exchange(
+                &vmexec->worker_overview->supervisor_rescan, 0
+            ) != 0
+        );
+        retryscan = 0;
         int i = 0;
-        while (i < vmexec->thread_count) {
-            h64vmthread *vt = vmexec->thread[i];
-            if (vt->suspend_info->suspendtype !=
-                    SUSPENDTYPE_ASYNCCALLSCHEDULED &&
-                    vt->suspend_info->suspendtype !=
-                    SUSPENDTYPE_DONE) {
-                if (vt->suspend_info->suspendtype ==
-                        SUSPENDTYPE_FIXEDTIME) {
-                    if (likely(!vt->suspend_info->suspenditemready)) {
-                        int64_t waititem = (
-                            vt->suspend_info->suspendarg - now
-                        );
-                        if (waititem < 1)
-                            waititem = 1;
-                        if (waititem < timerwaitsmin || timerwaitsmin < 0)
-                            timerwaitsmin = waititem + 1;
-                    }
-                }
+        while (needscan && i < vmexec->thread_count) {
+            vt = vmexec->thread[i];
+            suspendtype stype = vt->suspend_info->suspendtype;
+            if (stype == SUSPENDTYPE_NONE ||
+                    stype == SUSPENDTYPE_FIXEDTIME ||
+                    stype == SUSPENDTYPE_DONE ||
+                    stype == SUSPENDTYPE_UNINITIALIZED ||
+                    stype == SUSPENDTYPE_ASYNCCALLSCHEDULED ||
+                    atomic_load(&vt->queued_for_run) ||
+                    (vt->is_original_main &&
+                     !vmexec->worker_overview->workers_ran_main)) {
+                i++;
+                continue;
+            }
+            if (vmschedule_CanThreadResume_UnguardedCheck(vt, now) &&
+                    unlikely(!_vmschedule_QueueThread(vmexec, vt, NULL))) {
+                retryscan = 1;  // out of memory, retry soon
+                timerwaitsmin = 1;
             }
             i++;
         }
@@ -729,14 +1626,23 @@ void vmschedule_WorkerSupervisorRun(void *userdata) {
             // No immediate wake-up of us expected, take our time:
             sockset_Wait(&_waited_for_socklist, 5000);
         }
+        h64sockfd_t readybuf[128];
+        int readycount = 0;
+        h64sockfd_t *ready = sockset_GetResultList(
+            &_waited_for_socklist, readybuf,
+            sizeof(readybuf) / sizeof(*readybuf),
+            H64SOCKSET_WAITALL, &readycount
+        );
         mutex_Release(_waited_for_socklist_mutex);
+        if (unlikely(!ready)) {
+            // Out of memory, so find the ready ones by scanning:
+            readycount = 0;
+            retryscan = 1;
+        }
         #ifndef NDEBUG
         if (vmexec->moptions.vmscheduler_verbose_debug) {
-            int fds_count = 0;
-            int *fds = sockset_GetResultList(
-                &_waited_for_socklist, NULL, 0,
-                H64SOCKSET_WAITALL, &fds_count
-            );
+            int fds_count = readycount;
+            h64sockfd_t *fds = ready;
             char printmsg[2048] = "";
             h64snprintf(
                 printmsg, sizeof(printmsg) - 1,
@@ -769,18 +1675,25 @@ void vmschedule_WorkerSupervisorRun(void *userdata) {
             );
         }
         #endif
+        threadevent_FlushWakeUpEvents(
+            _waited_for_socklist_supervisorunlockevent
+        );
         asyncjob_FlushSupervisorWakeupEvents();
-        if (vmexec->supervisor_stop_signal)
-            break;
 
-        // Wake up workers to do work:
-        i = 0;
-        while (i < vmexec->worker_overview->worker_count) {
-            threadevent_Set(
-                vmexec->worker_overview->worker[i]->wakeupevent
-            );
-            i++;
+        // Hand threads waiting on sockets that became ready to the
+        // workers:
+        if (readycount > 0) {
+            mutex_Lock(access_mutex);
+            if (!_vmschedule_ReleaseSockWaiters(
+                    vmexec, ready, readycount
+                    ))
+                retryscan = 1;
+            mutex_Release(access_mutex);
         }
+        if (ready != readybuf)
+            free(ready);
+        if (vmexec->supervisor_stop_signal)
+            break;
     }
 }
 
@@ -801,7 +1714,11 @@ int vmschedule_ExecuteProgram(
             "or _waited_for_socklist_mutex\n");
         return -1;
     }
-    sockset_Init(&_waited_for_socklist);
+    if (!sockset_InitPersistent(&_waited_for_socklist)) {
+        h64fprintf(stderr, "horsevm: error: vmschedule.c: "
+            "failed to set up _waited_for_socklist\n");
+        return -1;
+    }
     _waited_for_socklist_supervisorunlockevent = (
         threadevent_Create()
     );
@@ -829,15 +1746,24 @@ int vmschedule_ExecuteProgram(
             return -1;
         }
     }
+    if (!mainexec->worker_overview->readyqueue_mutex) {
+        mainexec->worker_overview->readyqueue_mutex = (
+            mutex_Create()
+        );
+        if (!mainexec->worker_overview->readyqueue_mutex) {
+             h64fprintf(stderr, "horsevm: error: vmschedule.c: "
+                "out of memory in mutex_Create() during setup\n");
+            return -1;
+        }
+    }
 
-    h64vmthread *mainthread = vmthread_New(mainexec, 0);
+    h64vmthread *mainthread = vmthread_New(mainexec, 1);
     if (!mainthread) {
         h64fprintf(stderr, "horsevm: error: vmschedule.c: "
             "out of memory in vmthread_New() during setup\n");
         return -1;
     }
     mainexec->program = pr;
-    mainthread->is_on_main_thread = 1;
     mainthread->is_original_main = 1;
     vmthread_SetSuspendState(
         mainthread, SUSPENDTYPE_ASYNCCALLSCHEDULED, -1
@@ -954,7 +1880,15 @@ int vmschedule_ExecuteProgram(
         return -1;
     }
 
-    int worker_count = vmschedule_WorkerCount();
+    threadcpuset worker_cpus;
+    int pin_workers = _vmschedule_WorkerCpus(moptions, &worker_cpus);
+    if (pin_workers && threadcpuset_Count(&worker_cpus) <= 0) {
+        h64fprintf(stderr, "horsevm: error: vmschedule.c: "
+            "no CPUs left for the workers after excluding the "
+            "supervisor CPU\n");
+        return -1;
+    }
+    int worker_count = vmschedule_WorkerCount(moptions);
     #ifndef NDEBUG
     if (mainexec->moptions.vmscheduler_debug)
         h64fprintf(stderr, "horsevm: debug: vmschedule.c: "
@@ -990,6 +1924,18 @@ int vmschedule_ExecuteProgram(
                 sizeof(*mainexec->worker_overview->worker[k])
             );
             mainexec->worker_overview->worker[k]->vmexec = mainexec;
+            if (!vmrunqueue_Init(
+                    &mainexec->worker_overview->worker[k]->runqueue)) {
+                free(mainexec->worker_overview->worker[k]);
+                h64fprintf(
+                    stderr, "horsevm: error: vmschedule.c: out of "
+                    "memory when creating worker %d/%d's run queue "
+                    "during setup\n",
+                    k, worker_count
+                );
+                return -1;
+            }
+            mainexec->worker_overview->worker[k]->steal_offset = k + 1;
             mainexec->worker_overview->worker[k]->wakeupevent = (
                 threadevent_Create()
             );
@@ -1006,8 +1952,12 @@ int vmschedule_ExecuteProgram(
             k++;
         }
     }
+    // Have finished async jobs hand their waiting thread back directly:
+    asyncjob_SetNotifyVMExec(mainexec);
+
     // Spawn all threads other than main thread (that will be us!):
     worker_count = mainexec->worker_overview->worker_count;
+    mainexec->worker_overview->start_ticks = datetime_Ticks();
     int threaderror = 0;
     i = 0;
     while (i < worker_count) {
@@ -1020,11 +1970,31 @@ int vmschedule_ExecuteProgram(
                     mainexec->worker_overview->worker[i]
                 )
             );
-            if (!mainexec->worker_overview->worker[i]->worker_thread)
+            if (!mainexec->worker_overview->worker[i]->worker_thread) {
                 threaderror = 1;
+            } else {
+                mainexec->worker_overview->worker[i]->os_thread_id = (
+                    thread_GetId(
+                        mainexec->worker_overview->worker[i]->
+                            worker_thread
+                    )
+                );
+            }
+        } else {
+            mainexec->worker_overview->worker[i]->os_thread_id = (
+                thread_GetOurThreadId()  // we'll run worker 0
+            );
         }
         i++;
     }
+    if (!threaderror && pin_workers &&
+            !vmschedule_SetWorkerCpus(mainexec, &worker_cpus)) {
+        h64fprintf(
+            stderr, "horsevm: warning: vmschedule.c: failed to "
+            "pin workers to the given CPUs, not supported on this "
+            "platform?\n"
+        );
+    }
     if (threaderror) {
         mainexec->worker_overview->fatalerror = 1;
         h64fprintf(
@@ -1047,6 +2017,18 @@ int vmschedule_ExecuteProgram(
         );
         return -1;
     }
+    if (!threaderror && moptions->vm_pin_supervisor) {
+        threadcpuset supervisor_cpus = {0};
+        threadcpuset_Add(&supervisor_cpus, moptions->vm_supervisor_cpu);
+        if (!thread_SetCpuAffinity(
+                thread_GetId(supervisor_thread), &supervisor_cpus
+                ))
+            h64fprintf(
+                stderr, "horsevm: warning: vmschedule.c: failed to "
+                "pin supervisor to CPU %d, not supported on this "
+                "platform?\n", moptions->vm_supervisor_cpu
+            );
+    }
 
     // If we had a thread error, then signal to stop early:
     if (threaderror) {
@@ -1152,6 +2134,7 @@ int vmschedule_ExecuteProgram(
     thread_Join(
         supervisor_thread
     );
+    asyncjob_SetNotifyVMExec(NULL);  // before the vmexec goes away
     {
         // Free globals before we free anything else:
         int64_t i = 0;
@@ -1207,10 +2190,15 @@ int vmschedule_ExecuteProgram(
         threadevent_Free(
             mainexec->worker_overview->worker[i]->wakeupevent
         );
+        vmrunqueue_Uninit(&mainexec->worker_overview->worker[i]->runqueue);
         free(mainexec->worker_overview->worker[i]);
         i++;
     }
     mainexec->worker_overview->worker_count = 0;
+    sockset_Uninit(&_waited_for_socklist);
+    free(_sockwait_waiters);
+    _sockwait_waiters = NULL;
+    _sockwait_waiters_size = 0;
     threadevent_Free(_waited_for_socklist_supervisorunlockevent);
     _waited_for_socklist_supervisorunlockevent = NULL;
     mutex_Destroy(_waited_for_socklist_mutex);
@@ -11,6 +11,8 @@
 
 #include "compiler/globallimits.h"
 #include "threading.h"
+#include "vmrunqueue.h"
+#include "vmtimerheap.h"
 #include "widechar.h"
 
 
@@ -23,7 +25,7 @@ typedef struct h64misccompileroptions h64misccompileroptions;
 typedef struct vminnercfuncresumeinfo vminnercfuncresumeinfo;
 
 typedef struct vmsuspendoverview {
-    uint8_t *waittypes_currently_active;
+    int64_t *waittypes_currently_active;
 } vmsuspendoverview;
 
 typedef struct vmthreadsuspendinfo {
@@ -57,6 +59,18 @@ typedef struct h64vmworker {
     h64vmexec *vmexec;
     threadevent *wakeupevent;
     h64misccompileroptions *moptions;
+
+    vmrunqueue runqueue;  // parallel threads this worker made runnable
+    int steal_offset;  // where to start looking for a steal victim
+    _Atomic volatile int parked;  // 1 while sleeping on wakeupevent
+    uint64_t os_thread_id;  // for changing the CPU affinity
+
+    // Utilization counters, only written to by this worker itself:
+    _Atomic volatile int64_t stat_runs;  // vm threads picked up
+    _Atomic volatile int64_t stat_steals;  // of those, how many stolen
+    _Atomic volatile int64_t stat_parks;
+    _Atomic volatile int64_t stat_parked_ms;  // for all finished parks
+    _Atomic volatile int64_t stat_parked_since;  // ticks, 0 if not parked
 } h64vmworker;
 
 typedef struct h64vmworkerset {
@@ -64,12 +78,28 @@ typedef struct h64vmworkerset {
     int worker_count;
     mutex *worker_mutex;
 
+    // Runnable threads not owned by any worker, guarded by
+    // readyqueue_mutex. Threads that must run on the main thread
+    // go into mainonly_ready, which only worker 0 picks from:
+    mutex *readyqueue_mutex;
+    vmreadyring shared_ready, mainonly_ready;
+    _Atomic volatile int64_t shared_ready_count, mainonly_ready_count;
+    _Atomic volatile int idle_workers;  // how many are parked
+
+    // Threads suspended with SUSPENDTYPE_FIXEDTIME, ordered by their
+    // deadline. Guarded by worker_mutex:
+    vmtimerheap timers;
+
     _Atomic volatile int workers_ran_globalinitsimple;
     _Atomic volatile int workers_ran_globalinit;
     _Atomic volatile int workers_ran_main;
     _Atomic volatile int fatalerror;
+    _Atomic volatile int supervisor_rescan;  // set if a wakeup got lost
+
+    uint64_t start_ticks;  // when the workers were launched
 } h64vmworkerset;
 
+typedef struct h64asyncsysjob h64asyncsysjob;
 typedef struct h64program h64program;
 typedef struct h64misccompileroptions h64misccompileroptions;
 typedef struct h64vmthread h64vmthread;
@@ -84,13 +114,52 @@ int vmschedule_AsyncScheduleFunc(
     h64vmexec *vmexec, h64vmthread *vmthread,
     int64_t new_func_floor, int64_t func_id,
     int parallel
-);
+);  // returns 1 on success, 0 on oom, -1 if an argument can't be piped
 
 int vmschedule_SuspendFunc(
     h64vmthread *vmthread, suspendtype suspend_type,
     int64_t suspend_intarg
 );
 
+typedef struct genericlist genericlist;
+typedef struct h64paralleljob h64paralleljob;
+
+int vmschedule_ParallelJobStart(
+    h64vmthread *vmthread, int64_t func_id, genericlist *items,
+    int keep_results, h64paralleljob **out_job
+);  // returns 1 on success, 0 on oom, -1 if an item can't be piped
+
+int vmschedule_ParallelJobReturn(
+    h64vmthread *vmthread, h64paralleljob *job
+);  // frees the job, returns like a C func with the result list
+
+void vmschedule_ParallelJobAbandon(
+    h64vmthread *vmthread, h64paralleljob *job
+);
+
+int vmschedule_AsyncSysJobDone(
+    h64vmexec *vmexec, h64asyncsysjob *job
+);  // IMPORTANT: worker_mutex must be LOCKED entering this.
+    // Returns 0 if the waiting thread couldn't be queued, or if there
+    // are other waiters the supervisor needs to find.
+
+typedef struct h64channel h64channel;
+
+int vmschedule_ChannelWaiterWake(
+    h64vmthread *vt, suspendtype stype, h64channel *ch
+);  // IMPORTANT: worker_mutex must be UNLOCKED entering this.
+    // Returns 1 if vt was queued, 0 if it isn't suspended on ch yet,
+    // or -1 if it couldn't be queued (then the supervisor will).
+
+int vmschedule_WorkerCount(
+    h64misccompileroptions *moptions
+);  // how many workers the vm will launch with these options
+
+int vmschedule_SetWorkerCpus(
+    h64vmexec *vmexec, const threadcpuset *cpus
+);  // pins each worker to one of the cpus in turn, returns 1 on
+    // success, 0 if the platform doesn't support it or it failed
+
 int vmschedule_ExecuteProgram(
     h64program *pr, h64misccompileroptions *moptions,
     const h64wchar **argv, int64_t *argvlen, int argc
@@ -101,12 +170,12 @@ int vmschedule_CanThreadResume_UnguardedCheck(
 );
 
 int _vmschedule_RegisterSocketForWaiting(
-    int fd, int waittypes
-);
+    h64vmthread *vt, int fd, int waittypes
+);  // worker_mutex must be locked, returns 1 on success, 0 on oom
 
-int _vmschedule_UnregisterSocketForWaiting(
-    int fd, int waittypes
-);
+void _vmschedule_UnregisterSocketForWaiting(
+    h64vmthread *vt, int fd
+);  // worker_mutex must be locked
 
 #ifndef NDEBUG
 extern int _vmsockets_debug, _vmasyncjobs_debug;
@@ -6,7 +6,11 @@
 
 #include <stdlib.h>
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
+#include "bytecode.h"
 #include "gcvalue.h"
 #include "poolalloc.h"
 #include "threading.h"
@@ -14,7 +18,6 @@
 #include "valuecontentstruct.h"
 #include "vmstrings.h"
 
-#define POOLEDSTRSIZE 64
 
 
 int vmstrings_Equality(
@@ -75,9 +78,64 @@ int vmstrings_AllocBuffer(
     return (v->s != NULL);
 }
 
+int64_t _vmstrings_LetterOffsetSlow(
+        h64stringval *v, int64_t letteridx
+        ) {
+    if ((uint64_t)letteridx == v->letterlen)
+        return v->len;
+    if (!v->letter_offsets &&
+            v->len >= VMSTRINGS_LETTERINDEX_MINLEN) {
+        // Build the index in one pass. If this fails, we just
+        // scan from the start every time:
+        int64_t *offsets = malloc(
+            sizeof(*offsets) *
+            (v->letterlen / VMSTRINGS_LETTERINDEX_STRIDE + 1)
+        );
+        if (offsets) {
+            int64_t letters = utf32_letters_segment(
+                v->s, v->len, offsets, VMSTRINGS_LETTERINDEX_STRIDE
+            );
+            assert((uint64_t)letters == v->letterlen);
+            (void)letters;
+            v->letter_offsets = offsets;
+        }
+    }
+    int64_t offset = 0;
+    int64_t k = 0;
+    if (v->letter_offsets) {
+        offset = v->letter_offsets[letteridx / VMSTRINGS_LETTERINDEX_STRIDE];
+        k = letteridx - (letteridx % VMSTRINGS_LETTERINDEX_STRIDE);
+    }
+    while (k < letteridx) {
+        offset += utf32_letter_len(v->s + offset, v->len - offset);
+        k++;
+    }
+    return offset;
+}
+
+static void _vmstrings_DropSliceParent(
+        h64vmthread *vthread, h64gcvalue *parent
+        ) {
+    valuecontent vparent = {0};
+    vparent.type = H64VALTYPE_GCVAL;
+    vparent.ptr_value = parent;
+    DELREF_HEAP(&vparent);
+    valuecontent_Free(vthread, &vparent);
+}
+
 void vmstrings_Free(h64vmthread *vthread, h64stringval *v) {
     if (!vthread || !v)
         return;
+    free(v->letter_offsets);
+    v->letter_offsets = NULL;
+    if (v->slice_parent) {
+        h64gcvalue *parent = v->slice_parent;
+        v->slice_parent = NULL;
+        v->s = NULL;
+        v->len = 0;
+        _vmstrings_DropSliceParent(vthread, parent);
+        return;
+    }
     if (v->len * sizeof(h64wchar) <= POOLEDSTRSIZE) {
         poolalloc_free(vthread->str_pile, v->s);
     } else {
@@ -144,6 +202,14 @@ int vmbytes_AllocBuffer(
 void vmbytes_Free(h64vmthread *vthread, h64bytesval *v) {
     if (!vthread || !v)
         return;
+    if (v->slice_parent) {
+        h64gcvalue *parent = v->slice_parent;
+        v->slice_parent = NULL;
+        v->s = NULL;
+        v->len = 0;
+        _vmstrings_DropSliceParent(vthread, parent);
+        return;
+    }
     if (v->len <= POOLEDSTRSIZE) {
         poolalloc_free(vthread->str_pile, v->s);
     } else {
@@ -151,3 +217,126 @@ void vmbytes_Free(h64vmthread *vthread, h64bytesval *v) {
     }
     v->len = 0;
 }
+
+static h64gcvalue *_vmstrings_NewSliceGCValue(
+        h64vmthread *vthread, valuecontent *v, h64gcvalue *root
+        ) {
+    h64gcvalue *gcval = poolalloc_malloc(vthread->heap, 0);
+    if (!gcval)
+        return NULL;
+    memset(gcval, 0, sizeof(*gcval));
+    gcval->type = root->type;
+    v->type = H64VALTYPE_GCVAL;
+    v->ptr_value = gcval;
+    root->heapreferencecount++;
+    return gcval;
+}
+
+int vmstrings_SetSlice(
+        h64vmthread *vthread, valuecontent *v,
+        h64gcvalue *parent, int64_t offset, int64_t len
+        ) {
+    assert(parent->type == H64GCVALUETYPE_STRING);
+    assert(offset >= 0 && len >= 0 &&
+           (uint64_t)(offset + len) <= parent->str_val.len);
+    // Views always point at the owning string, never at other views:
+    h64gcvalue *root = parent;
+    if (parent->str_val.slice_parent)
+        root = parent->str_val.slice_parent;
+    if (len < VMSTRINGS_SLICE_MINLEN ||
+            (uint64_t)len * VMSTRINGS_SLICE_MAXPINRATIO <
+                root->str_val.len)
+        return valuecontent_SetStringU32(
+            vthread, v, parent->str_val.s + offset, len
+        );
+    valuecontent_Free(vthread, v);
+    memset(v, 0, sizeof(*v));
+    h64gcvalue *gcval = _vmstrings_NewSliceGCValue(vthread, v, root);
+    if (!gcval)
+        return 0;
+    gcval->str_val.s = parent->str_val.s + offset;
+    gcval->str_val.len = len;
+    gcval->str_val.slice_parent = root;
+    return 1;
+}
+
+int vmbytes_SetSlice(
+        h64vmthread *vthread, valuecontent *v,
+        h64gcvalue *parent, int64_t offset, int64_t len
+        ) {
+    assert(parent->type == H64GCVALUETYPE_BYTES);
+    assert(offset >= 0 && len >= 0 &&
+           (uint64_t)(offset + len) <= parent->bytes_val.len);
+    h64gcvalue *root = parent;
+    if (parent->bytes_val.slice_parent)
+        root = parent->bytes_val.slice_parent;
+    if (len < VMSTRINGS_SLICE_MINLEN ||
+            (uint64_t)len * VMSTRINGS_SLICE_MAXPINRATIO <
+                root->bytes_val.len)
+        return valuecontent_SetBytesU8(
+            vthread, v, (uint8_t *)parent->bytes_val.s + offset, len
+        );
+    valuecontent_Free(vthread, v);
+    memset(v, 0, sizeof(*v));
+    h64gcvalue *gcval = _vmstrings_NewSliceGCValue(vthread, v, root);
+    if (!gcval)
+        return 0;
+    gcval->bytes_val.s = parent->bytes_val.s + offset;
+    gcval->bytes_val.len = len;
+    gcval->bytes_val.slice_parent = root;
+    return 1;
+}
+
+static int64_t _vmstrings_FindCodepoint(
+        const h64wchar *s, h64wchar c, int64_t slen
+        ) {
+    int64_t i = 0;
+    #if defined(__SSE2__)
+    const __m128i cvec = _mm_set1_epi32((int)c);
+    while (i + 4 <= slen) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(
+            _mm_loadu_si128((const __m128i *)(s + i)), cvec
+        ));
+        if (mask != 0)
+            return i + (__builtin_ctz((unsigned int)mask) / 4);
+        i += 4;
+    }
+    #endif
+    while (i < slen) {
+        if (s[i] == c)
+            return i;
+        i++;
+    }
+    return -1;
+}
+
+static int64_t _vmbytes_FindByte(
+        const unsigned char *s, unsigned char c, int64_t slen
+        ) {
+    if (slen <= 0)
+        return -1;
+    const unsigned char *p = memchr(s, c, slen);
+    if (!p)
+        return -1;
+    return (p - s);
+}
+
+#define SEARCHELEM h64wchar
+#define SEARCHPUBLICELEM h64wchar
+#define SEARCHFUNC(name) vmstrings_ ## name
+#define SEARCHFINDELEM _vmstrings_FindCodepoint
+#include "vmstrings_search_INCLUDE.c"
+#undef SEARCHELEM
+#undef SEARCHPUBLICELEM
+#undef SEARCHFUNC
+#undef SEARCHFINDELEM
+
+#define SEARCHELEM unsigned char
+#define SEARCHPUBLICELEM char
+#define SEARCHFUNC(name) vmbytes_ ## name
+#define SEARCHFINDELEM _vmbytes_FindByte
+#include "vmstrings_search_INCLUDE.c"
+#undef SEARCHELEM
+#undef SEARCHPUBLICELEM
+#undef SEARCHFUNC
+#undef SEARCHFINDELEM
@@ -18,6 +18,10 @@ typedef struct valuecontent valuecontent;
 
 #include "vmstringsstruct.h"
 
+// String and bytes buffers up to this size come from the per-thread
+// str_pile, larger ones are regular malloc() allocations:
+#define POOLEDSTRSIZE 64
+
 
 ATTR_UNUSED static inline void vmstrings_RequireLetterLen(
         h64stringval *v
@@ -30,6 +34,33 @@ ATTR_UNUSED static inline void vmstrings_RequireLetterLen(
     }
 }
 
+// Strings with letters made up of multiple code points get a sparse
+// index once indexed into, storing the code point offset of every
+// VMSTRINGS_LETTERINDEX_STRIDE-th letter:
+#define VMSTRINGS_LETTERINDEX_STRIDE 32
+#define VMSTRINGS_LETTERINDEX_MINLEN 64
+
+int64_t _vmstrings_LetterOffsetSlow(h64stringval *v, int64_t letteridx);
+
+ATTR_UNUSED static inline int vmstrings_LettersAreCodepoints(
+        h64stringval *v
+        ) {
+    vmstrings_RequireLetterLen(v);
+    return (v->letterlen == v->len);
+}
+
+ATTR_UNUSED static inline int64_t vmstrings_LetterOffset(
+        h64stringval *v, int64_t letteridx
+        ) {
+    // Returns the code point offset where the letter with the given
+    // 0-based index starts. letterlen itself is allowed, mapping to len.
+    vmstrings_RequireLetterLen(v);
+    assert(letteridx >= 0 && (uint64_t)letteridx <= v->letterlen);
+    if (likely(v->letterlen == v->len))
+        return letteridx;
+    return _vmstrings_LetterOffsetSlow(v, letteridx);
+}
+
 int vmstrings_Equality(
     valuecontent *v1, valuecontent *v2
 );
@@ -44,10 +75,60 @@ int vmstrings_AllocBuffer(
 
 void vmstrings_Free(h64vmthread *vthread, h64stringval *v);
 
+ATTR_UNUSED static inline int vmstrings_IsPooled(h64stringval *v) {
+    return (v->len * sizeof(h64wchar) <= POOLEDSTRSIZE);
+}
+
 int vmbytes_AllocBuffer(
     h64vmthread *vthread, h64bytesval *v, uint64_t len
 );
 
 void vmbytes_Free(h64vmthread *vthread, h64bytesval *v);
 
+ATTR_UNUSED static inline int vmbytes_IsPooled(h64bytesval *v) {
+    return (v->len <= POOLEDSTRSIZE);
+}
+
+// Slices of at least VMSTRINGS_SLICE_MINLEN code points or bytes
+// share the buffer of the value they were taken from, unless they
+// would pin a parent more than VMSTRINGS_SLICE_MAXPINRATIO times
+// their own size. Those, and all smaller ones, get copied instead:
+#define VMSTRINGS_SLICE_MINLEN 64
+#define VMSTRINGS_SLICE_MAXPINRATIO 4
+
+int vmstrings_SetSlice(
+    h64vmthread *vthread, valuecontent *v,
+    h64gcvalue *parent, int64_t offset, int64_t len
+);  // returns 1 on success, 0 on out of memory
+
+int vmbytes_SetSlice(
+    h64vmthread *vthread, valuecontent *v,
+    h64gcvalue *parent, int64_t offset, int64_t len
+);  // returns 1 on success, 0 on out of memory
+
+// Prepared substring search, so that repeated searches for the
+// same needle don't redo the setup. The needle must outlive it:
+typedef struct h64searcher {
+    const void *needle;
+    int64_t needlelen;
+    int64_t critpos, period;
+    int periodic;
+} h64searcher;
+
+void vmstrings_SearcherInit(
+    h64searcher *sr, const h64wchar *needle, int64_t needlelen
+);
+
+int64_t vmstrings_SearcherFind(
+    const h64searcher *sr, const h64wchar *s, int64_t slen
+);  // returns code point offset of first match, or -1
+
+void vmbytes_SearcherInit(
+    h64searcher *sr, const char *needle, int64_t needlelen
+);
+
+int64_t vmbytes_SearcherFind(
+    const h64searcher *sr, const char *s, int64_t slen
+);  // returns byte offset of first match, or -1
+
 #endif  // HORSE64_VMSTRINGS_H_
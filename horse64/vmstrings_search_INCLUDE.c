@@ -0,0 +1,149 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+// NOTE:
+// THIS FILE IS INLINE-INCLUDED BY VMSTRINGS.C, ONCE FOR STRINGS AND
+// ONCE FOR BYTES. IT IS **NOT** A SEPARATE OBJECT FILE.
+// The including file must define these before including it:
+//   SEARCHELEM               the (unsigned) element type to compare
+//   SEARCHPUBLICELEM         the element type used in the public API
+//   SEARCHFUNC(name)         to give the functions their prefix
+//   SEARCHFINDELEM(s, c, n)  returning the index of the first
+//                            c in s[0..n), or -1 if there is none.
+//
+// This is the Two-Way algorithm by Crochemore and Perrin, which
+// finds a needle in linear time and with constant extra space.
+// Whenever the needle doesn't line up at its critical position,
+// SEARCHFINDELEM is used to skip ahead which is a lot faster than
+// advancing one element at a time.
+
+static int64_t SEARCHFUNC(_MaxSuffix)(
+        const SEARCHELEM *needle, int64_t needlelen,
+        int reverse, int64_t *out_period
+        ) {
+    int64_t max_suffix = -1;
+    int64_t j = 0;
+    int64_t k = 1;
+    int64_t period = 1;
+    while (j + k < needlelen) {
+        SEARCHELEM a = needle[j + k];
+        SEARCHELEM b = needle[max_suffix + k];
+        if (reverse ? (a > b) : (a < b)) {
+            j += k;
+            k = 1;
+            period = j - max_suffix;
+        } else if (a == b) {
+            if (k != period) {
+                k++;
+            } else {
+                j += period;
+                k = 1;
+            }
+        } else {
+            max_suffix = j;
+            j++;
+            k = 1;
+            period = 1;
+        }
+    }
+    *out_period = period;
+    return max_suffix;
+}
+
+void SEARCHFUNC(SearcherInit)(
+        h64searcher *sr, const SEARCHPUBLICELEM *needle_,
+        int64_t needlelen
+        ) {
+    const SEARCHELEM *needle = (const SEARCHELEM *)needle_;
+    memset(sr, 0, sizeof(*sr));
+    sr->needle = needle;
+    sr->needlelen = needlelen;
+    sr->period = 1;
+    if (needlelen <= 1)
+        return;
+
+    // Find the critical factorization, which is the later one of the
+    // two maximal suffixes for both possible element orderings:
+    int64_t period = 1;
+    int64_t period_rev = 1;
+    int64_t max_suffix = SEARCHFUNC(_MaxSuffix)(
+        needle, needlelen, 0, &period
+    );
+    int64_t max_suffix_rev = SEARCHFUNC(_MaxSuffix)(
+        needle, needlelen, 1, &period_rev
+    );
+    if (max_suffix_rev < max_suffix) {
+        sr->critpos = max_suffix + 1;
+    } else {
+        sr->critpos = max_suffix_rev + 1;
+        period = period_rev;
+    }
+
+    // If the left part repeats with the period, the searcher needs to
+    // remember how much already matched. Otherwise, it can shift
+    // further on a right side match:
+    if (sr->critpos + period <= needlelen &&
+            memcmp(needle, needle + period,
+                   sr->critpos * sizeof(*needle)) == 0) {
+        sr->periodic = 1;
+        sr->period = period;
+    } else {
+        sr->periodic = 0;
+        sr->period = (
+            sr->critpos > needlelen - sr->critpos ?
+            sr->critpos : needlelen - sr->critpos
+        ) + 1;
+    }
+}
+
+int64_t SEARCHFUNC(SearcherFind)(
+        const h64searcher *sr, const SEARCHPUBLICELEM *haystack_,
+        int64_t haystacklen
+        ) {
+    const SEARCHELEM *haystack = (const SEARCHELEM *)haystack_;
+    const SEARCHELEM *needle = sr->needle;
+    const int64_t needlelen = sr->needlelen;
+    if (unlikely(needlelen <= 0))
+        return 0;
+    if (needlelen > haystacklen)
+        return -1;
+    if (needlelen == 1)
+        return SEARCHFINDELEM(haystack, needle[0], haystacklen);
+
+    const int64_t critpos = sr->critpos;
+    const SEARCHELEM critelem = needle[critpos];
+    const int64_t lastpos = haystacklen - needlelen;
+    int64_t memory = 0;
+    int64_t j = 0;
+    while (j <= lastpos) {
+        if (memory == 0 && haystack[j + critpos] != critelem) {
+            int64_t skip = SEARCHFINDELEM(
+                haystack + j + critpos + 1, critelem, lastpos - j
+            );
+            if (skip < 0)
+                return -1;
+            j += skip + 1;
+            continue;
+        }
+        // Match the right side first:
+        int64_t i = (critpos > memory ? critpos : memory);
+        while (i < needlelen && needle[i] == haystack[j + i])
+            i++;
+        if (i < needlelen) {
+            j += i - critpos + 1;
+            memory = 0;
+            continue;
+        }
+        // Then the left side, leaving out what is known to match:
+        i = critpos - 1;
+        while (i >= memory && needle[i] == haystack[j + i])
+            i--;
+        if (i < memory)
+            return j;
+        j += sr->period;
+        if (sr->periodic)
+            memory = needlelen - sr->period;
+    }
+    return -1;
+}
@@ -9,16 +9,21 @@
 
 #include "widechar.h"
 
+typedef struct h64gcvalue h64gcvalue;
+
 typedef struct h64stringval {
     h64wchar *s;
     uint64_t len, letterlen;
     int refcount;
+    int64_t *letter_offsets;  // see vmstrings_LetterOffset()
+    h64gcvalue *slice_parent;  // owns s if set, see vmstrings_SetSlice()
 } h64stringval;
 
 typedef struct h64bytesval {
     char *s;
     uint64_t len;
     int refcount;
+    h64gcvalue *slice_parent;  // owns s if set, see vmbytes_SetSlice()
 } h64bytesval;
 
 #endif  // HORSE64_VMSTRINGSSTRUCT_H_
\ No newline at end of file
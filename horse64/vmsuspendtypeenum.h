@@ -14,6 +14,9 @@ typedef enum suspendtype {
     SUSPENDTYPE_ASYNCSYSJOBWAIT,
     SUSPENDTYPE_SOCKWAIT_WRITABLEORERROR,
     SUSPENDTYPE_SOCKWAIT_READABLEORERROR,
+    SUSPENDTYPE_PARALLELJOBWAIT,
+    SUSPENDTYPE_CHANNELSENDWAIT,
+    SUSPENDTYPE_CHANNELRECEIVEWAIT,
     SUSPENDTYPE_DONE,
     SUSPENDTYPE_TOTALCOUNT
 } suspendtype;
@@ -0,0 +1,119 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "compileconfig.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmexec.h"
+#include "vmtimerheap.h"
+
+#define TIMERHEAP_MIN_ALLOC 16
+
+
+int vmtimerheap_Reserve(vmtimerheap *heap, int64_t count) {
+    if (count <= heap->alloc)
+        return 1;
+    int64_t new_alloc = heap->alloc * 2;
+    if (new_alloc < count)
+        new_alloc = count;
+    if (new_alloc < TIMERHEAP_MIN_ALLOC)
+        new_alloc = TIMERHEAP_MIN_ALLOC;
+    vmtimerheapentry *new_entry = realloc(
+        heap->entry, sizeof(*new_entry) * new_alloc
+    );
+    if (!new_entry)
+        return 0;
+    heap->entry = new_entry;
+    heap->alloc = new_alloc;
+    return 1;
+}
+
+static void _vmtimerheap_Place(
+        vmtimerheap *heap, int64_t i, vmtimerheapentry *e
+        ) {
+    heap->entry[i] = *e;
+    e->vt->timer_heap_pos = i + 1;
+}
+
+static void _vmtimerheap_SiftUp(vmtimerheap *heap, int64_t i) {
+    vmtimerheapentry e = heap->entry[i];
+    while (i > 0) {
+        int64_t parent = (i - 1) / 2;
+        if (heap->entry[parent].deadline <= e.deadline)
+            break;
+        _vmtimerheap_Place(heap, i, &heap->entry[parent]);
+        i = parent;
+    }
+    _vmtimerheap_Place(heap, i, &e);
+}
+
+static void _vmtimerheap_SiftDown(vmtimerheap *heap, int64_t i) {
+    vmtimerheapentry e = heap->entry[i];
+    while (1) {
+        int64_t child = i * 2 + 1;
+        if (child >= heap->count)
+            break;
+        if (child + 1 < heap->count &&
+                heap->entry[child + 1].deadline <
+                heap->entry[child].deadline)
+            child++;
+        if (e.deadline <= heap->entry[child].deadline)
+            break;
+        _vmtimerheap_Place(heap, i, &heap->entry[child]);
+        i = child;
+    }
+    _vmtimerheap_Place(heap, i, &e);
+}
+
+void vmtimerheap_Insert(
+        vmtimerheap *heap, h64vmthread *vt, int64_t deadline
+        ) {
+    if (vt->timer_heap_pos > 0)
+        vmtimerheap_Remove(heap, vt);
+    assert(heap->count < heap->alloc);
+    heap->entry[heap->count].deadline = deadline;
+    heap->entry[heap->count].vt = vt;
+    heap->count++;
+    _vmtimerheap_SiftUp(heap, heap->count - 1);
+}
+
+void vmtimerheap_Remove(vmtimerheap *heap, h64vmthread *vt) {
+    if (vt->timer_heap_pos <= 0)
+        return;
+    int64_t i = vt->timer_heap_pos - 1;
+    assert(i < heap->count && heap->entry[i].vt == vt);
+    vt->timer_heap_pos = 0;
+    heap->count--;
+    if (i == heap->count)
+        return;
+    _vmtimerheap_Place(heap, i, &heap->entry[heap->count]);
+    if (i > 0 && heap->entry[(i - 1) / 2].deadline >
+            heap->entry[i].deadline)
+        _vmtimerheap_SiftUp(heap, i);
+    else
+        _vmtimerheap_SiftDown(heap, i);
+}
+
+int64_t vmtimerheap_NextDeadline(vmtimerheap *heap) {
+    if (heap->count <= 0)
+        return -1;
+    return heap->entry[0].deadline;
+}
+
+h64vmthread *vmtimerheap_PopExpired(vmtimerheap *heap, int64_t now) {
+    if (heap->count <= 0 || heap->entry[0].deadline > now)
+        return NULL;
+    h64vmthread *vt = heap->entry[0].vt;
+    vmtimerheap_Remove(heap, vt);
+    return vt;
+}
+
+void vmtimerheap_Uninit(vmtimerheap *heap) {
+    free(heap->entry);
+    memset(heap, 0, sizeof(*heap));
+}
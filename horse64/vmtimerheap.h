@@ -0,0 +1,51 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef HORSE64_VMTIMERHEAP_H_
+#define HORSE64_VMTIMERHEAP_H_
+
+#include "compileconfig.h"
+
+#include <stdint.h>
+
+typedef struct h64vmthread h64vmthread;
+
+// A binary min-heap of vm threads suspended until a fixed time,
+// ordered by their deadline. Every thread remembers its own heap
+// position in h64vmthread.timer_heap_pos, so it can be removed again
+// without a search. Callers must guard the heap with a lock.
+
+typedef struct vmtimerheapentry {
+    int64_t deadline;
+    h64vmthread *vt;
+} vmtimerheapentry;
+
+typedef struct vmtimerheap {
+    vmtimerheapentry *entry;
+    int64_t count, alloc;
+} vmtimerheap;
+
+int vmtimerheap_Reserve(
+    vmtimerheap *heap, int64_t count
+);  // returns 1 on success, 0 on oom
+
+void vmtimerheap_Insert(
+    vmtimerheap *heap, h64vmthread *vt, int64_t deadline
+);  // needs a vmtimerheap_Reserve() covering all threads beforehand
+
+void vmtimerheap_Remove(
+    vmtimerheap *heap, h64vmthread *vt
+);  // does nothing if the thread isn't in the heap
+
+int64_t vmtimerheap_NextDeadline(
+    vmtimerheap *heap
+);  // returns -1 if the heap is empty
+
+h64vmthread *vmtimerheap_PopExpired(
+    vmtimerheap *heap, int64_t now
+);  // returns NULL if no deadline is at or before now
+
+void vmtimerheap_Uninit(vmtimerheap *heap);
+
+#endif  // HORSE64_VMTIMERHEAP_H_
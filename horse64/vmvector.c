@@ -0,0 +1,820 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "compileconfig.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "bytecode.h"
+#include "compiler/operator.h"
+#include "valuecontentstruct.h"
+#include "vmlist.h"
+#include "vmvector.h"
+
+// Kernel op codes used internally, independent of the H64OP_* values:
+#define VOP_ADD 1
+#define VOP_SUB 2
+#define VOP_MUL 3
+#define VOP_DIV 4
+#define VOP_GT 5
+#define VOP_GE 6
+#define VOP_LT 7
+#define VOP_LE 8
+
+h64vector *vmvector_New(int is_float, int64_t prealloc) {
+    h64vector *v = malloc(sizeof(*v));
+    if (!v)
+        return NULL;
+    memset(v, 0, sizeof(*v));
+    v->is_float = (is_float != 0);
+    if (prealloc < 8)
+        prealloc = 8;
+    v->int_values = malloc(sizeof(*v->int_values) * prealloc);
+    if (!v->int_values) {
+        free(v);
+        return NULL;
+    }
+    v->alloc = prealloc;
+    return v;
+}
+
+void vmvector_Free(h64vector *v) {
+    if (!v)
+        return;
+    free(v->int_values);
+    free(v);
+}
+
+static void _vmvector_ConvertToFloat(h64vector *v) {
+    if (v->is_float)
+        return;
+    // Both int64_t and double are 8 bytes, so convert in-place:
+    int64_t i = 0;
+    while (i < v->len) {
+        int64_t iv = v->int_values[i];
+        v->float_values[i] = (double)iv;
+        i++;
+    }
+    v->is_float = 1;
+}
+
+int vmvector_Set(
+        h64vector *v, int64_t index, valuecontent *vc
+        ) {
+    if (index < 1 || index > v->len + 1)
+        return 0;
+    if (vc->type != H64VALTYPE_INT64 &&
+            vc->type != H64VALTYPE_FLOAT64)
+        return 0;
+    if (index > v->alloc) {
+        int64_t new_alloc = v->alloc * 2;
+        if (new_alloc < index)
+            new_alloc = index;
+        int64_t *new_values = realloc(
+            v->int_values, sizeof(*v->int_values) * new_alloc
+        );
+        if (!new_values)
+            return -1;
+        v->int_values = new_values;
+        v->alloc = new_alloc;
+    }
+    if (vc->type == H64VALTYPE_FLOAT64 && !v->is_float)
+        _vmvector_ConvertToFloat(v);
+    if (v->is_float) {
+        v->float_values[index - 1] = (
+            vc->type == H64VALTYPE_FLOAT64 ? vc->float_value :
+            (double)vc->int_value
+        );
+    } else {
+        v->int_values[index - 1] = vc->int_value;
+    }
+    if (index > v->len)
+        v->len = index;
+    return 1;
+}
+
+int vmvector_Equality(h64vector *v1, h64vector *v2) {
+    if (v1 == v2)
+        return 1;
+    if (v1->len != v2->len)
+        return 0;
+    if (!v1->is_float && !v2->is_float) {
+        return (v1->len == 0 || memcmp(
+            v1->int_values, v2->int_values,
+            sizeof(*v1->int_values) * v1->len
+        ) == 0);
+    }
+    int64_t i = 0;
+    while (i < v1->len) {
+        double d1 = (v1->is_float ? v1->float_values[i] :
+                     (double)v1->int_values[i]);
+        double d2 = (v2->is_float ? v2->float_values[i] :
+                     (double)v2->int_values[i]);
+        if (d1 != d2)
+            return 0;
+        i++;
+    }
+    return 1;
+}
+
+static void _setnumberresult(valuecontent *result, double f) {
+    // Same as for regular math, go back to int if non-fractional:
+    int64_t intval = f;
+    memset(result, 0, sizeof(*result));
+    if ((double)intval == f &&
+            is_double_to_int64_nonoverflowing(f)) {
+        result->type = H64VALTYPE_INT64;
+        result->int_value = intval;
+    } else {
+        result->type = H64VALTYPE_FLOAT64;
+        result->float_value = f;
+    }
+}
+
+// An operand for the elementwise kernels, either a packed array or
+// a scalar which gets broadcast over the entire length:
+typedef struct vectoroperand {
+    int is_scalar;
+    const int64_t *ints;
+    const double *floats;
+    int64_t int_scalar;
+    double float_scalar;
+} vectoroperand;
+
+HOTSPOT static int _vmvector_KernelInt(
+        int vop, vectoroperand *a, vectoroperand *b,
+        int64_t *out, int64_t len
+        ) {
+    int64_t i = 0;
+    int overflow = 0;
+    if (vop == VOP_ADD || vop == VOP_SUB) {
+        #if defined(__AVX2__)
+        __m256i acc = _mm256_setzero_si256();
+        __m256i sa = _mm256_set1_epi64x(a->int_scalar);
+        __m256i sb = _mm256_set1_epi64x(b->int_scalar);
+        while (i + 4 <= len) {
+            __m256i va = (a->is_scalar ? sa :
+                _mm256_loadu_si256((const __m256i *)(a->ints + i)));
+            __m256i vb = (b->is_scalar ? sb :
+                _mm256_loadu_si256((const __m256i *)(b->ints + i)));
+            __m256i r;
+            if (vop == VOP_ADD) {
+                r = _mm256_add_epi64(va, vb);
+                // Overflow if sign of result differs from both inputs:
+                acc = _mm256_or_si256(acc, _mm256_and_si256(
+                    _mm256_xor_si256(va, r), _mm256_xor_si256(vb, r)
+                ));
+            } else {
+                r = _mm256_sub_epi64(va, vb);
+                acc = _mm256_or_si256(acc, _mm256_and_si256(
+                    _mm256_xor_si256(va, vb), _mm256_xor_si256(va, r)
+                ));
+            }
+            _mm256_storeu_si256((__m256i *)(out + i), r);
+            i += 4;
+        }
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(acc)) != 0)
+            overflow = 1;
+        #elif defined(__SSE2__)
+        __m128i acc = _mm_setzero_si128();
+        __m128i sa = _mm_set1_epi64x(a->int_scalar);
+        __m128i sb = _mm_set1_epi64x(b->int_scalar);
+        while (i + 2 <= len) {
+            __m128i va = (a->is_scalar ? sa :
+                _mm_loadu_si128((const __m128i *)(a->ints + i)));
+            __m128i vb = (b->is_scalar ? sb :
+                _mm_loadu_si128((const __m128i *)(b->ints + i)));
+            __m128i r;
+            if (vop == VOP_ADD) {
+                r = _mm_add_epi64(va, vb);
+                acc = _mm_or_si128(acc, _mm_and_si128(
+                    _mm_xor_si128(va, r), _mm_xor_si128(vb, r)
+                ));
+            } else {
+                r = _mm_sub_epi64(va, vb);
+                acc = _mm_or_si128(acc, _mm_and_si128(
+                    _mm_xor_si128(va, vb), _mm_xor_si128(va, r)
+                ));
+            }
+            _mm_storeu_si128((__m128i *)(out + i), r);
+            i += 2;
+        }
+        if (_mm_movemask_pd(_mm_castsi128_pd(acc)) != 0)
+            overflow = 1;
+        #endif
+    }
+    #if defined(__AVX2__)
+    if (vop == VOP_GT || vop == VOP_GE ||
+            vop == VOP_LT || vop == VOP_LE) {
+        const __m256i one = _mm256_set1_epi64x(1);
+        __m256i sa = _mm256_set1_epi64x(a->int_scalar);
+        __m256i sb = _mm256_set1_epi64x(b->int_scalar);
+        while (i + 4 <= len) {
+            __m256i va = (a->is_scalar ? sa :
+                _mm256_loadu_si256((const __m256i *)(a->ints + i)));
+            __m256i vb = (b->is_scalar ? sb :
+                _mm256_loadu_si256((const __m256i *)(b->ints + i)));
+            __m256i r;
+            if (vop == VOP_GT)
+                r = _mm256_and_si256(_mm256_cmpgt_epi64(va, vb), one);
+            else if (vop == VOP_LT)
+                r = _mm256_and_si256(_mm256_cmpgt_epi64(vb, va), one);
+            else if (vop == VOP_GE)
+                r = _mm256_andnot_si256(_mm256_cmpgt_epi64(vb, va), one);
+            else
+                r = _mm256_andnot_si256(_mm256_cmpgt_epi64(va, vb), one);
+            _mm256_storeu_si256((__m256i *)(out + i), r);
+            i += 4;
+        }
+    }
+    #endif
+    // Scalar remainder, and the full range for ops without a kernel:
+    while (i < len) {
+        int64_t va = (a->is_scalar ? a->int_scalar : a->ints[i]);
+        int64_t vb = (b->is_scalar ? b->int_scalar : b->ints[i]);
+        switch (vop) {
+        case VOP_ADD:
+            if (__builtin_add_overflow(va, vb, &out[i]))
+                overflow = 1;
+            break;
+        case VOP_SUB:
+            if (__builtin_sub_overflow(va, vb, &out[i]))
+                overflow = 1;
+            break;
+        case VOP_MUL:
+            if (__builtin_mul_overflow(va, vb, &out[i]))
+                overflow = 1;
+            break;
+        case VOP_GT: out[i] = (va > vb); break;
+        case VOP_GE: out[i] = (va >= vb); break;
+        case VOP_LT: out[i] = (va < vb); break;
+        case VOP_LE: out[i] = (va <= vb); break;
+        default:
+            assert(0 && "unsupported int vector kernel op");
+        }
+        i++;
+    }
+    return !overflow;
+}
+
+HOTSPOT static int _vmvector_KernelFloat(
+        int vop, vectoroperand *a, vectoroperand *b,
+        double *out, int64_t len
+        ) {
+    // Note: comparison ops write 0/1 as int64_t into out.
+    int64_t *outint = (int64_t *)out;
+    int64_t i = 0;
+    int nonfinite = 0;
+    #if defined(__AVX2__)
+    {
+        __m256d sa = _mm256_set1_pd(a->float_scalar);
+        __m256d sb = _mm256_set1_pd(b->float_scalar);
+        __m256d zero = _mm256_setzero_pd();
+        __m256d acc = _mm256_setzero_pd();
+        const __m256i one = _mm256_set1_epi64x(1);
+        while (i + 4 <= len) {
+            __m256d va = (a->is_scalar ? sa :
+                _mm256_loadu_pd(a->floats + i));
+            __m256d vb = (b->is_scalar ? sb :
+                _mm256_loadu_pd(b->floats + i));
+            __m256d r;
+            switch (vop) {
+            case VOP_ADD: r = _mm256_add_pd(va, vb); break;
+            case VOP_SUB: r = _mm256_sub_pd(va, vb); break;
+            case VOP_MUL: r = _mm256_mul_pd(va, vb); break;
+            case VOP_DIV: r = _mm256_div_pd(va, vb); break;
+            case VOP_GT: r = _mm256_cmp_pd(va, vb, _CMP_GT_OQ); break;
+            case VOP_GE: r = _mm256_cmp_pd(va, vb, _CMP_GE_OQ); break;
+            case VOP_LT: r = _mm256_cmp_pd(va, vb, _CMP_LT_OQ); break;
+            default: r = _mm256_cmp_pd(va, vb, _CMP_LE_OQ); break;
+            }
+            if (vop >= VOP_GT) {
+                _mm256_storeu_si256((__m256i *)(outint + i),
+                    _mm256_and_si256(_mm256_castpd_si256(r), one));
+            } else {
+                // x - x is NaN exactly for infinities and NaN:
+                acc = _mm256_or_pd(acc, _mm256_cmp_pd(
+                    _mm256_sub_pd(r, r), zero, _CMP_NEQ_UQ
+                ));
+                _mm256_storeu_pd(out + i, r);
+            }
+            i += 4;
+        }
+        if (_mm256_movemask_pd(acc) != 0)
+            nonfinite = 1;
+    }
+    #elif defined(__SSE2__)
+    {
+        __m128d sa = _mm_set1_pd(a->float_scalar);
+        __m128d sb = _mm_set1_pd(b->float_scalar);
+        __m128d zero = _mm_setzero_pd();
+        __m128d acc = _mm_setzero_pd();
+        const __m128i one = _mm_set1_epi64x(1);
+        while (i + 2 <= len) {
+            __m128d va = (a->is_scalar ? sa :
+                _mm_loadu_pd(a->floats + i));
+            __m128d vb = (b->is_scalar ? sb :
+                _mm_loadu_pd(b->floats + i));
+            __m128d r;
+            switch (vop) {
+            case VOP_ADD: r = _mm_add_pd(va, vb); break;
+            case VOP_SUB: r = _mm_sub_pd(va, vb); break;
+            case VOP_MUL: r = _mm_mul_pd(va, vb); break;
+            case VOP_DIV: r = _mm_div_pd(va, vb); break;
+            case VOP_GT: r = _mm_cmpgt_pd(va, vb); break;
+            case VOP_GE: r = _mm_cmpge_pd(va, vb); break;
+            case VOP_LT: r = _mm_cmplt_pd(va, vb); break;
+            default: r = _mm_cmple_pd(va, vb); break;
+            }
+            if (vop >= VOP_GT) {
+                _mm_storeu_si128((__m128i *)(outint + i),
+                    _mm_and_si128(_mm_castpd_si128(r), one));
+            } else {
+                acc = _mm_or_pd(acc, _mm_cmpneq_pd(
+                    _mm_sub_pd(r, r), zero
+                ));
+                _mm_storeu_pd(out + i, r);
+            }
+            i += 2;
+        }
+        if (_mm_movemask_pd(acc) != 0)
+            nonfinite = 1;
+    }
+    #endif
+    while (i < len) {
+        double va = (a->is_scalar ? a->float_scalar : a->floats[i]);
+        double vb = (b->is_scalar ? b->float_scalar : b->floats[i]);
+        switch (vop) {
+        case VOP_ADD: out[i] = va + vb; break;
+        case VOP_SUB: out[i] = va - vb; break;
+        case VOP_MUL: out[i] = va * vb; break;
+        case VOP_DIV: out[i] = va / vb; break;
+        case VOP_GT: outint[i] = (va > vb); break;
+        case VOP_GE: outint[i] = (va >= vb); break;
+        case VOP_LT: outint[i] = (va < vb); break;
+        default: outint[i] = (va <= vb); break;
+        }
+        if (vop < VOP_GT && !isfinite(out[i]))
+            nonfinite = 1;
+        i++;
+    }
+    return !nonfinite;
+}
+
+static int _vmvector_HasZero(vectoroperand *b, int isfloat, int64_t len) {
+    if (b->is_scalar) {
+        return (isfloat ? (b->float_scalar == 0.0) :
+                (b->int_scalar == 0));
+    }
+    int64_t i = 0;
+    if (isfloat) {
+        while (i < len) {
+            if (b->floats[i] == 0.0)
+                return 1;
+            i++;
+        }
+    } else {
+        while (i < len) {
+            if (b->ints[i] == 0)
+                return 1;
+            i++;
+        }
+    }
+    return 0;
+}
+
+static int _vmvector_OperandAsFloat(
+        valuecontent *v, vectoroperand *op, double **tmpbuf
+        ) {
+    // Fill operand from given value, converting ints to floats.
+    // If a buffer needed to be allocated, it is returned in tmpbuf.
+    memset(op, 0, sizeof(*op));
+    *tmpbuf = NULL;
+    if (v->type == H64VALTYPE_INT64) {
+        op->is_scalar = 1;
+        op->float_scalar = (double)v->int_value;
+        return 1;
+    } else if (v->type == H64VALTYPE_FLOAT64) {
+        op->is_scalar = 1;
+        op->float_scalar = v->float_value;
+        return 1;
+    }
+    assert(v->type == H64VALTYPE_VECTOR);
+    h64vector *vec = v->vector;
+    if (vec->is_float) {
+        op->floats = vec->float_values;
+        return 1;
+    }
+    double *buf = malloc(sizeof(*buf) * (vec->len > 0 ? vec->len : 1));
+    if (!buf)
+        return 0;
+    int64_t i = 0;
+    while (i < vec->len) {
+        buf[i] = (double)vec->int_values[i];
+        i++;
+    }
+    op->floats = buf;
+    *tmpbuf = buf;
+    return 1;
+}
+
+int vmvector_BinOp(
+        int optype, valuecontent *v1, valuecontent *v2,
+        valuecontent *result
+        ) {
+    int vop = 0;
+    switch (optype) {
+    case H64OP_MATH_ADD: vop = VOP_ADD; break;
+    case H64OP_MATH_SUBSTRACT: vop = VOP_SUB; break;
+    case H64OP_MATH_MULTIPLY: vop = VOP_MUL; break;
+    case H64OP_MATH_DIVIDE: vop = VOP_DIV; break;
+    case H64OP_CMP_LARGER: vop = VOP_GT; break;
+    case H64OP_CMP_LARGEROREQUAL: vop = VOP_GE; break;
+    case H64OP_CMP_SMALLER: vop = VOP_LT; break;
+    case H64OP_CMP_SMALLEROREQUAL: vop = VOP_LE; break;
+    default: return VECTOROP_ERR_INVALIDTYPES;
+    }
+    if ((v1->type != H64VALTYPE_VECTOR &&
+            v1->type != H64VALTYPE_INT64 &&
+            v1->type != H64VALTYPE_FLOAT64) ||
+            (v2->type != H64VALTYPE_VECTOR &&
+            v2->type != H64VALTYPE_INT64 &&
+            v2->type != H64VALTYPE_FLOAT64) ||
+            (v1->type != H64VALTYPE_VECTOR &&
+            v2->type != H64VALTYPE_VECTOR))
+        return VECTOROP_ERR_INVALIDTYPES;
+    int64_t len = (v1->type == H64VALTYPE_VECTOR ?
+        v1->vector->len : v2->vector->len);
+    if (v1->type == H64VALTYPE_VECTOR &&
+            v2->type == H64VALTYPE_VECTOR &&
+            v1->vector->len != v2->vector->len)
+        return VECTOROP_ERR_LENMISMATCH;
+    int anyfloat = (
+        v1->type == H64VALTYPE_FLOAT64 ||
+        v2->type == H64VALTYPE_FLOAT64 ||
+        (v1->type == H64VALTYPE_VECTOR && v1->vector->is_float) ||
+        (v2->type == H64VALTYPE_VECTOR && v2->vector->is_float)
+    );
+    int floatmath = (anyfloat || vop == VOP_DIV);
+    int resultfloat = (floatmath && vop < VOP_GT);
+
+    h64vector *vresult = vmvector_New(resultfloat, len);
+    if (!vresult)
+        return VECTOROP_ERR_OOM;
+    vresult->len = len;
+    if (!floatmath) {
+        vectoroperand a = {0};
+        vectoroperand b = {0};
+        if (v1->type == H64VALTYPE_VECTOR) {
+            a.ints = v1->vector->int_values;
+        } else {
+            a.is_scalar = 1;
+            a.int_scalar = v1->int_value;
+        }
+        if (v2->type == H64VALTYPE_VECTOR) {
+            b.ints = v2->vector->int_values;
+        } else {
+            b.is_scalar = 1;
+            b.int_scalar = v2->int_value;
+        }
+        if (!_vmvector_KernelInt(
+                vop, &a, &b, vresult->int_values, len)) {
+            vmvector_Free(vresult);
+            return VECTOROP_ERR_OVERFLOW;
+        }
+    } else {
+        vectoroperand a, b;
+        double *tmpbuf1 = NULL;
+        double *tmpbuf2 = NULL;
+        if (!_vmvector_OperandAsFloat(v1, &a, &tmpbuf1) ||
+                !_vmvector_OperandAsFloat(v2, &b, &tmpbuf2)) {
+            free(tmpbuf1);
+            vmvector_Free(vresult);
+            return VECTOROP_ERR_OOM;
+        }
+        if (vop == VOP_DIV && _vmvector_HasZero(&b, 1, len)) {
+            free(tmpbuf1);
+            free(tmpbuf2);
+            vmvector_Free(vresult);
+            return VECTOROP_ERR_DIVISIONBYZERO;
+        }
+        int ok = _vmvector_KernelFloat(
+            vop, &a, &b, vresult->float_values, len
+        );
+        free(tmpbuf1);
+        free(tmpbuf2);
+        if (!ok) {
+            vmvector_Free(vresult);
+            return VECTOROP_ERR_OVERFLOW;
+        }
+    }
+    memset(result, 0, sizeof(*result));
+    result->type = H64VALTYPE_VECTOR;
+    result->vector = vresult;
+    return VECTOROP_OK;
+}
+
+int vmvector_Sum(h64vector *v, valuecontent *result) {
+    int64_t i = 0;
+    if (v->is_float) {
+        double sum = 0;
+        #if defined(__AVX2__)
+        __m256d acc = _mm256_setzero_pd();
+        while (i + 4 <= v->len) {
+            acc = _mm256_add_pd(acc, _mm256_loadu_pd(
+                v->float_values + i
+            ));
+            i += 4;
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, acc);
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        #elif defined(__SSE2__)
+        __m128d acc = _mm_setzero_pd();
+        while (i + 2 <= v->len) {
+            acc = _mm_add_pd(acc, _mm_loadu_pd(v->float_values + i));
+            i += 2;
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, acc);
+        sum = lanes[0] + lanes[1];
+        #endif
+        while (i < v->len) {
+            sum += v->float_values[i];
+            i++;
+        }
+        if (!isfinite(sum))
+            return VECTOROP_ERR_OVERFLOW;
+        _setnumberresult(result, sum);
+        return VECTOROP_OK;
+    }
+    int64_t sum = 0;
+    #if defined(__AVX2__)
+    {
+        __m256i acc = _mm256_setzero_si256();
+        __m256i ovf = _mm256_setzero_si256();
+        while (i + 4 <= v->len) {
+            __m256i x = _mm256_loadu_si256(
+                (const __m256i *)(v->int_values + i)
+            );
+            __m256i r = _mm256_add_epi64(acc, x);
+            ovf = _mm256_or_si256(ovf, _mm256_and_si256(
+                _mm256_xor_si256(acc, r), _mm256_xor_si256(x, r)
+            ));
+            acc = r;
+            i += 4;
+        }
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(ovf)) != 0)
+            return VECTOROP_ERR_OVERFLOW;
+        int64_t lanes[4];
+        _mm256_storeu_si256((__m256i *)lanes, acc);
+        int k = 0;
+        while (k < 4) {
+            if (__builtin_add_overflow(sum, lanes[k], &sum))
+                return VECTOROP_ERR_OVERFLOW;
+            k++;
+        }
+    }
+    #endif
+    while (i < v->len) {
+        if (__builtin_add_overflow(sum, v->int_values[i], &sum))
+            return VECTOROP_ERR_OVERFLOW;
+        i++;
+    }
+    memset(result, 0, sizeof(*result));
+    result->type = H64VALTYPE_INT64;
+    result->int_value = sum;
+    return VECTOROP_OK;
+}
+
+int vmvector_MinMax(h64vector *v, int getmax, valuecontent *result) {
+    if (v->len <= 0)
+        return VECTOROP_ERR_EMPTY;
+    int64_t i = 0;
+    if (v->is_float) {
+        double best = v->float_values[0];
+        #if defined(__AVX2__)
+        if (v->len >= 4) {
+            __m256d acc = _mm256_loadu_pd(v->float_values);
+            i = 4;
+            while (i + 4 <= v->len) {
+                __m256d x = _mm256_loadu_pd(v->float_values + i);
+                acc = (getmax ? _mm256_max_pd(acc, x) :
+                       _mm256_min_pd(acc, x));
+                i += 4;
+            }
+            double lanes[4];
+            _mm256_storeu_pd(lanes, acc);
+            best = lanes[0];
+            int k = 1;
+            while (k < 4) {
+                if (getmax ? (lanes[k] > best) : (lanes[k] < best))
+                    best = lanes[k];
+                k++;
+            }
+        }
+        #elif defined(__SSE2__)
+        if (v->len >= 2) {
+            __m128d acc = _mm_loadu_pd(v->float_values);
+            i = 2;
+            while (i + 2 <= v->len) {
+                __m128d x = _mm_loadu_pd(v->float_values + i);
+                acc = (getmax ? _mm_max_pd(acc, x) : _mm_min_pd(acc, x));
+                i += 2;
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, acc);
+            best = lanes[0];
+            if (getmax ? (lanes[1] > best) : (lanes[1] < best))
+                best = lanes[1];
+        }
+        #endif
+        while (i < v->len) {
+            if (getmax ? (v->float_values[i] > best) :
+                    (v->float_values[i] < best))
+                best = v->float_values[i];
+            i++;
+        }
+        _setnumberresult(result, best);
+        return VECTOROP_OK;
+    }
+    int64_t best = v->int_values[0];
+    #if defined(__AVX2__)
+    if (v->len >= 4) {
+        __m256i acc = _mm256_loadu_si256((const __m256i *)v->int_values);
+        i = 4;
+        while (i + 4 <= v->len) {
+            __m256i x = _mm256_loadu_si256(
+                (const __m256i *)(v->int_values + i)
+            );
+            __m256i takex = (getmax ? _mm256_cmpgt_epi64(x, acc) :
+                             _mm256_cmpgt_epi64(acc, x));
+            acc = _mm256_blendv_epi8(acc, x, takex);
+            i += 4;
+        }
+        int64_t lanes[4];
+        _mm256_storeu_si256((__m256i *)lanes, acc);
+        best = lanes[0];
+        int k = 1;
+        while (k < 4) {
+            if (getmax ? (lanes[k] > best) : (lanes[k] < best))
+                best = lanes[k];
+            k++;
+        }
+    }
+    #endif
+    while (i < v->len) {
+        if (getmax ? (v->int_values[i] > best) :
+                (v->int_values[i] < best))
+            best = v->int_values[i];
+        i++;
+    }
+    memset(result, 0, sizeof(*result));
+    result->type = H64VALTYPE_INT64;
+    result->int_value = best;
+    return VECTOROP_OK;
+}
+
+int vmvector_Dot(h64vector *v1, h64vector *v2, valuecontent *result) {
+    if (v1->len != v2->len)
+        return VECTOROP_ERR_LENMISMATCH;
+    int64_t i = 0;
+    if (!v1->is_float && !v2->is_float) {
+        // No packed 64-bit integer multiply before AVX-512, so scalar:
+        int64_t sum = 0;
+        while (i < v1->len) {
+            int64_t prod;
+            if (__builtin_mul_overflow(
+                    v1->int_values[i], v2->int_values[i], &prod) ||
+                    __builtin_add_overflow(sum, prod, &sum))
+                return VECTOROP_ERR_OVERFLOW;
+            i++;
+        }
+        memset(result, 0, sizeof(*result));
+        result->type = H64VALTYPE_INT64;
+        result->int_value = sum;
+        return VECTOROP_OK;
+    }
+    double sum = 0;
+    if (v1->is_float && v2->is_float) {
+        #if defined(__AVX2__)
+        __m256d acc = _mm256_setzero_pd();
+        while (i + 4 <= v1->len) {
+            acc = _mm256_add_pd(acc, _mm256_mul_pd(
+                _mm256_loadu_pd(v1->float_values + i),
+                _mm256_loadu_pd(v2->float_values + i)
+            ));
+            i += 4;
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, acc);
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        #elif defined(__SSE2__)
+        __m128d acc = _mm_setzero_pd();
+        while (i + 2 <= v1->len) {
+            acc = _mm_add_pd(acc, _mm_mul_pd(
+                _mm_loadu_pd(v1->float_values + i),
+                _mm_loadu_pd(v2->float_values + i)
+            ));
+            i += 2;
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, acc);
+        sum = lanes[0] + lanes[1];
+        #endif
+    }
+    while (i < v1->len) {
+        double d1 = (v1->is_float ? v1->float_values[i] :
+                     (double)v1->int_values[i]);
+        double d2 = (v2->is_float ? v2->float_values[i] :
+                     (double)v2->int_values[i]);
+        sum += d1 * d2;
+        i++;
+    }
+    if (!isfinite(sum))
+        return VECTOROP_ERR_OVERFLOW;
+    _setnumberresult(result, sum);
+    return VECTOROP_OK;
+}
+
+int vmvector_FromList(
+        genericlist *l, h64vector **result
+        ) {
+    int64_t len = vmlist_Count(l);
+    if (l->packed_type != LISTPACKED_NONE) {
+        // Packed lists already have the exact layout we need:
+        h64vector *v = vmvector_New(
+            (l->packed_type == LISTPACKED_FLOAT64), len
+        );
+        if (!v)
+            return VECTOROP_ERR_OOM;
+        if (len > 0)
+            memcpy(
+                v->int_values, l->packed_int_values,
+                sizeof(*v->int_values) * len
+            );
+        v->len = len;
+        *result = v;
+        return VECTOROP_OK;
+    }
+    int anyfloat = 0;
+    int64_t i = 1;
+    while (i <= len) {
+        valuecontent vc;
+        vmlist_Get(l, i, &vc);
+        if (vc.type == H64VALTYPE_FLOAT64) {
+            anyfloat = 1;
+        } else if (vc.type != H64VALTYPE_INT64) {
+            return VECTOROP_ERR_INVALIDTYPES;
+        }
+        i++;
+    }
+    h64vector *v = vmvector_New(anyfloat, len);
+    if (!v)
+        return VECTOROP_ERR_OOM;
+    i = 1;
+    while (i <= len) {
+        valuecontent vc;
+        vmlist_Get(l, i, &vc);
+        if (anyfloat) {
+            v->float_values[i - 1] = (
+                vc.type == H64VALTYPE_FLOAT64 ? vc.float_value :
+                (double)vc.int_value
+            );
+        } else {
+            v->int_values[i - 1] = vc.int_value;
+        }
+        i++;
+    }
+    v->len = len;
+    *result = v;
+    return VECTOROP_OK;
+}
+
+genericlist *vmvector_ToList(h64vector *v) {
+    genericlist *l = vmlist_New();
+    if (!l)
+        return NULL;
+    int64_t i = 1;
+    while (i <= v->len) {
+        valuecontent vc = {0};
+        vmvector_Get(v, i, &vc);
+        if (!vmlist_Add(l, &vc)) {
+            vmlist_Free(l);
+            return NULL;
+        }
+        i++;
+    }
+    return l;
+}
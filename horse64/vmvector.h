@@ -0,0 +1,74 @@
+// Copyright (c) 2020-2021, ellie/@ell1e & Horse64 Team (see AUTHORS.md),
+// also see LICENSE.md file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef HORSE64_VMVECTOR_H_
+#define HORSE64_VMVECTOR_H_
+
+#include "compileconfig.h"
+
+#include <stdint.h>
+
+#include "valuecontentstruct.h"
+#include "vmcontainerstruct.h"
+
+#define VECTOROP_OK 0
+#define VECTOROP_ERR_OOM -1
+#define VECTOROP_ERR_INVALIDTYPES -2
+#define VECTOROP_ERR_LENMISMATCH -3
+#define VECTOROP_ERR_DIVISIONBYZERO -4
+#define VECTOROP_ERR_OVERFLOW -5
+#define VECTOROP_ERR_EMPTY -6
+
+h64vector *vmvector_New(int is_float, int64_t prealloc);
+
+void vmvector_Free(h64vector *v);
+
+ATTR_UNUSED static inline int64_t vmvector_Count(h64vector *v) {
+    return v->len;
+}
+
+ATTR_UNUSED static inline int vmvector_Get(
+        h64vector *v, int64_t i, valuecontent *out
+        ) {
+    if (i < 1 || i > v->len)
+        return 0;
+    if (v->is_float) {
+        out->type = H64VALTYPE_FLOAT64;
+        out->float_value = v->float_values[i - 1];
+    } else {
+        out->type = H64VALTYPE_INT64;
+        out->int_value = v->int_values[i - 1];
+    }
+    return 1;
+}
+
+int vmvector_Set(
+    h64vector *v, int64_t index, valuecontent *vc
+);  // return value: 1 = ok, 0 = invalid index/type, -1 = oom
+    // (index may be v->len + 1 to append, and setting a float in an
+    // int vector converts the entire vector to float storage)
+
+int vmvector_Equality(h64vector *v1, h64vector *v2);
+
+int vmvector_BinOp(
+    int optype, valuecontent *v1, valuecontent *v2,
+    valuecontent *result
+);  // Elementwise, at least one side must be a vector and the other
+    // side either a vector of same length or a number to broadcast.
+    // Returns VECTOROP_OK or a VECTOROP_ERR_* error code, and on
+    // success sets a new vector with refcount 0 into result.
+
+int vmvector_Sum(h64vector *v, valuecontent *result);
+
+int vmvector_MinMax(h64vector *v, int getmax, valuecontent *result);
+
+int vmvector_Dot(h64vector *v1, h64vector *v2, valuecontent *result);
+
+int vmvector_FromList(
+    genericlist *l, h64vector **result
+);  // Returns VECTOROP_OK or a VECTOROP_ERR_* error code.
+
+genericlist *vmvector_ToList(h64vector *v);
+
+#endif  // HORSE64_VMVECTOR_H_
@@ -15,156 +15,47 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 
 #include "threading.h"
 #include "vendor/unicode/unicode_data_header.h"
-#include "vfs.h"
 #include "widechar.h"
 
-// The equivalents to the unicode data header "extern" refs:
-uint8_t *_widechartbl_ismodifier = NULL;
-uint8_t *_widechartbl_iscombining = NULL;
-uint8_t *_widechartbl_istag = NULL;
-int64_t *_widechartbl_lowercp = NULL;
-int64_t *_widechartbl_uppercp = NULL;
-uint8_t *_widechartbl_graphemebreaktype = NULL;
-
-void _load_unicode_data() {
-    int _exists = 0;
-    if (!vfs_ExistsEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_ismodifier.dat",
-            &_exists, VFSFLAG_NO_REALDISK_ACCESS
-            ) || !_exists) {
-        loadfail:
-        fprintf(stderr, "horsevm: error: fatal, failed "
-            "to unpack integrated unicode data, out of memory?\n");
-        exit(1);
-        return;
-    }
-    _widechartbl_ismodifier = malloc(
-        sizeof(*_widechartbl_ismodifier) *
-        _widechartbl_arraylen
-    );
-    if (!_widechartbl_ismodifier)
-        goto loadfail;
-    if (!vfs_GetBytesEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_ismodifier.dat",
-            0, sizeof(*_widechartbl_ismodifier) *
-            _widechartbl_arraylen,
-            (char *)_widechartbl_ismodifier,
-            VFSFLAG_NO_REALDISK_ACCESS))
-        goto loadfail;
-
-    if (!vfs_ExistsEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_graphemebreaktype.dat",
-            &_exists, VFSFLAG_NO_REALDISK_ACCESS
-            ) || !_exists)
-        goto loadfail;
-    _widechartbl_graphemebreaktype = malloc(
-        sizeof(*_widechartbl_graphemebreaktype) *
-        _widechartbl_arraylen
-    );
-    if (!_widechartbl_graphemebreaktype)
-        goto loadfail;
-    if (!vfs_GetBytesEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_graphemebreaktype.dat",
-            0, sizeof(*_widechartbl_graphemebreaktype) *
-            _widechartbl_arraylen,
-            (char *)_widechartbl_graphemebreaktype,
-            VFSFLAG_NO_REALDISK_ACCESS))
-        goto loadfail;
+// The unicode data header has all tables as const two-level tables:
+// the code point's block selects one of the deduplicated value blocks.
+// For case mappings, the values are the offset to the mapped code
+// point (0 if unchanged).
+#define WIDECHARTBL_BLOCKSIZE (1 << _WIDECHARTBL_BLOCKBITS)
 
-    if (!vfs_ExistsEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_iscombining.dat",
-            &_exists, VFSFLAG_NO_REALDISK_ACCESS
-            ) || !_exists)
-        goto loadfail;
-    _widechartbl_iscombining = malloc(
-        sizeof(*_widechartbl_iscombining) *
-        _widechartbl_arraylen
-    );
-    if (!_widechartbl_iscombining)
-        goto loadfail;
-    if (!vfs_GetBytesEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_iscombining.dat",
-            0, sizeof(*_widechartbl_iscombining) *
-            _widechartbl_arraylen,
-            (char *)_widechartbl_iscombining,
-            VFSFLAG_NO_REALDISK_ACCESS))
-        goto loadfail;
+typedef struct h64casetbl {
+    const uint16_t *block_index;
+    const int32_t *block_deltas;
+} h64casetbl;
 
-    if (!vfs_ExistsEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_istag.dat",
-            &_exists, VFSFLAG_NO_REALDISK_ACCESS
-            ) || !_exists) {
-        goto loadfail;
-    }
-    _widechartbl_istag = malloc(
-        sizeof(*_widechartbl_istag) *
-        _widechartbl_arraylen
-    );
-    if (!_widechartbl_istag)
-        goto loadfail;
-    if (!vfs_GetBytesEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_istag.dat",
-            0, sizeof(*_widechartbl_istag) *
-            _widechartbl_arraylen,
-            (char *)_widechartbl_istag,
-            VFSFLAG_NO_REALDISK_ACCESS))
-        goto loadfail;
-
-    if (!vfs_ExistsEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_lowercp.dat",
-            &_exists, VFSFLAG_NO_REALDISK_ACCESS
-            ) || !_exists) {
-        goto loadfail;
-    }
-    _widechartbl_lowercp = malloc(
-        sizeof(*_widechartbl_lowercp) *
-        _widechartbl_arraylen
-    );
-    if (!_widechartbl_lowercp)
-        goto loadfail;
-    if (!vfs_GetBytesEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_lowercp.dat",
-            0, sizeof(*_widechartbl_lowercp) *
-            _widechartbl_arraylen,
-            (char *)_widechartbl_lowercp,
-            VFSFLAG_NO_REALDISK_ACCESS))
-        goto loadfail;
+static const h64casetbl _casetbl_lower = {
+    _widechartbl_lowercp_index, _widechartbl_lowercp_blocks
+};
+static const h64casetbl _casetbl_upper = {
+    _widechartbl_uppercp_index, _widechartbl_uppercp_blocks
+};
 
-    if (!vfs_ExistsEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_uppercp.dat",
-            &_exists, VFSFLAG_NO_REALDISK_ACCESS
-            ) || !_exists) {
-        goto loadfail;
-    }
-    _widechartbl_uppercp = malloc(
-        sizeof(*_widechartbl_uppercp) *
-        _widechartbl_arraylen
-    );
-    if (!_widechartbl_uppercp)
-        goto loadfail;
-    if (!vfs_GetBytesEx(
-            NULL, "horse_modules_builtin/"
-                "unicode_data___widechartbl_uppercp.dat",
-            0, sizeof(*_widechartbl_uppercp) *
-            _widechartbl_arraylen,
-            (char *)_widechartbl_uppercp,
-            VFSFLAG_NO_REALDISK_ACCESS))
-        goto loadfail;
+ATTR_UNUSED static inline h64wchar _casetbl_map(
+        const h64casetbl *tbl, h64wchar cp
+        ) {
+    if (unlikely((int64_t)cp < _widechartbl_lowest_cp ||
+            (int64_t)cp > _widechartbl_highest_cp))
+        return cp;
+    uint64_t idx = (uint64_t)((int64_t)cp - _widechartbl_lowest_cp);
+    return cp + (h64wchar)tbl->block_deltas[
+        ((uint64_t)tbl->block_index[idx >> _WIDECHARTBL_BLOCKBITS] <<
+         _WIDECHARTBL_BLOCKBITS) | (idx & (WIDECHARTBL_BLOCKSIZE - 1))
+    ];
 }
 
 
@@ -192,15 +83,7 @@ int utf8_char_len(const unsigned char *p) {
 int64_t utf32_letters_count(
         h64wchar *sdata, int64_t sdata_len
         ) {
-    int64_t len = 0;
-    while (sdata_len > 0) {
-        int64_t letterlen = utf32_letter_len(sdata, sdata_len);
-        assert(letterlen > 0);
-        len += 1;
-        sdata += letterlen;
-        sdata_len -= letterlen;
-    }
-    return len;
+    return utf32_letters_segment(sdata, sdata_len, NULL, 0);
 }
 
 int64_t utf32_next_letter_byteslen_in_utf8(
@@ -295,7 +178,36 @@ static int _gbt(uint64_t cp) {
     if ((int64_t)cp < _widechartbl_lowest_cp ||
             (int64_t)cp > _widechartbl_highest_cp)
         return GBT_NONE;
-    return _widechartbl_graphemebreaktype[cp];
+    uint64_t idx = cp - (uint64_t)_widechartbl_lowest_cp;
+    return _widechartbl_graphemebreaktype_blocks[
+        ((uint64_t)_widechartbl_graphemebreaktype_index[
+            idx >> _WIDECHARTBL_BLOCKBITS
+        ] << _WIDECHARTBL_BLOCKBITS) | (idx & (WIDECHARTBL_BLOCKSIZE - 1))
+    ];
+}
+
+// Two code points that are both below this can only be part of the
+// same letter if they are CR LF:
+#define _ISTRIVIALPAIR(cp1, cp2) (\
+    (cp1) < _WIDECHARTBL_GRAPHEME_TRIVIALBELOW && \
+    (cp2) < _WIDECHARTBL_GRAPHEME_TRIVIALBELOW && \
+    ((cp1) != '\r' || (cp2) != '\n'))
+
+static int64_t _utf32_letter_len_dfa(
+        const h64wchar *sdata, int64_t sdata_len
+        ) {
+    // Runs the grapheme break state machine from the unicode data
+    // header until it hits the end of the letter:
+    int state = _gbt(sdata[0]);
+    int64_t len = 1;
+    while (likely(len < sdata_len)) {
+        uint8_t next = _widechartbl_graphemedfa[state][_gbt(sdata[len])];
+        if (next & _WIDECHARTBL_GRAPHEMEBREAK)
+            break;
+        state = next;
+        len++;
+    }
+    return len;
 }
 
 int64_t utf32_letter_len(
@@ -305,65 +217,37 @@ int64_t utf32_letter_len(
     // up the next full letter.
     if (unlikely(sdata_len <= 0))
         return 0;
-    int64_t len = 1;
-    while (likely(len < sdata_len)) {
-        uint64_t cp1 = sdata[len - 1];
-        uint64_t cp2 = sdata[len];
-        if (unlikely(cp2 == '\r' || (cp2 == '\n' && cp1 != '\r') ||
-                cp1 == '\n')) {
-            break;
-        }
-        // This should follow the grapheme break rules from the Unicode(R)
-        // standard:
-        int _gbt1 = _gbt(cp1);
-        int _gbt2 = _gbt(cp2);
-        if (unlikely(_gbt1 == GBT_CONTROL || _gbt2 == GBT_CONTROL))
-            break;
-        if (unlikely(_gbt1 == GBT_L && (
-                _gbt2 == GBT_L || _gbt2 == GBT_V ||
-                _gbt2 == GBT_LV || _gbt2 == GBT_LVT))) {
-            len++;
-            continue;
-        }
-        if (unlikely((_gbt1 == GBT_LV || _gbt1 == GBT_V) && (
-                _gbt2 == GBT_V || _gbt2 == GBT_T))) {
-            len++;
-            continue;
-        }
-        if (unlikely((_gbt1 == GBT_LVT || _gbt1 == GBT_T) && (
-                _gbt2 == GBT_T))) {
-            len++;
-            continue;
-        }
-        if (unlikely(_gbt2 == GBT_EXTEND || _gbt2 == GBT_ZWJ)) {
-            len++;
-            continue;
+    if (sdata_len == 1 || _ISTRIVIALPAIR(sdata[0], sdata[1]))
+        return 1;
+    return _utf32_letter_len_dfa(sdata, sdata_len);
+}
+
+int64_t utf32_letters_segment(
+        const h64wchar *sdata, int64_t sdata_len,
+        int64_t *offsets, int64_t offsets_stride
+        ) {
+    int64_t letters = 0;
+    int64_t pos = 0;
+    int64_t untiloffset = 0;
+    while (pos < sdata_len) {
+        if (offsets) {
+            if (untiloffset == 0) {
+                offsets[letters / offsets_stride] = pos;
+                untiloffset = offsets_stride;
+            }
+            untiloffset--;
         }
-        if (unlikely(_gbt1 == GBT_PREPEND || _gbt2 == GBT_SPACINGMARK)) {
-            len++;
+        letters++;
+        // Runs of code points that are letters on their own, which is
+        // most text, never need the break type tables:
+        if (pos + 1 >= sdata_len ||
+                _ISTRIVIALPAIR(sdata[pos], sdata[pos + 1])) {
+            pos++;
             continue;
         }
-        if (unlikely(cp1 >= 0x1F1E6LL &&
-                cp1 <= 0x1F1FFLL &&
-                cp2 >= 0x1F1E6LL &&
-                cp2 <= 0x1F1FFLL)) {  // A region pair!
-            uint64_t cp0 = (
-                len > 1 ? sdata[len - 2] : 0
-            );
-            uint64_t cpminus1 = (
-                len > 2 ? sdata[len - 2] : 0
-            );
-            if (likely(cp0 < 0x1F1E6LL || cp0 > 0x1F1FFLL ||
-                    (cpminus1 >= 0x1F1E6LL && cpminus1 <= 0x1F1FFLL))) {
-                // Can only continue after an uneven number of region pair
-                // items. (Since after one full pair we might want to break.)
-                len++;
-                continue;
-            }
-        }
-        break;
+        pos += _utf32_letter_len_dfa(sdata + pos, sdata_len - pos);
     }
-    return len;
+    return letters;
 }
 
 int write_codepoint_as_utf8(
@@ -546,6 +430,148 @@ int is_valid_utf8_char(
     return 1;
 }
 
+// ABOUT THE ASCII RUN HELPERS:
+// Most text that passes through here is largely ASCII, which maps
+// 1:1 between UTF-8 bytes and code points. Therefore, all conversion
+// loops hand off to these helpers which process whole ASCII runs in
+// SIMD registers at a time, and only decode the rest one by one.
+
+static int64_t _utf8_ascii_run_len(
+        const uint8_t *p, int64_t len
+        ) {
+    int64_t i = 0;
+    #if defined(__AVX2__)
+    while (i + 32 <= len) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        int mask = _mm256_movemask_epi8(v);
+        if (mask != 0)
+            return i + __builtin_ctz((unsigned int)mask);
+        i += 32;
+    }
+    #elif defined(__SSE2__)
+    while (i + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        int mask = _mm_movemask_epi8(v);
+        if (mask != 0)
+            return i + __builtin_ctz((unsigned int)mask);
+        i += 16;
+    }
+    #endif
+    while (i + 8 <= len) {
+        uint64_t v;
+        memcpy(&v, p + i, sizeof(v));
+        if ((v & 0x8080808080808080ULL) != 0)
+            break;
+        i += 8;
+    }
+    while (i < len && p[i] < 0x80)
+        i++;
+    return i;
+}
+
+static int64_t _utf8_ascii_run_to_utf32(
+        const uint8_t *p, int64_t len, h64wchar *out
+        ) {
+    // Converts the leading ASCII run, returns how many bytes that was.
+    int64_t i = 0;
+    #if defined(__AVX2__)
+    while (i + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        if (_mm_movemask_epi8(v) != 0)
+            break;
+        _mm256_storeu_si256(
+            (__m256i *)(out + i), _mm256_cvtepu8_epi32(v)
+        );
+        _mm256_storeu_si256(
+            (__m256i *)(out + i + 8),
+            _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8))
+        );
+        i += 16;
+    }
+    #elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        if (_mm_movemask_epi8(v) != 0)
+            break;
+        __m128i lo16 = _mm_unpacklo_epi8(v, zero);
+        __m128i hi16 = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_si128(
+            (__m128i *)(out + i), _mm_unpacklo_epi16(lo16, zero)
+        );
+        _mm_storeu_si128(
+            (__m128i *)(out + i + 4), _mm_unpackhi_epi16(lo16, zero)
+        );
+        _mm_storeu_si128(
+            (__m128i *)(out + i + 8), _mm_unpacklo_epi16(hi16, zero)
+        );
+        _mm_storeu_si128(
+            (__m128i *)(out + i + 12), _mm_unpackhi_epi16(hi16, zero)
+        );
+        i += 16;
+    }
+    #endif
+    while (i < len && p[i] < 0x80) {
+        out[i] = p[i];
+        i++;
+    }
+    return i;
+}
+
+static int64_t _utf32_ascii_run_to_utf8(
+        const h64wchar *p, int64_t len, uint8_t *out
+        ) {
+    // Converts the leading run of code points below 0x80, returns
+    // how many code points (= output bytes) that was.
+    int64_t i = 0;
+    #if defined(__SSE2__)
+    const __m128i high = _mm_set1_epi32(~0x7F);
+    while (i + 16 <= len) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + i + 4));
+        __m128i c = _mm_loadu_si128((const __m128i *)(p + i + 8));
+        __m128i d = _mm_loadu_si128((const __m128i *)(p + i + 12));
+        __m128i any_high = _mm_and_si128(
+            _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), high
+        );
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(
+                any_high, _mm_setzero_si128())) != 0xFFFF)
+            break;
+        // All values are < 0x80, so the saturating packs are exact:
+        __m128i ab = _mm_packs_epi32(a, b);
+        __m128i cd = _mm_packs_epi32(c, d);
+        _mm_storeu_si128(
+            (__m128i *)(out + i), _mm_packus_epi16(ab, cd)
+        );
+        i += 16;
+    }
+    #endif
+    while (i < len && p[i] < 0x80) {
+        out[i] = (uint8_t)p[i];
+        i++;
+    }
+    return i;
+}
+
+int is_valid_utf8(
+        const char *p, int64_t size
+        ) {
+    const uint8_t *up = (const uint8_t *)p;
+    int64_t i = 0;
+    while (i < size) {
+        i += _utf8_ascii_run_len(up + i, size - i);
+        if (i >= size)
+            break;
+        int cbytes = 0;
+        if (!get_utf8_codepoint(
+                up + i, (size - i > INT_MAX ? INT_MAX : size - i),
+                NULL, &cbytes))
+            return 0;
+        i += cbytes;
+    }
+    return 1;
+}
+
 h64wchar *utf8_to_utf32(
         const char *input,
         int64_t input_len,
@@ -587,14 +613,24 @@ h64wchar *utf8_to_utf32_ex(
             return NULL;
         }
     }
-    int k = 0;
-    int i = 0;
+    int64_t k = 0;
+    int64_t i = 0;
     while (i < input_len) {
+        if (((const uint8_t *)input)[i] < 0x80) {
+            int64_t runlen = _utf8_ascii_run_to_utf32(
+                (const uint8_t *)input + i, input_len - i,
+                (h64wchar *)temp_buf + k
+            );
+            i += runlen;
+            k += runlen;
+            continue;
+        }
         h64wchar c;
         int cbytes = 0;
         if (!get_utf8_codepoint(
                 (const unsigned char*)(input + i),
-                input_len - i, &c, &cbytes)) {
+                (input_len - i > INT_MAX ? INT_MAX : input_len - i),
+                &c, &cbytes)) {
             if (!surrogatereplaceinvalid && !questionmarkinvalid) {
                 if (free_temp_buf)
                     free(temp_buf);
@@ -664,6 +700,22 @@ int utf32_to_utf8(
     while (i < input_len) {
         if (outbuflen < 1)
             return 0;
+        if (*p < 0x80) {
+            int64_t runlen = _utf32_ascii_run_to_utf8(
+                p, (input_len - i < outbuflen ?
+                    input_len - i : outbuflen),
+                (uint8_t *)outbuf
+            );
+            assert(runlen > 0);
+            p += runlen;
+            outbuflen -= runlen;
+            outbuf += runlen;
+            totallen += runlen;
+            i += runlen;
+            if (outbuflen >= 1)
+                *outbuf = '\0';
+            continue;
+        }
         int inneroutlen = 0;
         if (!write_codepoint_as_utf8(
                 (uint64_t)*p, surrogateunescape,
@@ -898,32 +950,100 @@ int utf16_to_utf8(
     return 1;
 }
 
-void utf32_tolower(h64wchar *s, int64_t slen) {
-    int i = 0;
+static void _utf32_mapcase(
+        const h64casetbl *tbl, int islower,
+        h64wchar *s, int64_t slen
+        ) {
+    // ASCII letters are just one bit apart, so they don't need
+    // the tables at all:
+    const h64wchar asciifrom = (islower ? 'A' : 'a');
+    int64_t i = 0;
+    #if defined(__SSE2__)
+    const __m128i nonascii = _mm_set1_epi32(~0x7F);
+    const __m128i from = _mm_set1_epi32((int)asciifrom - 1);
+    const __m128i to = _mm_set1_epi32((int)asciifrom + 26);
+    const __m128i bit = _mm_set1_epi32(0x20);
+    while (i + 4 <= slen) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(
+                _mm_and_si128(v, nonascii), _mm_setzero_si128()
+                )) == 0xFFFF) {
+            __m128i isletter = _mm_and_si128(
+                _mm_cmpgt_epi32(v, from), _mm_cmplt_epi32(v, to)
+            );
+            v = _mm_xor_si128(v, _mm_and_si128(isletter, bit));
+            _mm_storeu_si128((__m128i *)(s + i), v);
+        } else {
+            int k = 0;
+            while (k < 4) {
+                s[i + k] = _casetbl_map(tbl, s[i + k]);
+                k++;
+            }
+        }
+        i += 4;
+    }
+    #endif
     while (i < slen) {
-        uint64_t codepoint = s[i];
-        int64_t lowered = -1;
-        if ((int64_t)codepoint <= _widechartbl_highest_cp &&
-                (int64_t)codepoint >= _widechartbl_lowest_cp)
-            lowered = _widechartbl_lowercp[codepoint];
-        if (lowered >= 0)
-            s[i] = lowered;
+        h64wchar c = s[i];
+        if (c < 0x80) {
+            if (c >= asciifrom && c < asciifrom + 26)
+                s[i] = c ^ 0x20;
+        } else {
+            s[i] = _casetbl_map(tbl, c);
+        }
         i++;
     }
 }
 
-void utf32_toupper(h64wchar *s, int64_t slen) {
-    int i = 0;
+static int64_t _utf32_findcasechange(
+        const h64casetbl *tbl, int islower,
+        const h64wchar *s, int64_t slen
+        ) {
+    const h64wchar asciifrom = (islower ? 'A' : 'a');
+    int64_t i = 0;
+    #if defined(__SSE2__)
+    const __m128i nonascii = _mm_set1_epi32(~0x7F);
+    const __m128i from = _mm_set1_epi32((int)asciifrom - 1);
+    const __m128i to = _mm_set1_epi32((int)asciifrom + 26);
+    while (i + 4 <= slen) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        int isascii = (_mm_movemask_epi8(_mm_cmpeq_epi32(
+            _mm_and_si128(v, nonascii), _mm_setzero_si128()
+        )) == 0xFFFF);
+        if (!isascii || _mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpgt_epi32(v, from), _mm_cmplt_epi32(v, to)
+                )) != 0)
+            break;  // let the scalar loop below find it
+        i += 4;
+    }
+    #endif
     while (i < slen) {
-        uint64_t codepoint = s[i];
-        int64_t uppered = -1;
-        if ((int64_t)codepoint <= _widechartbl_highest_cp &&
-                (int64_t)codepoint >= _widechartbl_lowest_cp)
-            uppered = _widechartbl_uppercp[codepoint];
-        if (uppered >= 0)
-            s[i] = uppered;
+        h64wchar c = s[i];
+        if (c < 0x80) {
+            if (c >= asciifrom && c < asciifrom + 26)
+                return i;
+        } else if (_casetbl_map(tbl, c) != c) {
+            return i;
+        }
         i++;
     }
+    return -1;
+}
+
+void utf32_tolower(h64wchar *s, int64_t slen) {
+    _utf32_mapcase(&_casetbl_lower, 1, s, slen);
+}
+
+void utf32_toupper(h64wchar *s, int64_t slen) {
+    _utf32_mapcase(&_casetbl_upper, 0, s, slen);
+}
+
+int64_t utf32_findnonlower(const h64wchar *s, int64_t slen) {
+    return _utf32_findcasechange(&_casetbl_lower, 1, s, slen);
+}
+
+int64_t utf32_findnonupper(const h64wchar *s, int64_t slen) {
+    return _utf32_findcasechange(&_casetbl_upper, 0, s, slen);
 }
 
 // Short-hand function:
@@ -964,67 +1084,24 @@ char *AS_U8(const h64wchar *s, int64_t slen) {
     return u8;
 }
 
-struct u8tmpstorage {
-    int64_t bufsize;
-    char *buf;
-};
-
-int32_t _u8tmpstorage_type = -1;
-
-void _clear_u8tmp_storage(
-        uint32_t type_id, void *storageptr,
-        ATTR_UNUSED uint64_t bytes
-        ) {
-    assert((int32_t)type_id == _u8tmpstorage_type);
-    struct u8tmpstorage *storage = storageptr;
-    if (storage->buf)
-        free(storage->buf);
-    storage->buf = NULL;
-}
-
-static __attribute__((constructor)) void _init_u8tmp_storage() {
-    if (_u8tmpstorage_type >= 0)
-        return;
-    _u8tmpstorage_type = threadlocalstorage_RegisterType(
-        sizeof(struct u8tmpstorage), &_clear_u8tmp_storage
-    );
-    if (_u8tmpstorage_type < 0) {
-        fprintf(stderr,
-            "widechar.c: error: failed to allocate "
-            "thread-local storge for AS_U8_TMP()\n"
-        );
-        exit(1);
-        return;
-    }
-}
-
 const char *AS_U8_TMP(const h64wchar *s, int64_t slen) {
     if (!s) {
         return NULL;
     }
-    struct u8tmpstorage *store = (
-        threadlocalstorage_GetByType(_u8tmpstorage_type)
-    );
-    if (!store)
-        return NULL;
     int64_t buflen_needed = slen * 5 + 2;
-    if (!store->buf || store->bufsize < buflen_needed) {
-        free(store->buf);
-        store->buf = malloc(buflen_needed);
-        if (!store->buf)
-            return NULL;
-        store->bufsize = buflen_needed;
-    }
+    char *buf = threadlocalstorage_GetScratch(buflen_needed);
+    if (!buf)
+        return NULL;
     int64_t resultlen = 0;
     int result = utf32_to_utf8(
-        s, slen, store->buf, store->bufsize,
+        s, slen, buf, buflen_needed,
         &resultlen, 1, 1
     );
-    if (!result || resultlen >= store->bufsize) {
+    if (!result || resultlen >= buflen_needed) {
         return NULL;
     }
-    store->buf[resultlen] = '\0';
-    return store->buf;
+    buf[resultlen] = '\0';
+    return buf;
 }
 
 h64wchar *strdupu32(
@@ -17,6 +17,10 @@ int is_valid_utf8_char(
     const unsigned char *p, int size
 );
 
+int is_valid_utf8(
+    const char *p, int64_t size
+);
+
 int get_utf8_codepoint(
     const unsigned char *p, int size,
     h64wchar *out, int *outlen
@@ -81,6 +85,13 @@ int64_t utf32_letters_count(
     h64wchar *sdata, int64_t sdata_len
 );
 
+int64_t utf32_letters_segment(
+    const h64wchar *sdata, int64_t sdata_len,
+    int64_t *offsets, int64_t offsets_stride
+);  // returns letter count. If offsets isn't NULL, the code point
+    // offset of every offsets_stride-th letter is written into it,
+    // which needs room for (letter count / offsets_stride + 1) items
+
 int utf8_to_utf16(
     const uint8_t *input, int64_t input_len,
     uint16_t *outbuf, int64_t outbuflen,
@@ -98,11 +109,21 @@ void utf32_tolower(h64wchar *s, int64_t slen);
 
 void utf32_toupper(h64wchar *s, int64_t slen);
 
+int64_t utf32_findnonlower(
+    const h64wchar *s, int64_t slen
+);  // returns index of first code point tolower changes, or -1
+
+int64_t utf32_findnonupper(
+    const h64wchar *s, int64_t slen
+);  // returns index of first code point toupper changes, or -1
+
 h64wchar *AS_U32(const char *s, int64_t *out_len);
 
 char *AS_U8(const h64wchar *s, int64_t slen);
 
-const char *AS_U8_TMP(const h64wchar *s, int64_t slen);
+const char *AS_U8_TMP(
+    const h64wchar *s, int64_t slen
+);  // result is in a per-thread scratch buffer, see threading.h
 
 h64wchar *strdupu32(
     const h64wchar *s, int64_t slen, int64_t *out_len
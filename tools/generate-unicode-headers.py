@@ -3,18 +3,29 @@
 
 
 import os
-import shutil
-import struct
 import sys
 import textwrap
 
-if os.path.exists(os.path.join(
-        os.path.abspath(os.path.dirname(__file__)),
-        "..", "vendor", "unicode", "unicode_data_header.h")
-        ):
-    print("Unicode(R) data header exists. Remove this file to regenerate:")
-    print("    vendor/unicode/unicode_data_header.h")
-    sys.exit(0)
+# Bump this whenever the generated header's layout changes, so that
+# an older header left over from a previous build gets regenerated:
+HEADER_FORMAT_VERSION = 2
+HEADER_FORMAT_MARKER = (
+    "// unicode_data_header.h format version: " +
+    str(HEADER_FORMAT_VERSION)
+)
+
+header_path = os.path.join(
+    os.path.abspath(os.path.dirname(__file__)),
+    "..", "vendor", "unicode", "unicode_data_header.h")
+if os.path.exists(header_path):
+    with open(header_path, "r", encoding="utf-8") as f:
+        up_to_date = (HEADER_FORMAT_MARKER + "\n") in f.readlines()
+    if up_to_date:
+        print("Unicode(R) data header exists. Remove this file to " +
+              "regenerate:")
+        print("    vendor/unicode/unicode_data_header.h")
+        sys.exit(0)
+    print("Unicode(R) data header has an outdated format, regenerating.")
 
 print("Generating Unicode(R) data header...")
 
@@ -60,64 +71,47 @@ with open(os.path.join(
 
 arraylen = (highest_cp_seen - smallest_cp_seen) + 1
 
-with open(os.path.join(
-        os.path.abspath(os.path.dirname(__file__)),
-            "..", "vendor", "unicode",
-            "unicode_data___widechartbl_ismodifier.dat"),
-        "wb") as f:
-    i = smallest_cp_seen
-    while i <= highest_cp_seen:
-        f.write(struct.pack(
-            "<B", 1 if i in chars and chars[i][2] else 0
-        ))
-        i += 1
+# All tables are emitted as const two-stage lookup tables: the code
+# point's block selects one of the deduplicated blocks of values. This
+# way they end up in the program's read-only data, and need neither
+# loading nor any initialization at program start.
+TABLE_BLOCKBITS = 7
+TABLE_BLOCKSIZE = 1 << TABLE_BLOCKBITS
 
-with open(os.path.join(
-        os.path.abspath(os.path.dirname(__file__)),
-            "..", "vendor", "unicode",
-            "unicode_data___widechartbl_iscombining.dat"),
-        "wb") as f:
-    i = smallest_cp_seen
-    while i <= highest_cp_seen:
-        f.write(struct.pack(
-            "<B", 1 if i in chars and chars[i][6] else 0
-        ))
-        i += 1
 
-with open(os.path.join(
-        os.path.abspath(os.path.dirname(__file__)),
-        "..", "vendor", "unicode", "unicode_data___widechartbl_istag.dat"),
-        "wb") as f:
-    i = smallest_cp_seen
-    while i <= highest_cp_seen:
-        f.write(struct.pack(
-            "<B", 1 if i in chars and chars[i][3] else 0
-        ))
-        i += 1
+def write_twostage_table(f, name, ctype, values):
+    assert(len(values) == arraylen)
+    values = list(values) + [0] * (
+        (TABLE_BLOCKSIZE - (len(values) % TABLE_BLOCKSIZE)) %
+        TABLE_BLOCKSIZE)
+    unique_blocks = dict()
+    block_values = list()
+    block_index = list()
+    i = 0
+    while i < len(values):
+        block = tuple(values[i:i + TABLE_BLOCKSIZE])
+        if block not in unique_blocks:
+            unique_blocks[block] = len(unique_blocks)
+            block_values += list(block)
+        block_index.append(unique_blocks[block])
+        i += TABLE_BLOCKSIZE
+    assert(len(unique_blocks) <= 65536)
 
-with open(os.path.join(
-        os.path.abspath(os.path.dirname(__file__)),
-        "..", "vendor", "unicode", "unicode_data___widechartbl_lowercp.dat"),
-        "wb") as f:
-    i = smallest_cp_seen
-    while i <= highest_cp_seen:
-        if i in chars:
-            f.write(struct.pack("<q", chars[i][4]))
-        else:
-            f.write(struct.pack("<q", -1))
-        i += 1
+    def write_array(arrayname, arraytype, items):
+        f.write("static const " + arraytype + " " + arrayname +
+                "[" + str(len(items)) + "] = {\n")
+        line = "   "
+        for item in items:
+            entry = " " + str(item) + ","
+            if len(line) + len(entry) > 79:
+                f.write(line + "\n")
+                line = "   "
+            line += entry
+        f.write(line + "\n};\n\n")
+
+    write_array(name + "_index", "uint16_t", block_index)
+    write_array(name + "_blocks", ctype, block_values)
 
-with open(os.path.join(
-        os.path.abspath(os.path.dirname(__file__)),
-        "..", "vendor", "unicode", "unicode_data___widechartbl_uppercp.dat"),
-        "wb") as f:
-    i = smallest_cp_seen
-    while i <= highest_cp_seen:
-        if i in chars:
-            f.write(struct.pack("<q", chars[i][5]))
-        else:
-            f.write(struct.pack("<q", -1))
-        i += 1
 
 graphemebreak_property_values = list()
 graphemebreak_property_ranges = dict()
@@ -154,54 +148,33 @@ with open(os.path.join(
             )
         i = range_start
         while i <= range_end:
-            idx = graphemebreak_property_values.index(breaktype)
-            assert(idx >= 0)
-            graphemebreak_property_ranges[i] = (idx + 1)
+            graphemebreak_property_ranges[i] = breaktype
             i += 1
 
-with open(os.path.join(
-        os.path.abspath(os.path.dirname(__file__)),
-        "..", "vendor", "unicode",
-        "unicode_data___widechartbl_graphemebreaktype.dat"),
-        "wb") as f:
-    print("Analysing grapheme break ranges, this may take a while...")
-    i = smallest_cp_seen
-    while i <= highest_cp_seen:
-        gbt = 0
-        if i in graphemebreak_property_ranges:
-            gbt = graphemebreak_property_ranges[i]
-            assert(gbt > 0)
-        f.write(struct.pack(
-            "<B", gbt
-        ))
-        i += 1
+# Only map to the enum values once all break types are known, since
+# adding one to the sorted list may shift the others:
+for cp in graphemebreak_property_ranges:
+    graphemebreak_property_ranges[cp] = (
+        graphemebreak_property_values.index(
+            graphemebreak_property_ranges[cp]) + 1
+    )
 
-with open(os.path.join(
-        os.path.abspath(os.path.dirname(__file__)),
-        "..", "vendor", "unicode", "unicode_data_header.h"),
-        "w", encoding="utf-8") as f:
+with open(header_path, "w", encoding="utf-8") as f:
     print("Writing final unicode_data_header.h...")
     f.write(textwrap.dedent("""\
     // UnicodeData.txt-based header as generated for core.horse64.org.
     // Original data still belongs to Unicode(R) Consortium, see accompanied
     // license files. This just transforms it for easier use by
     // horsec/horsevm.
-
-    #include <stdint.h>
-
     """))
+    f.write(HEADER_FORMAT_MARKER + "\n\n")
+    f.write("#include <stdint.h>\n\n")
     f.write("static int64_t _widechartbl_lowest_cp = " +
             str(smallest_cp_seen) + "LL;\n\n")
     f.write("static int64_t _widechartbl_highest_cp = " +
             str(highest_cp_seen) + "LL;\n\n")
     f.write("static int64_t _widechartbl_arraylen = " +
             str((highest_cp_seen - smallest_cp_seen) + 1) + ";\n")
-    f.write("extern uint8_t *_widechartbl_ismodifier;\n")
-    f.write("extern uint8_t *_widechartbl_istag;\n")
-    f.write("extern int64_t *_widechartbl_lowercp;\n")
-    f.write("extern int64_t *_widechartbl_uppercp;\n")
-    f.write("extern uint8_t *_widechartbl_iscombining;\n")
-    f.write("extern uint8_t *_widechartbl_graphemebreaktype;\n")
     f.write("\nenum _widechargraphbreaktype {\n")
     f.write("    GBT_NONE = 0,\n")
     n = 1
@@ -210,20 +183,84 @@ with open(os.path.join(
                 " = " + str(n) + ",\n")
         n += 1
     f.write("    GBT_TOTAL_TYPES = " + str(n) + "\n")
-    f.write("};\n")
+    f.write("};\n\n")
+    f.write("#define _WIDECHARTBL_BLOCKBITS " +
+            str(TABLE_BLOCKBITS) + "\n\n")
 
-for fname in os.listdir(os.path.join(
-        os.path.abspath(os.path.dirname(__file__)),
-        "..", "vendor", "unicode")):
-    if fname.startswith("unicode_data__") and fname.endswith(".dat"):
-        src_path = os.path.join(
-            os.path.abspath(os.path.dirname(__file__)),
-            "..", "vendor", "unicode", fname)
-        dest_path = os.path.join(
-            os.path.abspath(os.path.dirname(__file__)),
-            "..", "horse_modules_builtin", fname)
-        if os.path.exists(dest_path):
-            os.remove(dest_path)
-        shutil.copyfile(src_path, dest_path)
+    # The grapheme break rules from Unicode(R) Standard Annex #29 as a
+    # state machine: the state is the break type of the previous code
+    # point, or GBT_TOTAL_TYPES for a regional indicator that already
+    # completed a pair. Each entry has the next state, with the
+    # _WIDECHARTBL_GRAPHEMEBREAK bit set if a letter ends before the
+    # new code point. (Emoji sequences (GB11) aren't covered, since
+    # that needs the Extended_Pictographic property.)
+    gbt_names = ["none"] + graphemebreak_property_values
+    ri_paired_state = len(gbt_names)
+
+    def gbt_joins(prev, cur):
+        if prev == "cr" and cur == "lf":
+            return True
+        if prev in ("control", "cr", "lf") or \
+                cur in ("control", "cr", "lf"):
+            return False
+        if prev == "l" and cur in ("l", "v", "lv", "lvt"):
+            return True
+        if prev in ("lv", "v") and cur in ("v", "t"):
+            return True
+        if prev in ("lvt", "t") and cur == "t":
+            return True
+        if cur in ("extend", "zwj", "spacingmark"):
+            return True
+        if prev == "prepend":
+            return True
+        if prev == "regional_indicator" and cur == "regional_indicator":
+            return True
+        return False
+
+    # Every code point below this is its own letter, other than CR LF:
+    trivial_below = 0
+    while graphemebreak_property_ranges.get(trivial_below, 0) in (
+            0, gbt_names.index("control"),
+            gbt_names.index("cr"), gbt_names.index("lf")):
+        trivial_below += 1
+    f.write("#define _WIDECHARTBL_GRAPHEMEBREAK 0x80\n")
+    f.write("#define _WIDECHARTBL_GRAPHEME_TRIVIALBELOW " +
+            str(trivial_below) + "\n\n")
+    f.write("static const uint8_t _widechartbl_graphemedfa[" +
+            str(ri_paired_state + 1) + "][" + str(len(gbt_names)) +
+            "] = {\n")
+    state = 0
+    while state <= ri_paired_state:
+        prev = (gbt_names[state] if state != ri_paired_state else
+                "regional_indicator")
+        row = list()
+        for cur_idx, cur in enumerate(gbt_names):
+            if state == ri_paired_state and cur == "regional_indicator":
+                row.append(cur_idx | 0x80)
+            elif gbt_joins(prev, cur):
+                if prev == "regional_indicator" and cur == prev:
+                    row.append(ri_paired_state)
+                else:
+                    row.append(cur_idx)
+            else:
+                row.append(cur_idx | 0x80)
+        f.write("    {" + ", ".join([str(v) for v in row]) + "},\n")
+        state += 1
+    f.write("};\n\n")
+
+    # Case mappings store the offset to the mapped code point, which
+    # is 0 if there is none:
+    write_twostage_table(f, "_widechartbl_lowercp", "int32_t", [
+        (chars[i][4] - i if i in chars and chars[i][4] >= 0 else 0)
+        for i in range(smallest_cp_seen, highest_cp_seen + 1)
+    ])
+    write_twostage_table(f, "_widechartbl_uppercp", "int32_t", [
+        (chars[i][5] - i if i in chars and chars[i][5] >= 0 else 0)
+        for i in range(smallest_cp_seen, highest_cp_seen + 1)
+    ])
+    write_twostage_table(f, "_widechartbl_graphemebreaktype", "uint8_t", [
+        graphemebreak_property_ranges.get(i, 0)
+        for i in range(smallest_cp_seen, highest_cp_seen + 1)
+    ])
 
 print("Generated.")